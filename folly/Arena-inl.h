@@ -31,7 +31,9 @@ Arena<Alloc>::Block::allocate(Alloc& alloc, size_t size, bool allowSlack) {
   }
 
   void* mem = alloc.allocate(allocSize);
-  return std::make_pair(new (mem) Block(), allocSize - sizeof(Block));
+  auto block = new (mem) Block();
+  block->size = allocSize - sizeof(Block);
+  return std::make_pair(block, block->size);
 }
 
 template <class Alloc>
@@ -82,6 +84,67 @@ void Arena<Alloc>::merge(Arena<Alloc>&& other) {
   other.totalAllocatedSize_ = 0;
 }
 
+template <class Alloc>
+typename Arena<Alloc>::Mark Arena<Alloc>::mark() const {
+  Mark m;
+  if (!blocks_.empty()) {
+    // Normal blocks are added at the front, large blocks at the back; both
+    // ends are enough to find everything allocated since.
+    m.front_ = const_cast<Block*>(&blocks_.front());
+    m.back_ = const_cast<Block*>(&blocks_.back());
+  }
+  m.ptr_ = ptr_;
+  m.end_ = end_;
+  m.totalAllocatedSize_ = totalAllocatedSize_;
+  m.bytesUsed_ = bytesUsed_;
+  return m;
+}
+
+template <class Alloc>
+void Arena<Alloc>::rewindTo(const Mark& m) {
+  auto disposer = [this] (Block* b) { b->deallocate(this->alloc()); };
+  while (!blocks_.empty() && &blocks_.front() != m.front_) {
+    blocks_.pop_front_and_dispose(disposer);
+  }
+  if (!blocks_.empty()) {
+    assert(m.back_ != nullptr);
+    blocks_.erase_after_and_dispose(
+        blocks_.iterator_to(*m.back_), blocks_.end(), disposer);
+  }
+  ptr_ = m.ptr_;
+  end_ = m.end_;
+  totalAllocatedSize_ = m.totalAllocatedSize_;
+  bytesUsed_ = m.bytesUsed_;
+}
+
+template <class Alloc>
+void Arena<Alloc>::reset() {
+  auto disposer = [this] (Block* b) { b->deallocate(this->alloc()); };
+  Block* keep = nullptr;
+  for (auto& b : blocks_) {
+    if (!keep || b.size > keep->size) {
+      keep = &b;
+    }
+  }
+  while (!blocks_.empty() && &blocks_.front() != keep) {
+    blocks_.pop_front_and_dispose(disposer);
+  }
+  if (!blocks_.empty()) {
+    blocks_.erase_after_and_dispose(
+        blocks_.begin(), blocks_.end(), disposer);
+  }
+
+  bytesUsed_ = 0;
+  if (keep) {
+    ptr_ = keep->start();
+    end_ = ptr_ + keep->size;
+    totalAllocatedSize_ = keep->size + sizeof(Block);
+  } else {
+    ptr_ = end_ = nullptr;
+    totalAllocatedSize_ = 0;
+  }
+}
+
 template <class Alloc>
 Arena<Alloc>::~Arena() {
   auto disposer = [this] (Block* b) { b->deallocate(this->alloc()); };
@@ -56,6 +56,11 @@ namespace folly {
  *      required on your system; the returned value must be also.
  *
  * An implementation that uses malloc() / free() is defined below, see SysArena.
+ *
+ * Memory can also be given back in bulk, without destroying the arena:
+ * rewindTo(mark()) frees everything allocated since mark() was called, and
+ * reset() frees everything but keeps the largest block around for reuse,
+ * which makes an arena cheap to recycle for a new request.
  */
 template <class Alloc> struct ArenaAllocatorTraits;
 template <class Alloc>
@@ -104,8 +109,42 @@ class Arena {
   }
 
   // Transfer ownership of all memory allocated from "other" to "this".
+  // Blocks merged after a mark() are freed by rewindTo() that mark.
   void merge(Arena&& other);
 
+ private:
+  struct Block;
+
+ public:
+  // Position in the arena, see mark() and rewindTo().
+  class Mark {
+   public:
+    Mark() = default;
+
+   private:
+    friend class Arena;
+
+    Block* front_{nullptr};
+    Block* back_{nullptr};
+    char* ptr_{nullptr};
+    char* end_{nullptr};
+    size_t totalAllocatedSize_{0};
+    size_t bytesUsed_{0};
+  };
+
+  // Returns the current position in the arena.
+  Mark mark() const;
+
+  // Frees all memory allocated since m was returned by mark(); any pointer
+  // handed out since then is invalid afterwards. Marks must be rewound to in
+  // LIFO order: rewinding to a mark invalidates all marks taken after it, as
+  // does reset().
+  void rewindTo(const Mark& m);
+
+  // Frees all memory allocated from the arena, except for the largest block,
+  // which is used to serve subsequent allocations.
+  void reset();
+
   // Gets the total memory used by the arena
   size_t totalSize() const {
     return totalAllocatedSize_ + sizeof(Arena);
@@ -128,12 +167,13 @@ class Arena {
   Arena& operator=(Arena&&) = default;
 
  private:
-  struct Block;
   typedef boost::intrusive::slist_member_hook<
     boost::intrusive::tag<Arena>> BlockLink;
 
   struct FOLLY_ALIGNED_MAX Block {
     BlockLink link;
+    // Usable bytes, not including this header.
+    size_t size;
 
     // Allocate a block with at least size bytes of storage.
     // If allowSlack is true, allocate more than size bytes if convenient
@@ -240,6 +280,18 @@ class SysArena : public Arena<SysAlloc> {
 template <>
 struct IsArenaAllocator<SysArena> : std::true_type { };
 
+/**
+ * STL-compatible allocator that allocates from an arena, for use with
+ * containers that take an allocator (fbvector, std::vector, std::map, ...):
+ *
+ *   SysArena arena;
+ *   fbvector<int, ArenaAllocator<int>> v{ArenaAllocator<int>(&arena)};
+ *
+ * Deallocation is a no-op, memory is only reclaimed by the arena.
+ */
+template <class T, class ArenaT = SysArena>
+using ArenaAllocator = StlAllocator<ArenaT, T>;
+
 }  // namespace folly
 
 #include <folly/Arena-inl.h>
@@ -17,19 +17,32 @@
 // @author Andrei Alexandrescu (andrei.alexandrescu@fb.com)
 
 #include <folly/Benchmark.h>
+#include <folly/FileUtil.h>
+#include <folly/detail/CacheLocality.h>
 #include <folly/Foreach.h>
 #include <folly/json.h>
 #include <folly/String.h>
 
 #include <algorithm>
+#include <array>
 #include <boost/regex.hpp>
 #include <cmath>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <mutex>
 #include <utility>
 #include <vector>
 #include <cstring>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 DEFINE_bool(benchmark, false, "Run benchmarks.");
@@ -60,15 +73,78 @@ DEFINE_int32(
     1,
     "Maximum # of seconds we'll spend on each benchmark.");
 
+DEFINE_bool(
+    bm_stats,
+    false,
+    "Print the median, median absolute deviation and 95% confidence "
+    "interval of the per-epoch timings below each benchmark.");
+
+DEFINE_bool(
+    bm_json_verbose,
+    false,
+    "With --json, output per-benchmark statistics and counters instead "
+    "of a single number per benchmark.");
+
+DEFINE_bool(
+    bm_perf_counters,
+    false,
+    "Collect hardware performance counters (cycles, instructions, cache "
+    "misses, branch misses) for each benchmark. Linux only.");
+
+DEFINE_string(
+    bm_baseline,
+    "",
+    "Path to the output of a previous --json run; benchmarks slower than "
+    "their baseline by more than --bm_regression_threshold are flagged.");
+
+DEFINE_double(
+    bm_regression_threshold,
+    5.0,
+    "Percentage slowdown relative to --bm_baseline that counts as a "
+    "regression.");
+
+DEFINE_bool(
+    bm_fail_on_regression,
+    false,
+    "Exit with a non-zero status if any benchmark regressed relative to "
+    "--bm_baseline.");
+
+DEFINE_bool(
+    bm_pin_threads,
+    true,
+    "Pin the threads of multithreaded benchmarks to CPUs in cache "
+    "locality order. Linux only.");
+
+DEFINE_int32(
+    bm_latency_sample_interval,
+    64,
+    "After the timed run of a multithreaded benchmark, time one more "
+    "operation per this many to report latency percentiles; 0 disables "
+    "latency sampling.");
+
+DEFINE_int32(
+    bm_cpu,
+    -1,
+    "If non-negative, pin the measuring thread to this CPU while each "
+    "benchmark runs. Linux only.");
+
 namespace folly {
 
 std::chrono::high_resolution_clock::duration BenchmarkSuspender::timeSpent;
 
 typedef function<detail::TimeIterPair(unsigned int)> BenchmarkFun;
 
+// File, name, function and, for multithreaded benchmarks, where the
+// function stores its latency samples and per-thread results.
+typedef tuple<
+    string,
+    string,
+    BenchmarkFun,
+    std::shared_ptr<detail::MultithreadedBenchmarkStats>>
+    BenchmarkRegistration;
 
-vector<tuple<string, string, BenchmarkFun>>& benchmarks() {
-  static vector<tuple<string, string, BenchmarkFun>> _benchmarks;
+vector<BenchmarkRegistration>& benchmarks() {
+  static vector<BenchmarkRegistration> _benchmarks;
   return _benchmarks;
 }
 
@@ -89,7 +165,7 @@ size_t getGlobalBenchmarkBaselineIndex() {
   auto it = std::find_if(
     benchmarks().begin(),
     benchmarks().end(),
-    [global](const tuple<string, string, BenchmarkFun> &v) {
+    [global](const BenchmarkRegistration &v) {
       return get<1>(v) == global;
     }
   );
@@ -102,7 +178,376 @@ size_t getGlobalBenchmarkBaselineIndex() {
 
 void detail::addBenchmarkImpl(const char* file, const char* name,
                               BenchmarkFun fun) {
-  benchmarks().emplace_back(file, name, std::move(fun));
+  benchmarks().emplace_back(file, name, std::move(fun), nullptr);
+}
+
+void detail::addBenchmarkImpl(
+    const char* file,
+    const char* name,
+    BenchmarkFun fun,
+    std::shared_ptr<MultithreadedBenchmarkStats> stats) {
+  benchmarks().emplace_back(file, name, std::move(fun), std::move(stats));
+}
+
+detail::BenchmarkLatencySamples::BenchmarkLatencySamples(size_t capacity)
+    : capacity_(capacity), rngState_(0x9E3779B97F4A7C15ULL) {
+  assert(capacity_ > 0);
+}
+
+void detail::BenchmarkLatencySamples::add(const std::vector<uint64_t>& nanos) {
+  for (auto sample : nanos) {
+    ++seen_;
+    if (samples_.size() < capacity_) {
+      samples_.push_back(sample);
+      sorted_ = false;
+      continue;
+    }
+    // Reservoir sampling: the i-th sample replaces a random slot with
+    // probability capacity / i.
+    rngState_ ^= rngState_ << 13;
+    rngState_ ^= rngState_ >> 7;
+    rngState_ ^= rngState_ << 17;
+    auto slot = rngState_ % seen_;
+    if (slot < capacity_) {
+      samples_[size_t(slot)] = sample;
+      sorted_ = false;
+    }
+  }
+}
+
+void detail::BenchmarkLatencySamples::clear() {
+  samples_.clear();
+  seen_ = 0;
+  sorted_ = true;
+}
+
+void detail::MultithreadedBenchmarkStats::clear() {
+  latencies.clear();
+  threadOps.clear();
+  threadNanos.clear();
+}
+
+double detail::BenchmarkLatencySamples::percentile(double q) {
+  if (samples_.empty()) {
+    return 0;
+  }
+  if (!sorted_) {
+    std::sort(samples_.begin(), samples_.end());
+    sorted_ = true;
+  }
+  q = std::min(1.0, std::max(0.0, q));
+  return double(samples_[size_t(q * double(samples_.size() - 1) + 0.5)]);
+}
+
+std::vector<size_t> detail::benchmarkThreadCounts() {
+  const size_t numCpus =
+      std::max<size_t>(1, std::thread::hardware_concurrency());
+  std::vector<size_t> counts;
+  for (size_t n = 1; n < numCpus; n *= 2) {
+    counts.push_back(n);
+  }
+  counts.push_back(numCpus);
+  return counts;
+}
+
+unsigned int detail::benchmarkLatencySampleInterval() {
+  return unsigned(std::max(0, FLAGS_bm_latency_sample_interval));
+}
+
+void detail::pinBenchmarkThread(size_t threadIndex) {
+#ifdef __linux__
+  if (!FLAGS_bm_pin_threads) {
+    return;
+  }
+  static const std::vector<size_t> cpusByLocality = [] {
+    auto& locality = CacheLocality::system();
+    std::vector<size_t> cpus(locality.numCpus);
+    FOR_EACH_RANGE (cpu, 0, locality.numCpus) {
+      cpus[locality.localityIndexByCpu[cpu]] = cpu;
+    }
+    return cpus;
+  }();
+  if (cpusByLocality.empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpusByLocality[threadIndex % cpusByLocality.size()], &set);
+  // Failing to pin (e.g. because of a restricted cpuset) only costs
+  // accuracy, so it is not an error.
+  sched_setaffinity(0, sizeof(set), &set);
+#else
+  (void)threadIndex;
+#endif
+}
+
+namespace {
+
+constexpr size_t kNumPerfCounters = 4;
+
+const char* const kPerfCounterNames[kNumPerfCounters] = {
+    "cycles",
+    "instructions",
+    "cache_misses",
+    "branch_misses",
+};
+
+/**
+ * A group of hardware performance counters for the calling thread, read
+ * around each measured call of a benchmark. Counters that the kernel or
+ * the hardware does not support are left out; if none can be opened the
+ * group is invalid and the benchmark runs with wall time only.
+ */
+class PerfCounters {
+ public:
+  PerfCounters() {
+    fds_.fill(-1);
+#ifdef __linux__
+    static const uint64_t configs[kNumPerfCounters] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    FOR_EACH_RANGE (i, 0, kNumPerfCounters) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.disabled = leader_ == -1 ? 1 : 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+          PERF_FORMAT_TOTAL_TIME_RUNNING;
+      auto fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, leader_, 0));
+      if (fd == -1) {
+        if (leader_ == -1 && i == 0) {
+          // Without cycles there is no group to attach the rest to.
+          break;
+        }
+        continue;
+      }
+      if (leader_ == -1) {
+        leader_ = fd;
+      }
+      fds_[i] = fd;
+    }
+#endif
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  ~PerfCounters() {
+#ifdef __linux__
+    for (auto fd : fds_) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  bool valid() const {
+    return leader_ != -1;
+  }
+
+  bool has(size_t i) const {
+    return fds_[i] != -1;
+  }
+
+  void start() {
+#ifdef __linux__
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+#endif
+    resume();
+  }
+
+  void pause() {
+#ifdef __linux__
+    ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+  }
+
+  void resume() {
+#ifdef __linux__
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+  }
+
+  /**
+   * Stops counting and stores the counts since the last start() in out,
+   * scaled up if the kernel had to multiplex the counters.
+   */
+  bool stop(std::array<double, kNumPerfCounters>& out) {
+    pause();
+#ifdef __linux__
+    // nr, time_enabled, time_running, then one value per counter in the
+    // order the counters were added to the group.
+    uint64_t buf[3 + kNumPerfCounters];
+    auto bytes = read(leader_, buf, sizeof(buf));
+    if (bytes < ssize_t(3 * sizeof(uint64_t)) || buf[2] == 0) {
+      return false;
+    }
+    const double scale = double(buf[1]) / double(buf[2]);
+    size_t next = 3;
+    FOR_EACH_RANGE (i, 0, kNumPerfCounters) {
+      out[i] = has(i) && next < 3 + buf[0] ? double(buf[next++]) * scale : 0;
+    }
+    return true;
+#else
+    (void)out;
+    return false;
+#endif
+  }
+
+ private:
+  int leader_{-1};
+  std::array<int, kNumPerfCounters> fds_;
+};
+
+/**
+ * The counts the worker threads of a multithreaded benchmark add up
+ * during one measured call.
+ */
+struct WorkerCounterTotals {
+  std::mutex mutex;
+  std::array<double, kNumPerfCounters> counts{};
+};
+
+// The counters the calling thread is measuring a benchmark with, if any,
+// how many BenchmarkSuspenders are holding them paused, and where the
+// benchmark's worker threads add their counts.
+FOLLY_TLS PerfCounters* tActiveCounters = nullptr;
+FOLLY_TLS size_t tCountersPauseDepth = 0;
+FOLLY_TLS WorkerCounterTotals* tWorkerCounterTotals = nullptr;
+
+/**
+ * Pins the calling thread to a CPU for the lifetime of the object and
+ * restores the previous affinity mask afterwards.
+ */
+class ScopedCpuPin {
+ public:
+  explicit ScopedCpuPin(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || sched_getaffinity(0, sizeof(saved_), &saved_) != 0) {
+      return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      PLOG(WARNING) << "Unable to pin benchmark to CPU " << cpu;
+      return;
+    }
+    pinned_ = true;
+#else
+    (void)cpu;
+#endif
+  }
+
+  ScopedCpuPin(const ScopedCpuPin&) = delete;
+  ScopedCpuPin& operator=(const ScopedCpuPin&) = delete;
+
+  ~ScopedCpuPin() {
+#ifdef __linux__
+    if (pinned_) {
+      sched_setaffinity(0, sizeof(saved_), &saved_);
+    }
+#endif
+  }
+
+ private:
+#ifdef __linux__
+  cpu_set_t saved_;
+#endif
+  bool pinned_{false};
+};
+
+/**
+ * Everything we know about one benchmark after running it. Times are in
+ * nanoseconds per iteration, with the global baseline subtracted.
+ */
+struct BenchmarkResult {
+  std::string file;
+  std::string name;
+  // The estimate reported in the table and by --json.
+  double nsPerIter{0};
+  double median{0};
+  // Median absolute deviation of the epoch samples.
+  double mad{0};
+  // Distribution-free 95% confidence interval of the median.
+  double ciLow{0};
+  double ciHigh{0};
+  size_t epochs{0};
+  bool hasCounters{false};
+  // Which counters could be opened; the others are left out of the output.
+  std::array<bool, kNumPerfCounters> hasCounter{};
+  std::array<double, kNumPerfCounters> countersPerIter{};
+  // Per-operation latency percentiles of multithreaded benchmarks, in
+  // nanoseconds.
+  size_t latencySamples{0};
+  double latencyP50{0};
+  double latencyP90{0};
+  double latencyP99{0};
+  double latencyP999{0};
+  // Operations each thread of a multithreaded benchmark ran over all
+  // epochs, and its throughput in operations per second.
+  std::vector<uint64_t> threadOps;
+  std::vector<double> threadOpsPerSec;
+};
+
+} // namespace
+
+void detail::pauseBenchmarkCounters() {
+  if (tActiveCounters && tCountersPauseDepth++ == 0) {
+    tActiveCounters->pause();
+  }
+}
+
+void detail::resumeBenchmarkCounters() {
+  if (tActiveCounters && tCountersPauseDepth > 0 &&
+      --tCountersPauseDepth == 0) {
+    tActiveCounters->resume();
+  }
+}
+
+struct detail::BenchmarkWorkerCounters::State {
+  WorkerCounterTotals* totals;
+  std::unique_ptr<PerfCounters> counters;
+};
+
+detail::BenchmarkWorkerCounters::BenchmarkWorkerCounters() {
+  if (tWorkerCounterTotals) {
+    state_.reset(new State{tWorkerCounterTotals, nullptr});
+  }
+}
+
+detail::BenchmarkWorkerCounters::~BenchmarkWorkerCounters() {}
+
+void detail::BenchmarkWorkerCounters::open() {
+  if (state_) {
+    state_->counters.reset(new PerfCounters());
+  }
+}
+
+void detail::BenchmarkWorkerCounters::start() {
+  if (state_ && state_->counters->valid()) {
+    state_->counters->start();
+  }
+}
+
+void detail::BenchmarkWorkerCounters::stop() {
+  std::array<double, kNumPerfCounters> counts;
+  if (!state_ || !state_->counters->valid() ||
+      !state_->counters->stop(counts)) {
+    return;
+  }
+  std::lock_guard<std::mutex> g(state_->totals->mutex);
+  FOR_EACH_RANGE (i, 0, kNumPerfCounters) {
+    state_->totals->counts[i] += counts[i];
+  }
 }
 
 /**
@@ -116,8 +561,44 @@ static double estimateTime(double * begin, double * end) {
   return *min_element(begin, end);
 }
 
-static double runBenchmarkGetNSPerIteration(const BenchmarkFun& fun,
-                                            const double globalBaseline) {
+/**
+ * Fills in the median, MAD and confidence interval of the given
+ * samples. The samples are reordered.
+ */
+static void computeSampleStats(
+    double* begin,
+    double* end,
+    BenchmarkResult& result) {
+  assert(begin < end);
+  const size_t n = size_t(end - begin);
+  std::sort(begin, end);
+  auto median = [](const double* b, size_t count) {
+    return count % 2 ? b[count / 2] : (b[count / 2 - 1] + b[count / 2]) / 2;
+  };
+  result.epochs = n;
+  result.median = median(begin, n);
+
+  // The ranks n/2 -+ 1.96 * sqrt(n) / 2 bound the median with ~95%
+  // confidence regardless of the distribution of the samples.
+  const double halfWidth = 0.98 * std::sqrt(double(n));
+  auto lo = std::floor(n / 2.0 - halfWidth);
+  auto hi = std::ceil(n / 2.0 + halfWidth);
+  result.ciLow = begin[size_t(std::max(0.0, lo))];
+  result.ciHigh = begin[size_t(std::min(double(n - 1), hi))];
+
+  std::vector<double> deviations(begin, end);
+  for (auto& d : deviations) {
+    d = std::fabs(d - result.median);
+  }
+  std::sort(deviations.begin(), deviations.end());
+  result.mad = median(deviations.data(), n);
+}
+
+static BenchmarkResult runBenchmarkGetNSPerIteration(
+    const BenchmarkFun& fun,
+    const double globalBaseline,
+    PerfCounters* counters = nullptr,
+    const BenchmarkResult* counterBaseline = nullptr) {
   using std::chrono::duration_cast;
   using std::chrono::high_resolution_clock;
   using std::chrono::microseconds;
@@ -147,10 +628,37 @@ static double runBenchmarkGetNSPerIteration(const BenchmarkFun& fun,
   double epochResults[epochs] = { 0 };
   size_t actualEpochs = 0;
 
+  // Counters are summed over the epochs whose timing was kept, and
+  // divided by the total number of iterations of those epochs.
+  const bool useCounters = counters && counters->valid();
+  SCOPE_EXIT {
+    tActiveCounters = nullptr;
+    tWorkerCounterTotals = nullptr;
+  };
+  std::array<double, kNumPerfCounters> counterTotals{};
+  std::array<double, kNumPerfCounters> epochCounters{};
+  double counterIters = 0;
+  WorkerCounterTotals workerTotals;
+
   for (; actualEpochs < epochs; ++actualEpochs) {
     const auto maxIters = uint32_t(FLAGS_bm_max_iters);
     for (auto n = uint32_t(FLAGS_bm_min_iters); n < maxIters; n *= 2) {
+      if (useCounters) {
+        counters->start();
+        tActiveCounters = counters;
+        tCountersPauseDepth = 0;
+        tWorkerCounterTotals = &workerTotals;
+        workerTotals.counts.fill(0);
+      }
       auto const nsecsAndIter = fun(static_cast<unsigned int>(n));
+      tActiveCounters = nullptr;
+      tWorkerCounterTotals = nullptr;
+      const bool countersRead = useCounters && counters->stop(epochCounters);
+      if (countersRead) {
+        FOR_EACH_RANGE (i, 0, kNumPerfCounters) {
+          epochCounters[i] += workerTotals.counts[i];
+        }
+      }
       if (nsecsAndIter.first < minNanoseconds) {
         continue;
       }
@@ -159,6 +667,12 @@ static double runBenchmarkGetNSPerIteration(const BenchmarkFun& fun,
       auto nsecs = duration_cast<nanoseconds>(nsecsAndIter.first).count();
       epochResults[actualEpochs] =
           max(0.0, double(nsecs) / nsecsAndIter.second - globalBaseline);
+      if (countersRead) {
+        FOR_EACH_RANGE (i, 0, kNumPerfCounters) {
+          counterTotals[i] += epochCounters[i];
+        }
+        counterIters += nsecsAndIter.second;
+      }
       // Done with the current epoch, we got a meaningful timing.
       break;
     }
@@ -170,9 +684,26 @@ static double runBenchmarkGetNSPerIteration(const BenchmarkFun& fun,
     }
   }
 
+  BenchmarkResult result;
   // If the benchmark was basically drowned in baseline noise, it's
   // possible it became negative.
-  return max(0.0, estimateTime(epochResults, epochResults + actualEpochs));
+  result.nsPerIter =
+      max(0.0, estimateTime(epochResults, epochResults + actualEpochs));
+  computeSampleStats(epochResults, epochResults + actualEpochs, result);
+  if (counterIters > 0) {
+    result.hasCounters = true;
+    FOR_EACH_RANGE (i, 0, kNumPerfCounters) {
+      result.hasCounter[i] = counters->has(i);
+      result.countersPerIter[i] = counterTotals[i] / counterIters;
+      // Corrected for the loop overhead like the time is.
+      if (counterBaseline && counterBaseline->hasCounters) {
+        result.countersPerIter[i] = max(
+            0.0,
+            result.countersPerIter[i] - counterBaseline->countersPerIter[i]);
+      }
+    }
+  }
+  return result;
 }
 
 struct ScaleInfo {
@@ -240,8 +771,98 @@ static string metricReadable(double n, unsigned int decimals) {
   return humanReadable(n, decimals, kMetricSuffixes);
 }
 
+namespace {
+
+/**
+ * Timing of a benchmark in a previous run, loaded from --bm_baseline.
+ */
+struct BaselineResult {
+  double nsPerIter{0};
+  // Only present when the baseline was written with --bm_json_verbose.
+  bool hasInterval{false};
+  double ciLow{0};
+  double ciHigh{0};
+};
+
+enum class BaselineVerdict {
+  NONE,
+  IMPROVED,
+  UNCHANGED,
+  REGRESSED,
+};
+
+/**
+ * Benchmark results keyed by name, as written by --json. Both the plain
+ * format (name -> picoseconds per iteration) and the --bm_json_verbose
+ * format are accepted.
+ */
+std::map<std::string, BaselineResult> loadBaseline(const std::string& path) {
+  std::map<std::string, BaselineResult> baseline;
+  std::string contents;
+  if (!readFile(path.c_str(), contents)) {
+    LOG(ERROR) << "Unable to read benchmark baseline " << path;
+    return baseline;
+  }
+  dynamic d;
+  try {
+    d = parseJson(contents);
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Unable to parse benchmark baseline " << path << ": "
+               << ex.what();
+    return baseline;
+  }
+  if (!d.isObject()) {
+    LOG(ERROR) << "Benchmark baseline " << path << " is not a JSON object";
+    return baseline;
+  }
+  for (auto& kv : d.items()) {
+    BaselineResult b;
+    if (kv.second.isNumber()) {
+      b.nsPerIter = kv.second.asDouble() / 1000.;
+    } else if (kv.second.isObject() && kv.second.count("ns_per_iter")) {
+      b.nsPerIter = kv.second["ns_per_iter"].asDouble();
+      auto ci = kv.second.get_ptr("ci95_ns");
+      if (ci && ci->isArray() && ci->size() == 2) {
+        b.hasInterval = true;
+        b.ciLow = (*ci)[0].asDouble();
+        b.ciHigh = (*ci)[1].asDouble();
+      }
+    } else {
+      continue;
+    }
+    baseline[kv.first.asString()] = b;
+  }
+  return baseline;
+}
+
+/**
+ * A benchmark has regressed if it is slower than its baseline by more
+ * than --bm_regression_threshold percent. When both runs carry
+ * confidence intervals, overlapping intervals are treated as noise.
+ */
+BaselineVerdict compareToBaseline(
+    const BenchmarkResult& result,
+    const BaselineResult& base,
+    double* changePercent) {
+  if (base.nsPerIter <= 0) {
+    return BaselineVerdict::NONE;
+  }
+  *changePercent = (result.nsPerIter - base.nsPerIter) / base.nsPerIter * 100;
+  const bool overlapping = base.hasInterval &&
+      result.ciLow <= base.ciHigh && base.ciLow <= result.ciHigh;
+  if (std::fabs(*changePercent) <= FLAGS_bm_regression_threshold ||
+      overlapping) {
+    return BaselineVerdict::UNCHANGED;
+  }
+  return *changePercent > 0 ? BaselineVerdict::REGRESSED
+                            : BaselineVerdict::IMPROVED;
+}
+
+} // namespace
+
 static void printBenchmarkResultsAsTable(
-  const vector<tuple<string, string, double> >& data) {
+    const vector<BenchmarkResult>& data,
+    const std::map<std::string, BaselineResult>& baseline) {
   // Width available
   static const unsigned int columns = 76;
 
@@ -268,14 +889,14 @@ static void printBenchmarkResultsAsTable(
   string lastFile;
 
   for (auto& datum : data) {
-    auto file = get<0>(datum);
+    auto file = datum.file;
     if (file != lastFile) {
       // New file starting
       header(file);
       lastFile = file;
     }
 
-    string s = get<1>(datum);
+    string s = datum.name;
     if (s == "-") {
       separator('-');
       continue;
@@ -285,11 +906,11 @@ static void printBenchmarkResultsAsTable(
       s.erase(0, 1);
       useBaseline = true;
     } else {
-      baselineNsPerIter = get<2>(datum);
+      baselineNsPerIter = datum.nsPerIter;
       useBaseline = false;
     }
     s.resize(columns - 29, ' ');
-    auto nsPerIter = get<2>(datum);
+    auto nsPerIter = datum.nsPerIter;
     auto secPerIter = nsPerIter / 1E9;
     auto itersPerSec = (secPerIter == 0)
                            ? std::numeric_limits<double>::infinity()
@@ -309,34 +930,140 @@ static void printBenchmarkResultsAsTable(
              readableTime(secPerIter, 2).c_str(),
              metricReadable(itersPerSec, 2).c_str());
     }
+
+    // Optional detail lines, indented below the benchmark they describe.
+    if (FLAGS_bm_stats) {
+      printf("    median %s  mad %s  ci95 [%s, %s]  epochs %zu\n",
+             readableTime(datum.median / 1E9, 2).c_str(),
+             readableTime(datum.mad / 1E9, 2).c_str(),
+             readableTime(datum.ciLow / 1E9, 2).c_str(),
+             readableTime(datum.ciHigh / 1E9, 2).c_str(),
+             datum.epochs);
+    }
+    if (datum.latencySamples > 0) {
+      printf("    latency p50 %s  p90 %s  p99 %s  p99.9 %s  samples %zu\n",
+             readableTime(datum.latencyP50 / 1E9, 2).c_str(),
+             readableTime(datum.latencyP90 / 1E9, 2).c_str(),
+             readableTime(datum.latencyP99 / 1E9, 2).c_str(),
+             readableTime(datum.latencyP999 / 1E9, 2).c_str(),
+             datum.latencySamples);
+    }
+    if (!datum.threadOps.empty()) {
+      auto minMax = std::minmax_element(
+          datum.threadOpsPerSec.begin(), datum.threadOpsPerSec.end());
+      printf("    per thread: ops %s  ops/s min %s  max %s\n",
+             metricReadable(double(datum.threadOps[0]), 2).c_str(),
+             metricReadable(*minMax.first, 2).c_str(),
+             metricReadable(*minMax.second, 2).c_str());
+    }
+    if (datum.hasCounters) {
+      string line = "    per iter:";
+      FOR_EACH_RANGE (i, 0, kNumPerfCounters) {
+        if (!datum.hasCounter[i]) {
+          continue;
+        }
+        line += stringPrintf(" %s %s", kPerfCounterNames[i],
+                             metricReadable(datum.countersPerIter[i], 2)
+                                 .c_str());
+      }
+      if (datum.hasCounter[1] && datum.countersPerIter[0] > 0) {
+        line += stringPrintf(
+            "  ipc %.2f", datum.countersPerIter[1] / datum.countersPerIter[0]);
+      }
+      puts(line.c_str());
+    }
+    auto base = baseline.find(datum.name);
+    if (base != baseline.end()) {
+      double change = 0;
+      auto verdict = compareToBaseline(datum, base->second, &change);
+      if (verdict == BaselineVerdict::REGRESSED ||
+          verdict == BaselineVerdict::IMPROVED) {
+        printf("    %s %+.2f%% vs baseline %s\n",
+               verdict == BaselineVerdict::REGRESSED ? "REGRESSED" : "improved",
+               change,
+               readableTime(base->second.nsPerIter / 1E9, 2).c_str());
+      }
+    }
   }
   separator('=');
 }
 
 static void printBenchmarkResultsAsJson(
-  const vector<tuple<string, string, double> >& data) {
+    const vector<BenchmarkResult>& data,
+    const std::map<std::string, BaselineResult>& baseline) {
   dynamic d = dynamic::object;
   for (auto& datum: data) {
-    d[std::get<1>(datum)] = std::get<2>(datum) * 1000.;
+    if (!FLAGS_bm_json_verbose) {
+      d[datum.name] = datum.nsPerIter * 1000.;
+      continue;
+    }
+    if (datum.name == "-") {
+      continue;
+    }
+    dynamic entry = dynamic::object
+        ("file", datum.file)
+        ("ns_per_iter", datum.nsPerIter)
+        ("median_ns", datum.median)
+        ("mad_ns", datum.mad)
+        ("ci95_ns", dynamic::array(datum.ciLow, datum.ciHigh))
+        ("epochs", datum.epochs);
+    if (datum.hasCounters) {
+      dynamic counters = dynamic::object;
+      FOR_EACH_RANGE (i, 0, kNumPerfCounters) {
+        if (datum.hasCounter[i]) {
+          counters[kPerfCounterNames[i]] = datum.countersPerIter[i];
+        }
+      }
+      entry["counters_per_iter"] = std::move(counters);
+    }
+    if (datum.latencySamples > 0) {
+      entry["latency_ns"] = dynamic::object
+          ("p50", datum.latencyP50)
+          ("p90", datum.latencyP90)
+          ("p99", datum.latencyP99)
+          ("p99.9", datum.latencyP999)
+          ("samples", datum.latencySamples);
+    }
+    if (!datum.threadOps.empty()) {
+      dynamic threads = dynamic::array;
+      FOR_EACH_RANGE (t, 0, datum.threadOps.size()) {
+        threads.push_back(dynamic::object
+            ("ops", datum.threadOps[t])
+            ("ops_per_sec", datum.threadOpsPerSec[t]));
+      }
+      entry["threads"] = std::move(threads);
+    }
+    auto base = baseline.find(datum.name);
+    if (base != baseline.end()) {
+      double change = 0;
+      auto verdict = compareToBaseline(datum, base->second, &change);
+      if (verdict != BaselineVerdict::NONE) {
+        entry["baseline_ns_per_iter"] = base->second.nsPerIter;
+        entry["baseline_change_percent"] = change;
+        entry["regressed"] = verdict == BaselineVerdict::REGRESSED;
+      }
+    }
+    d[datum.name] = std::move(entry);
   }
 
   printf("%s\n", toPrettyJson(d).c_str());
 }
 
 static void printBenchmarkResults(
-  const vector<tuple<string, string, double> >& data) {
+    const vector<BenchmarkResult>& data,
+    const std::map<std::string, BaselineResult>& baseline) {
 
   if (FLAGS_json) {
-    printBenchmarkResultsAsJson(data);
+    printBenchmarkResultsAsJson(data, baseline);
   } else {
-    printBenchmarkResultsAsTable(data);
+    printBenchmarkResultsAsTable(data, baseline);
   }
 }
 
 void runBenchmarks() {
   CHECK(!benchmarks().empty());
 
-  vector<tuple<string, string, double>> results;
+  vector<BenchmarkResult> results;
   results.reserve(benchmarks().size() - 1);
 
   std::unique_ptr<boost::regex> bmRegex;
@@ -344,31 +1071,98 @@ void runBenchmarks() {
     bmRegex.reset(new boost::regex(FLAGS_bm_regex));
   }
 
+  std::map<std::string, BaselineResult> baseline;
+  if (!FLAGS_bm_baseline.empty()) {
+    baseline = loadBaseline(FLAGS_bm_baseline);
+  }
+
+  std::unique_ptr<PerfCounters> counters;
+  if (FLAGS_bm_perf_counters) {
+    counters.reset(new PerfCounters());
+    if (!counters->valid()) {
+      LOG(WARNING) << "Hardware performance counters are unavailable, "
+                   << "--bm_perf_counters is ignored";
+      counters.reset();
+    }
+  }
+
   // PLEASE KEEP QUIET. MEASUREMENTS IN PROGRESS.
 
   size_t baselineIndex = getGlobalBenchmarkBaselineIndex();
 
-  auto const globalBaseline =
-      runBenchmarkGetNSPerIteration(get<2>(benchmarks()[baselineIndex]), 0);
+  BenchmarkResult baselineResult;
+  {
+    ScopedCpuPin pin(FLAGS_bm_cpu);
+    baselineResult = runBenchmarkGetNSPerIteration(
+        get<2>(benchmarks()[baselineIndex]), 0, counters.get());
+  }
+  const double globalBaseline = baselineResult.nsPerIter;
   FOR_EACH_RANGE (i, 0, benchmarks().size()) {
     if (i == baselineIndex) {
       continue;
     }
-    double elapsed = 0.0;
+    BenchmarkResult result;
     if (get<1>(benchmarks()[i]) != "-") { // skip separators
       if (bmRegex && !boost::regex_search(get<1>(benchmarks()[i]), *bmRegex)) {
         continue;
       }
-      elapsed = runBenchmarkGetNSPerIteration(get<2>(benchmarks()[i]),
-                                              globalBaseline);
+      auto& stats = get<3>(benchmarks()[i]);
+      if (stats) {
+        stats->clear();
+      }
+      ScopedCpuPin pin(FLAGS_bm_cpu);
+      // The global baseline is the overhead of calling a benchmark on one
+      // thread, which has nothing to do with the wall time per operation
+      // of a multithreaded one.
+      result = runBenchmarkGetNSPerIteration(
+          get<2>(benchmarks()[i]),
+          stats ? 0 : globalBaseline,
+          counters.get(),
+          stats ? nullptr : &baselineResult);
+      if (stats && stats->latencies.size() > 0) {
+        auto& latencies = stats->latencies;
+        result.latencySamples = latencies.size();
+        result.latencyP50 = latencies.percentile(0.5);
+        result.latencyP90 = latencies.percentile(0.9);
+        result.latencyP99 = latencies.percentile(0.99);
+        result.latencyP999 = latencies.percentile(0.999);
+      }
+      if (stats) {
+        result.threadOps = stats->threadOps;
+        FOR_EACH_RANGE (t, 0, stats->threadOps.size()) {
+          result.threadOpsPerSec.push_back(
+              stats->threadNanos[t] == 0
+                  ? 0
+                  : stats->threadOps[t] * 1E9 / stats->threadNanos[t]);
+        }
+      }
     }
-    results.emplace_back(get<0>(benchmarks()[i]),
-                         get<1>(benchmarks()[i]), elapsed);
+    result.file = get<0>(benchmarks()[i]);
+    result.name = get<1>(benchmarks()[i]);
+    results.push_back(std::move(result));
   }
 
   // PLEASE MAKE NOISE. MEASUREMENTS DONE.
 
-  printBenchmarkResults(results);
+  printBenchmarkResults(results, baseline);
+
+  if (FLAGS_bm_fail_on_regression && !baseline.empty()) {
+    size_t regressions = 0;
+    for (auto& result : results) {
+      auto base = baseline.find(result.name);
+      double change = 0;
+      if (base != baseline.end() &&
+          compareToBaseline(result, base->second, &change) ==
+              BaselineVerdict::REGRESSED) {
+        LOG(ERROR) << "Benchmark " << result.name << " regressed by "
+                   << change << "%";
+        ++regressions;
+      }
+    }
+    if (regressions > 0) {
+      exit(EXIT_FAILURE);
+    }
+  }
 }
 
 } // namespace folly
@@ -20,13 +20,21 @@
 #include <folly/Preprocessor.h> // for FB_ANONYMOUS_VARIABLE
 #include <folly/ScopeGuard.h>
 #include <folly/Traits.h>
+#include <folly/portability/Asm.h>
 #include <folly/portability/GFlags.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <limits>
+#include <memory>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
 #include <boost/function_types/function_arity.hpp>
 #include <glog/logging.h>
@@ -64,6 +72,208 @@ void addBenchmarkImpl(const char* file,
                       const char* name,
                       std::function<TimeIterPair(unsigned int)>);
 
+/**
+ * Per-operation latencies sampled by a multithreaded benchmark, collected
+ * over all of its epochs. Keeps a uniformly random subset of at most
+ * capacity samples. Not thread safe; threads hand over their samples
+ * once they are done.
+ */
+class BenchmarkLatencySamples {
+ public:
+  explicit BenchmarkLatencySamples(size_t capacity = 1 << 16);
+
+  void add(const std::vector<uint64_t>& nanos);
+
+  void clear();
+
+  size_t size() const {
+    return samples_.size();
+  }
+
+  /**
+   * Returns the q-th quantile (0 <= q <= 1) of the samples in
+   * nanoseconds, or 0 if there are none.
+   */
+  double percentile(double q);
+
+ private:
+  size_t capacity_;
+  uint64_t seen_{0};
+  uint64_t rngState_;
+  bool sorted_{true};
+  std::vector<uint64_t> samples_;
+};
+
+/**
+ * What a multithreaded benchmark collects besides its time, over all of
+ * its epochs: sampled latencies, and for each thread the operations it
+ * ran and the nanoseconds from the release of the threads until it was
+ * done with them. Not thread safe either.
+ */
+struct MultithreadedBenchmarkStats {
+  BenchmarkLatencySamples latencies;
+  std::vector<uint64_t> threadOps;
+  std::vector<uint64_t> threadNanos;
+
+  void clear();
+};
+
+/**
+ * Like addBenchmarkImpl above, for multithreaded benchmarks.
+ */
+void addBenchmarkImpl(const char* file,
+                      const char* name,
+                      std::function<TimeIterPair(unsigned int)>,
+                      std::shared_ptr<MultithreadedBenchmarkStats>);
+
+/**
+ * The thread counts multithreaded benchmarks are run with: powers of two
+ * up to the number of CPUs, and the number of CPUs itself.
+ */
+std::vector<size_t> benchmarkThreadCounts();
+
+/**
+ * One in this many operations of a multithreaded benchmark is timed
+ * individually; 0 disables latency sampling.
+ */
+unsigned int benchmarkLatencySampleInterval();
+
+/**
+ * Pins the calling benchmark thread to a CPU chosen by CacheLocality, so
+ * that threads with neighboring indices share caches.
+ */
+void pinBenchmarkThread(size_t threadIndex);
+
+/**
+ * Stop and restart the hardware counters the calling thread reads for
+ * --bm_perf_counters, if any, so that like the time they leave out code
+ * run under a BenchmarkSuspender. Calls nest.
+ */
+void pauseBenchmarkCounters();
+void resumeBenchmarkCounters();
+
+/**
+ * The hardware counters (--bm_perf_counters) of one worker thread of a
+ * multithreaded benchmark. Created on the measuring thread; the worker
+ * calls open() before waiting to be released, and start() and stop()
+ * around its timed operations. stop() adds the counts to those of the
+ * measuring thread. Does nothing if that thread isn't reading counters.
+ */
+class BenchmarkWorkerCounters {
+ public:
+  BenchmarkWorkerCounters();
+  ~BenchmarkWorkerCounters();
+
+  BenchmarkWorkerCounters(const BenchmarkWorkerCounters&) = delete;
+  BenchmarkWorkerCounters& operator=(const BenchmarkWorkerCounters&) = delete;
+
+  void open();
+  void start();
+  void stop();
+
+ private:
+  struct State;
+  std::unique_ptr<State> state_;
+};
+
+/**
+ * Runs body(threadIndex) iters times in total, split evenly across
+ * numThreads threads that are released together. The time reported is
+ * from the release to the moment the last thread finished; the latency
+ * samples come from operations run after that, outside of the measurement.
+ * Hardware counters are read on the worker threads, not the calling one.
+ */
+template <typename Body>
+TimeIterPair runMultithreadedBenchmark(
+    const Body& body,
+    size_t numThreads,
+    unsigned int iters,
+    MultithreadedBenchmarkStats& stats) {
+  using Clock = std::chrono::high_resolution_clock;
+
+  const size_t opsPerThread = std::max<size_t>(1, iters / numThreads);
+  const unsigned int sampleInterval = benchmarkLatencySampleInterval();
+  std::atomic<size_t> ready{0};
+  std::atomic<bool> go{false};
+  std::atomic<size_t> finished{0};
+  std::vector<Clock::time_point> ends(numThreads);
+  std::vector<std::vector<uint64_t>> threadLatencies(numThreads);
+  std::vector<BenchmarkWorkerCounters> counters(numThreads);
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads);
+
+  // Only the workers' operations are counted.
+  pauseBenchmarkCounters();
+  SCOPE_EXIT {
+    resumeBenchmarkCounters();
+  };
+
+  for (size_t t = 0; t < numThreads; ++t) {
+    threads.emplace_back([&, t] {
+      pinBenchmarkThread(t);
+      auto& samples = threadLatencies[t];
+      if (sampleInterval != 0) {
+        samples.reserve(opsPerThread / sampleInterval + 1);
+      }
+      counters[t].open();
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      counters[t].start();
+      for (size_t op = 0; op < opsPerThread; ++op) {
+        body(t);
+      }
+      ends[t] = Clock::now();
+      counters[t].stop();
+      if (sampleInterval == 0) {
+        return;
+      }
+
+      // Latencies are sampled once all threads are done with the timed
+      // operations, so that reading the clock doesn't slow those down, while
+      // the threads still run concurrently.
+      finished.fetch_add(1);
+      while (finished.load(std::memory_order_acquire) < numThreads) {
+        std::this_thread::yield();
+      }
+      for (size_t op = 0; op < opsPerThread / sampleInterval + 1; ++op) {
+        auto begin = Clock::now();
+        body(t);
+        samples.push_back(uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - begin)
+                .count()));
+      }
+    });
+  }
+
+  while (ready.load() < numThreads) {
+    asm_volatile_pause();
+  }
+  // CORE MEASUREMENT STARTS
+  auto start = Clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto end = *std::max_element(ends.begin(), ends.end());
+  // CORE MEASUREMENT ENDS
+
+  for (auto& samples : threadLatencies) {
+    stats.latencies.add(samples);
+  }
+  stats.threadOps.resize(numThreads);
+  stats.threadNanos.resize(numThreads);
+  for (size_t t = 0; t < numThreads; ++t) {
+    stats.threadOps[t] += opsPerThread;
+    stats.threadNanos[t] += uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(ends[t] - start)
+            .count());
+  }
+  return TimeIterPair(end - start, unsigned(opsPerThread * numThreads));
+}
+
 } // namespace detail
 
 /**
@@ -76,6 +286,7 @@ struct BenchmarkSuspender {
 
   BenchmarkSuspender() {
     start = Clock::now();
+    detail::pauseBenchmarkCounters();
   }
 
   BenchmarkSuspender(const BenchmarkSuspender &) = delete;
@@ -109,6 +320,7 @@ struct BenchmarkSuspender {
   void rehire() {
     assert(start == TimePoint{});
     start = Clock::now();
+    detail::pauseBenchmarkCounters();
   }
 
   template <class F>
@@ -132,7 +344,9 @@ struct BenchmarkSuspender {
   static Duration timeSpent;
 
  private:
+  // Ends the suspension started at start.
   void tally() {
+    detail::resumeBenchmarkCounters();
     auto end = Clock::now();
     timeSpent += end - start;
     start = end;
@@ -193,6 +407,39 @@ addBenchmark(const char* file, const char* name, Lambda&& lambda) {
     });
 }
 
+/**
+ * Adds one benchmark per thread count in detail::benchmarkThreadCounts().
+ * Usually not called directly but instead through the macro
+ * BENCHMARK_MULTITHREADED defined below. The lambda takes the index of
+ * the calling thread and performs a single operation; the benchmark
+ * calls it repeatedly from every thread at once. The single-threaded
+ * run is the baseline of the others, so the relative column shows how
+ * throughput scales. The global baseline, measured on one thread, is not
+ * subtracted from their times.
+ */
+template <typename Lambda>
+void addMultithreadedBenchmark(
+    const char* file,
+    const char* name,
+    Lambda&& lambda) {
+  bool first = true;
+  for (auto numThreads : detail::benchmarkThreadCounts()) {
+    auto stats = std::make_shared<detail::MultithreadedBenchmarkStats>();
+    auto fullName = std::string(first ? "" : "%") + name + "(" +
+        std::to_string(numThreads) + "thr)";
+    first = false;
+    auto execute = [=](unsigned int times) {
+      return detail::runMultithreadedBenchmark(
+          lambda, numThreads, times, *stats);
+    };
+    detail::addBenchmarkImpl(
+        file,
+        fullName.c_str(),
+        std::function<detail::TimeIterPair(unsigned int)>(execute),
+        stats);
+  }
+}
+
 /**
  * Call doNotOptimizeAway(var) to ensure that var will be computed even
  * post-optimization.  Use it for variables that are computed during
@@ -517,6 +764,38 @@ auto makeUnpredictable(T& datum) -> typename std::enable_if<
     return name(iters, ## __VA_ARGS__);                                 \
   }
 
+/**
+ * Introduces a benchmark whose body runs concurrently on several threads,
+ * once per thread count from 1 up to the number of CPUs. The body is a
+ * single operation and may name a parameter that receives the index of
+ * the running thread. Threads are pinned to CPUs in cache locality
+ * order (see --bm_pin_threads) and start together. The time reported is
+ * wall time per operation across all threads, along with the operations
+ * each thread ran and its own throughput. One in
+ * --bm_latency_sample_interval operations is timed individually to
+ * report latency percentiles. Example:
+ *
+ * std::mutex mutex;
+ * BENCHMARK_MULTITHREADED(mutexLockUnlock) {
+ *   std::lock_guard<std::mutex> g(mutex);
+ * }
+ *
+ * std::atomic<size_t> counters[64];
+ * BENCHMARK_MULTITHREADED(stripedIncrement, thread) {
+ *   counters[thread % 64].fetch_add(1);
+ * }
+ */
+#define BENCHMARK_MULTITHREADED(name, ...)                              \
+  static void name(FB_ONE_OR_NONE(size_t, ## __VA_ARGS__) __VA_ARGS__); \
+  static bool FB_ANONYMOUS_VARIABLE(follyBenchmarkUnused) = (           \
+    ::folly::addMultithreadedBenchmark(__FILE__, FB_STRINGIZE(name),    \
+      [](size_t follyBenchmarkThread) {                                 \
+        (void)follyBenchmarkThread;                                     \
+        name(FB_ONE_OR_NONE(follyBenchmarkThread, ## __VA_ARGS__));     \
+      }),                                                               \
+    true);                                                              \
+  static void name(FB_ONE_OR_NONE(size_t, ## __VA_ARGS__) __VA_ARGS__)
+
 /**
  * Draws a line of dashes.
  */
@@ -0,0 +1,606 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+
+A sorted set of unique keys, like ConcurrentSkipList, but with up to
+NodeCapacity keys stored contiguously in each node. This makes the list
+several times smaller and much more cache friendly to scan, at the expense
+of more expensive writes: nodes are immutable once published, and a write
+replaces the node it touches with a modified copy (or two, if it had to
+split).
+
+Reads (find, lower_bound, iteration) are lock-free, and as with
+ConcurrentSkipList, nodes that got replaced are only freed once no Accessor
+is left. Writes are serialized on a mutex, which suits lists that are loaded
+in sorted batches and read much more than written:
+
+     typedef ConcurrentFatSkipList<int64_t> Index;
+     auto index = Index::createInstanceFromSorted(keys.begin(), keys.end());
+     {
+       Index::Accessor accessor(index);
+       accessor.insertSorted(batch.begin(), batch.end());
+       for (auto it = accessor.lower_bound(from);
+            it != accessor.end() && *it < to;
+            ++it) {
+         ...
+       }
+     }
+
+Iterators see the list as of the nodes they visit: a scan running
+concurrently with writes sees each node either before or after the write.
+Nodes are not merged when erase() leaves them underfull, so lists that
+shrink a lot scan less efficiently than freshly built ones.
+
+Elements must be copy-constructible, as writes copy the node. With an
+arena allocator, replaced nodes are only freed with the arena, so only use
+one for lists that are mostly built in bulk.
+
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/noncopyable.hpp>
+#include <glog/logging.h>
+
+#include <folly/Bits.h>
+#include <folly/ConcurrentSkipList-inl.h>
+#include <folly/Memory.h>
+
+namespace folly {
+
+namespace detail {
+
+template <typename T, size_t Capacity>
+class FatSkipListNode : private boost::noncopyable {
+ public:
+  typedef T value_type;
+
+  template <typename NodeAlloc>
+  static FatSkipListNode* create(NodeAlloc& alloc, int height) {
+    DCHECK(height >= 1 && height < 64) << height;
+
+    size_t size = sizeof(FatSkipListNode) +
+      height * sizeof(std::atomic<FatSkipListNode*>);
+    auto* node = static_cast<FatSkipListNode*>(alloc.allocate(size));
+    new (node) FatSkipListNode(uint8_t(height));
+    return node;
+  }
+
+  template <typename NodeAlloc>
+  static void destroy(NodeAlloc& alloc, FatSkipListNode* node) {
+    node->~FatSkipListNode();
+    alloc.deallocate(node);
+  }
+
+  template <typename NodeAlloc>
+  struct DestroyIsNoOp : std::integral_constant<bool,
+    IsArenaAllocator<NodeAlloc>::value &&
+    std::is_trivially_destructible<T>::value> { };
+
+  FatSkipListNode* skip(int layer) const {
+    DCHECK_LT(layer, height_);
+    return skip_[layer].load(std::memory_order_acquire);
+  }
+
+  void setSkip(int layer, FatSkipListNode* next) {
+    DCHECK_LT(layer, height_);
+    skip_[layer].store(next, std::memory_order_release);
+  }
+
+  int height() const { return height_; }
+  size_t size() const { return size_; }
+
+  const value_type* begin() const {
+    return reinterpret_cast<const value_type*>(keys_);
+  }
+  const value_type* end() const { return begin() + size_; }
+  const value_type& key(size_t i) const { return begin()[i]; }
+  const value_type& first() const { return key(0); }
+
+  // Only valid before the node is linked into a list.
+  template <typename U>
+  void append(U&& key) {
+    DCHECK_LT(size_, Capacity);
+    new (&keys_[size_]) value_type(std::forward<U>(key));
+    ++size_;
+  }
+
+  bool markedForRemoval() const {
+    return removed_.load(std::memory_order_acquire);
+  }
+  void setMarkedForRemoval() {
+    removed_.store(true, std::memory_order_release);
+  }
+
+ private:
+  explicit FatSkipListNode(uint8_t height)
+      : removed_(false), height_(height), size_(0) {
+    for (uint8_t i = 0; i < height_; ++i) {
+      new (&skip_[i]) std::atomic<FatSkipListNode*>(nullptr);
+    }
+  }
+
+  ~FatSkipListNode() {
+    for (size_t i = 0; i < size_; ++i) {
+      begin()[i].~value_type();
+    }
+    for (uint8_t i = 0; i < height_; ++i) {
+      skip_[i].~atomic();
+    }
+  }
+
+  std::atomic<bool> removed_;
+  const uint8_t height_;
+  uint16_t size_;
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type keys_[Capacity];
+
+  std::atomic<FatSkipListNode*> skip_[0];
+};
+
+template <typename ValT, typename NodeT>
+class fat_csl_iterator : public boost::iterator_facade<
+    fat_csl_iterator<ValT, NodeT>, const ValT, boost::forward_traversal_tag> {
+ public:
+  explicit fat_csl_iterator(const NodeT* node = nullptr, size_t index = 0)
+      : node_(node), index_(index) {}
+
+  bool good() const { return node_ != nullptr; }
+
+ private:
+  friend class boost::iterator_core_access;
+
+  void increment() {
+    if (++index_ == node_->size()) {
+      node_ = node_->skip(0);
+      index_ = 0;
+    }
+  }
+
+  bool equal(const fat_csl_iterator& other) const {
+    return node_ == other.node_ && index_ == other.index_;
+  }
+
+  const ValT& dereference() const { return node_->key(index_); }
+
+  const NodeT* node_;
+  size_t index_;
+};
+
+} // namespace detail
+
+template <typename T,
+          typename Comp = std::less<T>,
+          // All nodes are allocated using provided SimpleAllocator,
+          // it should be thread-safe.
+          typename NodeAlloc = SysAlloc,
+          size_t NodeCapacity = 16,
+          int MAX_HEIGHT = 24>
+class ConcurrentFatSkipList {
+  static_assert(NodeCapacity >= 2 &&
+                NodeCapacity <= std::numeric_limits<uint16_t>::max(),
+      "NodeCapacity can only be in the range of [2, 65536)");
+  static_assert(MAX_HEIGHT >= 2 && MAX_HEIGHT < 64,
+      "MAX_HEIGHT can only be in the range of [2, 64)");
+  typedef ConcurrentFatSkipList<T, Comp, NodeAlloc, NodeCapacity, MAX_HEIGHT>
+    SkipListType;
+
+ public:
+  typedef detail::FatSkipListNode<T, NodeCapacity> NodeType;
+  typedef T value_type;
+  typedef T key_type;
+  typedef detail::fat_csl_iterator<value_type, NodeType> const_iterator;
+  typedef const_iterator iterator;
+
+  class Accessor;
+
+  explicit ConcurrentFatSkipList(const NodeAlloc& alloc)
+      : recycler_(alloc),
+        head_(NodeType::create(recycler_.alloc(), MAX_HEIGHT)),
+        height_(1),
+        size_(0) {}
+
+  ConcurrentFatSkipList()
+      : recycler_(),
+        head_(NodeType::create(recycler_.alloc(), MAX_HEIGHT)),
+        height_(1),
+        size_(0) {}
+
+  static std::shared_ptr<SkipListType> createInstance(const NodeAlloc& alloc) {
+    return std::make_shared<ConcurrentFatSkipList>(alloc);
+  }
+
+  static std::shared_ptr<SkipListType> createInstance() {
+    return std::make_shared<ConcurrentFatSkipList>();
+  }
+
+  // Create a list holding the elements of the sorted range [first, last);
+  // duplicates are skipped. Nodes are filled up completely and get
+  // deterministic heights that keep the list balanced.
+  template <typename InputIt>
+  static std::shared_ptr<SkipListType> createInstanceFromSorted(
+      InputIt first, InputIt last, const NodeAlloc& alloc) {
+    auto sl = createInstance(alloc);
+    sl->buildFromSorted(first, last);
+    return sl;
+  }
+
+  template <typename InputIt>
+  static std::shared_ptr<SkipListType> createInstanceFromSorted(
+      InputIt first, InputIt last) {
+    auto sl = createInstance();
+    sl->buildFromSorted(first, last);
+    return sl;
+  }
+
+  ~ConcurrentFatSkipList() {
+    /* static */ if (NodeType::template DestroyIsNoOp<NodeAlloc>::value) {
+      // Avoid traversing the list if using arena allocator.
+      return;
+    }
+    for (NodeType* current = head_; current; ) {
+      NodeType* tmp = current->skip(0);
+      NodeType::destroy(recycler_.alloc(), current);
+      current = tmp;
+    }
+  }
+
+ private:
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+  int height() const { return height_.load(std::memory_order_acquire); }
+
+  // Returns the last node whose first element is not greater than data, or
+  // the head if there is none.
+  NodeType* findNode(const value_type& data) const {
+    NodeType* pred = head_;
+    for (int layer = height() - 1; layer >= 0; --layer) {
+      NodeType* node = pred->skip(layer);
+      while (node && !Comp()(data, node->first())) {
+        pred = node;
+        node = node->skip(layer);
+      }
+    }
+    return pred;
+  }
+
+  // Sets preds[layer] to the last node on each layer whose first element is
+  // less than data, or the head if there is none.
+  void findPreds(const value_type& data, NodeType* preds[MAX_HEIGHT]) const {
+    NodeType* pred = head_;
+    int top = height();
+    for (int layer = MAX_HEIGHT - 1; layer >= top; --layer) {
+      preds[layer] = head_;
+    }
+    for (int layer = top - 1; layer >= 0; --layer) {
+      NodeType* node = pred->skip(layer);
+      while (node && Comp()(node->first(), data)) {
+        pred = node;
+        node = node->skip(layer);
+      }
+      preds[layer] = pred;
+    }
+  }
+
+  const_iterator lower_bound(const value_type& data) const {
+    const NodeType* node = findNode(data);
+    if (node == head_) {
+      return const_iterator(head_->skip(0));
+    }
+    size_t index =
+      std::lower_bound(node->begin(), node->end(), data, Comp()) -
+      node->begin();
+    if (index == node->size()) {
+      return const_iterator(node->skip(0));
+    }
+    return const_iterator(node, index);
+  }
+
+  bool contains(const value_type& data) const {
+    const NodeType* node = findNode(data);
+    return node != head_ &&
+      std::binary_search(node->begin(), node->end(), data, Comp());
+  }
+
+  int randomHeight() const {
+    return detail::SkipListRandomHeight::instance()->getHeight(
+        std::min(MAX_HEIGHT, height() + 1));
+  }
+
+  // Adds the elements of the sorted range [first, last), returns the number
+  // of new ones. All the elements that fall into the same node are merged
+  // into it at once, so sorted batches only copy each affected node once.
+  template <typename InputIt>
+  size_t addSorted(InputIt first, InputIt last) {
+    std::lock_guard<std::mutex> g(writeMutex_);
+    NodeType* preds[MAX_HEIGHT];
+    std::vector<value_type> keys;
+    size_t added = 0;
+    while (first != last) {
+      NodeType* target = findNode(*first);
+      if (target == head_) {
+        // Smaller than everything, goes into the first node.
+        target = head_->skip(0);
+      }
+      NodeType* next = target ? target->skip(0) : nullptr;
+      if (target) {
+        findPreds(target->first(), preds);
+      } else {
+        std::fill(preds, preds + MAX_HEIGHT, head_);
+      }
+
+      // Merge target's elements with the incoming ones that belong before
+      // the next node.
+      keys.clear();
+      size_t addedToNode = 0;
+      const value_type* it = target ? target->begin() : nullptr;
+      const value_type* end = target ? target->end() : nullptr;
+      for (; first != last && (!next || Comp()(*first, next->first()));
+           ++first) {
+        auto&& data = *first;
+        DCHECK(keys.empty() || !Comp()(data, keys.back()))
+          << "input is not sorted";
+        while (it != end && Comp()(*it, data)) {
+          keys.push_back(*it++);
+        }
+        if ((it != end && !Comp()(data, *it)) ||
+            (!keys.empty() && !Comp()(keys.back(), data))) {
+          continue;  // already there
+        }
+        keys.push_back(std::forward<decltype(data)>(data));
+        ++addedToNode;
+      }
+      if (addedToNode > 0) {
+        keys.insert(keys.end(), it, end);
+        replaceNode(target, preds, keys);
+        added += addedToNode;
+      }
+    }
+    size_.fetch_add(added, std::memory_order_relaxed);
+    return added;
+  }
+
+  bool remove(const value_type& data) {
+    std::lock_guard<std::mutex> g(writeMutex_);
+    NodeType* target = findNode(data);
+    if (target == head_) {
+      return false;
+    }
+    auto pos = std::lower_bound(target->begin(), target->end(), data, Comp());
+    if (pos == target->end() || Comp()(data, *pos)) {
+      return false;
+    }
+
+    NodeType* preds[MAX_HEIGHT];
+    findPreds(target->first(), preds);
+    if (target->size() == 1) {
+      for (int k = target->height() - 1; k >= 0; --k) {
+        preds[k]->setSkip(k, target->skip(k));
+      }
+      target->setMarkedForRemoval();
+      recycler_.add(target);
+    } else {
+      std::vector<value_type> keys(target->begin(), pos);
+      keys.insert(keys.end(), pos + 1, target->end());
+      replaceNode(target, preds, keys);
+    }
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Replaces target (which may be null if the list is empty) with nodes
+  // holding keys, splitting them evenly if they don't fit in one node.
+  // The first new node takes target's place and height.
+  void replaceNode(
+      NodeType* target,
+      NodeType* preds[MAX_HEIGHT],
+      std::vector<value_type>& keys) {
+    DCHECK(!keys.empty());
+    size_t numNodes = (keys.size() + NodeCapacity - 1) / NodeCapacity;
+    NodeType* firsts[MAX_HEIGHT] = {};
+    NodeType* tails[MAX_HEIGHT] = {};
+    int maxHeight = 0;
+    for (size_t i = 0; i < numNodes; ++i) {
+      int nodeHeight =
+        i == 0 && target ? target->height() : randomHeight();
+      NodeType* node = NodeType::create(recycler_.alloc(), nodeHeight);
+      size_t begin = i * keys.size() / numNodes;
+      size_t end = (i + 1) * keys.size() / numNodes;
+      for (size_t j = begin; j < end; ++j) {
+        node->append(std::move(keys[j]));
+      }
+      for (int k = 0; k < nodeHeight; ++k) {
+        if (tails[k]) {
+          tails[k]->setSkip(k, node);
+        } else {
+          firsts[k] = node;
+        }
+        tails[k] = node;
+      }
+      maxHeight = std::max(maxHeight, nodeHeight);
+    }
+
+    // Link the new nodes to their successors before making them reachable,
+    // so readers see either all of the old node or all of the new ones.
+    for (int k = 0; k < maxHeight; ++k) {
+      tails[k]->setSkip(k,
+          target && k < target->height() ? target->skip(k)
+                                         : preds[k]->skip(k));
+    }
+    for (int k = maxHeight - 1; k >= 0; --k) {
+      preds[k]->setSkip(k, firsts[k]);
+    }
+    if (maxHeight > height()) {
+      height_.store(maxHeight, std::memory_order_release);
+    }
+    if (target) {
+      target->setMarkedForRemoval();
+      recycler_.add(target);
+    }
+  }
+
+  // Links the elements of [first, last) into this empty list, which must not
+  // be shared with other threads yet.
+  template <typename InputIt>
+  void buildFromSorted(InputIt first, InputIt last) {
+    DCHECK_EQ(0, size());
+    NodeType* tails[MAX_HEIGHT];
+    std::fill(tails, tails + MAX_HEIGHT, head_);
+    NodeType* node = nullptr;
+    const value_type* prev = nullptr;
+    size_t numNodes = 0;
+    size_t n = 0;
+    int maxHeight = 1;
+    for (; first != last; ++first) {
+      if (prev && !Comp()(*prev, *first)) {
+        DCHECK(!Comp()(*first, *prev)) << "input is not sorted";
+        continue;
+      }
+      if (!node || node->size() == NodeCapacity) {
+        // Every 4th node on a layer also appears on the layer above.
+        ++numNodes;
+        int nodeHeight =
+          std::min(MAX_HEIGHT, 1 + int(findFirstSet(numNodes) - 1) / 2);
+        node = NodeType::create(recycler_.alloc(), nodeHeight);
+        for (int k = 0; k < nodeHeight; ++k) {
+          tails[k]->setSkip(k, node);
+          tails[k] = node;
+        }
+        maxHeight = std::max(maxHeight, nodeHeight);
+      }
+      node->append(*first);
+      prev = &node->key(node->size() - 1);
+      ++n;
+    }
+    height_.store(maxHeight, std::memory_order_release);
+    size_.store(n, std::memory_order_relaxed);
+  }
+
+  detail::NodeRecycler<NodeType, NodeAlloc> recycler_;
+  NodeType* const head_;
+  std::atomic<int> height_;
+  std::atomic<size_t> size_;
+  std::mutex writeMutex_;
+};
+
+template <typename T,
+          typename Comp,
+          typename NodeAlloc,
+          size_t NodeCapacity,
+          int MAX_HEIGHT>
+class ConcurrentFatSkipList<T, Comp, NodeAlloc, NodeCapacity, MAX_HEIGHT>::
+    Accessor {
+  typedef ConcurrentFatSkipList<T, Comp, NodeAlloc, NodeCapacity, MAX_HEIGHT>
+    SkipListType;
+
+ public:
+  typedef T value_type;
+  typedef T key_type;
+  typedef const T& reference;
+  typedef const T& const_reference;
+  typedef const T* pointer;
+  typedef const T* const_pointer;
+  typedef size_t size_type;
+  typedef Comp key_compare;
+  typedef Comp value_compare;
+
+  typedef typename SkipListType::iterator iterator;
+  typedef typename SkipListType::const_iterator const_iterator;
+
+  explicit Accessor(std::shared_ptr<SkipListType> skip_list)
+      : slHolder_(std::move(skip_list)) {
+    sl_ = slHolder_.get();
+    DCHECK(sl_ != nullptr);
+    sl_->recycler_.addRef();
+  }
+
+  // Unsafe initializer: the caller assumes the responsibility to keep
+  // skip_list valid during the whole life cycle of the Accessor.
+  explicit Accessor(SkipListType* skip_list) : sl_(skip_list) {
+    DCHECK(sl_ != nullptr);
+    sl_->recycler_.addRef();
+  }
+
+  Accessor(const Accessor& accessor)
+      : sl_(accessor.sl_), slHolder_(accessor.slHolder_) {
+    sl_->recycler_.addRef();
+  }
+
+  Accessor& operator=(const Accessor& accessor) {
+    if (this != &accessor) {
+      slHolder_ = accessor.slHolder_;
+      sl_->recycler_.releaseRef();
+      sl_ = accessor.sl_;
+      sl_->recycler_.addRef();
+    }
+    return *this;
+  }
+
+  ~Accessor() {
+    sl_->recycler_.releaseRef();
+  }
+
+  bool empty() const { return sl_->size() == 0; }
+  size_t size() const { return sl_->size(); }
+  size_type max_size() const { return std::numeric_limits<size_type>::max(); }
+
+  const_iterator begin() const { return const_iterator(sl_->head_->skip(0)); }
+  const_iterator end() const { return const_iterator(); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  const_iterator find(const key_type& data) const {
+    auto it = lower_bound(data);
+    return it != end() && !Comp()(data, *it) ? it : end();
+  }
+
+  const_iterator lower_bound(const key_type& data) const {
+    return sl_->lower_bound(data);
+  }
+
+  bool contains(const key_type& data) const { return sl_->contains(data); }
+  size_type count(const key_type& data) const { return contains(data); }
+
+  // Returns true if data was added, false if it was already in the list.
+  bool insert(const key_type& data) {
+    return sl_->addSorted(&data, &data + 1) != 0;
+  }
+
+  // Adds the elements of the sorted range [first, last), returns the number
+  // of elements that were not in the list yet.
+  template <typename InputIt>
+  size_t insertSorted(InputIt first, InputIt last) {
+    return sl_->addSorted(first, last);
+  }
+
+  size_t erase(const key_type& data) { return sl_->remove(data); }
+
+  SkipListType* skiplist() const { return sl_; }
+
+ private:
+  SkipListType* sl_;
+  std::shared_ptr<SkipListType> slHolder_;
+};
+
+} // namespace folly
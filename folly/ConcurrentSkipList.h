@@ -115,6 +115,13 @@ Sample usage:
        ...  ...
        // GC may happen when the accessor gets destructed.
      }
+
+ Sorted input can be loaded much faster than element by element: use
+ createInstanceFromSorted() to build a new list from it, or
+ Accessor::insertSorted() to add a sorted batch to an existing list.
+
+ For read-mostly lists that are scanned in ranges, see also
+ ConcurrentFatSkipList, which stores several elements per node.
 */
 
 #pragma once
@@ -127,6 +134,7 @@ Sample usage:
 #include <boost/iterator/iterator_facade.hpp>
 #include <glog/logging.h>
 
+#include <folly/Bits.h>
 #include <folly/ConcurrentSkipList-inl.h>
 #include <folly/Likely.h>
 #include <folly/Memory.h>
@@ -189,6 +197,27 @@ class ConcurrentSkipList {
     return std::make_shared<ConcurrentSkipList>(height);
   }
 
+  // Create a shared_ptr skiplist object holding the elements of the sorted
+  // range [first, last); duplicates are skipped. This is much faster than
+  // adding the elements one by one: nodes are linked in order, without any
+  // searching or locking, and get deterministic heights that keep the list
+  // balanced.
+  template <typename InputIt>
+  static std::shared_ptr<SkipListType> createInstanceFromSorted(
+      InputIt first, InputIt last, const NodeAlloc& alloc) {
+    auto sl = createInstance(1, alloc);
+    sl->buildFromSorted(first, last);
+    return sl;
+  }
+
+  template <typename InputIt>
+  static std::shared_ptr<SkipListType> createInstanceFromSorted(
+      InputIt first, InputIt last) {
+    auto sl = createInstance(1);
+    sl->buildFromSorted(first, last);
+    return sl;
+  }
+
   //===================================================================
   // Below are implementation details.
   // Please see ConcurrentSkipList::Accessor for stdlib-like APIs.
@@ -241,6 +270,41 @@ class ConcurrentSkipList {
     return foundLayer;
   }
 
+  // Like findInsertionPointGetMaxLayer(), but on layers below hintLayers the
+  // search starts from preds[layer] rather than from the node above, if
+  // that is a live node further right that is still less than data. This is
+  // the case for the predecessors of a smaller element found earlier.
+  int findInsertionPointWithHint(const value_type &data,
+      NodeType *preds[], NodeType *succs[], int hintLayers,
+      int *max_layer) const {
+    NodeType *pred = head_.load(std::memory_order_consume);
+    *max_layer = pred->maxLayer();
+    int foundLayer = -1;
+    NodeType *foundNode = nullptr;
+    for (int layer = *max_layer; layer >= 0; --layer) {
+      if (layer < hintLayers) {
+        NodeType *hint = preds[layer];
+        if (hint != pred && !hint->isHeadNode() &&
+            !hint->markedForRemoval() && greater(data, hint) &&
+            (pred->isHeadNode() || Comp()(pred->data(), hint->data()))) {
+          pred = hint;
+        }
+      }
+      NodeType *node = pred->skip(layer);
+      while (greater(data, node)) {
+        pred = node;
+        node = node->skip(layer);
+      }
+      if (foundLayer == -1 && !less(data, node)) {
+        foundLayer = layer;
+        foundNode = node;
+      }
+      preds[layer] = pred;
+      succs[layer] = foundNode ? foundNode : node;
+    }
+    return foundLayer;
+  }
+
   size_t size() const { return size_.load(std::memory_order_relaxed); }
 
   int height() const {
@@ -299,11 +363,24 @@ class ConcurrentSkipList {
   template<typename U>
   std::pair<NodeType*, size_t> addOrGetData(U &&data) {
     NodeType *preds[MAX_HEIGHT], *succs[MAX_HEIGHT];
+    int hintLayers = 0;
+    return addOrGetData(std::forward<U>(data), preds, succs, hintLayers);
+  }
+
+  // Same as above, using preds[0, hintLayers) as search hints (see
+  // findInsertionPointWithHint()). On return, preds and hintLayers are set
+  // up for adding an element greater than data.
+  template<typename U>
+  std::pair<NodeType*, size_t> addOrGetData(U &&data,
+      NodeType *preds[MAX_HEIGHT], NodeType *succs[MAX_HEIGHT],
+      int &hintLayers) {
     NodeType *newNode;
     size_t newSize;
     while (true) {
       int max_layer = 0;
-      int layer = findInsertionPointGetMaxLayer(data, preds, succs, &max_layer);
+      int layer = findInsertionPointWithHint(
+          data, preds, succs, hintLayers, &max_layer);
+      hintLayers = max_layer + 1;
 
       if (layer >= 0) {
         NodeType *nodeFound = succs[layer];
@@ -313,6 +390,9 @@ class ConcurrentSkipList {
         }
         // wait until fully linked.
         while (UNLIKELY(!nodeFound->fullyLinked())) {}
+        for (int k = 0; k <= layer; ++k) {
+          preds[k] = nodeFound;
+        }
         return std::make_pair(nodeFound, 0);
       }
 
@@ -335,6 +415,9 @@ class ConcurrentSkipList {
 
       newNode->setFullyLinked();
       newSize = incrementSize(1);
+      for (int k = 0; k < nodeHeight; ++k) {
+        preds[k] = newNode;
+      }
       break;
     }
 
@@ -349,6 +432,68 @@ class ConcurrentSkipList {
     return std::make_pair(newNode, newSize);
   }
 
+  template <typename InputIt>
+  size_t addSorted(InputIt first, InputIt last) {
+    NodeType *preds[MAX_HEIGHT], *succs[MAX_HEIGHT];
+    int hintLayers = 0;
+    size_t added = 0;
+    for (; first != last; ++first) {
+      if (addOrGetData(*first, preds, succs, hintLayers).second) {
+        ++added;
+      }
+    }
+    return added;
+  }
+
+  // Links the elements of [first, last) into this empty list, which must not
+  // be shared with other threads yet. Node i (counting from 1) gets one layer
+  // for every two trailing zero bits of i, so every 4th node on a layer also
+  // appears on the layer above.
+  template <typename InputIt>
+  void buildFromSorted(InputIt first, InputIt last) {
+    DCHECK_EQ(0, size());
+    NodeType *firsts[MAX_HEIGHT] = {};
+    NodeType *tails[MAX_HEIGHT] = {};
+    int maxHeight = 1;
+    size_t n = 0;
+    for (; first != last; ++first) {
+      if (n > 0 && !Comp()(tails[0]->data(), *first)) {
+        DCHECK(!Comp()(*first, tails[0]->data())) << "input is not sorted";
+        continue;
+      }
+      ++n;
+      int nodeHeight =
+        std::min(MAX_HEIGHT, 1 + int(findFirstSet(n) - 1) / 2);
+      NodeType *node =
+        NodeType::create(recycler_.alloc(), nodeHeight, *first);
+      for (int k = 0; k < nodeHeight; ++k) {
+        if (tails[k]) {
+          tails[k]->setSkip(k, node);
+        } else {
+          firsts[k] = node;
+        }
+        tails[k] = node;
+      }
+      node->setFullyLinked();
+      maxHeight = std::max(maxHeight, nodeHeight);
+    }
+
+    // Start the head at the height adding n elements would have grown it to.
+    auto heights = detail::SkipListRandomHeight::instance();
+    while (maxHeight < MAX_HEIGHT && n > heights->getSizeLimit(maxHeight)) {
+      ++maxHeight;
+    }
+    NodeType *oldHead = head_.load(std::memory_order_relaxed);
+    NodeType *newHead = NodeType::create(recycler_.alloc(),
+        std::max(maxHeight, oldHead->height()), value_type(), true);
+    for (int k = 0; k < maxHeight; ++k) {
+      newHead->setSkip(k, firsts[k]);
+    }
+    head_.store(newHead, std::memory_order_release);
+    NodeType::destroy(recycler_.alloc(), oldHead);
+    size_.store(n, std::memory_order_relaxed);
+  }
+
   bool remove(const value_type &data) {
     NodeType *nodeToDelete = nullptr;
     ScopedLocker nodeGuard;
@@ -600,6 +745,15 @@ class ConcurrentSkipList<T, Comp, NodeAlloc, MAX_HEIGHT>::Accessor {
   }
   size_t erase(const key_type &data) { return remove(data); }
 
+  // Adds the elements of the sorted range [first, last), returns the number
+  // of elements that were not in the list yet. Cheaper than inserting them
+  // one at a time, as the search for each element starts from where the
+  // previous one went.
+  template <typename InputIt>
+  size_t insertSorted(InputIt first, InputIt last) {
+    return sl_->addSorted(first, last);
+  }
+
   iterator lower_bound(const key_type &data) const {
     return iterator(sl_->lower_bound(data));
   }
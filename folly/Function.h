@@ -678,6 +678,16 @@ class Function final : private detail::function::FunctionTraits<FunctionType> {
     return exec_(Op::HEAP, nullptr, nullptr);
   }
 
+  /**
+   * Returns the address of the code that invoking this `Function` runs.
+   * It is specific to the type of the stored callable, so it symbolizes to
+   * e.g. the lambda it holds; meant for diagnostics such as attributing slow
+   * callbacks. Returns nullptr if this `Function` is empty.
+   */
+  const void* getInvokerAddress() const noexcept {
+    return *this ? reinterpret_cast<const void*>(call_) : nullptr;
+  }
+
   using typename Traits::SharedProxy;
 
   /**
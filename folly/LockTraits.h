@@ -27,6 +27,9 @@
 #include <chrono>
 #include <type_traits>
 
+#include <folly/Likely.h>
+#include <folly/detail/LockContention.h>
+
 // Android, OSX, and Cygwin don't have timed mutexes
 #if defined(ANDROID) || defined(__ANDROID__) || defined(__APPLE__) || \
     defined(__CYGWIN__)
@@ -113,6 +116,90 @@ class LockInterfaceDispatcher {
       decltype(lock_upgrade_test<Mutex>(0))::value;
 };
 
+/**
+ * Lock contention profiling for mutexes that don't report contention
+ * themselves (std::mutex, boost::shared_mutex, ...): when profiling is
+ * enabled, try first, and time the blocking acquisition if that fails; it
+ * is reported once LockTraits unlocks the mutex. Otherwise this is a plain
+ * lock() (or unlock()) plus a load of the hooks pointer.
+ */
+template <class Mutex, class TryResult>
+using EnableIfLockTraitsReportContention = typename std::enable_if<
+    !LockReportsContention<Mutex>::value &&
+    std::is_convertible<TryResult, bool>::value>::type;
+
+template <class Mutex, class = void>
+struct ContentionReportingLock {
+  static void lock(Mutex& mutex) {
+    mutex.lock();
+  }
+};
+
+template <class Mutex>
+struct ContentionReportingLock<
+    Mutex,
+    EnableIfLockTraitsReportContention<
+        Mutex,
+        decltype(std::declval<Mutex&>().try_lock())>> {
+  static void lock(Mutex& mutex) {
+    if (LIKELY(lockContentionHooks() == nullptr)) {
+      mutex.lock();
+    } else if (!mutex.try_lock()) {
+      LockContentionTimer timer(
+          &mutex, LockType::Other, LockContentionKind::Exclusive);
+      mutex.lock();
+    }
+  }
+};
+
+template <class Mutex, class = void>
+struct ContentionReportingLockShared {
+  static void lock_shared(Mutex& mutex) {
+    mutex.lock_shared();
+  }
+};
+
+template <class Mutex>
+struct ContentionReportingLockShared<
+    Mutex,
+    EnableIfLockTraitsReportContention<
+        Mutex,
+        decltype(std::declval<Mutex&>().try_lock_shared())>> {
+  static void lock_shared(Mutex& mutex) {
+    if (LIKELY(lockContentionHooks() == nullptr)) {
+      mutex.lock_shared();
+    } else if (!mutex.try_lock_shared()) {
+      LockContentionTimer timer(
+          &mutex, LockType::Other, LockContentionKind::Shared);
+      mutex.lock_shared();
+    }
+  }
+};
+
+template <class Mutex, class = void>
+struct ContentionReportingLockUpgrade {
+  static void lock_upgrade(Mutex& mutex) {
+    mutex.lock_upgrade();
+  }
+};
+
+template <class Mutex>
+struct ContentionReportingLockUpgrade<
+    Mutex,
+    EnableIfLockTraitsReportContention<
+        Mutex,
+        decltype(std::declval<Mutex&>().try_lock_upgrade())>> {
+  static void lock_upgrade(Mutex& mutex) {
+    if (LIKELY(lockContentionHooks() == nullptr)) {
+      mutex.lock_upgrade();
+    } else if (!mutex.try_lock_upgrade()) {
+      LockContentionTimer timer(
+          &mutex, LockType::Other, LockContentionKind::Upgrade);
+      mutex.lock_upgrade();
+    }
+  }
+};
+
 /**
  * LockTraitsImpl is the base that is used to desribe the interface used by
  * different mutex types.  It accepts a MutexLevel argument and a boolean to
@@ -133,7 +220,7 @@ struct LockTraitsImpl<Mutex, MutexLevel::UNIQUE, false> {
    * Acquire the lock exclusively.
    */
   static void lock(Mutex& mutex) {
-    mutex.lock();
+    ContentionReportingLock<Mutex>::lock(mutex);
   }
 
   /**
@@ -141,6 +228,9 @@ struct LockTraitsImpl<Mutex, MutexLevel::UNIQUE, false> {
    */
   static void unlock(Mutex& mutex) {
     mutex.unlock();
+    if (!LockReportsContention<Mutex>::value) {
+      lockReleased(&mutex, LockType::Other);
+    }
   }
 };
 
@@ -159,7 +249,7 @@ struct LockTraitsImpl<Mutex, MutexLevel::SHARED, false>
    * Acquire the lock in shared (read) mode.
    */
   static void lock_shared(Mutex& mutex) {
-    mutex.lock_shared();
+    ContentionReportingLockShared<Mutex>::lock_shared(mutex);
   }
 
   /**
@@ -167,6 +257,9 @@ struct LockTraitsImpl<Mutex, MutexLevel::SHARED, false>
    */
   static void unlock_shared(Mutex& mutex) {
     mutex.unlock_shared();
+    if (!LockReportsContention<Mutex>::value) {
+      lockReleased(&mutex, LockType::Other);
+    }
   }
 };
 
@@ -208,7 +301,7 @@ struct LockTraitsImpl<Mutex, MutexLevel::UPGRADE, false>
    * Acquire the lock in upgradable mode.
    */
   static void lock_upgrade(Mutex& mutex) {
-    mutex.lock_upgrade();
+    ContentionReportingLockUpgrade<Mutex>::lock_upgrade(mutex);
   }
 
   /**
@@ -216,6 +309,9 @@ struct LockTraitsImpl<Mutex, MutexLevel::UPGRADE, false>
    */
   static void unlock_upgrade(Mutex& mutex) {
     mutex.unlock_upgrade();
+    if (!LockReportsContention<Mutex>::value) {
+      lockReleased(&mutex, LockType::Other);
+    }
   }
 
   /**
@@ -46,8 +46,10 @@
 #include <atomic>
 
 #include <glog/logging.h>
-#include <folly/detail/Sleeper.h>
+#include <folly/Likely.h>
 #include <folly/Portability.h>
+#include <folly/detail/LockContention.h>
+#include <folly/detail/Sleeper.h>
 
 namespace folly {
 
@@ -79,18 +81,16 @@ struct MicroSpinLock {
   }
 
   void lock() {
-    detail::Sleeper sleeper;
-    do {
-      while (payload()->load() != FREE) {
-        sleeper.wait();
-      }
-    } while (!try_lock());
+    if (UNLIKELY(payload()->load() != FREE || !try_lock())) {
+      lockSlow();
+    }
     DCHECK(payload()->load() == LOCKED);
   }
 
   void unlock() {
     CHECK(payload()->load() == LOCKED);
     payload()->store(FREE, std::memory_order_release);
+    detail::lockReleased(this, LockType::MicroSpinLock);
   }
 
  private:
@@ -98,6 +98,17 @@ struct MicroSpinLock {
     return reinterpret_cast<std::atomic<uint8_t>*>(&this->lock_);
   }
 
+  FOLLY_NOINLINE void lockSlow() {
+    detail::LockContentionTimer timer(
+        this, LockType::MicroSpinLock, LockContentionKind::Exclusive);
+    detail::Sleeper sleeper;
+    do {
+      while (payload()->load() != FREE) {
+        sleeper.wait();
+      }
+    } while (!try_lock());
+  }
+
   bool cas(uint8_t compare, uint8_t newVal) {
     return std::atomic_compare_exchange_strong_explicit(payload(), &compare, newVal,
                                                         std::memory_order_acquire,
@@ -154,6 +165,11 @@ struct FOLLY_ALIGNED_MAX SpinLockArray {
 
 typedef std::lock_guard<MicroSpinLock> MSLGuard;
 
+namespace detail {
+template <>
+struct LockReportsContention<MicroSpinLock> : std::true_type {};
+} // namespace detail
+
 //////////////////////////////////////////////////////////////////////
 
 }
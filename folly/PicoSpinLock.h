@@ -46,6 +46,8 @@
 #include <mutex>
 #include <type_traits>
 
+#include <folly/Likely.h>
+#include <folly/detail/LockContention.h>
 #include <folly/detail/Sleeper.h>
 #include <glog/logging.h>
 
@@ -211,9 +213,8 @@ struct PicoSpinLock {
    * Block until we can acquire the lock.  Uses Sleeper to wait.
    */
   void lock() const {
-    detail::Sleeper sleeper;
-    while (!try_lock()) {
-      sleeper.wait();
+    if (UNLIKELY(!try_lock())) {
+      lockSlow();
     }
   }
 
@@ -280,7 +281,22 @@ struct PicoSpinLock {
 #else
 # error "x64 aarch64 ppc64 only"
 #endif
+    detail::lockReleased(this, LockType::PicoSpinLock);
+  }
+
+  FOLLY_NOINLINE void lockSlow() const {
+    detail::LockContentionTimer timer(
+        this, LockType::PicoSpinLock, LockContentionKind::Exclusive);
+    detail::Sleeper sleeper;
+    while (!try_lock()) {
+      sleeper.wait();
+    }
   }
 };
 
+namespace detail {
+template <class IntType, int Bit>
+struct LockReportsContention<PicoSpinLock<IntType, Bit>> : std::true_type {};
+} // namespace detail
+
 }
@@ -164,6 +164,7 @@ pthread_rwlock_t Read        728698     24us       101ns     7.28ms     194us
 #include <glog/logging.h>
 
 #include <folly/Likely.h>
+#include <folly/detail/LockContention.h>
 
 namespace folly {
 
@@ -192,6 +193,11 @@ class RWSpinLock {
 
   // Lockable Concept
   void lock() {
+    if (LIKELY(try_lock())) {
+      return;
+    }
+    detail::LockContentionTimer timer(
+        this, LockType::RWSpinLock, LockContentionKind::Exclusive);
     int count = 0;
     while (!LIKELY(try_lock())) {
       if (++count > 1000) std::this_thread::yield();
@@ -202,10 +208,16 @@ class RWSpinLock {
   void unlock() {
     static_assert(READER > WRITER + UPGRADED, "wrong bits!");
     bits_.fetch_and(~(WRITER | UPGRADED), std::memory_order_release);
+    detail::lockReleased(this, LockType::RWSpinLock);
   }
 
   // SharedLockable Concept
   void lock_shared() {
+    if (LIKELY(try_lock_shared())) {
+      return;
+    }
+    detail::LockContentionTimer timer(
+        this, LockType::RWSpinLock, LockContentionKind::Shared);
     int count = 0;
     while (!LIKELY(try_lock_shared())) {
       if (++count > 1000) std::this_thread::yield();
@@ -214,6 +226,7 @@ class RWSpinLock {
 
   void unlock_shared() {
     bits_.fetch_add(-READER, std::memory_order_release);
+    detail::lockReleased(this, LockType::RWSpinLock);
   }
 
   // Downgrade the lock from writer status to reader status.
@@ -224,6 +237,11 @@ class RWSpinLock {
 
   // UpgradeLockable Concept
   void lock_upgrade() {
+    if (LIKELY(try_lock_upgrade())) {
+      return;
+    }
+    detail::LockContentionTimer timer(
+        this, LockType::RWSpinLock, LockContentionKind::Upgrade);
     int count = 0;
     while (!try_lock_upgrade()) {
       if (++count > 1000) std::this_thread::yield();
@@ -232,6 +250,7 @@ class RWSpinLock {
 
   void unlock_upgrade() {
     bits_.fetch_add(-UPGRADED, std::memory_order_acq_rel);
+    detail::lockReleased(this, LockType::RWSpinLock);
   }
 
   // unlock upgrade and try to acquire write lock
@@ -461,6 +480,11 @@ class RWSpinLock {
   std::atomic<int32_t> bits_;
 };
 
+namespace detail {
+template <>
+struct LockReportsContention<RWSpinLock> : std::true_type {};
+} // namespace detail
+
 
 #ifdef RW_SPINLOCK_USE_X86_INTRINSIC_
 // A more balanced Read-Write spin lock implemented based on GCC intrinsics.
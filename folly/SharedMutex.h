@@ -25,8 +25,10 @@
 #include <folly/Likely.h>
 #include <folly/detail/CacheLocality.h>
 #include <folly/detail/Futex.h>
+#include <folly/detail/LockContention.h>
 #include <folly/portability/Asm.h>
 #include <folly/portability/SysResource.h>
+#include <folly/tracing/StaticTracepoint.h>
 
 // SharedMutex is a reader-writer lock.  It is small, very fast, scalable
 // on multi-core, and suitable for use when readers or writers may block.
@@ -314,6 +316,7 @@ class SharedMutexImpl {
     auto state = (state_ &= ~(kWaitingNotS | kPrevDefer | kHasE));
     assert((state & ~kWaitingAny) == 0);
     wakeRegisteredWaiters(state, kWaitingE | kWaitingU | kWaitingS);
+    detail::lockReleased(this, LockType::SharedMutex);
   }
 
   // Managing the token yourself makes unlock_shared a bit faster
@@ -381,6 +384,7 @@ class SharedMutexImpl {
       // lock has already been inlined by applyDeferredReaders()
       unlockSharedInline();
     }
+    detail::lockReleased(this, LockType::SharedMutex);
   }
 
   void unlock_shared(Token& token) {
@@ -394,6 +398,7 @@ class SharedMutexImpl {
 #ifndef NDEBUG
     token.type_ = Token::Type::INVALID;
 #endif
+    detail::lockReleased(this, LockType::SharedMutex);
   }
 
   void unlock_and_lock_shared() {
@@ -446,6 +451,7 @@ class SharedMutexImpl {
     auto state = (state_ -= kHasU);
     assert((state & (kWaitingNotS | kHasSolo)) == 0);
     wakeRegisteredWaiters(state, kWaitingE | kWaitingU);
+    detail::lockReleased(this, LockType::SharedMutex);
   }
 
   void unlock_upgrade_and_lock() {
@@ -493,6 +499,8 @@ class SharedMutexImpl {
   // before the wait context is invoked.
 
   struct WaitForever {
+    detail::LockContentionTimer contention;
+
     bool canBlock() { return true; }
     bool canTimeOut() { return false; }
     bool shouldTimeOut() { return false; }
@@ -504,6 +512,8 @@ class SharedMutexImpl {
   };
 
   struct WaitNever {
+    detail::LockContentionTimer contention;
+
     bool canBlock() { return false; }
     bool canTimeOut() { return true; }
     bool shouldTimeOut() { return true; }
@@ -520,6 +530,7 @@ class SharedMutexImpl {
     std::chrono::duration<Rep, Period> duration_;
     bool deadlineComputed_;
     std::chrono::steady_clock::time_point deadline_;
+    detail::LockContentionTimer contention;
 
     explicit WaitForDuration(const std::chrono::duration<Rep, Period>& duration)
         : duration_(duration), deadlineComputed_(false) {}
@@ -548,6 +559,7 @@ class SharedMutexImpl {
   template <class Clock, class Duration>
   struct WaitUntilDeadline {
     std::chrono::time_point<Clock, Duration> absDeadline_;
+    detail::LockContentionTimer contention;
 
     bool canBlock() { return true; }
     bool canTimeOut() { return true; }
@@ -834,12 +846,30 @@ class SharedMutexImpl {
       asm_volatile_pause();
       ++spinCount;
       if (UNLIKELY(spinCount >= kMaxSpinCount)) {
-        return ctx.canBlock() &&
-               yieldWaitForZeroBits(state, goal, waitMask, ctx);
+        if (!ctx.canBlock()) {
+          return false;
+        }
+        FOLLY_SDT(folly, shared_mutex_contended_begin, this, waitMask);
+        // Timed from the acquisition's first wait to its release
+        ctx.contention.begin(
+            this, LockType::SharedMutex, contentionKind(waitMask));
+        bool done = yieldWaitForZeroBits(state, goal, waitMask, ctx);
+        if (!done) {
+          ctx.contention.reportNow();
+        }
+        FOLLY_SDT(folly, shared_mutex_contended_end, this, waitMask, done);
+        return done;
       }
     }
   }
 
+  static LockContentionKind contentionKind(uint32_t waitMask) {
+    return waitMask == kWaitingS
+        ? LockContentionKind::Shared
+        : waitMask == kWaitingU ? LockContentionKind::Upgrade
+                                : LockContentionKind::Exclusive;
+  }
+
   template <class WaitContext>
   bool yieldWaitForZeroBits(uint32_t& state,
                             uint32_t goal,
@@ -927,6 +957,7 @@ class SharedMutexImpl {
   }
 
   void wakeRegisteredWaitersImpl(uint32_t& state, uint32_t wakeMask) {
+    detail::reportLockReleasedWithWaiters(this, LockType::SharedMutex);
     // If there are multiple lock() pending only one of them will actually
     // get to wake up, so issuing futexWakeAll will make a thundering herd.
     // There's nothing stopping us from issuing futexWake(1) instead,
@@ -1335,6 +1366,17 @@ typedef SharedMutexImpl<true> SharedMutexReadPriority;
 typedef SharedMutexImpl<false> SharedMutexWritePriority;
 typedef SharedMutexWritePriority SharedMutex;
 
+namespace detail {
+template <
+    bool ReaderPriority,
+    typename Tag_,
+    template <typename> class Atom,
+    bool BlockImmediately>
+struct LockReportsContention<
+    SharedMutexImpl<ReaderPriority, Tag_, Atom, BlockImmediately>>
+    : std::true_type {};
+} // namespace detail
+
 // Prevent the compiler from instantiating these in other translation units.
 // They are instantiated once in SharedMutex.cpp
 extern template class SharedMutexImpl<true>;
@@ -90,6 +90,7 @@ void SingletonHolder<T>::registerSingletonMock(CreateFunc c, TeardownFunc t) {
 
 template <typename T>
 T* SingletonHolder<T>::get() {
+  SingletonCreationScope::noteAccess(vault_, this);
   if (LIKELY(state_.load(std::memory_order_acquire) ==
              SingletonHolderState::Living)) {
     return instance_ptr_;
@@ -108,6 +109,7 @@ T* SingletonHolder<T>::get() {
 
 template <typename T>
 std::weak_ptr<T> SingletonHolder<T>::get_weak() {
+  SingletonCreationScope::noteAccess(vault_, this);
   if (UNLIKELY(state_.load(std::memory_order_acquire) !=
                SingletonHolderState::Living)) {
     createInstance();
@@ -118,6 +120,7 @@ std::weak_ptr<T> SingletonHolder<T>::get_weak() {
 
 template <typename T>
 std::shared_ptr<T> SingletonHolder<T>::try_get() {
+  SingletonCreationScope::noteAccess(vault_, this);
   if (UNLIKELY(state_.load(std::memory_order_acquire) !=
                SingletonHolderState::Living)) {
     createInstance();
@@ -128,6 +131,7 @@ std::shared_ptr<T> SingletonHolder<T>::try_get() {
 
 template <typename T>
 folly::ReadMostlySharedPtr<T> SingletonHolder<T>::try_get_fast() {
+  SingletonCreationScope::noteAccess(vault_, this);
   if (UNLIKELY(state_.load(std::memory_order_acquire) !=
                SingletonHolderState::Living)) {
     createInstance();
@@ -249,6 +253,8 @@ void SingletonHolder<T>::createInstance() {
     return;
   }
 
+  SingletonCreationScope creation_scope(vault_, this);
+
   auto destroy_baton = std::make_shared<folly::Baton<>>();
   auto print_destructor_stack_trace =
     std::make_shared<std::atomic<bool>>(false);
@@ -294,6 +300,7 @@ void SingletonHolder<T>::createInstance() {
   state_.store(SingletonHolderState::Living, std::memory_order_release);
 
   vault_.creationOrder_.wlock()->push_back(type());
+  creation_scope.created();
 }
 
 }
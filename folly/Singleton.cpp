@@ -23,9 +23,11 @@
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <iostream>
 #include <string>
 
+#include <folly/Portability.h>
 #include <folly/ScopeGuard.h>
 
 #if !defined(_WIN32) && !defined(__APPLE__) && !defined(__ANDROID__)
@@ -60,6 +62,55 @@ namespace detail {
             << type.name() << ">\n";
   std::abort();
 }
+
+#ifdef FOLLY_TLS
+FOLLY_TLS SingletonCreationScope* SingletonCreationScope::current_ = nullptr;
+#else
+SingletonCreationScope*& SingletonCreationScope::current() {
+  static thread_local SingletonCreationScope* current = nullptr;
+  return current;
+}
+#endif
+
+SingletonCreationScope::SingletonCreationScope(
+    SingletonVault& vault,
+    SingletonHolderBase* entry)
+    : vault_(vault),
+      entry_(entry),
+      parent_(current()),
+      start_(std::chrono::steady_clock::now()) {
+  current() = this;
+}
+
+SingletonCreationScope::~SingletonCreationScope() {
+  current() = parent_;
+
+  auto totalTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start_);
+  if (parent_) {
+    parent_->dependencyTime_ += totalTime;
+  }
+  if (!created_) {
+    return;
+  }
+
+  SingletonVault::CreationStats stats;
+  stats.name = entry_->type().name();
+  stats.totalTime = totalTime;
+  stats.selfTime = totalTime - dependencyTime_;
+  stats.thread = std::this_thread::get_id();
+  stats.eager = vault_.eagerInitSingletons_.rlock()->count(entry_) != 0;
+  vault_.creationStats_.wlock()->push_back(std::move(stats));
+}
+
+void SingletonCreationScope::noteAccessSlow(
+    SingletonVault& vault,
+    SingletonHolderBase* entry) {
+  auto scope = current();
+  if (&scope->vault_ == &vault && scope->entry_ != entry) {
+    vault.addDependency(scope->entry_, entry);
+  }
+}
 }
 
 namespace {
@@ -143,6 +194,121 @@ void SingletonVault::registrationComplete() {
   state->registrationComplete = true;
 }
 
+struct SingletonVault::EagerInitPlan {
+  // Singletons to build; dependencies come before their dependents, except
+  // in dependency cycles.
+  std::vector<detail::SingletonHolderBase*> entries;
+  // entries[i] must be built before entries[j] for each j in dependents[i]
+  std::vector<std::vector<size_t>> dependents;
+  // Number of dependencies not built yet
+  std::unique_ptr<std::atomic<size_t>[]> pendingDependencies;
+  std::atomic<size_t> remaining{0};
+  folly::Baton<>* done{nullptr};
+};
+
+std::shared_ptr<SingletonVault::EagerInitPlan>
+SingletonVault::makeEagerInitPlan() const {
+  auto singletons = singletons_.rlock();
+  auto dependencies = dependencies_.rlock();
+
+  auto isRegistered = [&](detail::SingletonHolderBase* entry) {
+    auto it = singletons->find(entry->type());
+    return it != singletons->end() && it->second == entry;
+  };
+
+  // Eager singletons and, transitively, their dependencies
+  std::unordered_map<detail::SingletonHolderBase*, size_t> index;
+  std::vector<detail::SingletonHolderBase*> entries;
+  {
+    auto eagerInitSingletons = eagerInitSingletons_.rlock();
+    std::vector<detail::SingletonHolderBase*> toVisit(
+        eagerInitSingletons->begin(), eagerInitSingletons->end());
+    while (!toVisit.empty()) {
+      auto entry = toVisit.back();
+      toVisit.pop_back();
+      if (index.count(entry) || !isRegistered(entry)) {
+        continue;
+      }
+      index.emplace(entry, entries.size());
+      entries.push_back(entry);
+      auto it = dependencies->find(entry);
+      if (it != dependencies->end()) {
+        toVisit.insert(toVisit.end(), it->second.begin(), it->second.end());
+      }
+    }
+  }
+
+  const size_t n = entries.size();
+  std::vector<std::vector<size_t>> dependsOn(n);
+  std::vector<std::vector<size_t>> dependents(n);
+  for (size_t i = 0; i < n; ++i) {
+    auto it = dependencies->find(entries[i]);
+    if (it == dependencies->end()) {
+      continue;
+    }
+    for (auto dependency : it->second) {
+      auto j = index.find(dependency);
+      if (j != index.end()) {
+        dependsOn[i].push_back(j->second);
+        dependents[j->second].push_back(i);
+      }
+    }
+  }
+
+  // Topological sort; whatever is left is in, or depends on, a cycle.
+  std::vector<size_t> order;
+  std::vector<size_t> pending(n);
+  std::vector<bool> ordered(n, false);
+  std::deque<size_t> ready;
+  for (size_t i = 0; i < n; ++i) {
+    pending[i] = dependsOn[i].size();
+    if (pending[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+  while (!ready.empty()) {
+    auto i = ready.front();
+    ready.pop_front();
+    ordered[i] = true;
+    order.push_back(i);
+    for (auto j : dependents[i]) {
+      if (--pending[j] == 0) {
+        ready.push_back(j);
+      }
+    }
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (!ordered[i]) {
+      order.push_back(i);
+    }
+  }
+
+  // Only wait for dependencies that are not part of a cycle, so every
+  // singleton gets scheduled.
+  auto plan = std::make_shared<EagerInitPlan>();
+  plan->entries.reserve(n);
+  std::vector<size_t> position(n);
+  for (size_t k = 0; k < n; ++k) {
+    position[order[k]] = k;
+    plan->entries.push_back(entries[order[k]]);
+  }
+  plan->dependents.resize(n);
+  plan->pendingDependencies.reset(new std::atomic<size_t>[n]);
+  for (size_t k = 0; k < n; ++k) {
+    size_t i = order[k];
+    size_t count = 0;
+    for (auto j : dependsOn[i]) {
+      if (ordered[j]) {
+        plan->dependents[position[j]].push_back(k);
+        ++count;
+      }
+    }
+    plan->pendingDependencies[k].store(count, std::memory_order_relaxed);
+  }
+  plan->remaining.store(n, std::memory_order_relaxed);
+  return plan;
+}
+
 void SingletonVault::doEagerInit() {
   {
     auto state = state_.rlock();
@@ -152,12 +318,45 @@ void SingletonVault::doEagerInit() {
     }
   }
 
-  auto eagerInitSingletons = eagerInitSingletons_.rlock();
-  for (auto* single : *eagerInitSingletons) {
+  auto plan = makeEagerInitPlan();
+  for (auto* single : plan->entries) {
     single->createInstance();
   }
 }
 
+void SingletonVault::scheduleEagerInit(
+    std::shared_ptr<EagerInitPlan> plan,
+    Executor& exe,
+    size_t index) {
+  // plan is retained by shared_ptr, and will be alive until last lambda is
+  // done.  Its entries, which are SingletonHolderBase pointers, are alive as
+  // long as SingletonVault is not being destroyed.  exe and plan->done are
+  // provided by the caller, and expected to remain present.
+  exe.add([plan, &exe, index] {
+    // schedule dependents, decrement counter and notify if requested,
+    // whether initialization was successful, was skipped (already
+    // initialized), or exception thrown.
+    SCOPE_EXIT {
+      for (auto dependent : plan->dependents[index]) {
+        if (--plan->pendingDependencies[dependent] == 0) {
+          scheduleEagerInit(plan, exe, dependent);
+        }
+      }
+      if (--plan->remaining == 0) {
+        if (plan->done != nullptr) {
+          plan->done->post();
+        }
+      }
+    };
+    // if initialization is in progress in another thread, don't try to init
+    // here.  Otherwise the current thread will block on 'createInstance'.
+    auto single = plan->entries[index];
+    if (!single->creationStarted()) {
+      single->createInstance();
+    }
+  });
+}
+
 void SingletonVault::doEagerInitVia(Executor& exe, folly::Baton<>* done) {
   {
     auto state = state_.rlock();
@@ -167,32 +366,80 @@ void SingletonVault::doEagerInitVia(Executor& exe, folly::Baton<>* done) {
     }
   }
 
-  auto eagerInitSingletons = eagerInitSingletons_.rlock();
-  auto countdown =
-      std::make_shared<std::atomic<size_t>>(eagerInitSingletons->size());
-  for (auto* single : *eagerInitSingletons) {
-    // countdown is retained by shared_ptr, and will be alive until last lambda
-    // is done.  notifyBaton is provided by the caller, and expected to remain
-    // present (if it's non-nullptr).  singletonSet can go out of scope but
-    // its values, which are SingletonHolderBase pointers, are alive as long as
-    // SingletonVault is not being destroyed.
-    exe.add([=] {
-      // decrement counter and notify if requested, whether initialization
-      // was successful, was skipped (already initialized), or exception thrown.
-      SCOPE_EXIT {
-        if (--(*countdown) == 0) {
-          if (done != nullptr) {
-            done->post();
-          }
-        }
-      };
-      // if initialization is in progress in another thread, don't try to init
-      // here.  Otherwise the current thread will block on 'createInstance'.
-      if (!single->creationStarted()) {
-        single->createInstance();
-      }
-    });
+  auto plan = makeEagerInitPlan();
+  plan->done = done;
+  if (plan->entries.empty()) {
+    if (done != nullptr) {
+      done->post();
+    }
+    return;
   }
+
+  std::vector<size_t> roots;
+  for (size_t i = 0; i < plan->entries.size(); ++i) {
+    if (plan->pendingDependencies[i].load(std::memory_order_relaxed) == 0) {
+      roots.push_back(i);
+    }
+  }
+  for (auto i : roots) {
+    scheduleEagerInit(plan, exe, i);
+  }
+}
+
+void SingletonVault::addDependency(
+    detail::SingletonHolderBase* dependent,
+    detail::SingletonHolderBase* dependency) {
+  if (dependent == dependency) {
+    return;
+  }
+  {
+    auto dependencies = dependencies_.rlock();
+    auto it = dependencies->find(dependent);
+    if (it != dependencies->end() && it->second.count(dependency)) {
+      return;
+    }
+  }
+  (*dependencies_.wlock())[dependent].insert(dependency);
+}
+
+SingletonVault::DependencyList SingletonVault::getDependencies() const {
+  DependencyList result;
+  auto dependencies = dependencies_.rlock();
+  for (const auto& p : *dependencies) {
+    auto dependent = p.first->type().name();
+    for (auto dependency : p.second) {
+      result.emplace_back(dependent, dependency->type().name());
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+size_t SingletonVault::addDependencies(const DependencyList& dependencies) {
+  std::unordered_map<std::string, detail::SingletonHolderBase*> byName;
+  {
+    auto singletons = singletons_.rlock();
+    for (const auto& p : *singletons) {
+      byName.emplace(p.first.name(), p.second);
+    }
+  }
+
+  size_t added = 0;
+  for (const auto& p : dependencies) {
+    auto dependent = byName.find(p.first);
+    auto dependency = byName.find(p.second);
+    if (dependent == byName.end() || dependency == byName.end()) {
+      continue;
+    }
+    addDependency(dependent->second, dependency->second);
+    ++added;
+  }
+  return added;
+}
+
+std::vector<SingletonVault::CreationStats> SingletonVault::getCreationStats()
+    const {
+  return *creationStats_.rlock();
 }
 
 void SingletonVault::destroyInstances() {
@@ -237,6 +484,7 @@ void SingletonVault::destroyInstances() {
     auto creationOrder = creationOrder_.wlock();
     creationOrder->clear();
   }
+  creationStats_.wlock()->clear();
 }
 
 void SingletonVault::reenableInstances() {
@@ -109,6 +109,22 @@
 // if the program opted-in to that feature by calling "doEagerInit" or
 // "doEagerInitVia" during its startup.
 //
+// Eager singletons are built in dependency order: a singleton whose create
+// function uses other singletons is built after them, and doEagerInitVia
+// builds independent singletons in parallel.  Dependencies are recorded as
+// singletons are created, and can also be declared up front:
+//
+// namespace {
+// auto the_singleton =
+//     folly::Singleton<MyExpensiveService>().shouldEagerInit()
+//     .dependsOn<MyOtherService>();
+// }
+//
+// Dependencies recorded in one run can be saved with getDependencies() and
+// passed to addDependencies() in the next, so the first eager
+// initialization is already parallel.  getCreationStats() reports how long
+// each singleton took to create.
+//
 // What if you need to destroy all of your singletons?  Say, some of
 // your singletons manage threads, but you need to fork?  Or your unit
 // test wants to clean up all global state?  Then you can call
@@ -134,6 +150,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <memory>
@@ -254,6 +271,59 @@ class SingletonHolderBase {
   TypeDescriptor type_;
 };
 
+// Marks the creation of a singleton on the current thread.  Singletons
+// requested while it is alive are recorded as dependencies of the singleton
+// being created, and its creation time is recorded when it completes.
+class SingletonCreationScope {
+ public:
+  SingletonCreationScope(SingletonVault& vault, SingletonHolderBase* entry);
+  ~SingletonCreationScope();
+
+  // Called when the instance was created successfully; otherwise no
+  // creation time is recorded.
+  void created() {
+    created_ = true;
+  }
+
+  // Records entry as a dependency of the singleton being created on this
+  // thread, if any.  Called on every access, so that dependencies on
+  // singletons that already exist are recorded too.
+  static void noteAccess(SingletonVault& vault, SingletonHolderBase* entry) {
+    if (LIKELY(current() == nullptr)) {
+      return;
+    }
+    noteAccessSlow(vault, entry);
+  }
+
+  SingletonCreationScope(const SingletonCreationScope&) = delete;
+  SingletonCreationScope& operator=(const SingletonCreationScope&) = delete;
+
+ private:
+  static void noteAccessSlow(
+      SingletonVault& vault,
+      SingletonHolderBase* entry);
+
+  // Innermost singleton being created on this thread
+#ifdef FOLLY_TLS
+  static SingletonCreationScope*& current() {
+    return current_;
+  }
+
+  static FOLLY_TLS SingletonCreationScope* current_;
+#else
+  static SingletonCreationScope*& current();
+#endif
+
+  SingletonVault& vault_;
+  SingletonHolderBase* entry_;
+  SingletonCreationScope* parent_;
+  std::chrono::steady_clock::time_point start_;
+  // Time spent creating dependencies from within this singleton's create
+  // function
+  std::chrono::nanoseconds dependencyTime_{0};
+  bool created_{false};
+};
+
 // An actual instance of a singleton, tracking the instance itself,
 // its state as described above, and the create and teardown
 // functions.
@@ -410,9 +480,56 @@ class SingletonVault {
    *   doEagerInitVia(executor, &done);
    *   done.wait();  // or 'timed_wait', or spin with 'try_wait'
    *
+   * A singleton is scheduled only once all singletons it depends on (see
+   * addDependency()) were built, so executor threads don't block on each
+   * other's constructors.  Dependencies that aren't marked for eager
+   * initialization themselves are built too.
    */
   void doEagerInitVia(Executor& exe, folly::Baton<>* done = nullptr);
 
+  /**
+   * Declare that dependent's create function uses dependency.  Called by
+   * `Singleton<T, Tag>::dependsOn<U, UTag>()`.  Dependencies are also recorded
+   * automatically when a singleton is requested while another one is being
+   * created on the same thread.  Dependency cycles are ignored for
+   * scheduling purposes.
+   */
+  void addDependency(
+      detail::SingletonHolderBase* dependent,
+      detail::SingletonHolderBase* dependency);
+
+  // Dependencies as (dependent, dependency) pairs of singleton names, as
+  // returned by TypeDescriptor::name().
+  typedef std::vector<std::pair<std::string, std::string>> DependencyList;
+
+  /**
+   * All dependencies recorded or declared so far, to be saved and passed
+   * to addDependencies() in a later run of the program.
+   */
+  DependencyList getDependencies() const;
+
+  /**
+   * Add dependencies saved from getDependencies().  Names that don't match
+   * a registered singleton are ignored.  Returns the number of dependencies
+   * added.
+   */
+  size_t addDependencies(const DependencyList& dependencies);
+
+  struct CreationStats {
+    std::string name;
+    // Time spent in the create function
+    std::chrono::nanoseconds totalTime{0};
+    // totalTime, less the time spent creating other singletons from it
+    std::chrono::nanoseconds selfTime{0};
+    std::thread::id thread;
+    bool eager{false};
+  };
+
+  /**
+   * Creation times of the living singletons, in creation order.
+   */
+  std::vector<CreationStats> getCreationStats() const;
+
   // Destroy all singletons; when complete, the vault can't create
   // singletons once again until reenableInstances() is called.
   void destroyInstances();
@@ -474,6 +591,9 @@ class SingletonVault {
  private:
   template <typename T>
   friend struct detail::SingletonHolder;
+  friend class detail::SingletonCreationScope;
+
+  struct EagerInitPlan;
 
   // The two stages of life for a vault, as mentioned in the class comment.
   enum class SingletonVaultState {
@@ -511,6 +631,13 @@ class SingletonVault {
   //    any of the singletons managed by folly::Singleton was requested.
   static void scheduleDestroyInstances();
 
+  // Eager singletons and their dependencies, in dependency order
+  std::shared_ptr<EagerInitPlan> makeEagerInitPlan() const;
+  static void scheduleEagerInit(
+      std::shared_ptr<EagerInitPlan> plan,
+      Executor& exe,
+      size_t index);
+
   typedef std::unordered_map<detail::TypeDescriptor,
                              detail::SingletonHolderBase*,
                              detail::TypeDescriptorHasher> SingletonMap;
@@ -518,6 +645,12 @@ class SingletonVault {
   folly::Synchronized<std::unordered_set<detail::SingletonHolderBase*>>
       eagerInitSingletons_;
   folly::Synchronized<std::vector<detail::TypeDescriptor>> creationOrder_;
+  // dependent -> dependencies
+  folly::Synchronized<std::unordered_map<
+      detail::SingletonHolderBase*,
+      std::unordered_set<detail::SingletonHolderBase*>>>
+      dependencies_;
+  folly::Synchronized<std::vector<CreationStats>> creationStats_;
 
   // Using SharedMutexReadPriority is important here, because we want to make
   // sure we don't block nested singleton creation happening concurrently with
@@ -606,6 +739,28 @@ class Singleton {
     return *this;
   }
 
+  /**
+   * Declare that this singleton's create function uses
+   * Singleton<Dependency, DependencyTag, VaultTag> (which lives in the same
+   * vault as this one), so eager initialization builds that one first.  Dependencies are also recorded as singletons get
+   * created; declaring them lets even the first doEagerInitVia() run build
+   * independent singletons in parallel.
+   *
+   * Use like:
+   *   Singleton<Foo> gFooInstance =
+   *       Singleton<Foo>(...).shouldEagerInit().dependsOn<Bar>();
+   */
+  template <typename Dependency, typename DependencyTag = detail::DefaultTag>
+  Singleton& dependsOn() {
+    auto vault = SingletonVault::singleton<VaultTag>();
+    vault->addDependency(
+        &getEntry(),
+        &detail::SingletonHolder<Dependency>::template singleton<
+            DependencyTag,
+            VaultTag>());
+    return *this;
+  }
+
   /**
   * Construct and inject a mock singleton which should be used only from tests.
   * Unlike regular singletons which are initialized once per process lifetime,
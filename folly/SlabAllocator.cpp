@@ -0,0 +1,546 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/SlabAllocator.h>
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include <folly/Bits.h>
+#include <folly/Indestructible.h>
+#include <folly/detail/MemoryIdler.h>
+#include <folly/portability/Fcntl.h>
+#include <folly/portability/Memory.h>
+#include <folly/portability/SysMman.h>
+#include <folly/portability/Unistd.h>
+
+#ifdef __linux__
+#include <folly/experimental/io/HugePages.h>
+#endif
+
+namespace folly {
+
+constexpr size_t SlabAllocator::kAlignment;
+constexpr uint32_t SlabAllocator::kLargeSizeClass;
+constexpr size_t SlabAllocator::kMaxMagazineSize;
+constexpr size_t SlabAllocator::kHeaderSize;
+
+namespace {
+
+// Allocators whose free memory is released by threads going idle.
+struct Registry {
+  std::mutex lock;
+  std::vector<SlabAllocator*> allocators;
+};
+
+Registry& registry() {
+  static Indestructible<Registry> registry;
+  return *registry;
+}
+
+void flushOnIdle() {
+  auto& r = registry();
+  std::lock_guard<std::mutex> g(r.lock);
+  for (auto allocator : r.allocators) {
+    allocator->flushThreadCache();
+  }
+}
+
+size_t roundUp(size_t n, size_t multiple) {
+  return (n + multiple - 1) / multiple * multiple;
+}
+
+} // namespace
+
+SlabAllocator::SlabAllocator(const Options& options)
+    : options_(options), slabMask_(~uintptr_t(options.slabSize - 1)) {
+  CHECK(isPowTwo(options_.slabSize) && options_.slabSize >= 4096)
+      << "invalid slab size: " << options_.slabSize;
+
+  // Size classes are the multiples of kAlignment up to 128 bytes, and then
+  // four per doubling, which bounds internal fragmentation to 25%.
+  maxSmallSize_ = options_.slabSize / 8;
+  std::vector<size_t> sizes;
+  for (size_t size = kAlignment; size <= std::min<size_t>(128, maxSmallSize_);
+       size += kAlignment) {
+    sizes.push_back(size);
+  }
+  for (size_t base = 128; base < maxSmallSize_; base *= 2) {
+    for (size_t i = 1; i <= 4; ++i) {
+      sizes.push_back(base + i * base / 4);
+    }
+  }
+  CHECK_LE(sizes.size(), std::numeric_limits<uint8_t>::max());
+
+  numClasses_ = sizes.size();
+  classes_.reset(new SizeClass[numClasses_]);
+  for (size_t i = 0; i < numClasses_; ++i) {
+    auto& sc = classes_[i];
+    sc.size = sizes[i];
+    sc.objectsPerSlab = (options_.slabSize - kHeaderSize) / sizes[i];
+    // About 8KB worth of objects per magazine.
+    sc.rounds = std::max<size_t>(
+        2, std::min<size_t>(kMaxMagazineSize, 8192 / sizes[i]));
+  }
+
+  sizeClassOfGranule_.resize(maxSmallSize_ / kAlignment);
+  uint8_t sizeClass = 0;
+  for (size_t g = 0; g < sizeClassOfGranule_.size(); ++g) {
+    while (sizes[sizeClass] < (g + 1) * kAlignment) {
+      ++sizeClass;
+    }
+    sizeClassOfGranule_[g] = sizeClass;
+  }
+
+  emptyMagazine_.count = 0;
+  emptyMagazine_.capacity = 0;
+
+  static std::once_flag registerFlusher;
+  std::call_once(registerFlusher, [] {
+    detail::MemoryIdler::addLocalCacheFlusher(&flushOnIdle);
+  });
+  auto& r = registry();
+  std::lock_guard<std::mutex> g(r.lock);
+  r.allocators.push_back(this);
+}
+
+SlabAllocator::~SlabAllocator() {
+  {
+    auto& r = registry();
+    std::lock_guard<std::mutex> g(r.lock);
+    r.allocators.erase(
+        std::find(r.allocators.begin(), r.allocators.end(), this));
+  }
+
+  // Thread caches still alive are discarded when threadCache_ is destroyed
+  // (see createThreadCache()); they don't touch the slabs.
+  for (size_t i = 0; i < numClasses_; ++i) {
+    for (auto mag : classes_[i].fullMagazines) {
+      delete mag;
+    }
+    for (auto mag : classes_[i].emptyMagazines) {
+      delete mag;
+    }
+  }
+  for (auto& chunk : chunks_) {
+    munmap(std::get<0>(chunk), std::get<1>(chunk));
+  }
+}
+
+SlabAllocator& SlabAllocator::getDefault() {
+  static auto instance = new SlabAllocator();
+  return *instance;
+}
+
+SlabAllocator::ThreadCache::ThreadCache(SlabAllocator& a)
+    : allocator(a), bins(new Bin[a.numClasses_]) {
+  for (size_t i = 0; i < a.numClasses_; ++i) {
+    bins[i].loaded = bins[i].previous = &a.emptyMagazine_;
+  }
+}
+
+SlabAllocator::ThreadCache::~ThreadCache() {
+  // Only reached with objects still cached when the allocator itself is
+  // being destroyed; see createThreadCache().
+  for (size_t i = 0; i < allocator.numClasses_; ++i) {
+    for (auto mag : {bins[i].loaded, bins[i].previous}) {
+      if (mag != &allocator.emptyMagazine_) {
+        delete mag;
+      }
+    }
+  }
+}
+
+SlabAllocator::ThreadCache& SlabAllocator::createThreadCache() {
+  auto cache = new ThreadCache(*this);
+  threadCache_.reset(cache, [](ThreadCache* c, TLPDestructionMode mode) {
+    // On thread exit, return the cached objects so that other threads can
+    // use them.  When the allocator is destroyed, its slabs are about to be
+    // unmapped anyway.
+    if (mode == TLPDestructionMode::THIS_THREAD) {
+      c->allocator.flushCache(*c);
+    }
+    delete c;
+  });
+  return *cache;
+}
+
+void SlabAllocator::flushThreadCache() {
+  auto cache = threadCache_.get();
+  if (cache != nullptr) {
+    flushCache(*cache);
+  }
+}
+
+void SlabAllocator::flushCache(ThreadCache& cache) {
+  for (size_t i = 0; i < numClasses_; ++i) {
+    auto& bin = cache.bins[i];
+    if (bin.loaded == &emptyMagazine_ && bin.previous == &emptyMagazine_) {
+      continue;
+    }
+    auto& sc = classes_[i];
+    std::lock_guard<std::mutex> g(sc.lock);
+    for (auto mag : {bin.loaded, bin.previous}) {
+      if (mag == &emptyMagazine_) {
+        continue;
+      }
+      if (mag->count == mag->capacity) {
+        putFullMagazine(sc, mag);
+      } else {
+        drainMagazine(sc, mag);
+        putEmptyMagazine(sc, mag);
+      }
+    }
+    bin.loaded = bin.previous = &emptyMagazine_;
+  }
+}
+
+void* SlabAllocator::allocateSlow(uint32_t sizeClass) {
+  auto& bin = threadCache().bins[sizeClass];
+  if (bin.previous->count != 0) {
+    // previous is full.
+    std::swap(bin.loaded, bin.previous);
+  } else {
+    auto& sc = classes_[sizeClass];
+    std::lock_guard<std::mutex> g(sc.lock);
+    if (!sc.fullMagazines.empty()) {
+      if (bin.previous != &emptyMagazine_) {
+        putEmptyMagazine(sc, bin.previous);
+      }
+      bin.previous = bin.loaded;
+      bin.loaded = sc.fullMagazines.back();
+      sc.fullMagazines.pop_back();
+    } else {
+      if (bin.loaded == &emptyMagazine_) {
+        bin.loaded = takeEmptyMagazine(sc);
+      }
+      fillMagazine(sc, bin.loaded);
+    }
+  }
+  return bin.loaded->objects[--bin.loaded->count];
+}
+
+void SlabAllocator::deallocateSlow(void* ptr, uint32_t sizeClass) {
+  auto& bin = threadCache().bins[sizeClass];
+  if (bin.previous != &emptyMagazine_ && bin.previous->count == 0) {
+    std::swap(bin.loaded, bin.previous);
+  } else {
+    auto& sc = classes_[sizeClass];
+    std::lock_guard<std::mutex> g(sc.lock);
+    Magazine* mag;
+    try {
+      mag = takeEmptyMagazine(sc);
+    } catch (const std::bad_alloc&) {
+      returnObject(sc, ptr);
+      return;
+    }
+    if (bin.loaded != &emptyMagazine_) {
+      // loaded is full, and so is previous, if any.
+      if (bin.previous != &emptyMagazine_) {
+        putFullMagazine(sc, bin.previous);
+      }
+      bin.previous = bin.loaded;
+    }
+    bin.loaded = mag;
+  }
+  bin.loaded->objects[bin.loaded->count++] = ptr;
+}
+
+void* SlabAllocator::allocateLarge(size_t size) {
+  if (size > std::numeric_limits<size_t>::max() - kHeaderSize) {
+    throw std::bad_alloc();
+  }
+  auto slab = static_cast<Slab*>(
+      detail::aligned_malloc(kHeaderSize + size, options_.slabSize));
+  if (slab == nullptr) {
+    throw std::bad_alloc();
+  }
+  slab->owner = this;
+  slab->sizeClass = kLargeSizeClass;
+  slab->largeSize = size;
+  largeBytes_.fetch_add(size, std::memory_order_relaxed);
+  return reinterpret_cast<char*>(slab) + kHeaderSize;
+}
+
+void SlabAllocator::deallocateLarge(Slab* slab) {
+  largeBytes_.fetch_sub(slab->largeSize, std::memory_order_relaxed);
+  detail::aligned_free(slab);
+}
+
+void SlabAllocator::fillMagazine(SizeClass& sc, Magazine* mag) {
+  while (mag->count < mag->capacity) {
+    auto slab = sc.partialSlabs;
+    if (slab == nullptr) {
+      try {
+        slab = takeSlab(&sc - classes_.get());
+      } catch (const std::bad_alloc&) {
+        if (mag->count != 0) {
+          return;
+        }
+        throw;
+      }
+      linkSlab(sc, slab);
+    }
+    while (mag->count < mag->capacity &&
+           slab->numAllocated < sc.objectsPerSlab) {
+      void* obj;
+      if (slab->freeList != nullptr) {
+        obj = slab->freeList;
+        slab->freeList = *static_cast<void**>(obj);
+      } else {
+        obj = reinterpret_cast<char*>(slab) + kHeaderSize +
+            size_t(slab->numCarved++) * sc.size;
+      }
+      ++slab->numAllocated;
+      mag->objects[mag->count++] = obj;
+    }
+    if (slab->numAllocated == sc.objectsPerSlab) {
+      unlinkSlab(sc, slab);
+    }
+  }
+}
+
+void SlabAllocator::drainMagazine(SizeClass& sc, Magazine* mag) {
+  while (mag->count != 0) {
+    returnObject(sc, mag->objects[--mag->count]);
+  }
+}
+
+void SlabAllocator::returnObject(SizeClass& sc, void* obj) {
+  auto slab = slabOf(obj);
+  *static_cast<void**>(obj) = slab->freeList;
+  slab->freeList = obj;
+  if (slab->numAllocated-- == sc.objectsPerSlab) {
+    linkSlab(sc, slab);
+  }
+  if (slab->numAllocated == 0) {
+    unlinkSlab(sc, slab);
+    releaseSlab(slab);
+  }
+}
+
+void SlabAllocator::linkSlab(SizeClass& sc, Slab* slab) {
+  slab->prev = nullptr;
+  slab->next = sc.partialSlabs;
+  if (slab->next != nullptr) {
+    slab->next->prev = slab;
+  }
+  sc.partialSlabs = slab;
+}
+
+void SlabAllocator::unlinkSlab(SizeClass& sc, Slab* slab) {
+  if (slab->prev != nullptr) {
+    slab->prev->next = slab->next;
+  } else {
+    sc.partialSlabs = slab->next;
+  }
+  if (slab->next != nullptr) {
+    slab->next->prev = slab->prev;
+  }
+}
+
+SlabAllocator::Magazine* SlabAllocator::takeEmptyMagazine(SizeClass& sc) {
+  Magazine* mag;
+  if (!sc.emptyMagazines.empty()) {
+    mag = sc.emptyMagazines.back();
+    sc.emptyMagazines.pop_back();
+  } else {
+    mag = new Magazine;
+    mag->count = 0;
+    mag->capacity = sc.rounds;
+  }
+  return mag;
+}
+
+void SlabAllocator::putEmptyMagazine(SizeClass& sc, Magazine* mag) {
+  DCHECK_EQ(mag->count, 0);
+  if (sc.emptyMagazines.size() < options_.maxDepotMagazines) {
+    sc.emptyMagazines.push_back(mag);
+  } else {
+    delete mag;
+  }
+}
+
+void SlabAllocator::putFullMagazine(SizeClass& sc, Magazine* mag) {
+  sc.fullMagazines.push_back(mag);
+  if (sc.fullMagazines.size() > options_.maxDepotMagazines) {
+    // Give the objects of the magazine that has been sitting in the depot
+    // the longest back to their slabs, so those can eventually be released.
+    auto oldest = sc.fullMagazines.front();
+    sc.fullMagazines.erase(sc.fullMagazines.begin());
+    drainMagazine(sc, oldest);
+    putEmptyMagazine(sc, oldest);
+  }
+}
+
+SlabAllocator::Slab* SlabAllocator::takeSlab(uint32_t sizeClass) {
+  Slab* slab;
+  {
+    std::lock_guard<std::mutex> g(slabsLock_);
+    if (!emptySlabs_.empty()) {
+      slab = emptySlabs_.back();
+      emptySlabs_.pop_back();
+    } else if (!purgedSlabs_.empty()) {
+      slab = purgedSlabs_.back();
+      purgedSlabs_.pop_back();
+      slab->hugePages = false;
+    } else {
+      if (chunkCur_ == chunkEnd_) {
+        mapChunk();
+      }
+      slab = reinterpret_cast<Slab*>(chunkCur_);
+      slab->hugePages = chunkHugePages_;
+      chunkCur_ += options_.slabSize;
+    }
+  }
+  slab->owner = this;
+  slab->sizeClass = sizeClass;
+  slab->freeList = nullptr;
+  slab->numAllocated = 0;
+  slab->numCarved = 0;
+  slab->prev = slab->next = nullptr;
+  slab->largeSize = 0;
+  return slab;
+}
+
+void SlabAllocator::releaseSlab(Slab* slab) {
+  std::lock_guard<std::mutex> g(slabsLock_);
+  emptySlabs_.push_back(slab);
+  if (emptySlabs_.size() <= options_.maxEmptySlabs) {
+    return;
+  }
+  // Return the slab that has been empty for the longest to the OS.
+  auto it = std::find_if(emptySlabs_.begin(), emptySlabs_.end(), [](Slab* s) {
+    return !s->hugePages;
+  });
+  if (it != emptySlabs_.end()) {
+    auto victim = *it;
+    emptySlabs_.erase(it);
+    purge(victim);
+  }
+}
+
+size_t SlabAllocator::purge(Slab* slab) {
+  DCHECK(!slab->hugePages);
+  // The header goes too; takeSlab() reinitializes it.
+  madvise(slab, options_.slabSize, MADV_DONTNEED);
+  purgedSlabs_.push_back(slab);
+  return options_.slabSize;
+}
+
+void SlabAllocator::mapChunk() {
+  auto size = roundUp(options_.chunkSize, options_.slabSize);
+
+  if (options_.useHugePages) {
+#ifdef __linux__
+    auto hugePageSize = getHugePageSize();
+    // hugetlbfs mappings are aligned to the huge page size, which is what
+    // makes slabs no larger than that aligned to their size.
+    if (hugePageSize != nullptr && options_.slabSize <= hugePageSize->size) {
+      auto hugeSize = roundUp(size, hugePageSize->size);
+      auto path = hugePageSize->filePath("folly_slab_XXXXXX").string();
+      int fd = mkstemp(&path[0]);
+      if (fd != -1) {
+        unlink(path.c_str());
+        void* p = MAP_FAILED;
+        if (ftruncate(fd, off_t(hugeSize)) == 0) {
+          p = mmap(
+              nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (p != MAP_FAILED) {
+          chunks_.emplace_back(p, hugeSize, true);
+          chunkCur_ = static_cast<char*>(p);
+          chunkEnd_ = chunkCur_ + hugeSize;
+          chunkHugePages_ = true;
+          mappedBytes_.fetch_add(hugeSize, std::memory_order_relaxed);
+          return;
+        }
+      }
+    }
+#endif
+    LOG_FIRST_N(WARNING, 1)
+        << "SlabAllocator: huge pages unavailable, using regular pages";
+  }
+
+  // Over-map by a slab, and trim both ends to get an aligned chunk.
+  auto mapSize = size + options_.slabSize;
+  auto p = mmap(
+      nullptr,
+      mapSize,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS,
+      -1,
+      0);
+  if (p == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  auto begin = static_cast<char*>(p);
+  auto aligned = reinterpret_cast<char*>(
+      roundUp(reinterpret_cast<uintptr_t>(begin), options_.slabSize));
+  if (aligned != begin) {
+    munmap(begin, aligned - begin);
+  }
+  auto tail = begin + mapSize - (aligned + size);
+  if (tail != 0) {
+    munmap(aligned + size, tail);
+  }
+  chunks_.emplace_back(aligned, size, false);
+  chunkCur_ = aligned;
+  chunkEnd_ = aligned + size;
+  chunkHugePages_ = false;
+  mappedBytes_.fetch_add(size, std::memory_order_relaxed);
+}
+
+size_t SlabAllocator::releaseFreeMemory() {
+  for (size_t i = 0; i < numClasses_; ++i) {
+    auto& sc = classes_[i];
+    std::lock_guard<std::mutex> g(sc.lock);
+    for (auto mag : sc.fullMagazines) {
+      drainMagazine(sc, mag);
+      delete mag;
+    }
+    sc.fullMagazines.clear();
+    for (auto mag : sc.emptyMagazines) {
+      delete mag;
+    }
+    sc.emptyMagazines.clear();
+  }
+
+  size_t released = 0;
+  std::lock_guard<std::mutex> g(slabsLock_);
+  auto it = std::partition(emptySlabs_.begin(), emptySlabs_.end(), [](Slab* s) {
+    return s->hugePages;
+  });
+  for (auto p = it; p != emptySlabs_.end(); ++p) {
+    released += purge(*p);
+  }
+  emptySlabs_.erase(it, emptySlabs_.end());
+  return released;
+}
+
+SlabAllocator::Stats SlabAllocator::getStats() const {
+  Stats stats;
+  stats.mappedBytes = mappedBytes_.load(std::memory_order_relaxed);
+  stats.largeBytes = largeBytes_.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> g(slabsLock_);
+  stats.emptySlabBytes = emptySlabs_.size() * options_.slabSize;
+  stats.purgedSlabBytes = purgedSlabs_.size() * options_.slabSize;
+  return stats;
+}
+
+} // namespace folly
@@ -0,0 +1,421 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <glog/logging.h>
+
+#include <folly/Likely.h>
+#include <folly/ThreadLocal.h>
+
+namespace folly {
+
+/**
+ * General purpose allocator for small objects, with frees.
+ *
+ * Requests are rounded up to one of a fixed set of size classes; objects of
+ * a size class are carved out of slabs (by default 64KB) that only hold
+ * objects of that class.  Every slab is aligned to its size, and starts with
+ * a header, so the slab (and thus the size class) of any pointer is found by
+ * masking its low bits: deallocate() doesn't need to be told the size.
+ *
+ * Each thread caches freed objects in two "magazines" per size class, so
+ * that allocate() and deallocate() usually touch only thread-local memory
+ * (Bonwick & Adams, "Magazines and Vmem", USENIX 2001).  Threads exchange
+ * full and empty magazines through a per-size-class depot, which is how
+ * objects freed by one thread (say, the consumer end of a queue) flow back
+ * to others (the producer) without going through the slabs.  Only depot
+ * misses take objects from, or return them to, the slabs themselves.
+ *
+ * Slabs are mapped from the OS in larger chunks, optionally backed by
+ * huge pages (see Options::useHugePages).  Slabs whose objects have all been
+ * returned are kept around for reuse by any size class, up to
+ * Options::maxEmptySlabs of them; the rest are returned to the OS with
+ * madvise(MADV_DONTNEED).  releaseFreeMemory() returns all of them.
+ *
+ * Threads going idle through detail::MemoryIdler::flushLocalMallocCaches()
+ * flush their cache (see flushThreadCache()), so that other threads can
+ * reuse the objects it holds.
+ *
+ * Requests larger than maxSmallSize() (an eighth of the slab size) are
+ * served by aligned malloc, with the same header; the allocator is meant for
+ * small objects.  All returned memory is aligned to kAlignment.
+ *
+ * Any thread may free memory allocated by any other thread.  The allocator
+ * must outlive all memory allocated from it; destroying it releases all of
+ * its slabs.
+ *
+ * SlabAllocator provides the SimpleAllocator interface (see Memory.h), so it
+ * can be used with StlAllocator; see also SlabAlloc and SlabStlAllocator
+ * below for value-type handles usable with folly and STL containers.
+ */
+class SlabAllocator : boost::noncopyable {
+ public:
+  static constexpr size_t kAlignment = 16;
+
+  struct Options {
+    /// Size (and alignment) of a slab; must be a power of two no smaller
+    /// than 4KB.
+    size_t slabSize{64 * 1024};
+    /// Slabs are mapped from the OS this many bytes at a time; rounded up
+    /// to a multiple of the slab size (and of the huge page size).
+    size_t chunkSize{2 * 1024 * 1024};
+    /// Back chunks with huge pages from a mounted hugetlbfs file system, if
+    /// one is found (see getHugePageSize()); Linux only.  Falls back to
+    /// regular pages otherwise.  Slabs backed by huge pages are never returned to the OS.
+    bool useHugePages{false};
+    /// Number of empty slabs kept resident for reuse.  Slabs emptied beyond
+    /// this are returned to the OS right away.
+    size_t maxEmptySlabs{16};
+    /// Number of full magazines the depot of each size class holds before
+    /// returning objects to their slabs.
+    size_t maxDepotMagazines{16};
+  };
+
+  struct Stats {
+    /// Bytes mapped from the OS for slabs (including purged ones).
+    size_t mappedBytes{0};
+    /// Bytes in empty slabs that are still resident.
+    size_t emptySlabBytes{0};
+    /// Bytes in slabs that have been returned to the OS.
+    size_t purgedSlabBytes{0};
+    /// Bytes currently allocated for requests larger than maxSmallSize().
+    size_t largeBytes{0};
+  };
+
+  SlabAllocator() : SlabAllocator(Options()) {}
+  explicit SlabAllocator(const Options& options);
+  ~SlabAllocator();
+
+  /**
+   * Process-wide instance with default options, used by default-constructed
+   * SlabAlloc and SlabStlAllocator.  Never destroyed.
+   */
+  static SlabAllocator& getDefault();
+
+  /**
+   * Allocates size bytes, aligned to kAlignment.  Throws std::bad_alloc on
+   * failure.
+   */
+  void* allocate(size_t size) {
+    if (LIKELY(size <= maxSmallSize_)) {
+      auto sizeClass = sizeClassOf(size);
+      auto& bin = threadCache().bins[sizeClass];
+      if (LIKELY(bin.loaded->count != 0)) {
+        return bin.loaded->objects[--bin.loaded->count];
+      }
+      return allocateSlow(sizeClass);
+    }
+    return allocateLarge(size);
+  }
+
+  /**
+   * Frees memory returned by allocate() of this allocator, from any thread.
+   */
+  void deallocate(void* ptr) {
+    if (UNLIKELY(ptr == nullptr)) {
+      return;
+    }
+    auto slab = slabOf(ptr);
+    DCHECK(slab->owner == this) << "freeing memory of another allocator";
+    if (UNLIKELY(slab->sizeClass == kLargeSizeClass)) {
+      deallocateLarge(slab);
+      return;
+    }
+    auto& bin = threadCache().bins[slab->sizeClass];
+    if (LIKELY(bin.loaded->count != bin.loaded->capacity)) {
+      bin.loaded->objects[bin.loaded->count++] = ptr;
+      return;
+    }
+    deallocateSlow(ptr, slab->sizeClass);
+  }
+
+  /**
+   * Number of usable bytes of an allocation of the given size, that is, the
+   * size of its size class.
+   */
+  size_t goodSize(size_t size) const {
+    return size <= maxSmallSize_ ? classes_[sizeClassOf(size)].size : size;
+  }
+
+  /**
+   * Largest request served from slabs.
+   */
+  size_t maxSmallSize() const {
+    return maxSmallSize_;
+  }
+
+  /**
+   * Returns the calling thread's cached objects to the shared depots (or
+   * the slabs).  Done automatically on thread exit.
+   */
+  void flushThreadCache();
+
+  /**
+   * Returns the objects held by the depots to their slabs, and all empty
+   * slabs (that aren't backed by huge pages) to the OS.  Returns the number
+   * of bytes returned to the OS.
+   */
+  size_t releaseFreeMemory();
+
+  Stats getStats() const;
+
+ private:
+  static constexpr uint32_t kLargeSizeClass =
+      std::numeric_limits<uint32_t>::max();
+  static constexpr size_t kMaxMagazineSize = 64;
+
+  // Header at the start of every slab (and large allocation).  All fields
+  // but the ones identifying the slab are protected by the lock of its size
+  // class.
+  struct Slab {
+    SlabAllocator* owner;
+    uint32_t sizeClass;
+    bool hugePages;
+    // Objects returned to the slab, linked through their first word.
+    void* freeList;
+    // Objects currently handed out of the slab.
+    uint32_t numAllocated;
+    // Objects ever carved from the slab; the rest of it is untouched.
+    uint32_t numCarved;
+    // Links in the list of slabs of the size class with objects available.
+    Slab* prev;
+    Slab* next;
+    // Bytes requested, for large allocations.
+    size_t largeSize;
+  };
+  static constexpr size_t kHeaderSize = 64;
+  static_assert(sizeof(Slab) <= kHeaderSize, "Slab header too large");
+
+  struct Magazine {
+    uint32_t count;
+    uint32_t capacity;
+    void* objects[kMaxMagazineSize];
+  };
+
+  struct SizeClass {
+    std::mutex lock;
+    uint32_t size{0};
+    uint32_t objectsPerSlab{0};
+    uint32_t rounds{0};
+    // Depot.
+    std::vector<Magazine*> fullMagazines;
+    std::vector<Magazine*> emptyMagazines;
+    // Slabs with free or never carved objects, which aren't empty.
+    Slab* partialSlabs{nullptr};
+  };
+
+  // Per-thread cache.  loaded is where objects are taken from and returned
+  // to; previous is always either full or empty, so that a thread
+  // alternating between allocations and frees at a magazine boundary
+  // doesn't go to the depot every time.  Both start out as the zero
+  // capacity emptyMagazine_, which sends the first allocate() and
+  // deallocate() to the slow path without a separate check.
+  struct ThreadCache {
+    struct Bin {
+      Magazine* loaded;
+      Magazine* previous;
+    };
+
+    explicit ThreadCache(SlabAllocator& allocator);
+    ~ThreadCache();
+
+    SlabAllocator& allocator;
+    std::unique_ptr<Bin[]> bins;
+  };
+
+  struct ThreadCacheTag {};
+
+  Slab* slabOf(void* ptr) const {
+    return reinterpret_cast<Slab*>(
+        reinterpret_cast<uintptr_t>(ptr) & slabMask_);
+  }
+
+  uint32_t sizeClassOf(size_t size) const {
+    return sizeClassOfGranule_[size == 0 ? 0 : (size - 1) / kAlignment];
+  }
+
+  ThreadCache& threadCache() {
+    auto cache = threadCache_.get();
+    if (LIKELY(cache != nullptr)) {
+      return *cache;
+    }
+    return createThreadCache();
+  }
+
+  ThreadCache& createThreadCache();
+  void flushCache(ThreadCache& cache);
+
+  void* allocateSlow(uint32_t sizeClass);
+  void deallocateSlow(void* ptr, uint32_t sizeClass);
+  void* allocateLarge(size_t size);
+  void deallocateLarge(Slab* slab);
+
+  // All of the below require the size class lock to be held.
+  void fillMagazine(SizeClass& sc, Magazine* mag);
+  void drainMagazine(SizeClass& sc, Magazine* mag);
+  void returnObject(SizeClass& sc, void* obj);
+  void linkSlab(SizeClass& sc, Slab* slab);
+  void unlinkSlab(SizeClass& sc, Slab* slab);
+  Magazine* takeEmptyMagazine(SizeClass& sc);
+  void putEmptyMagazine(SizeClass& sc, Magazine* mag);
+  void putFullMagazine(SizeClass& sc, Magazine* mag);
+
+  // Slab management; these take slabsLock_, but for mapChunk() and purge()
+  // which require it to be held.
+  Slab* takeSlab(uint32_t sizeClass);
+  void releaseSlab(Slab* slab);
+  void mapChunk();
+  size_t purge(Slab* slab);
+
+  const Options options_;
+  const uintptr_t slabMask_;
+  size_t maxSmallSize_{0};
+  std::vector<uint8_t> sizeClassOfGranule_;
+  std::unique_ptr<SizeClass[]> classes_;
+  size_t numClasses_{0};
+  Magazine emptyMagazine_;
+
+  mutable std::mutex slabsLock_;
+  // Chunks mapped from the OS, and whether they're backed by huge pages.
+  std::vector<std::tuple<void*, size_t, bool>> chunks_;
+  // Part of the most recent chunk not carved into slabs yet.
+  char* chunkCur_{nullptr};
+  char* chunkEnd_{nullptr};
+  bool chunkHugePages_{false};
+  std::vector<Slab*> emptySlabs_;
+  std::vector<Slab*> purgedSlabs_;
+  std::atomic<size_t> mappedBytes_{0};
+  std::atomic<size_t> largeBytes_{0};
+
+  // Must be last, so that thread caches are flushed before the rest of the
+  // allocator is destroyed.
+  ThreadLocalPtr<ThreadCache, ThreadCacheTag> threadCache_;
+};
+
+/**
+ * SimpleAllocator (see Memory.h) handle to a SlabAllocator, by default the
+ * process-wide one.  Copyable, so that it can be used as the NodeAlloc of
+ * ConcurrentSkipList.
+ */
+class SlabAlloc {
+ public:
+  SlabAlloc() : allocator_(&SlabAllocator::getDefault()) {}
+  explicit SlabAlloc(SlabAllocator* allocator) : allocator_(allocator) {}
+
+  void* allocate(size_t size) {
+    return allocator_->allocate(size);
+  }
+
+  void deallocate(void* ptr) {
+    allocator_->deallocate(ptr);
+  }
+
+  SlabAllocator* allocator() const {
+    return allocator_;
+  }
+
+ private:
+  SlabAllocator* allocator_;
+};
+
+/**
+ * std::allocator compatible adaptor of a SlabAllocator, by default the
+ * process-wide one.  Unlike StlAllocator<SlabAllocator, T>, it's
+ * default-constructible, so it can be used as the allocator of containers
+ * such as sorted_vector_map or std::map without passing one explicitly.
+ */
+template <class T>
+class SlabStlAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef ptrdiff_t difference_type;
+  typedef size_t size_type;
+
+  template <class U>
+  struct rebind {
+    typedef SlabStlAllocator<U> other;
+  };
+
+  SlabStlAllocator() : allocator_(&SlabAllocator::getDefault()) {}
+  explicit SlabStlAllocator(SlabAllocator* allocator)
+      : allocator_(allocator) {}
+
+  template <class U>
+  /* implicit */ SlabStlAllocator(const SlabStlAllocator<U>& other)
+      : allocator_(other.allocator()) {}
+
+  T* allocate(size_t n, const void* /* hint */ = nullptr) {
+    static_assert(
+        alignof(T) <= SlabAllocator::kAlignment,
+        "SlabAllocator doesn't support over-aligned types");
+    if (n > max_size()) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(allocator_->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t /* n */) {
+    allocator_->deallocate(p);
+  }
+
+  size_t max_size() const {
+    return std::numeric_limits<size_t>::max() / sizeof(T);
+  }
+
+  template <class U, class... Args>
+  void construct(U* p, Args&&... args) {
+    new (p) U(std::forward<Args>(args)...);
+  }
+
+  template <class U>
+  void destroy(U* p) {
+    p->~U();
+  }
+
+  SlabAllocator* allocator() const {
+    return allocator_;
+  }
+
+  template <class U>
+  bool operator==(const SlabStlAllocator<U>& other) const {
+    return allocator_ == other.allocator();
+  }
+
+  template <class U>
+  bool operator!=(const SlabStlAllocator<U>& other) const {
+    return allocator_ != other.allocator();
+  }
+
+ private:
+  SlabAllocator* allocator_;
+};
+
+} // namespace folly
@@ -36,6 +36,7 @@
 
 #include <folly/Portability.h>
 #include <folly/SmallLocks.h>
+#include <folly/detail/LockContention.h>
 
 namespace folly {
 
@@ -74,4 +75,10 @@ class SpinLockGuardImpl : private boost::noncopyable {
 
 typedef SpinLockGuardImpl<SpinLock> SpinLockGuard;
 
+namespace detail {
+// Through its MicroSpinLock
+template <>
+struct LockReportsContention<SpinLock> : std::true_type {};
+} // namespace detail
+
 }
@@ -878,8 +878,12 @@ class LockedPtrBase<SynchronizedType, std::mutex, LockPolicy> {
    * Destructor releases.
    */
   ~LockedPtrBase() {
-    // The std::unique_lock will automatically release the lock when it is
-    // destroyed, so we don't need to do anything extra here.
+    // Unlocked here rather than by the std::unique_lock's destructor, so that
+    // contention is reported as for the other mutex types.
+    if (lock_.owns_lock()) {
+      lock_.unlock();
+      detail::lockReleased(lock_.mutex(), LockType::Other);
+    }
   }
 
   LockedPtrBase(LockedPtrBase&& rhs) noexcept
@@ -887,6 +891,10 @@ class LockedPtrBase<SynchronizedType, std::mutex, LockPolicy> {
     rhs.parent_ = nullptr;
   }
   LockedPtrBase& operator=(LockedPtrBase&& rhs) noexcept {
+    if (lock_.owns_lock()) {
+      lock_.unlock();
+      detail::lockReleased(lock_.mutex(), LockType::Other);
+    }
     lock_ = std::move(rhs.lock_);
     parent_ = rhs.parent_;
     rhs.parent_ = nullptr;
@@ -918,13 +926,18 @@ class LockedPtrBase<SynchronizedType, std::mutex, LockPolicy> {
   void unlock() {
     DCHECK(parent_ != nullptr);
     lock_.unlock();
+    detail::lockReleased(lock_.mutex(), LockType::Other);
     parent_ = nullptr;
   }
 
  protected:
   LockedPtrBase() {}
-  explicit LockedPtrBase(SynchronizedType* parent)
-      : lock_(parent->mutex_), parent_(parent) {}
+  explicit LockedPtrBase(SynchronizedType* parent) : parent_(parent) {
+    // Lock through LockPolicy so contention is reported, then hand the
+    // mutex to the unique_lock.
+    LockPolicy::lock(parent->mutex_);
+    lock_ = std::unique_lock<std::mutex>(parent->mutex_, std::adopt_lock);
+  }
 
   using UnlockerData =
       std::pair<std::unique_lock<std::mutex>, SynchronizedType*>;
@@ -938,11 +951,15 @@ class LockedPtrBase<SynchronizedType, std::mutex, LockPolicy> {
     UnlockerData data(std::move(lock_), parent_);
     parent_ = nullptr;
     data.first.unlock();
+    detail::lockReleased(data.first.mutex(), LockType::Other);
     return data;
   }
   void reacquireLock(UnlockerData&& data) {
-    lock_ = std::move(data.first);
-    lock_.lock();
+    // Lock through LockPolicy, as in the constructor, so contention is
+    // reported.
+    auto mutex = data.first.release();
+    LockPolicy::lock(*mutex);
+    lock_ = std::unique_lock<std::mutex>(*mutex, std::adopt_lock);
     parent_ = data.second;
   }
 
@@ -20,9 +20,11 @@
  * than boost::thread_specific_ptr).
  *
  * Also includes an accessor interface to walk all the thread local child
- * objects of a parent.  accessAllThreads() initializes an accessor which holds
- * a global lock *that blocks all creation and destruction of ThreadLocal
- * objects with the same Tag* and can be used as an iterable container.
+ * objects of a parent.  accessAllThreads() initializes an accessor which
+ * snapshots the child objects and can be used as an iterable container.  The
+ * accessor holds a per-Tag lock *that delays the exit of threads with child
+ * objects of the same Tag* until it is released; creation of threads and of
+ * ThreadLocal objects is not blocked by it.
  * accessAllThreads() can race with destruction of thread-local elements. We
  * provide a strict mode which is dangerous because it requires the access lock
  * to be held while destroying thread-local elements which could cause
@@ -47,6 +49,7 @@
 #include <folly/SharedMutex.h>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace folly {
 enum class TLPDestructionMode {
@@ -126,7 +129,9 @@ class ThreadLocal {
  * each array has an index for each unique instance of the ThreadLocalPtr
  * object.  Each ThreadLocalPtr object has a unique id that is an index into
  * these arrays so we can fetch the correct object from thread local storage
- * very efficiently.
+ * very efficiently.  When __thread is usable, the elements for the first
+ * kStaticElementsCapacity ids of each Tag live in a fixed __thread array
+ * instead, so that get() on them is a single TLS load.
  *
  * In order to prevent unbounded growth of the id space and thus huge
  * ThreadEntry::elements, arrays, for example due to continuous creation and
@@ -170,6 +175,12 @@ class ThreadLocalPtr {
   }
 
   T* get() const {
+#ifdef FOLLY_TLD_USE_FOLLY_TLS
+    uint32_t id = id_.getOrInvalid();
+    if (LIKELY(id < threadlocal_detail::kStaticElementsCapacity)) {
+      return static_cast<T*>(StaticMeta::getStaticElements()[id].ptr);
+    }
+#endif
     threadlocal_detail::ElementWrapper& w = StaticMeta::instance().get(&id_);
     return static_cast<T*>(w.ptr);
   }
@@ -250,16 +261,16 @@ class ThreadLocalPtr {
     w.set(newPtr, deleter);
   }
 
-  // Holds a global lock for iteration through all thread local child objects.
-  // Can be used as an iterable container.
+  // Snapshot of all thread local child objects, usable as an iterable
+  // container.  Holds the per-Tag access lock (which delays exiting threads'
+  // cleanup, see above) but not the lock guarding thread and ThreadLocal
+  // creation, which is only taken briefly to take the snapshot.
   // Use accessAllThreads() to obtain one.
   class Accessor {
     friend class ThreadLocalPtr<T, Tag, AccessMode>;
 
-    threadlocal_detail::StaticMetaBase& meta_;
-    SharedMutex* accessAllThreadsLock_;
-    std::mutex* lock_;
-    uint32_t id_;
+    SharedMutexReadPriority* accessAllThreadsLock_;
+    std::vector<T*> elements_;
 
    public:
     class Iterator;
@@ -272,46 +283,26 @@ class ThreadLocalPtr {
           boost::bidirectional_traversal_tag> {   // traversal
       friend class Accessor;
       friend class boost::iterator_core_access;
-      const Accessor* accessor_;
-      threadlocal_detail::ThreadEntry* e_;
+      typename std::vector<T*>::const_iterator it_;
 
       void increment() {
-        e_ = e_->next;
-        incrementToValid();
+        ++it_;
       }
 
       void decrement() {
-        e_ = e_->prev;
-        decrementToValid();
+        --it_;
       }
 
       T& dereference() const {
-        return *static_cast<T*>(e_->elements[accessor_->id_].ptr);
+        return **it_;
       }
 
       bool equal(const Iterator& other) const {
-        return (accessor_->id_ == other.accessor_->id_ &&
-                e_ == other.e_);
-      }
-
-      explicit Iterator(const Accessor* accessor)
-        : accessor_(accessor),
-          e_(&accessor_->meta_.head_) {
-      }
-
-      bool valid() const {
-        return (e_->elements &&
-                accessor_->id_ < e_->elementsCapacity &&
-                e_->elements[accessor_->id_].ptr);
+        return it_ == other.it_;
       }
 
-      void incrementToValid() {
-        for (; e_ != &accessor_->meta_.head_ && !valid(); e_ = e_->next) { }
-      }
-
-      void decrementToValid() {
-        for (; e_ != &accessor_->meta_.head_ && !valid(); e_ = e_->prev) { }
-      }
+      explicit Iterator(typename std::vector<T*>::const_iterator it)
+          : it_(it) {}
     };
 
     ~Accessor() {
@@ -319,24 +310,21 @@ class ThreadLocalPtr {
     }
 
     Iterator begin() const {
-      return ++Iterator(this);
+      return Iterator(elements_.begin());
     }
 
     Iterator end() const {
-      return Iterator(this);
+      return Iterator(elements_.end());
     }
 
     Accessor(const Accessor&) = delete;
     Accessor& operator=(const Accessor&) = delete;
 
     Accessor(Accessor&& other) noexcept
-        : meta_(other.meta_),
-          accessAllThreadsLock_(other.accessAllThreadsLock_),
-          lock_(other.lock_),
-          id_(other.id_) {
-      other.id_ = 0;
+        : accessAllThreadsLock_(other.accessAllThreadsLock_),
+          elements_(std::move(other.elements_)) {
       other.accessAllThreadsLock_ = nullptr;
-      other.lock_ = nullptr;
+      other.elements_.clear();
     }
 
     Accessor& operator=(Accessor&& other) noexcept {
@@ -346,44 +334,43 @@ class ThreadLocalPtr {
       // meta (and lock), so they'd both hold the lock at the same time,
       // which is impossible, which leaves only one possible scenario --
       // *this is empty.  Assert it.
-      assert(&meta_ == &other.meta_);
-      assert(lock_ == nullptr);
+      assert(accessAllThreadsLock_ == nullptr);
       using std::swap;
       swap(accessAllThreadsLock_, other.accessAllThreadsLock_);
-      swap(lock_, other.lock_);
-      swap(id_, other.id_);
+      swap(elements_, other.elements_);
+      return *this;
     }
 
-    Accessor()
-        : meta_(threadlocal_detail::StaticMeta<Tag, AccessMode>::instance()),
-          accessAllThreadsLock_(nullptr),
-          lock_(nullptr),
-          id_(0) {}
+    Accessor() : accessAllThreadsLock_(nullptr) {}
 
    private:
-    explicit Accessor(uint32_t id)
-        : meta_(threadlocal_detail::StaticMeta<Tag, AccessMode>::instance()),
-          accessAllThreadsLock_(&meta_.accessAllThreadsLock_),
-          lock_(&meta_.lock_) {
+    explicit Accessor(uint32_t id) {
+      auto& meta = StaticMeta::instance();
+      accessAllThreadsLock_ = &meta.accessAllThreadsLock_;
       accessAllThreadsLock_->lock();
-      lock_->lock();
-      id_ = id;
+      auto guard = makeGuard([&] { accessAllThreadsLock_->unlock(); });
+
+      std::lock_guard<std::mutex> g(meta.lock_);
+      for (auto e = meta.head_.next; e != &meta.head_; e = e->next) {
+        if (e->elements && id < e->elementsCapacity && e->element(id).ptr) {
+          elements_.push_back(static_cast<T*>(e->element(id).ptr));
+        }
+      }
+      guard.dismiss();
     }
 
     void release() {
-      if (lock_) {
-        lock_->unlock();
-        DCHECK(accessAllThreadsLock_ != nullptr);
+      if (accessAllThreadsLock_) {
         accessAllThreadsLock_->unlock();
-        id_ = 0;
-        lock_ = nullptr;
         accessAllThreadsLock_ = nullptr;
+        elements_.clear();
       }
     }
   };
 
   // accessor allows a client to iterate through all thread local child
   // elements of this ThreadLocal instance.  Holds a global lock for each <Tag>
+  // that delays thread exit, but not thread or ThreadLocal creation
   Accessor accessAllThreads() const {
     static_assert(!std::is_same<Tag, void>::value,
                   "Must use a unique Tag to use the accessAllThreads feature");
@@ -0,0 +1,470 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Bits.h>
+#include <folly/Hash.h>
+#include <folly/Likely.h>
+#include <folly/Optional.h>
+#include <folly/SharedMutex.h>
+#include <folly/ThreadCachedInt.h>
+#include <folly/detail/CacheLocality.h>
+
+namespace folly {
+
+namespace detail {
+
+/**
+ * Count-min sketch of 4-bit counters, used by ConcurrentEvictingCache to
+ * estimate how often a key was requested in the recent past (TinyLFU).
+ *
+ * Counters saturate at 15 and are all halved after every sampleSize
+ * effective increments, so that old popularity fades away. Saturated
+ * counters are not written to, hence keys that are hot enough stop
+ * touching the sketch altogether.
+ */
+class FrequencySketch {
+ public:
+  explicit FrequencySketch(size_t expectedEntries)
+      : mask_(nextPowTwo(std::max<size_t>(expectedEntries, 16)) - 1),
+        sampleSize_(10 * std::max<size_t>(expectedEntries, 8)),
+        table_(new std::atomic<uint64_t>[mask_ + 1]()) {}
+
+  uint32_t frequency(uint64_t hash) const {
+    uint32_t freq = kMaxCount;
+    Positions positions(hash);
+    for (size_t row = 0; row < kRows; ++row) {
+      auto pos = positions.at(row, mask_);
+      auto word = table_[pos.first].load(std::memory_order_relaxed);
+      freq = std::min(freq, uint32_t(word >> pos.second) & kMaxCount);
+    }
+    return freq;
+  }
+
+  void increment(uint64_t hash) {
+    bool added = false;
+    Positions positions(hash);
+    for (size_t row = 0; row < kRows; ++row) {
+      auto pos = positions.at(row, mask_);
+      auto& cell = table_[pos.first];
+      auto word = cell.load(std::memory_order_relaxed);
+      while (((word >> pos.second) & kMaxCount) != kMaxCount) {
+        if (cell.compare_exchange_weak(
+                word,
+                word + (uint64_t(1) << pos.second),
+                std::memory_order_relaxed)) {
+          added = true;
+          break;
+        }
+      }
+    }
+    if (added &&
+        additions_.fetch_add(1, std::memory_order_relaxed) + 1 ==
+            sampleSize_) {
+      age();
+    }
+  }
+
+ private:
+  static constexpr size_t kRows = 4;
+  static constexpr uint32_t kMaxCount = 15;
+
+  // Counter positions of a key in each row, by double hashing. The low
+  // bits of the key's hash select its cache shard, so they are rotated
+  // away rather than used for the word index.
+  struct Positions {
+    explicit Positions(uint64_t hash)
+        : h1((hash >> 32) | (hash << 32)),
+          h2(hash::twang_mix64(hash) | 1) {}
+
+    // Word index and bit offset of the counter in `row'.
+    std::pair<size_t, unsigned> at(size_t row, size_t mask) const {
+      return {size_t(h1 + row * h2) & mask,
+              unsigned(h2 >> (44 + 4 * row)) & 0x3c};
+    }
+
+    const uint64_t h1;
+    const uint64_t h2;
+  };
+
+  // Races with concurrent increments, which may be lost; the sketch is
+  // only an estimate anyway.
+  void age() {
+    for (size_t i = 0; i <= mask_; ++i) {
+      auto word = table_[i].load(std::memory_order_relaxed);
+      table_[i].store(
+          (word >> 1) & 0x7777777777777777ULL, std::memory_order_relaxed);
+    }
+    additions_.fetch_sub(sampleSize_ / 2, std::memory_order_relaxed);
+  }
+
+  const size_t mask_;
+  const size_t sampleSize_;
+  std::unique_ptr<std::atomic<uint64_t>[]> table_;
+  std::atomic<size_t> additions_{0};
+};
+
+} // namespace detail
+
+/**
+ * A thread-safe, weight-bounded cache.
+ *
+ * Unlike EvictingCacheMap, which keeps a strict LRU order and therefore
+ * writes to a shared list on every hit, this cache is designed to be
+ * shared by many threads:
+ *
+ *  - Keys are hashed onto independently locked shards. Lookups take the
+ *    shard's SharedMutex in shared mode, so hits do not serialize.
+ *  - Eviction uses CLOCK: a hit only sets the entry's reference bit (if it
+ *    is not set already) instead of reordering a list.
+ *  - Admission uses TinyLFU: when a shard is full, a new key only replaces
+ *    the CLOCK victim if it was requested more often recently, according
+ *    to a per-shard frequency sketch. One-off keys from a scan therefore
+ *    cannot flush the popular ones.
+ *
+ * Each entry has a weight (1 by default), and the cache holds entries of at
+ * most `capacity' total weight, divided evenly among the shards. Entries
+ * may have a time to live; expired entries are never returned and are
+ * evicted first.
+ *
+ * Values are copied out by get(), so large values are best stored as
+ * std::shared_ptr<const T>.
+ */
+template <
+    class TKey,
+    class TValue,
+    class THash = std::hash<TKey>,
+    class TKeyEqual = std::equal_to<TKey>,
+    class TClock = std::chrono::steady_clock>
+class ConcurrentEvictingCache {
+ public:
+  using Clock = TClock;
+  using Duration = typename Clock::duration;
+
+  struct Options {
+    // Total weight of the entries the cache may hold
+    size_t capacity{1024};
+    // Rounded up to a power of two, and reduced for small capacities
+    size_t numShards{64};
+    // Time to live of entries set() without one; zero means forever
+    Duration ttl{Duration::zero()};
+  };
+
+  struct Stats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    // New entries admitted by set()
+    uint64_t insertions{0};
+    // New entries turned away by set()
+    uint64_t rejections{0};
+    uint64_t evictions{0};
+    uint64_t expirations{0};
+    size_t size{0};
+    size_t weight{0};
+
+    double hitRatio() const {
+      auto lookups = hits + misses;
+      return lookups ? double(hits) / lookups : 0.0;
+    }
+  };
+
+  explicit ConcurrentEvictingCache(size_t capacity)
+      : ConcurrentEvictingCache(makeOptions(capacity)) {}
+
+  explicit ConcurrentEvictingCache(const Options& options)
+      : defaultTtl_(options.ttl) {
+    size_t numShards = nextPowTwo(std::max<size_t>(options.numShards, 1));
+    while (numShards > 1 && options.capacity / numShards < kMinShardCapacity) {
+      numShards /= 2;
+    }
+    shardMask_ = numShards - 1;
+    shards_.reserve(numShards);
+    for (size_t i = 0; i < numShards; ++i) {
+      shards_.emplace_back(new Shard(
+          options.capacity / numShards + (i < options.capacity % numShards)));
+    }
+  }
+
+  ConcurrentEvictingCache(const ConcurrentEvictingCache&) = delete;
+  ConcurrentEvictingCache& operator=(const ConcurrentEvictingCache&) = delete;
+
+  /**
+   * Returns a copy of the value of `key', or none if it is not cached or
+   * has expired. Either way the request counts towards the key's
+   * frequency.
+   */
+  Optional<TValue> get(const TKey& key) {
+    auto hash = hashKey(key);
+    auto& shard = shardFor(hash);
+    shard.sketch.increment(hash);
+    {
+      SharedMutex::ReadHolder guard(shard.mutex);
+      auto it = shard.map.find(key);
+      if (it != shard.map.end() && !isExpired(*it->second)) {
+        auto& node = *it->second;
+        if (!node.referenced.load(std::memory_order_relaxed)) {
+          node.referenced.store(true, std::memory_order_relaxed);
+        }
+        ++hits_;
+        return node.value;
+      }
+    }
+    ++misses_;
+    return none;
+  }
+
+  /**
+   * Like get() != none, but does not affect the statistics, the key's
+   * frequency, or the eviction order.
+   */
+  bool exists(const TKey& key) const {
+    auto& shard = shardFor(hashKey(key));
+    SharedMutex::ReadHolder guard(shard.mutex);
+    auto it = shard.map.find(key);
+    return it != shard.map.end() && !isExpired(*it->second);
+  }
+
+  /**
+   * Inserts or replaces the value of `key'. A ttl of zero means the cache's
+   * default ttl, and Duration::max() means forever.
+   *
+   * Returns false if the entry was not admitted: its weight exceeds the
+   * capacity of a shard, or the shard is full of entries that are more
+   * popular. Replacing an existing entry always succeeds.
+   */
+  bool set(
+      const TKey& key,
+      TValue value,
+      size_t weight = 1,
+      Duration ttl = Duration::zero()) {
+    auto hash = hashKey(key);
+    auto& shard = shardFor(hash);
+    auto expiry = expiryFor(ttl);
+    SharedMutex::WriteHolder guard(shard.mutex);
+    if (weight > shard.capacity) {
+      ++shard.rejections;
+      return false;
+    }
+
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+      auto& node = *it->second;
+      shard.weight = shard.weight - node.weight + weight;
+      node.value = std::move(value);
+      node.weight = weight;
+      node.expiry = expiry;
+      node.referenced.store(true, std::memory_order_relaxed);
+      evictOverflow(shard, &node);
+      return true;
+    }
+
+    if (shard.weight + weight > shard.capacity) {
+      auto victim = findVictim(shard);
+      if (victim && !isExpired(*victim) &&
+          shard.sketch.frequency(hash) <=
+              shard.sketch.frequency(victim->hash)) {
+        ++shard.rejections;
+        return false;
+      }
+    }
+
+    std::unique_ptr<Node> node(
+        new Node(hash, std::move(value), weight, expiry));
+    auto inserted = shard.map.emplace(key, std::move(node)).first;
+    auto raw = inserted->second.get();
+    raw->key = &inserted->first;
+    raw->clockIndex = shard.clock.size();
+    shard.clock.push_back(raw);
+    shard.weight += weight;
+    ++shard.insertions;
+    evictOverflow(shard, raw);
+    return true;
+  }
+
+  bool erase(const TKey& key) {
+    auto& shard = shardFor(hashKey(key));
+    SharedMutex::WriteHolder guard(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+      return false;
+    }
+    remove(shard, it->second.get());
+    return true;
+  }
+
+  void clear() {
+    for (auto& shard : shards_) {
+      SharedMutex::WriteHolder guard(shard->mutex);
+      shard->map.clear();
+      shard->clock.clear();
+      shard->hand = 0;
+      shard->weight = 0;
+    }
+  }
+
+  size_t size() const {
+    size_t size = 0;
+    for (auto& shard : shards_) {
+      SharedMutex::ReadHolder guard(shard->mutex);
+      size += shard->map.size();
+    }
+    return size;
+  }
+
+  Stats getStats() const {
+    Stats stats;
+    stats.hits = hits_.readFull();
+    stats.misses = misses_.readFull();
+    for (auto& shard : shards_) {
+      SharedMutex::ReadHolder guard(shard->mutex);
+      stats.insertions += shard->insertions;
+      stats.rejections += shard->rejections;
+      stats.evictions += shard->evictions;
+      stats.expirations += shard->expirations;
+      stats.size += shard->map.size();
+      stats.weight += shard->weight;
+    }
+    return stats;
+  }
+
+ private:
+  static constexpr size_t kMinShardCapacity = 16;
+
+  struct Node {
+    Node(uint64_t h, TValue&& v, size_t w, typename Clock::time_point e)
+        : hash(h), value(std::move(v)), weight(w), expiry(e) {}
+
+    const uint64_t hash;
+    // Points to the key in the shard's map
+    const TKey* key{nullptr};
+    TValue value;
+    size_t weight;
+    typename Clock::time_point expiry;
+    size_t clockIndex{0};
+    std::atomic<bool> referenced{false};
+  };
+
+  struct Shard {
+    explicit Shard(size_t cap) : capacity(cap), sketch(cap) {}
+
+    mutable SharedMutex mutex;
+    std::unordered_map<TKey, std::unique_ptr<Node>, THash, TKeyEqual> map;
+    // Entries in CLOCK order, swept by `hand'
+    std::vector<Node*> clock;
+    size_t hand{0};
+    size_t weight{0};
+    const size_t capacity;
+    detail::FrequencySketch sketch;
+    uint64_t insertions{0};
+    uint64_t rejections{0};
+    uint64_t evictions{0};
+    uint64_t expirations{0};
+    // Shards are allocated separately, keep their hot fields apart
+    char padding[detail::CacheLocality::kFalseSharingRange];
+  };
+
+  static Options makeOptions(size_t capacity) {
+    Options options;
+    options.capacity = capacity;
+    return options;
+  }
+
+  static uint64_t hashKey(const TKey& key) {
+    return hash::twang_mix64(THash()(key));
+  }
+
+  Shard& shardFor(uint64_t hash) const {
+    return *shards_[hash & shardMask_];
+  }
+
+  typename Clock::time_point expiryFor(Duration ttl) const {
+    if (ttl == Duration::zero()) {
+      ttl = defaultTtl_;
+    }
+    if (ttl == Duration::zero() || ttl == Duration::max()) {
+      return Clock::time_point::max();
+    }
+    return Clock::now() + ttl;
+  }
+
+  static bool isExpired(const Node& node) {
+    return UNLIKELY(node.expiry != Clock::time_point::max()) &&
+        node.expiry <= Clock::now();
+  }
+
+  // Sweeps the clock hand past recently referenced entries, clearing their
+  // reference bits, and returns the first entry that is unreferenced or
+  // expired. Terminates within two revolutions.
+  static Node* findVictim(Shard& shard) {
+    while (!shard.clock.empty()) {
+      if (shard.hand >= shard.clock.size()) {
+        shard.hand = 0;
+      }
+      auto node = shard.clock[shard.hand];
+      if (isExpired(*node) ||
+          !node->referenced.exchange(false, std::memory_order_relaxed)) {
+        return node;
+      }
+      ++shard.hand;
+    }
+    return nullptr;
+  }
+
+  // Evicts entries other than `keep' until the shard is within capacity.
+  static void evictOverflow(Shard& shard, Node* keep) {
+    while (shard.weight > shard.capacity) {
+      auto victim = findVictim(shard);
+      if (victim == keep) {
+        keep->referenced.store(true, std::memory_order_relaxed);
+        ++shard.hand;
+        continue;
+      }
+      if (isExpired(*victim)) {
+        ++shard.expirations;
+      } else {
+        ++shard.evictions;
+      }
+      remove(shard, victim);
+    }
+  }
+
+  static void remove(Shard& shard, Node* node) {
+    auto index = node->clockIndex;
+    shard.clock[index] = shard.clock.back();
+    shard.clock[index]->clockIndex = index;
+    shard.clock.pop_back();
+    shard.weight -= node->weight;
+    shard.map.erase(shard.map.find(*node->key));
+  }
+
+  const Duration defaultTtl_;
+  size_t shardMask_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  ThreadCachedInt<uint64_t> hits_;
+  ThreadCachedInt<uint64_t> misses_;
+};
+
+} // namespace folly
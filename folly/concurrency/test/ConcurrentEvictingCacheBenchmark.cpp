@@ -0,0 +1,174 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/concurrency/ConcurrentEvictingCache.h>
+
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <folly/Benchmark.h>
+#include <folly/EvictingCacheMap.h>
+#include <folly/portability/GFlags.h>
+
+DEFINE_int32(keys, 1000000, "Number of distinct keys in the trace");
+DEFINE_int32(capacity, 10000, "Cache capacity");
+DEFINE_double(zipf_s, 0.99, "Skew of the Zipfian key distribution");
+
+namespace {
+
+// Keys drawn from a Zipfian distribution; key 0 is the most popular.
+const std::vector<uint32_t>& zipfTrace() {
+  static const auto trace = [] {
+    std::vector<double> cdf(FLAGS_keys);
+    double sum = 0;
+    for (int i = 0; i < FLAGS_keys; ++i) {
+      sum += 1.0 / std::pow(i + 1, FLAGS_zipf_s);
+      cdf[i] = sum;
+    }
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> dist(0, sum);
+    std::vector<uint32_t> keys(1 << 22);
+    for (auto& key : keys) {
+      key = std::lower_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin();
+    }
+    return keys;
+  }();
+  return trace;
+}
+
+class LockedLru {
+ public:
+  explicit LockedLru(size_t capacity) : map_(capacity) {}
+
+  bool lookup(uint32_t key) {
+    std::lock_guard<std::mutex> g(mutex_);
+    if (map_.find(key) != map_.end()) {
+      return true;
+    }
+    map_.set(key, key);
+    return false;
+  }
+
+ private:
+  std::mutex mutex_;
+  folly::EvictingCacheMap<uint32_t, uint32_t> map_;
+};
+
+class Concurrent {
+ public:
+  explicit Concurrent(size_t capacity) : cache_(capacity) {}
+
+  bool lookup(uint32_t key) {
+    if (cache_.get(key)) {
+      return true;
+    }
+    cache_.set(key, key);
+    return false;
+  }
+
+ private:
+  folly::ConcurrentEvictingCache<uint32_t, uint32_t> cache_;
+};
+
+// Each thread replays its own slice of the trace, lookups that miss insert
+// the key. Returns the hit ratio.
+template <class Cache>
+double runTrace(Cache& cache, size_t numOps, size_t numThreads) {
+  const auto& trace = zipfTrace();
+  std::atomic<size_t> hits{0};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < numThreads; ++t) {
+    threads.emplace_back([&, t] {
+      size_t pos = t * (trace.size() / numThreads);
+      size_t localHits = 0;
+      for (size_t i = t; i < numOps; i += numThreads) {
+        localHits += cache.lookup(trace[pos]);
+        if (++pos == trace.size()) {
+          pos = 0;
+        }
+      }
+      hits += localHits;
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return numOps ? double(hits) / numOps : 0.0;
+}
+
+template <class Cache>
+void runBenchmark(size_t numOps, size_t numThreads) {
+  folly::BenchmarkSuspender braces;
+  zipfTrace();
+  Cache cache(FLAGS_capacity);
+  braces.dismissing([&] { runTrace(cache, numOps, numThreads); });
+}
+
+void locked_lru(size_t numOps, size_t numThreads) {
+  runBenchmark<LockedLru>(numOps, numThreads);
+}
+
+void concurrent_cache(size_t numOps, size_t numThreads) {
+  runBenchmark<Concurrent>(numOps, numThreads);
+}
+
+} // namespace
+
+#define BENCH_BASE(...) FB_VA_GLUE(BENCHMARK_NAMED_PARAM, (__VA_ARGS__))
+#define BENCH_REL(...) FB_VA_GLUE(BENCHMARK_RELATIVE_NAMED_PARAM, (__VA_ARGS__))
+
+BENCH_BASE(locked_lru, 1thread, 1)
+BENCH_REL(concurrent_cache, 1thread, 1)
+BENCHMARK_DRAW_LINE()
+BENCH_BASE(locked_lru, 2thread, 2)
+BENCH_REL(concurrent_cache, 2thread, 2)
+BENCHMARK_DRAW_LINE()
+BENCH_BASE(locked_lru, 4thread, 4)
+BENCH_REL(concurrent_cache, 4thread, 4)
+BENCHMARK_DRAW_LINE()
+BENCH_BASE(locked_lru, 8thread, 8)
+BENCH_REL(concurrent_cache, 8thread, 8)
+BENCHMARK_DRAW_LINE()
+BENCH_BASE(locked_lru, 16thread, 16)
+BENCH_REL(concurrent_cache, 16thread, 16)
+BENCHMARK_DRAW_LINE()
+BENCH_BASE(locked_lru, 32thread, 32)
+BENCH_REL(concurrent_cache, 32thread, 32)
+BENCHMARK_DRAW_LINE()
+BENCH_BASE(locked_lru, 64thread, 64)
+BENCH_REL(concurrent_cache, 64thread, 64)
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  // Hit ratios over a pass of the whole trace, from a cold cache
+  auto numOps = zipfTrace().size();
+  for (size_t threads : {1, 16}) {
+    LockedLru lru(FLAGS_capacity);
+    Concurrent concurrent(FLAGS_capacity);
+    printf(
+        "hit ratio, %2zu threads: locked_lru %.4f concurrent_cache %.4f\n",
+        threads,
+        runTrace(lru, numOps, threads),
+        runTrace(concurrent, numOps, threads));
+  }
+
+  folly::runBenchmarks();
+
+  return 0;
+}
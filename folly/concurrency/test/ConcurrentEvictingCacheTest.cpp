@@ -0,0 +1,221 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/concurrency/ConcurrentEvictingCache.h>
+
+#include <string>
+#include <thread>
+
+#include <folly/Random.h>
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+
+namespace {
+
+struct FakeClock {
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<FakeClock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() {
+    return time_point(duration(nowNs));
+  }
+
+  static std::atomic<int64_t> nowNs;
+};
+
+std::atomic<int64_t> FakeClock::nowNs{0};
+
+using Cache = ConcurrentEvictingCache<int, std::string>;
+
+Cache::Options singleShard(size_t capacity) {
+  Cache::Options options;
+  options.capacity = capacity;
+  options.numShards = 1;
+  return options;
+}
+
+// Requests `key' until it is cached, so it counts as popular.
+template <class C>
+void makePopular(C& cache, int key, int times = 4) {
+  using Value = typename std::decay<decltype(*cache.get(key))>::type;
+  for (int i = 0; i < times; ++i) {
+    if (!cache.get(key)) {
+      cache.set(key, Value());
+    }
+  }
+}
+} // namespace
+
+TEST(ConcurrentEvictingCache, Basic) {
+  Cache cache(100);
+  EXPECT_FALSE(cache.get(1).hasValue());
+  EXPECT_TRUE(cache.set(1, "one"));
+  EXPECT_TRUE(cache.exists(1));
+  EXPECT_EQ("one", cache.get(1).value());
+  EXPECT_EQ(1, cache.size());
+
+  EXPECT_TRUE(cache.set(1, "uno"));
+  EXPECT_EQ("uno", cache.get(1).value());
+  EXPECT_EQ(1, cache.size());
+
+  EXPECT_TRUE(cache.erase(1));
+  EXPECT_FALSE(cache.erase(1));
+  EXPECT_FALSE(cache.exists(1));
+  EXPECT_EQ(0, cache.size());
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(2, stats.hits);
+  EXPECT_EQ(1, stats.misses);
+  EXPECT_EQ(1, stats.insertions);
+  EXPECT_EQ(0, stats.size);
+}
+
+TEST(ConcurrentEvictingCache, ScanResistance) {
+  Cache cache(singleShard(16));
+  for (int i = 0; i < 16; ++i) {
+    makePopular(cache, i);
+  }
+  EXPECT_EQ(16, cache.size());
+
+  // A scan over keys requested only once must not evict the popular ones
+  for (int i = 100; i < 200; ++i) {
+    EXPECT_FALSE(cache.get(i).hasValue());
+    EXPECT_FALSE(cache.set(i, "scan"));
+  }
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_TRUE(cache.exists(i)) << i;
+  }
+  auto stats = cache.getStats();
+  EXPECT_EQ(100, stats.rejections);
+  EXPECT_EQ(0, stats.evictions);
+
+  // ...but a key that becomes more popular than the victim is admitted
+  makePopular(cache, 1000, 8);
+  EXPECT_TRUE(cache.exists(1000));
+  stats = cache.getStats();
+  EXPECT_EQ(1, stats.evictions);
+  EXPECT_EQ(16, stats.size);
+}
+
+TEST(ConcurrentEvictingCache, Weights) {
+  Cache cache(singleShard(16));
+  EXPECT_TRUE(cache.set(1, "a", 10));
+  EXPECT_FALSE(cache.set(2, "too big", 17));
+
+  makePopular(cache, 3);
+  cache.erase(3);
+  // Not full yet
+  EXPECT_TRUE(cache.set(3, "b", 6));
+  EXPECT_EQ(16, cache.getStats().weight);
+
+  // More popular than either, and needs both evicted
+  for (int i = 0; i < 8; ++i) {
+    cache.get(4);
+  }
+  EXPECT_TRUE(cache.set(4, "c", 12));
+  auto stats = cache.getStats();
+  EXPECT_EQ(12, stats.weight);
+  EXPECT_EQ(1, stats.size);
+  EXPECT_EQ(2, stats.evictions);
+
+  // Growing an entry evicts others, but never the entry itself
+  makePopular(cache, 5);
+  EXPECT_TRUE(cache.exists(5));
+  EXPECT_TRUE(cache.set(5, "d", 16));
+  EXPECT_TRUE(cache.exists(5));
+  EXPECT_FALSE(cache.exists(4));
+  EXPECT_EQ(16, cache.getStats().weight);
+}
+
+TEST(ConcurrentEvictingCache, Ttl) {
+  using TtlCache = ConcurrentEvictingCache<
+      int,
+      int,
+      std::hash<int>,
+      std::equal_to<int>,
+      FakeClock>;
+  TtlCache::Options options;
+  options.capacity = 16;
+  options.numShards = 1;
+  options.ttl = std::chrono::seconds(10);
+  TtlCache cache(options);
+
+  EXPECT_TRUE(cache.set(1, 1));
+  EXPECT_TRUE(cache.set(2, 2, 1, std::chrono::seconds(1)));
+  EXPECT_TRUE(cache.set(3, 3, 1, FakeClock::duration::max()));
+
+  FakeClock::nowNs += std::chrono::nanoseconds(std::chrono::seconds(5)).count();
+  EXPECT_TRUE(cache.get(1).hasValue());
+  EXPECT_FALSE(cache.get(2).hasValue());
+  EXPECT_FALSE(cache.exists(2));
+
+  FakeClock::nowNs += std::chrono::nanoseconds(std::chrono::seconds(6)).count();
+  EXPECT_FALSE(cache.get(1).hasValue());
+  EXPECT_TRUE(cache.get(3).hasValue());
+
+  // Expired entries make room regardless of popularity
+  for (int i = 100; i < 114; ++i) {
+    makePopular(cache, i);
+  }
+  EXPECT_EQ(1, cache.getStats().expirations);
+  EXPECT_TRUE(cache.set(200, 200));
+  auto stats = cache.getStats();
+  EXPECT_EQ(2, stats.expirations);
+  EXPECT_EQ(0, stats.rejections);
+  EXPECT_EQ(16, stats.size);
+}
+
+TEST(ConcurrentEvictingCache, Concurrent) {
+  constexpr size_t kCapacity = 256;
+  constexpr int kThreads = 8;
+  constexpr int kOps = 20000;
+  ConcurrentEvictingCache<int, int> cache(kCapacity);
+  std::atomic<uint64_t> gets{0};
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < kOps; ++i) {
+        // Skewed towards small keys
+        int key = Random::rand32(Random::rand32(1, 1000));
+        ++gets;
+        auto value = cache.get(key);
+        if (value) {
+          EXPECT_EQ(key, *value);
+        } else {
+          cache.set(key, key);
+        }
+        if (i % 1000 == 0) {
+          cache.erase(key);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(gets.load(), stats.hits + stats.misses);
+  EXPECT_LE(stats.weight, kCapacity);
+  EXPECT_EQ(stats.size, stats.weight);
+  EXPECT_EQ(cache.size(), stats.size);
+  EXPECT_GT(stats.hitRatio(), 0.0);
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+#include <folly/Likely.h>
+#include <folly/Portability.h>
+
+namespace folly {
+
+enum class LockType : uint8_t {
+  SharedMutex,
+  MicroSpinLock,
+  PicoSpinLock,
+  RWSpinLock,
+  // Any other mutex locked through LockTraits (e.g. by Synchronized)
+  Other,
+};
+
+enum class LockContentionKind : uint8_t {
+  Exclusive,
+  Shared,
+  Upgrade,
+};
+
+namespace detail {
+
+/**
+ * Hooks for lock contention profiling (see
+ * experimental/symbolizer/LockContentionProfiler.h). Locks time their slow
+ * paths only, after failing to acquire right away, and report them once
+ * released; releasing only checks whether this thread has any contended
+ * acquisition pending.
+ */
+struct LockContentionHooks {
+  // A thread waited waitNanos to acquire lock, and just released it (or
+  // gave up waiting)
+  void (*contended)(
+      const void* lock,
+      LockType type,
+      LockContentionKind kind,
+      uint64_t waitNanos);
+  // A thread released lock while others were waiting for it. Only locks
+  // that track their waiters (SharedMutex) report this.
+  void (*releasedWithWaiters)(const void* lock, LockType type);
+};
+
+inline std::atomic<const LockContentionHooks*>& lockContentionHooksSlot() {
+  static std::atomic<const LockContentionHooks*> hooks{nullptr};
+  return hooks;
+}
+
+inline const LockContentionHooks* lockContentionHooks() {
+  return lockContentionHooksSlot().load(std::memory_order_acquire);
+}
+
+inline void setLockContentionHooks(const LockContentionHooks* hooks) {
+  lockContentionHooksSlot().store(hooks, std::memory_order_release);
+}
+
+struct PendingLockContention {
+  const LockContentionHooks* hooks;
+  const void* lock;
+  LockType type;
+  LockContentionKind kind;
+  uint64_t waitNanos;
+};
+
+// Contended acquisitions a thread holds at once before they are reported
+// right away instead
+constexpr size_t kMaxPendingLockContention = 8;
+
+struct PendingLockContentions {
+  size_t size;
+  PendingLockContention entries[kMaxPendingLockContention];
+};
+
+inline PendingLockContentions& pendingLockContentions() {
+  static FOLLY_TLS PendingLockContentions pending;
+  return pending;
+}
+
+/**
+ * Holds a contended acquisition's report until the lock is released, so
+ * that the hook (which may capture a stack and allocate) doesn't run while
+ * the lock is held. Reported right away if this thread already has too many
+ * acquisitions pending.
+ *
+ * An acquisition released by another thread stays pending here; it is
+ * dropped once this thread contends on the same address again, or releases
+ * a lock of another type there.
+ */
+FOLLY_NOINLINE inline void deferLockContention(
+    const LockContentionHooks* hooks,
+    const void* lock,
+    LockType type,
+    LockContentionKind kind,
+    uint64_t waitNanos) noexcept {
+  auto& pending = pendingLockContentions();
+  for (size_t i = 0; i < pending.size;) {
+    if (pending.entries[i].lock == lock) {
+      pending.entries[i] = pending.entries[--pending.size];
+    } else {
+      ++i;
+    }
+  }
+  if (pending.size == kMaxPendingLockContention) {
+    hooks->contended(lock, type, kind, waitNanos);
+    return;
+  }
+  pending.entries[pending.size++] = {hooks, lock, type, kind, waitNanos};
+}
+
+/**
+ * Reports this thread's pending acquisitions of lock.
+ */
+FOLLY_NOINLINE inline void reportDeferredLockContention(
+    const void* lock,
+    LockType type) noexcept {
+  auto& pending = pendingLockContentions();
+  for (size_t i = 0; i < pending.size;) {
+    if (pending.entries[i].lock == lock) {
+      // Remove it first: the hook may take and release locks itself
+      auto entry = pending.entries[i];
+      pending.entries[i] = pending.entries[--pending.size];
+      if (entry.type == type) {
+        entry.hooks->contended(
+            entry.lock, entry.type, entry.kind, entry.waitNanos);
+      }
+    } else {
+      ++i;
+    }
+  }
+}
+
+/**
+ * To be called by locks that report their contention, once released.
+ */
+inline void lockReleased(const void* lock, LockType type) {
+  if (UNLIKELY(pendingLockContentions().size != 0)) {
+    reportDeferredLockContention(lock, type);
+  }
+}
+
+/**
+ * Times the contended waits of one acquisition, and reports them as one wait
+ * once the lock is released (see deferLockContention()), if profiling is
+ * enabled. Construct or begin() it only on a slow path.
+ */
+class LockContentionTimer {
+ public:
+  // Times nothing until begin()
+  LockContentionTimer() noexcept {}
+
+  LockContentionTimer(
+      const void* lock,
+      LockType type,
+      LockContentionKind kind) noexcept {
+    begin(lock, type, kind);
+  }
+
+  /**
+   * Starts timing, unless already started: an acquisition that waits more
+   * than once (e.g. SharedMutex::lock() waiting for the previous writer,
+   * then for readers) is timed from its first wait.
+   */
+  void begin(const void* lock, LockType type, LockContentionKind kind) {
+    if (hooks_ == nullptr) {
+      hooks_ = lockContentionHooks();
+      if (UNLIKELY(hooks_ != nullptr)) {
+        lock_ = lock;
+        type_ = type;
+        kind_ = kind;
+        start_ = std::chrono::steady_clock::now();
+      }
+    }
+  }
+
+  /**
+   * Reports right away, for an acquisition that timed out: there is no
+   * release to wait for.
+   */
+  void reportNow() {
+    if (UNLIKELY(hooks_ != nullptr)) {
+      hooks_->contended(lock_, type_, kind_, elapsedNanos());
+      hooks_ = nullptr;
+    }
+  }
+
+  ~LockContentionTimer() {
+    if (UNLIKELY(hooks_ != nullptr)) {
+      deferLockContention(hooks_, lock_, type_, kind_, elapsedNanos());
+    }
+  }
+
+  LockContentionTimer(const LockContentionTimer&) = delete;
+  LockContentionTimer& operator=(const LockContentionTimer&) = delete;
+
+ private:
+  uint64_t elapsedNanos() const {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start_)
+                        .count());
+  }
+
+  const LockContentionHooks* hooks_{nullptr};
+  const void* lock_{nullptr};
+  LockType type_{LockType::Other};
+  LockContentionKind kind_{LockContentionKind::Exclusive};
+  std::chrono::steady_clock::time_point start_;
+};
+
+inline void reportLockReleasedWithWaiters(const void* lock, LockType type) {
+  auto hooks = lockContentionHooks();
+  if (UNLIKELY(hooks != nullptr)) {
+    hooks->releasedWithWaiters(lock, type);
+  }
+}
+
+/**
+ * True for mutexes that report their own contention, so LockTraits
+ * doesn't report it a second time.
+ */
+template <class Mutex>
+struct LockReportsContention : std::false_type {};
+
+} // namespace detail
+} // namespace folly
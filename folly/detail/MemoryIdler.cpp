@@ -29,6 +29,7 @@
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include <utility>
 
 namespace folly { namespace detail {
@@ -36,7 +37,30 @@ namespace folly { namespace detail {
 AtomicStruct<std::chrono::steady_clock::duration>
 MemoryIdler::defaultIdleTimeout(std::chrono::seconds(5));
 
+namespace {
+std::atomic<void (*)()> localCacheFlushers[MemoryIdler::kMaxLocalCacheFlushers];
+std::atomic<size_t> numLocalCacheFlushers{0};
+}
+
+void MemoryIdler::addLocalCacheFlusher(void (*flusher)()) {
+  auto i = numLocalCacheFlushers.fetch_add(1);
+  CHECK_LT(i, size_t(kMaxLocalCacheFlushers)) << "too many cache flushers";
+  localCacheFlushers[i].store(flusher, std::memory_order_release);
+}
+
 void MemoryIdler::flushLocalMallocCaches() {
+  // Flush caches layered on top of malloc first, so that memory they return
+  // to malloc gets flushed below.
+  auto n = std::min<size_t>(
+      numLocalCacheFlushers.load(std::memory_order_acquire),
+      kMaxLocalCacheFlushers);
+  for (size_t i = 0; i < n; ++i) {
+    auto flusher = localCacheFlushers[i].load(std::memory_order_acquire);
+    if (flusher != nullptr) {
+      flusher();
+    }
+  }
+
   if (!usingJEMalloc()) {
     return;
   }
@@ -50,6 +50,16 @@ struct MemoryIdler {
   /// jemalloc is supported.
   static void flushLocalMallocCaches();
 
+  /// Registers a function for flushLocalMallocCaches() to call (on the
+  /// thread going idle), so that allocators keeping thread-local caches
+  /// of their own, such as SlabAllocator, can return them as well.
+  /// Flushers can't be unregistered; at most kMaxLocalCacheFlushers
+  /// can be registered.
+  static void addLocalCacheFlusher(void (*flusher)());
+
+  enum {
+    kMaxLocalCacheFlushers = 8,
+  };
 
   enum {
     /// This value is a tradeoff between reclaiming memory and triggering
@@ -15,6 +15,7 @@
  */
 #include <folly/ThreadLocal.h>
 
+#include <algorithm>
 #include <list>
 #include <mutex>
 
@@ -45,16 +46,22 @@ void StaticMetaBase::onThreadExit(void* ptr) {
   };
 
   {
-    SharedMutex::ReadHolder rlock(nullptr);
-    if (meta.strict_) {
-      rlock = SharedMutex::ReadHolder(meta.accessAllThreadsLock_);
-    }
+    // accessAllThreads() iterates over a snapshot of the per-thread pointers
+    // taken without holding lock_ for the duration, so wait for any
+    // iteration in progress before unlinking the entry: later snapshots
+    // won't see it. Only strict mode keeps the lock while disposing of the
+    // elements, as the deleters may themselves wait for a thread that is
+    // iterating.
+    SharedMutexReadPriority::ReadHolder rlock(meta.accessAllThreadsLock_);
     {
       std::lock_guard<std::mutex> g(meta.lock_);
       meta.erase(&(*threadEntry));
       // No need to hold the lock any longer; the ThreadEntry is private to this
       // thread now that it's been removed from meta.
     }
+    if (!meta.strict_) {
+      rlock.unlock();
+    }
     // NOTE: User-provided deleter / object dtor itself may be using ThreadLocal
     // with the same Tag, so dispose() calls below may (re)create some of the
     // elements or even increase elementsCapacity, thus multiple cleanup rounds
@@ -62,7 +69,7 @@ void StaticMetaBase::onThreadExit(void* ptr) {
     for (bool shouldRun = true; shouldRun;) {
       shouldRun = false;
       FOR_EACH_RANGE (i, 0, threadEntry->elementsCapacity) {
-        if (threadEntry->elements[i].dispose(TLPDestructionMode::THIS_THREAD)) {
+        if (threadEntry->element(i).dispose(TLPDestructionMode::THIS_THREAD)) {
           shouldRun = true;
         }
       }
@@ -103,7 +110,7 @@ void StaticMetaBase::destroy(EntryID* ent) {
     std::vector<ElementWrapper> elements;
 
     {
-      SharedMutex::WriteHolder wlock(nullptr);
+      SharedMutexReadPriority::WriteHolder wlock(nullptr);
       if (meta.strict_) {
         /*
          * In strict mode, the logic guarantees per-thread instances are
@@ -112,7 +119,8 @@ void StaticMetaBase::destroy(EntryID* ent) {
          * onThreadExit() calls (that might acquire ownership over per-thread
          * instances in order to destroy them) are finished.
          */
-        wlock = SharedMutex::WriteHolder(meta.accessAllThreadsLock_);
+        wlock =
+            SharedMutexReadPriority::WriteHolder(meta.accessAllThreadsLock_);
       }
 
       {
@@ -123,8 +131,9 @@ void StaticMetaBase::destroy(EntryID* ent) {
         }
 
         for (ThreadEntry* e = meta.head_.next; e != &meta.head_; e = e->next) {
-          if (id < e->elementsCapacity && e->elements[id].ptr) {
-            elements.push_back(e->elements[id]);
+          if (id < e->elementsCapacity && e->element(id).ptr) {
+            ElementWrapper& elem = e->element(id);
+            elements.push_back(elem);
 
             /*
              * Writing another thread's ThreadEntry from here is fine;
@@ -137,9 +146,9 @@ void StaticMetaBase::destroy(EntryID* ent) {
              * it's illegal to call get on a thread local that's
              * destructing.
              */
-            e->elements[id].ptr = nullptr;
-            e->elements[id].deleter1 = nullptr;
-            e->elements[id].ownsDeleter = false;
+            elem.ptr = nullptr;
+            elem.deleter1 = nullptr;
+            elem.ownsDeleter = false;
           }
         }
         meta.freeIds_.push_back(id);
@@ -169,7 +178,10 @@ void StaticMetaBase::reserve(EntryID* id) {
   }
   // Growth factor < 2, see folly/docs/FBVector.md; + 5 to prevent
   // very slow start.
-  size_t newCapacity = static_cast<size_t>((idval + 5) * 1.7);
+  // Always cover the static range, so that "id < elementsCapacity" holds
+  // for every id whose element may live in ThreadEntry::staticElements.
+  size_t newCapacity = std::max<size_t>(
+      static_cast<size_t>((idval + 5) * 1.7), kStaticElementsCapacity);
   assert(newCapacity > prevCapacity);
   ElementWrapper* reallocated = nullptr;
 
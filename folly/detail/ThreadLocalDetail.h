@@ -136,6 +136,16 @@ struct ElementWrapper {
 
 struct StaticMetaBase;
 
+/**
+ * Number of ids per Tag whose elements live in a fixed FOLLY_TLS array
+ * rather than in the heap-allocated ThreadEntry::elements.  Reads of those
+ * ids compile down to a single TLS load, without going through the
+ * StaticMeta singleton or the ThreadEntry.  Ids are handed out from 1 (and
+ * recycled), so the first kStaticElementsCapacity - 1 live ThreadLocals of
+ * every Tag take the fast path.
+ */
+constexpr uint32_t kStaticElementsCapacity = 16;
+
 /**
  * Per-thread entry.  Each thread using a StaticMeta object has one.
  * This is written from the owning thread only (under the lock), read
@@ -143,7 +153,19 @@ struct StaticMetaBase;
  * (under the lock).
  */
 struct ThreadEntry {
+  ElementWrapper& element(uint32_t id) {
+#ifdef FOLLY_TLD_USE_FOLLY_TLS
+    if (id < kStaticElementsCapacity) {
+      return staticElements[id];
+    }
+#endif
+    return elements[id];
+  }
+
   ElementWrapper* elements{nullptr};
+  // Points into the owning thread's FOLLY_TLS storage.  Valid for as long as
+  // the entry is linked into its StaticMeta.
+  ElementWrapper* staticElements{nullptr};
   size_t elementsCapacity{0};
   ThreadEntry* next{nullptr};
   ThreadEntry* prev{nullptr};
@@ -296,7 +318,11 @@ struct StaticMetaBase {
   uint32_t nextId_;
   std::vector<uint32_t> freeIds_;
   std::mutex lock_;
-  SharedMutex accessAllThreadsLock_;
+  // Held exclusively by accessAllThreads() and shared by exiting threads,
+  // while they unlink themselves or, in strict mode, until their elements
+  // are disposed of. Readers get priority so that a steady stream of
+  // aggregations doesn't starve thread exit.
+  SharedMutexReadPriority accessAllThreadsLock_;
   pthread_key_t pthreadKey_;
   ThreadEntry head_;
   ThreadEntry* (*threadEntry_)();
@@ -340,9 +366,21 @@ struct StaticMeta : StaticMetaBase {
       id = ent->getOrInvalid();
       assert(threadEntry->elementsCapacity > id);
     }
-    return threadEntry->elements[id];
+    return threadEntry->element(id);
   }
 
+#ifdef FOLLY_TLD_USE_FOLLY_TLS
+  /**
+   * The calling thread's elements for ids below kStaticElementsCapacity.
+   * Zero-initialized, so reading an element of a thread that has never
+   * touched this Tag yields nullptr without having to register the thread.
+   */
+  inline static ElementWrapper* getStaticElements() {
+    static FOLLY_TLS ElementWrapper staticElements[kStaticElementsCapacity];
+    return staticElements;
+  }
+#endif
+
   static ThreadEntry* getThreadEntrySlow() {
     auto& meta = instance();
     auto key = meta.pthreadKey_;
@@ -352,6 +390,7 @@ struct StaticMeta : StaticMetaBase {
 #ifdef FOLLY_TLD_USE_FOLLY_TLS
       static FOLLY_TLS ThreadEntry threadEntrySingleton;
       threadEntry = &threadEntrySingleton;
+      threadEntry->staticElements = getStaticElements();
 #else
       threadEntry = new ThreadEntry();
 #endif
@@ -375,10 +414,14 @@ struct StaticMeta : StaticMetaBase {
   }
 
   static void preFork(void) {
-    instance().lock_.lock();  // Make sure it's created
+    instance().accessAllThreadsLock_.lock(); // Make sure it's created
+    instance().lock_.lock();
   }
 
-  static void onForkParent(void) { instance().lock_.unlock(); }
+  static void onForkParent(void) {
+    instance().lock_.unlock();
+    instance().accessAllThreadsLock_.unlock();
+  }
 
   static void onForkChild(void) {
     // only the current thread survives
@@ -389,6 +432,7 @@ struct StaticMeta : StaticMetaBase {
       instance().push_back(threadEntry);
     }
     instance().lock_.unlock();
+    instance().accessAllThreadsLock_.unlock();
   }
 };
 
@@ -22,6 +22,7 @@
 #include <folly/detail/Futex.h>
 #include <folly/portability/Asm.h>
 #include <folly/portability/Unistd.h>
+#include <folly/tracing/StaticTracepoint.h>
 
 #include <glog/logging.h>
 
@@ -152,14 +153,19 @@ struct TurnSequencer {
           continue;
         }
       }
+      // MPMCQueue's blocking operations end up here when they have to
+      // sleep.
+      FOLLY_SDT(folly, turn_sequencer_wait_begin, this, turn);
       if (absTime) {
         auto futexResult =
             state_.futexWaitUntil(new_state, *absTime, futexChannel(turn));
+        FOLLY_SDT(folly, turn_sequencer_wait_end, this, turn);
         if (futexResult == FutexResult::TIMEDOUT) {
           return TryWaitResult::TIMEDOUT;
         }
       } else {
         state_.futexWait(new_state, futexChannel(turn));
+        FOLLY_SDT(folly, turn_sequencer_wait_end, this, turn);
       }
     }
 
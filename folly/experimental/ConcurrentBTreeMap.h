@@ -0,0 +1,744 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ConcurrentBTreeMap is an ordered map that supports concurrent lookups,
+ * range scans, insertions and deletions. It is a B+-tree using optimistic
+ * lock coupling (Leis et al., "The ART of Practical Synchronization"):
+ *
+ * - Every node carries a version word. Readers never write shared memory;
+ *   they record a node's version, read the node, and then check that the
+ *   version is unchanged, restarting from the root if it is not.
+ * - Writers descend the same way and only lock (by bumping the version) the
+ *   nodes they modify: the leaf, and on a split also its parent. Full inner
+ *   nodes are split eagerly on the way down, so a split never propagates
+ *   further than one level.
+ * - Leaves that become empty are unlinked from their parent and retired
+ *   through hazard pointers (folly/experimental/hazptr), so readers holding
+ *   a pointer to one never touch freed memory. Inner nodes are never merged
+ *   or freed before the map is destroyed.
+ *
+ * Compared with ConcurrentSkipList, a lookup touches one node per level of
+ * a tree with NodeCapacity-way fanout, and keys within a node are
+ * contiguous, so point lookups take fewer cache misses and range scans
+ * proceed at memory bandwidth.
+ *
+ * Because readers may observe a node while it is being written (and discard
+ * what they read when validation fails), Key and Value must be trivially
+ * copyable and default constructible, and Compare must not have side
+ * effects. Store larger values out of line, e.g. as row ids or pointers.
+ *
+ * Iterators are weakly consistent: an iterator holds a copy of the rest of
+ * the current leaf, and moves to the next leaf by searching for the first
+ * key past the leaf's upper bound. Every element present for the whole
+ * duration of the scan is visited exactly once, in order; elements inserted
+ * or erased concurrently may or may not be. Iterators stay valid no matter
+ * what happens to the map, except its destruction.
+ *
+ * Sample usage:
+ *
+ *   ConcurrentBTreeMap<int64_t, uint32_t> index;
+ *   index.insert(42, rowId);
+ *   if (auto row = index.get(42)) {
+ *     ...
+ *   }
+ *   for (auto it = index.lower_bound(10);
+ *        it != index.end() && it->first < 20;
+ *        ++it) {
+ *     ...
+ *   }
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <folly/Optional.h>
+#include <folly/detail/Sleeper.h>
+#include <folly/experimental/hazptr/hazptr.h>
+#include <folly/portability/TypeTraits.h>
+
+namespace folly {
+
+namespace detail {
+
+/**
+ * Version word for optimistic lock coupling. Bit 1 is the write lock and
+ * bit 0 marks a node that has been unlinked from the tree; each write
+ * advances the remaining bits.
+ */
+class OptimisticVersionLock {
+ public:
+  /**
+   * Records the current version. Returns false if the node is locked or
+   * obsolete, in which case the caller should restart.
+   */
+  bool readLock(uint64_t& version) const {
+    version = version_.load(std::memory_order_acquire);
+    return (version & (kLocked | kObsolete)) == 0;
+  }
+
+  /**
+   * Returns true if nothing was written since readLock() returned version,
+   * i.e. everything read in between is consistent.
+   */
+  bool validate(uint64_t version) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
+
+  /**
+   * Takes the write lock if nothing was written since readLock() returned
+   * version.
+   */
+  bool upgrade(uint64_t version) {
+    if (!version_.compare_exchange_strong(
+            version, version + kLocked, std::memory_order_acquire)) {
+      return false;
+    }
+    // Order the lock before the writes it protects, for validate().
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+  }
+
+  void unlock() {
+    version_.fetch_add(kLocked, std::memory_order_release);
+  }
+
+  void unlockObsolete() {
+    version_.fetch_add(kLocked | kObsolete, std::memory_order_release);
+  }
+
+ private:
+  static constexpr uint64_t kObsolete = 1;
+  static constexpr uint64_t kLocked = 2;
+
+  std::atomic<uint64_t> version_{0};
+};
+
+} // namespace detail
+
+template <
+    typename Key,
+    typename Value,
+    typename Compare = std::less<Key>,
+    size_t NodeCapacity = 32>
+class ConcurrentBTreeMap : private boost::noncopyable {
+  static_assert(
+      FOLLY_IS_TRIVIALLY_COPYABLE(Key),
+      "Key must be trivially copyable");
+  static_assert(
+      FOLLY_IS_TRIVIALLY_COPYABLE(Value),
+      "Value must be trivially copyable");
+  static_assert(NodeCapacity >= 4, "NodeCapacity must be at least 4");
+
+  struct NodeBase;
+  struct Leaf;
+  struct Inner;
+
+ public:
+  typedef Key key_type;
+  typedef Value mapped_type;
+  typedef std::pair<Key, Value> value_type;
+  typedef Compare key_compare;
+  class const_iterator;
+  typedef const_iterator iterator;
+
+  explicit ConcurrentBTreeMap(
+      const Compare& comp = Compare(),
+      hazptr::hazptr_domain& domain = hazptr::default_hazptr_domain())
+      : comp_(comp), domain_(domain), root_(new Leaf()) {}
+
+  ~ConcurrentBTreeMap() {
+    destroy(root_.load(std::memory_order_relaxed));
+  }
+
+  /**
+   * Inserts (key, value) if key is not present. Returns true if it was
+   * inserted.
+   */
+  bool insert(const Key& key, const Value& value) {
+    return update(key, value, false);
+  }
+
+  /**
+   * Inserts (key, value), overwriting the value if key is present. Returns
+   * true if it was inserted, false if it was assigned.
+   */
+  bool insert_or_assign(const Key& key, const Value& value) {
+    return update(key, value, true);
+  }
+
+  /**
+   * Removes key. Returns the number of elements removed (0 or 1).
+   */
+  size_t erase(const Key& key) {
+    hazptr::hazptr_owner<NodeBase> hptr(domain_);
+    detail::Sleeper sleeper;
+    size_t erased;
+    while (!tryErase(hptr, key, erased)) {
+      sleeper.wait();
+    }
+    return erased;
+  }
+
+  /**
+   * Returns the value for key, or none if key is not present.
+   */
+  Optional<Value> get(const Key& key) const {
+    Optional<Value> result;
+    readLeaf(&key, false, [&](const Leaf* leaf, const Key*) {
+      auto count = leaf->size();
+      auto pos = lowerBound(leaf->keys, count, key);
+      if (pos < count && !comp_(key, leaf->keys[pos])) {
+        result = leaf->values[pos];
+      } else {
+        result.clear();
+      }
+    });
+    return result;
+  }
+
+  bool contains(const Key& key) const {
+    bool found;
+    readLeaf(&key, false, [&](const Leaf* leaf, const Key*) {
+      auto count = leaf->size();
+      auto pos = lowerBound(leaf->keys, count, key);
+      found = pos < count && !comp_(key, leaf->keys[pos]);
+    });
+    return found;
+  }
+
+  bool empty() const {
+    return begin() == end();
+  }
+
+  const_iterator begin() const {
+    const_iterator it(this);
+    it.fill(nullptr, false);
+    return it;
+  }
+
+  const_iterator end() const {
+    return const_iterator();
+  }
+
+  /** Returns an iterator to key, or end() if key is not present. */
+  const_iterator find(const Key& key) const {
+    auto it = lower_bound(key);
+    if (it != end() && comp_(key, it->first)) {
+      return end();
+    }
+    return it;
+  }
+
+  /** Returns an iterator to the first element not less than key. */
+  const_iterator lower_bound(const Key& key) const {
+    const_iterator it(this);
+    it.fill(&key, false);
+    return it;
+  }
+
+  /** Returns an iterator to the first element greater than key. */
+  const_iterator upper_bound(const Key& key) const {
+    const_iterator it(this);
+    it.fill(&key, true);
+    return it;
+  }
+
+  const Compare& key_comp() const {
+    return comp_;
+  }
+
+ private:
+  struct NodeDeleter {
+    void operator()(NodeBase* node) const {
+      if (node->isLeaf) {
+        delete static_cast<Leaf*>(node);
+      } else {
+        delete static_cast<Inner*>(node);
+      }
+    }
+  };
+
+  struct NodeBase : hazptr::hazptr_obj_base<NodeBase, NodeDeleter> {
+    explicit NodeBase(bool leaf) : isLeaf(leaf) {}
+
+    // Clamped, since an optimistic reader may see a count being written.
+    size_t size() const {
+      return std::min<size_t>(
+          count.load(std::memory_order_relaxed), NodeCapacity);
+    }
+
+    void setSize(size_t n) {
+      count.store(n, std::memory_order_relaxed);
+    }
+
+    detail::OptimisticVersionLock lock;
+    std::atomic<uint32_t> count{0};
+    const bool isLeaf;
+  };
+
+  struct Leaf : NodeBase {
+    Leaf() : NodeBase(true) {}
+
+    Key keys[NodeCapacity];
+    Value values[NodeCapacity];
+  };
+
+  // Child i holds the keys in (keys[i - 1], keys[i]], the last child holds
+  // everything greater than keys[size() - 1].
+  struct Inner : NodeBase {
+    explicit Inner(bool leafChildren)
+        : NodeBase(false), leafChildren(leafChildren) {
+      for (auto& child : children) {
+        child.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    NodeBase* child(size_t i) const {
+      return children[i].load(std::memory_order_relaxed);
+    }
+
+    void setChild(size_t i, NodeBase* node) {
+      children[i].store(node, std::memory_order_relaxed);
+    }
+
+    const bool leafChildren;
+    Key keys[NodeCapacity];
+    std::atomic<NodeBase*> children[NodeCapacity + 1];
+  };
+
+  size_t lowerBound(const Key* keys, size_t count, const Key& key) const {
+    return std::lower_bound(keys, keys + count, key, comp_) - keys;
+  }
+
+  size_t upperBound(const Key* keys, size_t count, const Key& key) const {
+    return std::upper_bound(keys, keys + count, key, comp_) - keys;
+  }
+
+  /**
+   * Runs fn(leaf, fence) on the leaf covering key, or the leftmost leaf if
+   * key is nullptr. If strict, that is the leaf covering the keys just
+   * greater than key. fence points to the leaf's inclusive upper bound, or
+   * is nullptr for the rightmost leaf. fn may run several times, on
+   * inconsistent data; only the results of the last run are consistent.
+   */
+  template <typename Fn>
+  void readLeaf(const Key* key, bool strict, Fn fn) const {
+    hazptr::hazptr_owner<NodeBase> hptr(domain_);
+    detail::Sleeper sleeper;
+    while (!tryReadLeaf(hptr, key, strict, fn)) {
+      sleeper.wait();
+    }
+  }
+
+  template <typename Fn>
+  bool tryReadLeaf(
+      hazptr::hazptr_owner<NodeBase>& hptr,
+      const Key* key,
+      bool strict,
+      Fn& fn) const {
+    NodeBase* node = hptr.get_protected(root_);
+    uint64_t version;
+    if (!node->lock.readLock(version)) {
+      return false;
+    }
+    Key fence;
+    bool hasFence = false;
+    while (!node->isLeaf) {
+      auto inner = static_cast<const Inner*>(node);
+      auto count = inner->size();
+      size_t pos = 0;
+      if (key) {
+        pos = strict ? upperBound(inner->keys, count, *key)
+                     : lowerBound(inner->keys, count, *key);
+      }
+      if (pos < count) {
+        fence = inner->keys[pos];
+        hasFence = true;
+      }
+      if (!descend(hptr, inner, version, pos, node)) {
+        return false;
+      }
+    }
+    fn(static_cast<const Leaf*>(node), hasFence ? &fence : nullptr);
+    return node->lock.validate(version);
+  }
+
+  /**
+   * Loads child pos of inner and read-locks it, replacing version (inner's)
+   * with the child's. The child is protected by hptr if it is a leaf, since
+   * leaves are retired once unlinked from their parent. inner is validated
+   * only after the child's version is read, so that what was read from
+   * inner (such as the child's bounds) still holds for that version.
+   */
+  bool descend(
+      hazptr::hazptr_owner<NodeBase>& hptr,
+      const Inner* inner,
+      uint64_t& version,
+      size_t pos,
+      NodeBase*& child) const {
+    child = inner->child(pos);
+    if (inner->leafChildren && !hptr.try_protect(child, inner->children[pos])) {
+      return false;
+    }
+    auto innerVersion = version;
+    if (!child || !child->lock.readLock(version)) {
+      return false;
+    }
+    return inner->lock.validate(innerVersion);
+  }
+
+  bool update(const Key& key, const Value& value, bool assign) {
+    hazptr::hazptr_owner<NodeBase> hptr(domain_);
+    detail::Sleeper sleeper;
+    bool inserted;
+    while (!tryUpdate(hptr, key, value, assign, inserted)) {
+      sleeper.wait();
+    }
+    return inserted;
+  }
+
+  bool tryUpdate(
+      hazptr::hazptr_owner<NodeBase>& hptr,
+      const Key& key,
+      const Value& value,
+      bool assign,
+      bool& inserted) {
+    NodeBase* node = hptr.get_protected(root_);
+    uint64_t version;
+    if (!node->lock.readLock(version)) {
+      return false;
+    }
+    Inner* parent = nullptr;
+    uint64_t parentVersion = 0;
+    while (!node->isLeaf) {
+      auto inner = static_cast<Inner*>(node);
+      auto count = inner->size();
+      if (count == NodeCapacity) {
+        split(parent, parentVersion, node, version);
+        return false;
+      }
+      auto pos = lowerBound(inner->keys, count, key);
+      parent = inner;
+      parentVersion = version;
+      if (!descend(hptr, inner, version, pos, node)) {
+        return false;
+      }
+    }
+
+    auto leaf = static_cast<Leaf*>(node);
+    auto count = leaf->size();
+    auto pos = lowerBound(leaf->keys, count, key);
+    if (pos < count && !comp_(key, leaf->keys[pos])) {
+      inserted = false;
+      if (!assign) {
+        return leaf->lock.validate(version);
+      }
+      if (!leaf->lock.upgrade(version)) {
+        return false;
+      }
+      leaf->values[pos] = value;
+      leaf->lock.unlock();
+      return true;
+    }
+    if (count == NodeCapacity) {
+      split(parent, parentVersion, node, version);
+      return false;
+    }
+    if (!leaf->lock.upgrade(version)) {
+      return false;
+    }
+    std::copy_backward(
+        leaf->keys + pos, leaf->keys + count, leaf->keys + count + 1);
+    std::copy_backward(
+        leaf->values + pos, leaf->values + count, leaf->values + count + 1);
+    leaf->keys[pos] = key;
+    leaf->values[pos] = value;
+    leaf->setSize(count + 1);
+    leaf->lock.unlock();
+    inserted = true;
+    return true;
+  }
+
+  /**
+   * Splits the full node in two, adding the new node to parent (which is
+   * never full) or to a new root. The caller restarts afterwards either way.
+   */
+  void split(
+      Inner* parent,
+      uint64_t parentVersion,
+      NodeBase* node,
+      uint64_t version) {
+    if (parent && !parent->lock.upgrade(parentVersion)) {
+      return;
+    }
+    if (!node->lock.upgrade(version)) {
+      if (parent) {
+        parent->lock.unlock();
+      }
+      return;
+    }
+    if (!parent && node != root_.load(std::memory_order_relaxed)) {
+      // Someone else grew the tree above node.
+      node->lock.unlock();
+      return;
+    }
+
+    Key separator;
+    NodeBase* right;
+    if (node->isLeaf) {
+      right = splitLeaf(static_cast<Leaf*>(node), separator);
+    } else {
+      right = splitInner(static_cast<Inner*>(node), separator);
+    }
+    if (parent) {
+      auto count = parent->size();
+      auto pos = lowerBound(parent->keys, count, separator);
+      std::copy_backward(
+          parent->keys + pos, parent->keys + count, parent->keys + count + 1);
+      for (auto i = count; i > pos; --i) {
+        parent->setChild(i + 1, parent->child(i));
+      }
+      parent->keys[pos] = separator;
+      parent->setChild(pos + 1, right);
+      parent->setSize(count + 1);
+    } else {
+      auto root = new Inner(node->isLeaf);
+      root->keys[0] = separator;
+      root->setChild(0, node);
+      root->setChild(1, right);
+      root->setSize(1);
+      root_.store(root, std::memory_order_release);
+    }
+
+    node->lock.unlock();
+    if (parent) {
+      parent->lock.unlock();
+    }
+  }
+
+  // Moves the upper half of leaf to a new leaf, and sets separator to the
+  // largest key left in leaf.
+  Leaf* splitLeaf(Leaf* leaf, Key& separator) {
+    auto right = new Leaf();
+    auto count = leaf->size();
+    auto half = count / 2;
+    std::copy(leaf->keys + half, leaf->keys + count, right->keys);
+    std::copy(leaf->values + half, leaf->values + count, right->values);
+    right->setSize(count - half);
+    leaf->setSize(half);
+    separator = leaf->keys[half - 1];
+    return right;
+  }
+
+  // Moves the upper half of inner to a new node, and moves the middle key
+  // to separator.
+  Inner* splitInner(Inner* inner, Key& separator) {
+    auto right = new Inner(inner->leafChildren);
+    auto count = inner->size();
+    auto half = count / 2;
+    std::copy(inner->keys + half + 1, inner->keys + count, right->keys);
+    for (auto i = half + 1; i <= count; ++i) {
+      right->setChild(i - half - 1, inner->child(i));
+    }
+    right->setSize(count - half - 1);
+    inner->setSize(half);
+    separator = inner->keys[half];
+    return right;
+  }
+
+  bool tryErase(
+      hazptr::hazptr_owner<NodeBase>& hptr,
+      const Key& key,
+      size_t& erased) {
+    NodeBase* node = hptr.get_protected(root_);
+    uint64_t version;
+    if (!node->lock.readLock(version)) {
+      return false;
+    }
+    Inner* parent = nullptr;
+    uint64_t parentVersion = 0;
+    size_t childPos = 0;
+    while (!node->isLeaf) {
+      auto inner = static_cast<Inner*>(node);
+      childPos = lowerBound(inner->keys, inner->size(), key);
+      parent = inner;
+      parentVersion = version;
+      if (!descend(hptr, inner, version, childPos, node)) {
+        return false;
+      }
+    }
+
+    auto leaf = static_cast<Leaf*>(node);
+    auto count = leaf->size();
+    auto pos = lowerBound(leaf->keys, count, key);
+    if (pos == count || comp_(key, leaf->keys[pos])) {
+      erased = 0;
+      return leaf->lock.validate(version);
+    }
+
+    if (count == 1 && parent && parent->size() > 0) {
+      // Unlink the leaf instead of leaving it empty; its neighbor takes over
+      // its key range.
+      if (!parent->lock.upgrade(parentVersion)) {
+        return false;
+      }
+      if (!leaf->lock.upgrade(version)) {
+        parent->lock.unlock();
+        return false;
+      }
+      auto parentCount = parent->size();
+      auto keyPos = std::min(childPos, parentCount - 1);
+      std::copy(
+          parent->keys + keyPos + 1,
+          parent->keys + parentCount,
+          parent->keys + keyPos);
+      for (auto i = childPos; i < parentCount; ++i) {
+        parent->setChild(i, parent->child(i + 1));
+      }
+      parent->setChild(parentCount, nullptr);
+      parent->setSize(parentCount - 1);
+      leaf->lock.unlockObsolete();
+      parent->lock.unlock();
+      leaf->retire(domain_);
+      erased = 1;
+      return true;
+    }
+
+    if (!leaf->lock.upgrade(version)) {
+      return false;
+    }
+    std::copy(leaf->keys + pos + 1, leaf->keys + count, leaf->keys + pos);
+    std::copy(leaf->values + pos + 1, leaf->values + count, leaf->values + pos);
+    leaf->setSize(count - 1);
+    leaf->lock.unlock();
+    erased = 1;
+    return true;
+  }
+
+  static void destroy(NodeBase* node) {
+    if (!node->isLeaf) {
+      auto inner = static_cast<Inner*>(node);
+      for (size_t i = 0; i <= inner->size(); ++i) {
+        destroy(inner->child(i));
+      }
+    }
+    NodeDeleter()(node);
+  }
+
+  Compare comp_;
+  hazptr::hazptr_domain& domain_;
+  std::atomic<NodeBase*> root_;
+
+ public:
+  class const_iterator : public boost::iterator_facade<
+                             const_iterator,
+                             const value_type,
+                             boost::forward_traversal_tag> {
+   public:
+    const_iterator() = default;
+
+   private:
+    friend class ConcurrentBTreeMap;
+    friend class boost::iterator_core_access;
+
+    explicit const_iterator(const ConcurrentBTreeMap* map) : map_(map) {}
+
+    // Buffers the rest of the leaf covering key (or the leftmost leaf),
+    // starting at the first element not less than (or if strict, greater
+    // than) key, and moves on to the next leaf while that is empty.
+    void fill(const Key* key, bool strict) {
+      Key next;
+      while (true) {
+        map_->readLeaf(key, strict, [&](const Leaf* leaf, const Key* fence) {
+          size_t pos = 0;
+          if (key) {
+            auto count = leaf->size();
+            pos = strict ? map_->upperBound(leaf->keys, count, *key)
+                         : map_->lowerBound(leaf->keys, count, *key);
+          }
+          copyFrom(leaf, pos, fence);
+        });
+        pos_ = 0;
+        if (size_ > 0 || !hasFence_) {
+          return;
+        }
+        next = fence_;
+        key = &next;
+        strict = true;
+      }
+    }
+
+    void copyFrom(const Leaf* leaf, size_t pos, const Key* fence) {
+      auto count = leaf->size();
+      size_ = 0;
+      for (; pos < count; ++pos) {
+        buffer_[size_].first = leaf->keys[pos];
+        buffer_[size_].second = leaf->values[pos];
+        ++size_;
+      }
+      hasFence_ = fence != nullptr;
+      if (fence) {
+        fence_ = *fence;
+      }
+    }
+
+    bool atEnd() const {
+      return pos_ == size_;
+    }
+
+    void increment() {
+      if (++pos_ == size_ && hasFence_) {
+        Key key = fence_;
+        fill(&key, true);
+      }
+    }
+
+    bool equal(const const_iterator& other) const {
+      if (atEnd() || other.atEnd()) {
+        return atEnd() == other.atEnd();
+      }
+      auto& comp = map_->comp_;
+      auto& key = buffer_[pos_].first;
+      auto& otherKey = other.buffer_[other.pos_].first;
+      return !comp(key, otherKey) && !comp(otherKey, key);
+    }
+
+    const value_type& dereference() const {
+      return buffer_[pos_];
+    }
+
+    const ConcurrentBTreeMap* map_{nullptr};
+    uint32_t pos_{0};
+    uint32_t size_{0};
+    bool hasFence_{false};
+    Key fence_;
+    std::array<value_type, NodeCapacity> buffer_;
+  };
+
+};
+
+} // namespace folly
@@ -0,0 +1,286 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string.h>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include <folly/Bits.h>
+#include <folly/Range.h>
+#include <folly/ScopeGuard.h>
+#include <folly/detail/CacheLocality.h>
+#include <folly/detail/Futex.h>
+#include <folly/experimental/AsymmetricMemoryBarrier.h>
+
+namespace folly {
+
+/// LockFreeByteRingBuffer is a fixed-size, concurrent ring buffer of
+/// variable-length records, with the semantics of LockFreeRingBuffer:
+///
+///  1. Writers never block, on other writers or on readers
+///  2. Readers can wait for writes that haven't occurred yet
+///  3. Readers can detect if they are lagging behind
+///
+/// The buffer holds the most recent records that fit in it. Any number of
+/// readers can follow the stream of records, each with its own Cursor.
+///
+/// A writer claims space for its record with a single fetch_add, fills it
+/// in, and publishes it by storing the record's commit word last. A
+/// reader copies a record out and then checks, as with a seqlock, that no
+/// writer has claimed its space again in the meantime. Records are stored
+/// 7 bytes to a word, so that until a record is committed, nothing left
+/// in its space by older records can pass for its commit word. Unlike with
+/// LockFreeRingBuffer, cursors only move by reading, since only a
+/// record's header says where the next one starts; a reader that has
+/// fallen behind starts over from currentHead().
+///
+/// A writer that is descheduled in the middle of a write for a whole lap
+/// of the buffer will scribble over the newer record in its space when it
+/// resumes, so make the buffer much larger than what is written while a
+/// writer might be descheduled.
+///
+/// Usage example, as a trace sink:
+/// @code
+///   LockFreeByteRingBuffer<> sink(1 << 20);
+///   sink.write(StringPiece(event)); // from any thread
+///
+///   // exporter thread
+///   auto cursor = sink.currentHead();
+///   std::string record;
+///   while (!stopping) {
+///     auto deadline =
+///         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+///     switch (sink.waitAndTryRead(record, cursor, deadline)) {
+///       case ReadResult::SUCCESS: exportRecord(record); break;
+///       case ReadResult::PAST: cursor = sink.currentHead(); break;
+///       case ReadResult::FUTURE: break; // timed out
+///     }
+///   }
+/// @endcode
+
+template <template <typename> class Atom = std::atomic>
+class LockFreeByteRingBuffer : boost::noncopyable {
+ public:
+  /// Opaque pointer to a past or future record.
+  struct Cursor {
+    explicit Cursor(uint64_t initialPos) noexcept : pos(initialPos) {}
+
+  protected: // for test visibility reasons
+    // In words since the start of the stream
+    uint64_t pos;
+    friend class LockFreeByteRingBuffer;
+  };
+
+  enum class ReadResult {
+    SUCCESS, // read the record, and moved the cursor past it
+    FUTURE, // the record has not been written yet
+    PAST, // the record has been overwritten
+  };
+
+  /// capacity is in bytes, and rounded up to a multiple of 8. Each record
+  /// takes 16 bytes of header, and 8 bytes for every 7 bytes of data.
+  explicit LockFreeByteRingBuffer(size_t capacity)
+      : numWords_(std::max<size_t>(
+            kHeaderWords + 1,
+            (capacity + kWordSize - 1) / kWordSize)),
+        words_(new Atom<uint64_t>[numWords_]) {
+    for (size_t i = 0; i < numWords_; ++i) {
+      words_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /// Size of the largest record that fits in the buffer.
+  size_t maxRecordSize() const noexcept {
+    return (numWords_ - kHeaderWords) * kBytesPerWord;
+  }
+
+  /// Write a record, truncated to maxRecordSize().
+  void write(ByteRange record) noexcept {
+    writeAndGetCursor(record);
+  }
+
+  /// Write a record, truncated to maxRecordSize(), and return a Cursor
+  /// pointing to it.
+  Cursor writeAndGetCursor(ByteRange record) noexcept {
+    record = record.subpiece(0, maxRecordSize());
+    uint64_t pos = head_.fetch_add(
+        recordWords(record.size()), std::memory_order_relaxed);
+    // Readers of the record previously in this space must see the claim
+    // above if they see any of the stores below.
+    std::atomic_thread_fence(std::memory_order_release);
+    word(pos + 1).store(record.size(), std::memory_order_relaxed);
+    storeBytes(pos + kHeaderWords, record);
+    word(pos).store(commitTag(pos), std::memory_order_release);
+
+    // Pairs with the heavy barrier in waitAndTryRead(): either a waiting
+    // reader sees the record, or we see the reader.
+    asymmetricLightBarrier();
+    if (waiters_.load(std::memory_order_relaxed) != 0) {
+      wakeups_.fetch_add(1, std::memory_order_release);
+      wakeups_.futexWake();
+    }
+    return Cursor(pos);
+  }
+
+  /// Read the record at the cursor into dest and, on success, move the
+  /// cursor to the next record. dest is unspecified unless the read
+  /// succeeded.
+  ReadResult tryRead(std::string& dest, Cursor& cursor) {
+    uint64_t pos = cursor.pos;
+    if (word(pos).load(std::memory_order_acquire) != commitTag(pos)) {
+      return overwritten(pos) ? ReadResult::PAST : ReadResult::FUTURE;
+    }
+    uint64_t size = word(pos + 1).load(std::memory_order_relaxed);
+    // Only possible if the record is being overwritten
+    bool torn = size > maxRecordSize();
+    dest.resize(torn ? 0 : size);
+    loadBytes(pos + kHeaderWords, &dest[0], dest.size());
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (torn || overwritten(pos)) {
+      return ReadResult::PAST;
+    }
+    cursor.pos = pos + recordWords(size);
+    return ReadResult::SUCCESS;
+  }
+
+  /// Like tryRead(), but if the record has not been written yet, block
+  /// until it is.
+  ReadResult waitAndTryRead(std::string& dest, Cursor& cursor) {
+    return waitAndTryRead(
+        dest, cursor, std::chrono::steady_clock::time_point::max());
+  }
+
+  /// Like tryRead(), but if the record has not been written yet, block
+  /// until it is or until the deadline, whichever comes first. Returns
+  /// FUTURE on timeout.
+  template <class Clock, class Duration>
+  ReadResult waitAndTryRead(
+      std::string& dest,
+      Cursor& cursor,
+      const std::chrono::time_point<Clock, Duration>& deadline) {
+    auto result = tryRead(dest, cursor);
+    if (result != ReadResult::FUTURE) {
+      return result;
+    }
+    waiters_.fetch_add(1, std::memory_order_relaxed);
+    SCOPE_EXIT {
+      waiters_.fetch_sub(1, std::memory_order_relaxed);
+    };
+    // Writers only pay for a compiler barrier to check for waiters; this
+    // is what makes that enough.
+    asymmetricHeavyBarrier();
+    while (true) {
+      auto epoch = wakeups_.load(std::memory_order_acquire);
+      result = tryRead(dest, cursor);
+      if (result != ReadResult::FUTURE) {
+        return result;
+      }
+      if (deadline == std::chrono::time_point<Clock, Duration>::max()) {
+        wakeups_.futexWait(epoch);
+      } else if (
+          wakeups_.futexWaitUntil(epoch, deadline) ==
+          detail::FutexResult::TIMEDOUT) {
+        return ReadResult::FUTURE;
+      }
+    }
+  }
+
+  /// Returns a Cursor pointing to the first record that has not been
+  /// written yet.
+  Cursor currentHead() noexcept {
+    return Cursor(head_.load(std::memory_order_acquire));
+  }
+
+ private:
+  static constexpr size_t kWordSize = sizeof(uint64_t);
+  // The top byte of data words is always 0
+  static constexpr size_t kBytesPerWord = kWordSize - 1;
+  // The commit word, then the size in bytes
+  static constexpr uint64_t kHeaderWords = 2;
+
+  const size_t numWords_;
+  const std::unique_ptr<Atom<uint64_t>[]> words_;
+
+  Atom<uint64_t> head_{0};
+  char pad_[detail::CacheLocality::kFalseSharingRange];
+  Atom<uint32_t> waiters_{0};
+  detail::Futex<Atom> wakeups_{0};
+
+  /// The commit word of the record at pos. Its top bit is set, unlike in
+  /// the zeroed buffer and in size and data words, so it can only be
+  /// mistaken for the commit word of a record at another position.
+  static uint64_t commitTag(uint64_t pos) noexcept {
+    return ~pos;
+  }
+
+  static uint64_t recordWords(size_t size) noexcept {
+    return kHeaderWords + (size + kBytesPerWord - 1) / kBytesPerWord;
+  }
+
+  Atom<uint64_t>& word(uint64_t pos) noexcept {
+    return words_[pos % numWords_];
+  }
+
+  /// True iff a writer has claimed the space of the record at pos for a
+  /// newer record.
+  bool overwritten(uint64_t pos) noexcept {
+    return head_.load(std::memory_order_relaxed) > pos + numWords_;
+  }
+
+  void storeBytes(uint64_t pos, ByteRange bytes) noexcept {
+    size_t idx = pos % numWords_;
+    while (!bytes.empty()) {
+      uint64_t w = 0;
+      size_t n = std::min(bytes.size(), kBytesPerWord);
+      memcpy(&w, bytes.data(), n);
+      words_[idx].store(Endian::little(w), std::memory_order_relaxed);
+      bytes.advance(n);
+      if (++idx == numWords_) {
+        idx = 0;
+      }
+    }
+  }
+
+  void loadBytes(uint64_t pos, char* dest, size_t size) noexcept {
+    size_t idx = pos % numWords_;
+    while (size > 0) {
+      uint64_t w = Endian::little(words_[idx].load(std::memory_order_relaxed));
+      size_t n = std::min(size, kBytesPerWord);
+      memcpy(dest, &w, n);
+      dest += n;
+      size -= n;
+      if (++idx == numWords_) {
+        idx = 0;
+      }
+    }
+  }
+}; // LockFreeByteRingBuffer
+
+template <template <typename> class Atom>
+constexpr size_t LockFreeByteRingBuffer<Atom>::kWordSize;
+template <template <typename> class Atom>
+constexpr size_t LockFreeByteRingBuffer<Atom>::kBytesPerWord;
+template <template <typename> class Atom>
+constexpr uint64_t LockFreeByteRingBuffer<Atom>::kHeaderWords;
+
+} // namespace folly
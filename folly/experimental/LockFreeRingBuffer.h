@@ -18,6 +18,7 @@
 
 #include <atomic>
 #include <boost/noncopyable.hpp>
+#include <chrono>
 #include <cmath>
 #include <memory>
 #include <string.h>
@@ -54,6 +55,8 @@ class RingBufferSlot;
 /// Cursor that can point anywhere in this stream of writes. Reads from the
 /// "future" can optionally block but reads from the "past" will always fail.
 ///
+/// For records of varying length, see LockFreeByteRingBuffer.
+///
 
 template<typename T, template<typename> class Atom = std::atomic>
 class LockFreeRingBuffer: boost::noncopyable {
@@ -135,6 +138,50 @@ public:
     return slots_[idx(cursor.ticket)].waitAndTryRead(dest, turn(cursor.ticket));
   }
 
+  /// Like waitAndTryRead(dest, cursor), but gives up and returns false if
+  /// the write has not occurred by the deadline. Lets a background reader
+  /// sleep until there is data and still wake up periodically, e.g. to
+  /// check whether it should stop.
+  template <class Clock, class Duration>
+  bool waitAndTryRead(
+      T& dest,
+      const Cursor& cursor,
+      const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+    return slots_[idx(cursor.ticket)].waitAndTryRead(
+        dest, turn(cursor.ticket), &deadline);
+  }
+
+  /// Read up to count consecutive values, starting at the cursor, into
+  /// dest. Stops at the first value that has not been written yet or has
+  /// already been overwritten. Returns the number of values read, all of
+  /// which are consistent; the cursor is left to the caller to move.
+  size_t tryReadBatch(T* dest, size_t count, const Cursor& cursor) noexcept {
+    size_t n = 0;
+    for (; n < count; ++n) {
+      uint64_t ticket = cursor.ticket + n;
+      if (!slots_[idx(ticket)].tryRead(dest[n], turn(ticket))) {
+        break;
+      }
+    }
+    return n;
+  }
+
+  /// Like tryReadBatch(), but first waits, until the deadline at the
+  /// latest, for the value at the cursor to be written. Returns 0 if it
+  /// was not written in time or has been overwritten.
+  template <class Clock, class Duration>
+  size_t waitAndTryReadBatch(
+      T* dest,
+      size_t count,
+      const Cursor& cursor,
+      const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+    if (count == 0 || !waitAndTryRead(dest[0], cursor, deadline)) {
+      return 0;
+    }
+    Cursor rest(cursor.ticket + 1);
+    return 1 + tryReadBatch(dest + 1, count - 1, rest);
+  }
+
   /// Returns a Cursor pointing to the first write that has not occurred yet.
   Cursor currentHead() noexcept {
     return Cursor(ticket_.load());
@@ -200,10 +247,17 @@ public:
     // At (turn + 1) * 2
   }
 
-  bool waitAndTryRead(T& dest, uint32_t turn) noexcept {
+  template <
+      class Clock = std::chrono::steady_clock,
+      class Duration = typename Clock::duration>
+  bool waitAndTryRead(
+      T& dest,
+      uint32_t turn,
+      const std::chrono::time_point<Clock, Duration>* absTime =
+          nullptr) noexcept {
     uint32_t desired_turn = (turn + 1) * 2;
     Atom<uint32_t> cutoff(0);
-    if (sequencer_.tryWaitForTurn(desired_turn, cutoff, false) !=
+    if (sequencer_.tryWaitForTurn(desired_turn, cutoff, false, absTime) !=
         TurnSequencer<Atom>::TryWaitResult::SUCCESS) {
       return false;
     }
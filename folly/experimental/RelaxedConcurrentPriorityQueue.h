@@ -0,0 +1,332 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <folly/Likely.h>
+#include <folly/Portability.h>
+#include <folly/Random.h>
+#include <folly/ScopeGuard.h>
+#include <folly/SpinLock.h>
+#include <folly/detail/CacheLocality.h>
+#include <folly/detail/Futex.h>
+
+namespace folly {
+
+namespace detail {
+
+/// Per-thread xorshift generator for picking sub-queues.
+inline uint32_t relaxedPriorityQueueRandom() {
+  static FOLLY_TLS uint32_t state = 0;
+  if (UNLIKELY(state == 0)) {
+    state = folly::Random::rand32() | 1;
+  }
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+} // namespace detail
+
+/// Thread-safe, unbounded priority queue that trades exact priority
+/// order for scalability (a "MultiQueue", Rihani, Sanders and
+/// Dementiev, SPAA 2015).
+///
+/// Elements are spread over many sequential heaps, each with its own
+/// lock: by default twice as many as there are hardware threads. push()
+/// inserts into a random heap, and pop() picks two heaps at random and
+/// removes the higher-priority of their tops; a heap found locked is
+/// swapped for another random one. So operations rarely contend, and
+/// a popped element is, in expectation, among the top O(number of
+/// heaps) elements of the queue, which is good enough for scheduling by
+/// deadline or priority. FlatCombiningPriorityQueue, by contrast, is
+/// exact but runs every operation on one combiner.
+///
+/// In strict mode, pop() locks all heaps and removes the highest
+/// priority element overall. This gives exact order, but pops no longer
+/// scale; pushes are unaffected.
+///
+/// As with std::priority_queue, Compare(a, b) is true if a has lower
+/// priority than b, so the default pops the greatest element first; use
+/// std::greater<> to pop the smallest (e.g. the earliest deadline)
+/// first. tryPop() and pop() copy the popped element. Mutex must
+/// support try_lock().
+///
+/// Usage example:
+/// @code
+///   RelaxedConcurrentPriorityQueue<Task, TaskDeadlineGreater> tasks;
+///   tasks.push(task);
+///   ...
+///   Task next;
+///   tasks.pop(next); // blocks until there is a task
+/// @endcode
+
+template <
+    typename T,
+    typename Compare = std::less<T>,
+    typename Mutex = folly::SpinLock,
+    template <typename> class Atom = std::atomic>
+class RelaxedConcurrentPriorityQueue : boost::noncopyable {
+ public:
+  /// numQueues is the number of heaps (0 = twice the number of hardware
+  /// threads).
+  explicit RelaxedConcurrentPriorityQueue(
+      size_t numQueues = 0,
+      bool strict = false,
+      const Compare& comp = Compare())
+      : numQueues_(
+            numQueues ? numQueues
+                      : 2 * std::max(1u, std::thread::hardware_concurrency())),
+        strict_(strict),
+        comp_(comp),
+        queues_(new SubQueue[numQueues_]) {
+    for (size_t i = 0; i < numQueues_; ++i) {
+      queues_[i].heap = Heap(comp_);
+    }
+  }
+
+  /// Returns true iff the priority queue is empty. Not synchronized
+  /// with concurrent operations.
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /// Returns the number of elements. Not synchronized with concurrent
+  /// operations.
+  size_t size() const {
+    size_t result = 0;
+    for (size_t i = 0; i < numQueues_; ++i) {
+      result += queues_[i].size.load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  /// Inserts the provided item, and wakes up a blocked pop() if any.
+  void push(const T& val) {
+    pushImpl(val);
+  }
+
+  void push(T&& val) {
+    pushImpl(std::move(val));
+  }
+
+  /// Non-blocking pop. Succeeds if the priority queue is nonempty.
+  /// Tries once if no time point is provided or until the provided
+  /// time_point is reached. If successful, copies a high priority item
+  /// (the highest in strict mode) and removes it from the queue.
+  template <class Clock = std::chrono::steady_clock>
+  bool tryPop(
+      T& val,
+      const std::chrono::time_point<Clock>& when =
+          std::chrono::time_point<Clock>::min());
+
+  /// Blocking pop. If the priority queue is empty, blocks until it is
+  /// nonempty.
+  void pop(T& val) {
+    tryPop(val, std::chrono::time_point<std::chrono::steady_clock>::max());
+  }
+
+ private:
+  using Heap = std::priority_queue<T, std::vector<T>, Compare>;
+
+  struct SubQueue {
+    Mutex lock;
+    Heap heap;
+    // heap.size(), written under lock, so that pops can skip empty
+    // heaps without locking them.
+    Atom<size_t> size{0};
+    char pad[detail::CacheLocality::kFalseSharingRange];
+  };
+
+  const size_t numQueues_;
+  const bool strict_;
+  Compare comp_;
+  std::unique_ptr<SubQueue[]> queues_;
+  // Threads blocked in tryPop() with a time point, and a counter they
+  // wait on that push() bumps when there are any.
+  Atom<uint32_t> waiters_{0};
+  detail::Futex<Atom> wakeups_{0};
+
+  SubQueue& randomQueue() {
+    auto r = detail::relaxedPriorityQueueRandom();
+    return queues_[(uint64_t(r) * numQueues_) >> 32];
+  }
+
+  void popFrom(SubQueue& q, T& val) {
+    val = q.heap.top();
+    q.heap.pop();
+    q.size.store(q.heap.size(), std::memory_order_relaxed);
+  }
+
+  template <typename V>
+  void pushImpl(V&& val) {
+    bool wake;
+    while (true) {
+      auto& q = randomQueue();
+      std::unique_lock<Mutex> g(q.lock, std::try_to_lock);
+      if (!g) {
+        continue;
+      }
+      q.heap.push(std::forward<V>(val));
+      q.size.store(q.heap.size(), std::memory_order_relaxed);
+      // A waiter registers before it locks each heap to look for work,
+      // so if it found this one empty, the lock makes its registration
+      // visible here.
+      wake = waiters_.load(std::memory_order_relaxed) != 0;
+      break;
+    }
+    if (wake) {
+      wakeups_.fetch_add(1, std::memory_order_release);
+      wakeups_.futexWake(1);
+    }
+  }
+
+  /// Two-choice pop: removes the better of the tops of two random heaps.
+  /// Falls back to a scan if the choices keep landing on empty or busy
+  /// heaps.
+  bool tryPopRelaxed(T& val) {
+    for (size_t attempt = 0; attempt < numQueues_; ++attempt) {
+      SubQueue* first = &randomQueue();
+      SubQueue* second = &randomQueue();
+      if (first->size.load(std::memory_order_relaxed) == 0) {
+        std::swap(first, second);
+      }
+      if (first->size.load(std::memory_order_relaxed) == 0) {
+        continue;
+      }
+      if (second == first ||
+          second->size.load(std::memory_order_relaxed) == 0) {
+        second = nullptr;
+      }
+      std::unique_lock<Mutex> g1(first->lock, std::try_to_lock);
+      if (!g1) {
+        continue;
+      }
+      std::unique_lock<Mutex> g2;
+      if (second) {
+        g2 = std::unique_lock<Mutex>(second->lock, std::try_to_lock);
+      }
+      SubQueue* best = first->heap.empty() ? nullptr : first;
+      if (g2 && !second->heap.empty() &&
+          (!best || comp_(best->heap.top(), second->heap.top()))) {
+        best = second;
+      }
+      if (best) {
+        popFrom(*best, val);
+        return true;
+      }
+    }
+    return tryPopScan(val, false);
+  }
+
+  /// Pops from the first nonempty heap, starting at a random one. With
+  /// lockAll, also locks the heaps that look empty, which blocked pops
+  /// rely on to not miss a push.
+  bool tryPopScan(T& val, bool lockAll) {
+    size_t start = &randomQueue() - queues_.get();
+    for (size_t i = 0; i < numQueues_; ++i) {
+      auto& q = queues_[(start + i) % numQueues_];
+      if (!lockAll && q.size.load(std::memory_order_relaxed) == 0) {
+        continue;
+      }
+      std::lock_guard<Mutex> g(q.lock);
+      if (!q.heap.empty()) {
+        popFrom(q, val);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Locks every heap (in index order, so that strict pops do not
+  /// deadlock with each other) and pops the best top among them.
+  bool tryPopStrict(T& val) {
+    size_t locked = 0;
+    SCOPE_EXIT {
+      for (size_t i = 0; i < locked; ++i) {
+        queues_[i].lock.unlock();
+      }
+    };
+    SubQueue* best = nullptr;
+    for (; locked < numQueues_; ++locked) {
+      auto& q = queues_[locked];
+      q.lock.lock();
+      if (!q.heap.empty() &&
+          (!best || comp_(best->heap.top(), q.heap.top()))) {
+        best = &q;
+      }
+    }
+    if (!best) {
+      return false;
+    }
+    popFrom(*best, val);
+    return true;
+  }
+};
+
+/// Implementation
+
+template <
+    typename T,
+    typename Compare,
+    typename Mutex,
+    template <typename> class Atom>
+template <class Clock>
+inline bool RelaxedConcurrentPriorityQueue<T, Compare, Mutex, Atom>::tryPop(
+    T& val,
+    const std::chrono::time_point<Clock>& when) {
+  if (strict_ ? tryPopStrict(val) : tryPopRelaxed(val)) {
+    return true;
+  }
+  if (when == std::chrono::time_point<Clock>::min()) {
+    return false;
+  }
+  waiters_.fetch_add(1, std::memory_order_acq_rel);
+  SCOPE_EXIT {
+    waiters_.fetch_sub(1, std::memory_order_release);
+  };
+  while (true) {
+    // Read before looking for work: a push after the look bumps it.
+    auto epoch = wakeups_.load(std::memory_order_acquire);
+    if (strict_ ? tryPopStrict(val) : tryPopScan(val, true)) {
+      return true;
+    }
+    if (when == std::chrono::time_point<Clock>::max()) {
+      wakeups_.futexWait(epoch);
+    } else {
+      if (Clock::now() > when) {
+        return false;
+      }
+      wakeups_.futexWaitUntil(epoch, when);
+    }
+  }
+}
+
+} // namespace folly
@@ -0,0 +1,815 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ResizableAtomicHashMap is a concurrent hash map that, unlike
+ * AtomicHashMap, rehashes itself as it grows or as erased entries pile up:
+ *
+ * - Entries live in immutable heap nodes, and the table holds a hash and a
+ *   node pointer per cell. Any copyable key type works; there are no
+ *   reserved empty, locked or erased keys.
+ * - Lookups are lock-free and probe a single table (two while a rehash is
+ *   running), so their cost does not depend on how far the map has grown
+ *   beyond its initial size. AtomicHashMap instead probes one more submap
+ *   for every time it has outgrown its capacity.
+ * - erase() marks the node as erased. Inserting the same key again reuses
+ *   the cell, and rehashing drops erased entries, so the memory of erased
+ *   entries is reclaimed and workloads that churn keys do not run out of
+ *   room.
+ * - When the cells in use reach Config::maxLoadFactor, a new table is
+ *   allocated with room for twice the live entries. It may be larger,
+ *   the same size or smaller than the current one. Entries are migrated
+ *   into it incrementally: every operation that runs during the rehash
+ *   moves a chunk of cells, so no single operation pays for the whole
+ *   table. Writers move the cells on their own key's probe sequence first,
+ *   so a key is never present in both tables.
+ * - Old tables and erased nodes are freed through hazard pointers
+ *   (folly/experimental/hazptr), once no reader can still reach them.
+ *
+ * The price is an indirection: a hit reads the cell and then the node,
+ * where AtomicHashArray reads one cell. Values are returned by copy (or
+ * visited under protection, see forEach()), never by reference.
+ *
+ * All operations are safe to call concurrently, except construction and
+ * destruction. forEach() is weakly consistent: it visits every entry present
+ * for the whole call at least once; entries inserted or erased concurrently
+ * may or may not be visited, and an entry may be visited twice if a rehash
+ * runs during the call.
+ *
+ * Sample usage:
+ *
+ *   ResizableAtomicHashMap<std::string, int64_t> counts(1000);
+ *   counts.insert("foo", 1);
+ *   if (auto count = counts.get("foo")) {
+ *     ...
+ *   }
+ *   counts.erase("foo");
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+#include <boost/noncopyable.hpp>
+#include <glog/logging.h>
+
+#include <folly/Bits.h>
+#include <folly/Hash.h>
+#include <folly/Optional.h>
+#include <folly/ThreadCachedInt.h>
+#include <folly/ThreadLocal.h>
+#include <folly/detail/CacheLocality.h>
+#include <folly/detail/Sleeper.h>
+#include <folly/experimental/hazptr/hazptr.h>
+
+namespace folly {
+
+template <
+    class KeyT,
+    class ValueT,
+    class HashFcn = std::hash<KeyT>,
+    class EqualFcn = std::equal_to<KeyT>>
+class ResizableAtomicHashMap : boost::noncopyable {
+ public:
+  typedef KeyT key_type;
+  typedef ValueT mapped_type;
+  typedef std::pair<const KeyT, ValueT> value_type;
+  typedef HashFcn hasher;
+  typedef EqualFcn key_equal;
+
+  struct Config {
+    // Fraction of the cells in use (by entries, erased entries or replaced
+    // nodes) at which the map rehashes. The new table is sized so that the
+    // live entries fill half of this.
+    double maxLoadFactor;
+    // Minimum number of cells that each operation migrates while a rehash
+    // runs; more when the new table would otherwise fill up before the
+    // rehash is done.
+    size_t migrationChunkSize;
+
+    Config() : maxLoadFactor(0.8), migrationChunkSize(256) {}
+  };
+
+  /**
+   * sizeEst is the number of entries the map is expected to hold. The map
+   * starts with room for it, and never shrinks below that.
+   */
+  explicit ResizableAtomicHashMap(
+      size_t sizeEst,
+      const Config& config = Config(),
+      hazptr::hazptr_domain& domain = hazptr::default_hazptr_domain())
+      : config_(config),
+        minCapacity_(capacityFor(sizeEst)),
+        domain_(domain),
+        root_(newTable(minCapacity_, 0, 0, 1)),
+        hazptrs_([this] { return new CachedHazptr(domain_); }) {}
+
+  ~ResizableAtomicHashMap() {
+    Table* t = root_.load(std::memory_order_acquire);
+    // Finish an interrupted rehash, so that all entries are in one table.
+    while (Table* next = t->next.load(std::memory_order_acquire)) {
+      size_t moved = 0;
+      bool wasEmpty;
+      for (size_t i = 0; i < t->capacity(); ++i) {
+        moved += migrateCell(t, next, i, wasEmpty);
+      }
+      finishMigrated(t, next, moved);
+      t = next;
+    }
+    for (size_t i = 0; i < t->capacity(); ++i) {
+      delete toNode(t->cells[i].word.load(std::memory_order_relaxed));
+    }
+    // If the previous table is still waiting to be reclaimed, its
+    // destruction retires this one.
+    if (t->gate.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete t;
+    }
+  }
+
+  /**
+   * Inserts (key, value) if key is not present. Returns true if it was
+   * inserted, false if key was already present (and the map is unchanged).
+   */
+  bool insert(const KeyT& key, const ValueT& value) {
+    return emplace(key, value);
+  }
+
+  bool insert(const KeyT& key, ValueT&& value) {
+    return emplace(key, std::move(value));
+  }
+
+  /**
+   * Like insert(), but constructs the value from args. The node is only
+   * allocated if key is not present.
+   */
+  template <class... Args>
+  bool emplace(const KeyT& key, Args&&... args) {
+    auto h = hash(key);
+    Node* node = nullptr;
+    auto makeNode = [&]() -> Node* {
+      if (!node) {
+        node = new Node(h, key, std::forward<Args>(args)...);
+      }
+      return node;
+    };
+    if (update(h, [&](Table* t) { return tryInsert(t, key, h, makeNode); })) {
+      return true;
+    }
+    delete node;
+    return false;
+  }
+
+  /**
+   * Erases key. Returns the number of entries erased (0 or 1).
+   */
+  size_t erase(const KeyT& key) {
+    auto h = hash(key);
+    return update(h, [&](Table* t) { return tryErase(t, key, h); }) ? 1 : 0;
+  }
+
+  /**
+   * Returns a copy of the value mapped to key, or none.
+   */
+  Optional<ValueT> get(const KeyT& key) const {
+    Optional<ValueT> result;
+    find(key, [&](const value_type& entry) { result = entry.second; });
+    return result;
+  }
+
+  bool contains(const KeyT& key) const {
+    bool found = false;
+    find(key, [&](const value_type&) { found = true; });
+    return found;
+  }
+
+  /**
+   * Calls fn(const value_type&) for every entry (see the weak consistency
+   * guarantees at the top of this file). The entry stays valid until fn
+   * returns.
+   */
+  template <class Fn>
+  void forEach(Fn fn) const {
+    HazptrHolder holder(*this);
+    auto& hptr = *holder;
+    Optional<hazptr::hazptr_owner<Table>> scratch;
+    Table* t = hptr.get_protected(root_);
+    while (true) {
+      for (size_t i = 0; i < t->capacity(); ++i) {
+        auto w = t->cells[i].word.load(std::memory_order_acquire);
+        // Migrated cells are visited in the next table.
+        if (!isMoved(w) && !(w & kErased)) {
+          if (auto node = toNode(w)) {
+            fn(static_cast<const value_type&>(node->value));
+          }
+        }
+      }
+      Table* next = t->next.load(std::memory_order_acquire);
+      if (!next) {
+        return;
+      }
+      t = advance(t, next, hptr, scratch);
+    }
+  }
+
+  /**
+   * Returns the number of entries. Exact when there are no concurrent
+   * writers; costs a pass over all threads' cached counts.
+   */
+  size_t size() const {
+    return std::max<int64_t>(size_.readFull(), 0);
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /**
+   * Returns the number of cells in the current table.
+   */
+  size_t capacity() const {
+    HazptrHolder holder(*this);
+    return (*holder).get_protected(root_)->capacity();
+  }
+
+ private:
+  // Low bits of a cell word. An erased entry keeps its node, so that the
+  // same key can reuse the cell. While a cell is migrated its word carries
+  // kMoving, and afterwards it is one of the two moved sentinels, which are
+  // never valid node addresses.
+  static constexpr uintptr_t kErased = 1;
+  static constexpr uintptr_t kMoving = 2;
+  static constexpr uintptr_t kMovedEmpty = kMoving;
+  static constexpr uintptr_t kMovedFull = 4 | kMoving;
+  static constexpr uintptr_t kStateMask = 7;
+  static constexpr size_t kMinCapacity = 16;
+  static constexpr size_t kMaxShrink = 8;
+
+  struct alignas(8) Node {
+    template <class... Args>
+    Node(size_t h, const KeyT& key, Args&&... args)
+        : hash(h),
+          value(
+              std::piecewise_construct,
+              std::forward_as_tuple(key),
+              std::forward_as_tuple(std::forward<Args>(args)...)) {}
+
+    const size_t hash;
+    value_type value;
+    Node* nextGarbage{nullptr};
+  };
+
+  struct Cell {
+    // Published right after word, so 0 also means "not yet known".
+    std::atomic<size_t> hash{0};
+    std::atomic<uintptr_t> word{0};
+  };
+
+  struct Table : hazptr::hazptr_obj_base<Table> {
+    Table(
+        size_t capacity,
+        size_t maxUsedCells,
+        size_t reserved,
+        size_t chunkSize,
+        int gateCount,
+        hazptr::hazptr_domain& hazptrDomain)
+        : mask(capacity - 1),
+          maxUsed(maxUsedCells),
+          migrationChunk(chunkSize),
+          cells(new Cell[capacity]),
+          domain(hazptrDomain),
+          gate(gateCount),
+          used(reserved) {}
+
+    ~Table() {
+      for (Node* node = garbage.load(std::memory_order_acquire); node;) {
+        Node* nextNode = node->nextGarbage;
+        delete node;
+        node = nextNode;
+      }
+      // Nodes in next's garbage may have been read through this table.
+      if (Table* nextTable = next.load(std::memory_order_acquire)) {
+        nextTable->release();
+      }
+    }
+
+    size_t capacity() const {
+      return mask + 1;
+    }
+
+    /**
+     * A table is retired once it has been rehashed away (or the map is
+     * destroyed), and the table before it has been freed.
+     */
+    void release() {
+      if (gate.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        this->retire(domain);
+      }
+    }
+
+    const size_t mask;
+    const size_t maxUsed;
+    // Cells to migrate per operation while this table is a rehash target.
+    const size_t migrationChunk;
+    const std::unique_ptr<Cell[]> cells;
+    hazptr::hazptr_domain& domain;
+    std::atomic<Table*> next{nullptr};
+    std::atomic<int> gate;
+
+    char pad[detail::CacheLocality::kFalseSharingRange];
+
+    // Cells claimed by a key. A rehash target starts with the estimated
+    // number of entries still to be migrated into it.
+    std::atomic<size_t> used;
+    // Cells holding an erased entry.
+    std::atomic<size_t> erased{0};
+    // Nodes replaced or dropped while this table was current; freed with it.
+    std::atomic<Node*> garbage{nullptr};
+    std::atomic<size_t> garbageCount{0};
+    // Rehash progress: the next chunk to migrate, and cells migrated.
+    std::atomic<size_t> migrateCursor{0};
+    std::atomic<size_t> migrated{0};
+  };
+
+  enum class Result { kFalse, kTrue, kMoved, kFull };
+
+  // Acquiring a hazard pointer costs more than a lookup, so each thread
+  // keeps one per map.
+  struct CachedHazptr {
+    explicit CachedHazptr(hazptr::hazptr_domain& domain) : owner(domain) {}
+
+    hazptr::hazptr_owner<Table> owner;
+    bool inUse{false};
+  };
+
+  /**
+   * The calling thread's cached hazard pointer, or, for a nested call (from
+   * a forEach() callback), a new one.
+   */
+  class HazptrHolder : boost::noncopyable {
+   public:
+    explicit HazptrHolder(const ResizableAtomicHashMap& map)
+        : cached_(map.hazptrs_.get()) {
+      if (cached_->inUse) {
+        cached_ = nullptr;
+        own_.emplace(map.domain_);
+      } else {
+        cached_->inUse = true;
+      }
+    }
+
+    ~HazptrHolder() {
+      if (cached_) {
+        cached_->owner.clear();
+        cached_->inUse = false;
+      }
+    }
+
+    hazptr::hazptr_owner<Table>& operator*() {
+      return cached_ ? cached_->owner : *own_;
+    }
+
+   private:
+    CachedHazptr* cached_;
+    Optional<hazptr::hazptr_owner<Table>> own_;
+  };
+
+  static Node* toNode(uintptr_t word) {
+    return reinterpret_cast<Node*>(word & ~kStateMask);
+  }
+
+  static uintptr_t toWord(Node* node) {
+    return reinterpret_cast<uintptr_t>(node);
+  }
+
+  static bool isMoved(uintptr_t word) {
+    return word == kMovedEmpty || word == kMovedFull;
+  }
+
+  size_t hash(const KeyT& key) const {
+    return hash::twang_mix64(hasher_(key));
+  }
+
+  size_t capacityFor(size_t entries) const {
+    return std::max(
+        kMinCapacity,
+        nextPowTwo(static_cast<size_t>(entries / config_.maxLoadFactor) + 1));
+  }
+
+  Table* newTable(
+      size_t capacity,
+      size_t reserved,
+      size_t chunkSize,
+      int gateCount) const {
+    return new Table(
+        capacity,
+        static_cast<size_t>(capacity * config_.maxLoadFactor),
+        reserved,
+        chunkSize,
+        gateCount,
+        domain_);
+  }
+
+  bool matches(const Cell& cell, uintptr_t word, const KeyT& key, size_t h)
+      const {
+    const Node* node = toNode(word);
+    auto cellHash = cell.hash.load(std::memory_order_acquire);
+    if (cellHash == 0) {
+      cellHash = node->hash;
+    }
+    return cellHash == h && equal_(node->value.first, key);
+  }
+
+  static void pushGarbage(Table* t, Node* node) {
+    node->nextGarbage = t->garbage.load(std::memory_order_relaxed);
+    while (!t->garbage.compare_exchange_weak(
+        node->nextGarbage, node, std::memory_order_release)) {
+    }
+    t->garbageCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Moves from t, protected by hptr, to t->next. Returns the table to
+   * continue with, protected by hptr: next, or the root if next may already
+   * have been retired.
+   */
+  Table* advance(
+      Table* t,
+      Table* next,
+      hazptr::hazptr_owner<Table>& hptr,
+      Optional<hazptr::hazptr_owner<Table>>& scratch) const {
+    if (!scratch) {
+      scratch.emplace(domain_);
+    }
+    // t->next never changes; this sets the hazard pointer and orders it
+    // before the check below. next is not retired before root_ moves past
+    // it.
+    scratch->try_protect(next, t->next);
+    Table* root = root_.load(std::memory_order_acquire);
+    if (root == t || root == next) {
+      hptr.swap(*scratch);
+      return next;
+    }
+    return hptr.get_protected(root_);
+  }
+
+  /**
+   * Returns the word of the cell holding key in t, without kMoving, or 0 if
+   * key is not in t, or kMovedEmpty if it has to be looked up in t->next.
+   */
+  uintptr_t probe(const Table* t, const KeyT& key, size_t h) const {
+    const Cell* cells = t->cells.get();
+    bool sawMoved = false;
+    for (size_t i = h & t->mask, probes = 0; probes <= t->mask;
+         i = (i + 1) & t->mask, ++probes) {
+      auto w = cells[i].word.load(std::memory_order_acquire);
+      if (w == 0 || w == kMovedEmpty) {
+        return sawMoved || w == kMovedEmpty ? kMovedEmpty : 0;
+      }
+      if (w == kMovedFull) {
+        // Maybe key's own cell; keep going in case it is further along.
+        sawMoved = true;
+      } else if (matches(cells[i], w, key, h)) {
+        // Writers wait for a moving cell, so its node is still current.
+        return w & ~kMoving;
+      }
+    }
+    return sawMoved ? kMovedEmpty : 0;
+  }
+
+  template <class Fn>
+  void find(const KeyT& key, Fn fn) const {
+    auto h = hash(key);
+    HazptrHolder holder(*this);
+    auto& hptr = *holder;
+    Optional<hazptr::hazptr_owner<Table>> scratch;
+    Table* t = hptr.get_protected(root_);
+    while (true) {
+      auto w = probe(t, key, h);
+      if (w != kMovedEmpty) {
+        if (!(w & kErased)) {
+          if (auto node = toNode(w)) {
+            fn(static_cast<const value_type&>(node->value));
+          }
+        }
+        return;
+      }
+      t = advance(t, t->next.load(std::memory_order_acquire), hptr, scratch);
+    }
+  }
+
+  /**
+   * Runs op on the current table: first, if a rehash is running, after
+   * migrating the cells on key's probe sequence and one more chunk, and,
+   * if op finds the table full, after starting a rehash.
+   */
+  template <class Op>
+  bool update(size_t h, Op op) {
+    HazptrHolder holder(*this);
+    auto& hptr = *holder;
+    Optional<hazptr::hazptr_owner<Table>> scratch;
+    detail::Sleeper sleeper;
+    Table* t = hptr.get_protected(root_);
+    while (true) {
+      if (Table* next = t->next.load(std::memory_order_acquire)) {
+        migrateChain(t, next, h);
+        migrateChunk(t, next);
+        t = advance(t, next, hptr, scratch);
+        continue;
+      }
+      switch (op(t)) {
+        case Result::kFalse:
+          return false;
+        case Result::kTrue:
+          return true;
+        case Result::kMoved:
+          // A rehash of t started; t->next is set.
+          break;
+        case Result::kFull:
+          if (t == root_.load(std::memory_order_acquire)) {
+            startRehash(t);
+            break;
+          }
+          // t is the target of a rehash that has to finish first.
+          t = hptr.get_protected(root_);
+          if (Table* next = t->next.load(std::memory_order_acquire)) {
+            while (migrateChunk(t, next)) {
+            }
+            sleeper.wait();
+          }
+          break;
+      }
+    }
+  }
+
+  template <class MakeNode>
+  Result tryInsert(Table* t, const KeyT& key, size_t h, MakeNode& makeNode) {
+    Cell* cells = t->cells.get();
+    size_t i = h & t->mask;
+    for (size_t probes = 0; probes <= t->mask;) {
+      auto& cell = cells[i];
+      auto w = cell.word.load(std::memory_order_acquire);
+      if (w == 0) {
+        if (t->used.load(std::memory_order_relaxed) +
+                t->garbageCount.load(std::memory_order_relaxed) >=
+            t->maxUsed) {
+          return Result::kFull;
+        }
+        if (cell.word.compare_exchange_strong(
+                w,
+                toWord(makeNode()),
+                std::memory_order_acq_rel,
+                std::memory_order_acquire)) {
+          cell.hash.store(h, std::memory_order_release);
+          t->used.fetch_add(1, std::memory_order_relaxed);
+          ++size_;
+          return Result::kTrue;
+        }
+        // Lost the cell; look at what took it.
+      }
+      if (w & kMoving) {
+        return Result::kMoved;
+      }
+      if (matches(cell, w, key, h)) {
+        if (!(w & kErased)) {
+          return Result::kFalse;
+        }
+        if (cell.word.compare_exchange_strong(
+                w,
+                toWord(makeNode()),
+                std::memory_order_acq_rel,
+                std::memory_order_acquire)) {
+          pushGarbage(t, toNode(w));
+          t->erased.fetch_sub(1, std::memory_order_relaxed);
+          ++size_;
+          return Result::kTrue;
+        }
+        continue;
+      }
+      i = (i + 1) & t->mask;
+      ++probes;
+    }
+    return Result::kFull;
+  }
+
+  Result tryErase(Table* t, const KeyT& key, size_t h) {
+    Cell* cells = t->cells.get();
+    size_t i = h & t->mask;
+    for (size_t probes = 0; probes <= t->mask;) {
+      auto& cell = cells[i];
+      auto w = cell.word.load(std::memory_order_acquire);
+      if (w == 0) {
+        return Result::kFalse;
+      }
+      if (w & kMoving) {
+        return Result::kMoved;
+      }
+      if (matches(cell, w, key, h)) {
+        if (w & kErased) {
+          return Result::kFalse;
+        }
+        if (cell.word.compare_exchange_strong(
+                w,
+                w | kErased,
+                std::memory_order_acq_rel,
+                std::memory_order_acquire)) {
+          t->erased.fetch_add(1, std::memory_order_relaxed);
+          --size_;
+          return Result::kTrue;
+        }
+        continue;
+      }
+      i = (i + 1) & t->mask;
+      ++probes;
+    }
+    return Result::kFalse;
+  }
+
+  void startRehash(Table* t) {
+    if (t->next.load(std::memory_order_acquire)) {
+      return;
+    }
+    auto used = t->used.load(std::memory_order_relaxed);
+    auto erased = t->erased.load(std::memory_order_relaxed);
+    size_t live = used > erased ? used - erased : 0;
+    // Shrink gradually, so that the rehash can stay incremental.
+    auto capacity = std::max(
+        {minCapacity_, capacityFor(2 * live), t->capacity() / kMaxShrink});
+    // Migrate fast enough to finish before half of the room for new
+    // entries in the new table is used up.
+    auto room = std::max<size_t>(
+        static_cast<size_t>(capacity * config_.maxLoadFactor) - live, 2);
+    auto chunkSize =
+        std::max(config_.migrationChunkSize, 2 * t->capacity() / room + 1);
+    Table* next = newTable(capacity, live, chunkSize, 2);
+    Table* expected = nullptr;
+    if (!t->next.compare_exchange_strong(
+            expected, next, std::memory_order_acq_rel)) {
+      delete next;
+    }
+  }
+
+  /**
+   * Migrates cell i of t into next, unless that is already done. Returns
+   * true if this call did it; sets wasEmpty if the cell held no entry.
+   */
+  bool migrateCell(Table* t, Table* next, size_t i, bool& wasEmpty) {
+    auto& cell = t->cells[i];
+    detail::Sleeper sleeper;
+    auto w = cell.word.load(std::memory_order_acquire);
+    while (true) {
+      if (isMoved(w)) {
+        wasEmpty = w == kMovedEmpty;
+        return false;
+      }
+      if (w & kMoving) {
+        sleeper.wait();
+        w = cell.word.load(std::memory_order_acquire);
+        continue;
+      }
+      if (w == 0) {
+        if (cell.word.compare_exchange_weak(
+                w, kMovedEmpty, std::memory_order_acq_rel)) {
+          wasEmpty = true;
+          return true;
+        }
+        continue;
+      }
+      if (cell.word.compare_exchange_weak(
+              w, w | kMoving, std::memory_order_acq_rel)) {
+        break;
+      }
+    }
+    Node* node = toNode(w);
+    if (w & kErased) {
+      pushGarbage(t, node);
+    } else {
+      insertMigrated(next, node);
+    }
+    cell.word.store(kMovedFull, std::memory_order_release);
+    wasEmpty = false;
+    return true;
+  }
+
+  /**
+   * Links node into an empty cell of next. No other cell of next holds its
+   * key: writers of that key wait until the migration of its cell is done.
+   */
+  static void insertMigrated(Table* next, Node* node) {
+    Cell* cells = next->cells.get();
+    for (size_t i = node->hash & next->mask, probes = 0;
+         probes <= next->mask;
+         i = (i + 1) & next->mask, ++probes) {
+      uintptr_t expected = 0;
+      if (cells[i].word.load(std::memory_order_relaxed) == 0 &&
+          cells[i].word.compare_exchange_strong(
+              expected, toWord(node), std::memory_order_acq_rel)) {
+        cells[i].hash.store(node->hash, std::memory_order_release);
+        return;
+      }
+    }
+    // Impossible: next was sized with room for everything in t.
+    LOG(FATAL) << "ResizableAtomicHashMap: no room to migrate an entry";
+  }
+
+  /**
+   * Migrates the cells on the probe sequence of hash h, up to the first
+   * empty one, so that the key is in next if it is present at all.
+   */
+  void migrateChain(Table* t, Table* next, size_t h) {
+    size_t moved = 0;
+    bool wasEmpty = false;
+    for (size_t i = h & t->mask, probes = 0; probes <= t->mask && !wasEmpty;
+         i = (i + 1) & t->mask, ++probes) {
+      moved += migrateCell(t, next, i, wasEmpty);
+    }
+    finishMigrated(t, next, moved);
+  }
+
+  /**
+   * Migrates the next chunk of cells that nobody has claimed yet. Returns
+   * false if there was none.
+   */
+  bool migrateChunk(Table* t, Table* next) {
+    if (t->migrateCursor.load(std::memory_order_relaxed) >= t->capacity()) {
+      return false;
+    }
+    size_t begin = t->migrateCursor.fetch_add(
+        next->migrationChunk, std::memory_order_relaxed);
+    if (begin >= t->capacity()) {
+      return false;
+    }
+    size_t end = std::min(begin + next->migrationChunk, t->capacity());
+    size_t moved = 0;
+    bool wasEmpty;
+    for (size_t i = begin; i < end; ++i) {
+      moved += migrateCell(t, next, i, wasEmpty);
+    }
+    finishMigrated(t, next, moved);
+    return true;
+  }
+
+  /**
+   * Accounts for moved cells; whoever moves the last one makes next the
+   * root. Only the root is ever rehashed, so t is the root until then.
+   */
+  void finishMigrated(Table* t, Table* next, size_t moved) {
+    if (moved != 0 &&
+        t->migrated.fetch_add(moved, std::memory_order_acq_rel) + moved ==
+            t->capacity()) {
+      root_.store(next, std::memory_order_release);
+      t->release();
+    }
+  }
+
+  const Config config_;
+  const size_t minCapacity_;
+  hasher hasher_;
+  key_equal equal_;
+  hazptr::hazptr_domain& domain_;
+  std::atomic<Table*> root_;
+  ThreadLocal<CachedHazptr> hazptrs_;
+  ThreadCachedInt<int64_t> size_;
+};
+
+template <class KeyT, class ValueT, class HashFcn, class EqualFcn>
+constexpr uintptr_t
+    ResizableAtomicHashMap<KeyT, ValueT, HashFcn, EqualFcn>::kErased;
+template <class KeyT, class ValueT, class HashFcn, class EqualFcn>
+constexpr uintptr_t
+    ResizableAtomicHashMap<KeyT, ValueT, HashFcn, EqualFcn>::kMoving;
+template <class KeyT, class ValueT, class HashFcn, class EqualFcn>
+constexpr uintptr_t
+    ResizableAtomicHashMap<KeyT, ValueT, HashFcn, EqualFcn>::kMovedEmpty;
+template <class KeyT, class ValueT, class HashFcn, class EqualFcn>
+constexpr uintptr_t
+    ResizableAtomicHashMap<KeyT, ValueT, HashFcn, EqualFcn>::kMovedFull;
+template <class KeyT, class ValueT, class HashFcn, class EqualFcn>
+constexpr uintptr_t
+    ResizableAtomicHashMap<KeyT, ValueT, HashFcn, EqualFcn>::kStateMask;
+template <class KeyT, class ValueT, class HashFcn, class EqualFcn>
+constexpr size_t
+    ResizableAtomicHashMap<KeyT, ValueT, HashFcn, EqualFcn>::kMinCapacity;
+template <class KeyT, class ValueT, class HashFcn, class EqualFcn>
+constexpr size_t
+    ResizableAtomicHashMap<KeyT, ValueT, HashFcn, EqualFcn>::kMaxShrink;
+
+} // namespace folly
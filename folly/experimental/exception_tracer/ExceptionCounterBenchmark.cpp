@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/Benchmark.h>
+#include <folly/experimental/exception_tracer/ExceptionCounterLib.h>
+#include <folly/portability/GFlags.h>
+
+using namespace folly::exception_tracer;
+
+namespace {
+
+void recurse(int level) {
+  if (level == 0) {
+    throw std::runtime_error("");
+  }
+  recurse(level - 1);
+  folly::doNotOptimizeAway(0);  // prevent tail recursion
+}
+
+// Cost per throw (and catch) of a 20 frames deep exception
+void run(size_t iters, ExceptionSamplingOptions options) {
+  setExceptionSamplingOptions(options);
+  for (size_t i = 0; i < iters; ++i) {
+    try {
+      recurse(20);
+    } catch (const std::exception& e) {
+      folly::doNotOptimizeAway(e);
+    }
+  }
+  folly::BenchmarkSuspender suspender;
+  setExceptionSamplingOptions({});
+  getExceptionStatistics();
+}
+
+void throwOnce(ExceptionSamplingOptions options) {
+  if (getExceptionSamplingOptions().sampleRate != options.sampleRate) {
+    setExceptionSamplingOptions(options);
+  }
+  try {
+    recurse(20);
+  } catch (const std::exception& e) {
+    folly::doNotOptimizeAway(e);
+  }
+}
+
+} // namespace
+
+BENCHMARK(ThrowNotCounted, iters) {
+  run(iters, {0, 0});
+}
+
+BENCHMARK_RELATIVE(ThrowCountedEveryStack, iters) {
+  run(iters, {1, 0});
+}
+
+BENCHMARK_RELATIVE(ThrowSampled1In10, iters) {
+  run(iters, {10, 0});
+}
+
+BENCHMARK_RELATIVE(ThrowSampled1In1000, iters) {
+  run(iters, {1000, 0});
+}
+
+BENCHMARK_RELATIVE(ThrowRateLimited100PerSec, iters) {
+  run(iters, {1, 100});
+}
+
+BENCHMARK_DRAW_LINE();
+
+// Contention between throwing threads: one throw per call
+BENCHMARK_MULTITHREADED(ThrowCountedEveryStackMT) {
+  throwOnce({1, 0});
+}
+
+BENCHMARK_MULTITHREADED(ThrowSampled1In1000MT) {
+  throwOnce({1000, 0});
+}
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  folly::runBenchmarks();
+  return 0;
+}
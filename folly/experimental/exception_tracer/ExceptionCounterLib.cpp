@@ -16,9 +16,15 @@
 
 #include <folly/experimental/exception_tracer/ExceptionCounterLib.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <iosfwd>
+#include <mutex>
 #include <unordered_map>
 
+#include <folly/Random.h>
 #include <folly/Range.h>
 #include <folly/RWSpinLock.h>
 #include <folly/SpookyHashV2.h>
@@ -40,20 +46,187 @@ using ExceptionId = uint64_t;
 using ExceptionStatsHolderType =
     std::unordered_map<ExceptionId, ExceptionStats>;
 
-struct ExceptionStatsStorage {
-  void appendTo(ExceptionStatsHolderType& data) {
-    ExceptionStatsHolderType tempHolder;
-    statsHolder->swap(tempHolder);
+std::atomic<uint32_t> gSampleRate{1};
+std::atomic<uint32_t> gMaxSamplesPerTypePerSecond{0};
+
+// Serializes readers, and readers with exiting threads.
+std::mutex gMergeMutex;
+
+// Statistics of threads that exited since the last read, under gMergeMutex.
+// Leaked, as threads may exit during static destruction.
+ExceptionStatsHolderType& exitedThreadStats() {
+  static auto stats = new ExceptionStatsHolderType();
+  return *stats;
+}
+
+void addTo(
+    ExceptionStatsHolderType& data,
+    ExceptionId id,
+    const ExceptionInfo& info,
+    uint64_t count) {
+  auto inserted = data.emplace(id, ExceptionStats{count, info});
+  if (!inserted.second) {
+    inserted.first->second.count += count;
+  }
+}
+
+void appendAll(
+    ExceptionStatsHolderType& data,
+    ExceptionStatsHolderType& from) {
+  for (const auto& item : from) {
+    addTo(data, item.first, item.second.info, item.second.count);
+  }
+  from.clear();
+}
+
+/*
+ * Per-thread statistics. The owning thread records into a fixed-size open
+ * addressing table without locks or atomic read-modify-writes; readers
+ * (under gMergeMutex) compute what changed since their last visit. Stacks
+ * that don't fit in the table go to a locked overflow map.
+ */
+class ExceptionStatsStorage {
+ public:
+  ~ExceptionStatsStorage() {
+    {
+      std::lock_guard<std::mutex> lock(gMergeMutex);
+      appendTo(exitedThreadStats());
+    }
+    for (auto& entry : table_) {
+      delete entry.info.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Owning thread only
+  void add(
+      ExceptionId id,
+      const std::type_info* type,
+      const uintptr_t* frames,
+      size_t frameCount,
+      uint64_t count) {
+    if (id == 0) {
+      id = 1;  // 0 marks empty slots
+    }
+    for (size_t i = 0; i < kMaxProbes; ++i) {
+      auto& entry = table_[(id + i) % kTableSize];
+      auto entryId = entry.id.load(std::memory_order_relaxed);
+      if (entryId == id) {
+        entry.count.store(
+            entry.count.load(std::memory_order_relaxed) + count,
+            std::memory_order_release);
+        return;
+      }
+      if (entryId == 0) {
+        auto info = new ExceptionInfo;
+        info->type = type;
+        info->frames.assign(frames, frames + frameCount);
+        entry.info.store(info, std::memory_order_relaxed);
+        entry.count.store(count, std::memory_order_relaxed);
+        entry.id.store(id, std::memory_order_release);
+        return;
+      }
+    }
 
-    for (const auto& myData : tempHolder) {
-      auto inserted = data.insert(myData);
-      if (!inserted.second) {
-        inserted.first->second.count += myData.second.count;
+    SYNCHRONIZED(holder, overflow_) {
+      auto it = holder.find(id);
+      if (it != holder.end()) {
+        it->second.count += count;
+      } else {
+        ExceptionInfo info;
+        info.type = type;
+        info.frames.assign(frames, frames + frameCount);
+        holder.emplace(id, ExceptionStats{count, std::move(info)});
       }
     }
   }
 
-  folly::Synchronized<ExceptionStatsHolderType, folly::RWSpinLock> statsHolder;
+  // Owning thread only. Decides whether this throw is sampled, drawing
+  // gaps uniformly from [1, 2 * sampleRate - 1] so periodic throw patterns
+  // don't alias with the sampling.
+  bool sample(uint32_t sampleRate) {
+    if (throwsUntilSample_ > 1) {
+      --throwsUntilSample_;
+      return false;
+    }
+    throwsUntilSample_ = folly::Random::rand32(1, 2 * sampleRate);
+    return true;
+  }
+
+  // Owning thread only. Token bucket per exception type.
+  bool withinRateLimit(const std::type_info* type, uint32_t perSecond) {
+    auto now = std::chrono::steady_clock::now();
+    TypeBudget* budget = nullptr;
+    for (auto& b : budgets_) {
+      if (b.type == type) {
+        budget = &b;
+        break;
+      }
+    }
+    if (!budget) {
+      if (budgets_.size() == kMaxTypeBudgets) {
+        return true;
+      }
+      budgets_.push_back(TypeBudget{type, double(perSecond), now});
+      budget = &budgets_.back();
+    }
+    std::chrono::duration<double> elapsed = now - budget->refill;
+    budget->tokens = std::min<double>(
+        perSecond, budget->tokens + elapsed.count() * perSecond);
+    budget->refill = now;
+    if (budget->tokens < 1) {
+      return false;
+    }
+    budget->tokens -= 1;
+    return true;
+  }
+
+  // Under gMergeMutex
+  void appendTo(ExceptionStatsHolderType& data) {
+    for (auto& entry : table_) {
+      auto id = entry.id.load(std::memory_order_acquire);
+      if (id == 0) {
+        continue;
+      }
+      auto count = entry.count.load(std::memory_order_acquire);
+      if (count != entry.reported) {
+        addTo(
+            data,
+            id,
+            *entry.info.load(std::memory_order_relaxed),
+            count - entry.reported);
+        entry.reported = count;
+      }
+    }
+
+    ExceptionStatsHolderType tempHolder;
+    overflow_->swap(tempHolder);
+    appendAll(data, tempHolder);
+  }
+
+ private:
+  static constexpr size_t kTableSize = 512;
+  static constexpr size_t kMaxProbes = 16;
+  static constexpr size_t kMaxTypeBudgets = 64;
+
+  struct Entry {
+    std::atomic<ExceptionId> id{0};
+    std::atomic<uint64_t> count{0};
+    std::atomic<ExceptionInfo*> info{nullptr};
+    // Value of count at the last read, under gMergeMutex
+    uint64_t reported{0};
+  };
+
+  struct TypeBudget {
+    const std::type_info* type;
+    double tokens;
+    std::chrono::steady_clock::time_point refill;
+  };
+
+  std::array<Entry, kTableSize> table_;
+  folly::Synchronized<ExceptionStatsHolderType, folly::RWSpinLock> overflow_;
+
+  uint32_t throwsUntilSample_{0};
+  std::vector<TypeBudget> budgets_;
 };
 
 class Tag {};
@@ -65,10 +238,28 @@ folly::ThreadLocal<ExceptionStatsStorage, Tag> gExceptionStats;
 namespace folly {
 namespace exception_tracer {
 
+void setExceptionSamplingOptions(const ExceptionSamplingOptions& options) {
+  gSampleRate.store(options.sampleRate, std::memory_order_relaxed);
+  gMaxSamplesPerTypePerSecond.store(
+      options.maxSamplesPerTypePerSecond, std::memory_order_relaxed);
+}
+
+ExceptionSamplingOptions getExceptionSamplingOptions() {
+  ExceptionSamplingOptions options;
+  options.sampleRate = gSampleRate.load(std::memory_order_relaxed);
+  options.maxSamplesPerTypePerSecond =
+      gMaxSamplesPerTypePerSecond.load(std::memory_order_relaxed);
+  return options;
+}
+
 std::vector<ExceptionStats> getExceptionStatistics() {
   ExceptionStatsHolderType accumulator;
-  for (auto& threadStats : gExceptionStats.accessAllThreads()) {
-    threadStats.appendTo(accumulator);
+  {
+    std::lock_guard<std::mutex> lock(gMergeMutex);
+    appendAll(accumulator, exitedThreadStats());
+    for (auto& threadStats : gExceptionStats.accessAllThreads()) {
+      threadStats.appendTo(accumulator);
+    }
   }
 
   std::vector<ExceptionStats> result;
@@ -104,11 +295,24 @@ namespace {
  * Information is being stored in thread local storage.
  */
 void throwHandler(void*, std::type_info* exType, void (*)(void*)) noexcept {
+  auto sampleRate = gSampleRate.load(std::memory_order_relaxed);
+  if (sampleRate == 0) {
+    return;
+  }
+  auto& storage = *gExceptionStats;
+  if (sampleRate > 1 && !storage.sample(sampleRate)) {
+    return;
+  }
+
   // This array contains the exception type and the stack frame
   // pointers so they get all hashed together.
   uintptr_t frames[kMaxFrames + 1];
   frames[0] = reinterpret_cast<uintptr_t>(exType);
-  auto n = folly::symbolizer::getStackTrace(frames + 1, kMaxFrames);
+  ssize_t n = 0;
+  auto perSecond = gMaxSamplesPerTypePerSecond.load(std::memory_order_relaxed);
+  if (perSecond == 0 || storage.withinRateLimit(exType, perSecond)) {
+    n = folly::symbolizer::getStackTrace(frames + 1, kMaxFrames);
+  }
 
   if (n == -1) {
     // If we fail to collect the stack trace for this exception we
@@ -119,17 +323,7 @@ void throwHandler(void*, std::type_info* exType, void (*)(void*)) noexcept {
   auto exceptionId =
       folly::hash::SpookyHashV2::Hash64(frames, (n + 1) * sizeof(frames[0]), 0);
 
-  SYNCHRONIZED(holder, gExceptionStats->statsHolder) {
-    auto it = holder.find(exceptionId);
-    if (it != holder.end()) {
-      ++it->second.count;
-    } else {
-      ExceptionInfo info;
-      info.type = exType;
-      info.frames.assign(frames + 1, frames + 1 + n);
-      holder.emplace(exceptionId, ExceptionStats{1, std::move(info)});
-    }
-  }
+  storage.add(exceptionId, exType, frames + 1, n, sampleRate);
 }
 
 struct Initializer {
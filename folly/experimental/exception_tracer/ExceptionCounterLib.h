@@ -25,15 +25,39 @@ namespace folly {
 namespace exception_tracer {
 
 struct ExceptionStats {
+  // Number of throws; an estimate (a multiple of the sample rate) when
+  // sampling is enabled.
   uint64_t count;
   ExceptionInfo info;
 };
 
 /**
- * This function accumulates exception throwing statistics across all threads.
- * Please note, that during call to this function, other threads might block
- * on exception throws, so it should be called seldomly.
- * All pef-thread statistics is being reset by the call.
+ * Controls the cost of exception counting on the throw path.
+ *
+ * With sampleRate > 1, only about one in sampleRate throws captures a stack
+ * trace, and each captured throw counts for sampleRate throws. Counts stay
+ * unbiased estimates; rare throw sites may be missed.
+ *
+ * With maxSamplesPerTypePerSecond != 0, each thread captures at most that
+ * many stacks per second for a given exception type. Throws over the limit
+ * are still counted, under their type with an empty stack trace.
+ */
+struct ExceptionSamplingOptions {
+  // 1: count every throw with its stack (the default); 0: count nothing
+  uint32_t sampleRate{1};
+  // 0: unlimited
+  uint32_t maxSamplesPerTypePerSecond{0};
+};
+
+void setExceptionSamplingOptions(const ExceptionSamplingOptions& options);
+ExceptionSamplingOptions getExceptionSamplingOptions();
+
+/**
+ * This function accumulates exception throwing statistics across all threads,
+ * including threads that exited since the last call.
+ * Throwing threads never block on it: they update their own lock-free table,
+ * which this function merges.
+ * All per-thread statistics is being reset by the call.
  */
 std::vector<ExceptionStats> getExceptionStatistics();
 
@@ -129,3 +129,55 @@ TEST(ExceptionCounter, multyThreads) {
     t.join();
   }
 }
+
+TEST(ExceptionCounter, exitedThreads) {
+  std::thread([] {
+    for (size_t i = 0; i < 10; ++i) {
+      throwAndCatch(foo);
+    }
+  }).join();
+  auto stats = getExceptionStatistics();
+  ASSERT_EQ(stats.size(), 1);
+  EXPECT_EQ(stats[0].count, 10);
+}
+
+TEST(ExceptionCounter, disabled) {
+  setExceptionSamplingOptions({0, 0});
+  throwAndCatch(foo);
+  setExceptionSamplingOptions({});
+  EXPECT_EQ(getExceptionStatistics().size(), 0);
+}
+
+TEST(ExceptionCounter, sampled) {
+  constexpr size_t kNumIterations = 10000;
+  setExceptionSamplingOptions({10, 0});
+  for (volatile size_t i = 0; i < kNumIterations; ++i) {
+    throwAndCatch(bar);
+  }
+  setExceptionSamplingOptions({});
+
+  auto stats = getExceptionStatistics();
+  ASSERT_EQ(stats.size(), 1);
+  EXPECT_EQ(stats[0].count % 10, 0);
+  // About 1000 samples, so well within 20% of the real count
+  EXPECT_GT(stats[0].count, kNumIterations * 8 / 10);
+  EXPECT_LT(stats[0].count, kNumIterations * 12 / 10);
+}
+
+TEST(ExceptionCounter, rateLimited) {
+  setExceptionSamplingOptions({1, 5});
+  for (volatile int i = 0; i < 100; ++i) {
+    throwAndCatch(foo);
+  }
+  setExceptionSamplingOptions({});
+
+  auto stats = getExceptionStatistics();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_EQ(stats[0].count + stats[1].count, 100);
+  // Over the limit: counted without a stack trace
+  EXPECT_TRUE(stats[0].info.frames.empty());
+  EXPECT_EQ(*(stats[0].info.type), typeid(MyException));
+  EXPECT_GE(stats[1].count, 5);
+  EXPECT_LT(stats[1].count, 10);
+  EXPECT_FALSE(stats[1].info.frames.empty());
+}
@@ -23,6 +23,8 @@
 #include <cstddef>
 #include <memory>
 
+#include <folly/experimental/hazptr/debug.h>
+
 namespace folly {
 namespace hazptr {
 
@@ -45,7 +47,6 @@ memory_resource* new_delete_resource();
 ////////////////////////////////////////////////////////////////////////////////
 /// Implementation
 ////////////////////////////////////////////////////////////////////////////////
-#include <folly/experimental/hazptr/debug.h>
 
 inline memory_resource** default_mr_ptr() {
   /* library-local */ static memory_resource* default_mr =
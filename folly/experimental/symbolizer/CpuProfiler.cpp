@@ -0,0 +1,517 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/symbolizer/CpuProfiler.h>
+
+#include <dirent.h>
+#include <sched.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <glog/logging.h>
+
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/Hash.h>
+#include <folly/ScopeGuard.h>
+#include <folly/experimental/LockFreeRingBuffer.h>
+#include <folly/experimental/symbolizer/StackTrace.h>
+#include <folly/experimental/symbolizer/Symbolizer.h>
+#include <folly/portability/SysSyscall.h>
+#include <folly/portability/Unistd.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace folly { namespace symbolizer {
+
+namespace {
+
+constexpr uint64_t kThreadStateMagic = 0x70726f66696c6572;  // "profiler"
+
+// Set while timers are armed; the handler ignores signals otherwise.
+std::atomic<bool> gEnabled{false};
+// Number of handlers currently running, so stop() can wait for them before
+// freeing the buffers they write to.
+std::atomic<size_t> gHandlersRunning{0};
+struct sigaction gOldAction;
+
+pid_t currentTid() {
+  return static_cast<pid_t>(syscall(FOLLY_SYS_gettid));
+}
+
+// CPU time clock of an arbitrary thread of this process, by tid.
+// pthread_getcpuclockid() needs a pthread_t, which we don't have for
+// threads found in /proc; this is the encoding the kernel uses
+// (see CPUCLOCK_PERTHREAD_MASK and CPUCLOCK_SCHED in linux/posix-timers.h).
+clockid_t threadCpuClock(pid_t tid) {
+  return static_cast<clockid_t>((~static_cast<unsigned>(tid) << 3) | 6);
+}
+
+uintptr_t interruptedAddress(void* uctx) {
+  auto context = static_cast<ucontext_t*>(uctx);
+#if defined(__x86_64__)
+  return static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+  return static_cast<uintptr_t>(context->uc_mcontext.pc);
+#else
+  (void)context;
+  return 0;
+#endif
+}
+
+std::vector<pid_t> listThreads() {
+  std::vector<pid_t> tids;
+  DIR* dir = opendir("/proc/self/task");
+  if (!dir) {
+    return tids;
+  }
+  SCOPE_EXIT { closedir(dir); };
+  while (auto entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    auto tid = tryTo<pid_t>(entry->d_name);
+    if (tid.hasValue()) {
+      tids.push_back(tid.value());
+    }
+  }
+  return tids;
+}
+
+template <class T>
+void appendWord(std::string& out, T value) {
+  auto word = static_cast<uintptr_t>(value);
+  out.append(reinterpret_cast<const char*>(&word), sizeof(word));
+}
+
+}  // namespace
+
+struct CpuProfiler::ThreadState {
+  struct Sample {
+    uint32_t depth;
+    uintptr_t frames[kMaxStackDepth];
+  };
+
+  explicit ThreadState(uint32_t c) : capacity(c), buffer(c) {}
+
+  const uint64_t magic{kThreadStateMagic};
+  const uint32_t capacity;
+  // The thread sampled into this state while active. Neither is reset
+  // until a signal still queued for the previous thread can't find them
+  // any more, so the handler checks both before writing.
+  std::atomic<pid_t> tid{0};
+  std::atomic<bool> active{false};
+  bool hasTimer{false};
+  timer_t timer;
+  LockFreeRingBuffer<Sample> buffer;
+  // Written only by the signal handler, which is the only writer of
+  // buffer, so this matches the buffer's write tickets (a late signal of a
+  // previous thread may add a sample, which is merely attributed to the
+  // wrong thread).
+  std::atomic<uint64_t> written{0};
+  // Next ticket to read, owned by the collector (under mutex_)
+  uint64_t read{0};
+};
+
+uint64_t CpuProfile::totalSamples() const {
+  uint64_t total = 0;
+  for (auto& p : stacks) {
+    total += p.second;
+  }
+  return total;
+}
+
+std::string CpuProfile::toFolded(IndexedSymbolizer* symbolizer) const {
+  // All frames but the innermost are return addresses; look up the call
+  // instruction instead, so calls at the very end of a function (or
+  // followed by an inlined frame) are attributed correctly.
+  auto lookupAddress = [](const Stack& stack, size_t i) {
+    return i == 0 ? stack[i] : stack[i] - 1;
+  };
+
+  std::vector<uintptr_t> addresses;
+  for (auto& p : stacks) {
+    for (size_t i = 0; i < p.first.size(); ++i) {
+      addresses.push_back(lookupAddress(p.first, i));
+    }
+  }
+  std::sort(addresses.begin(), addresses.end());
+  addresses.erase(
+      std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+  std::unique_ptr<IndexedSymbolizer> ownSymbolizer;
+  if (!symbolizer) {
+    ownSymbolizer = std::make_unique<IndexedSymbolizer>(
+        nullptr, 0, Dwarf::LocationInfoMode::FAST);
+    symbolizer = ownSymbolizer.get();
+  }
+  std::vector<SymbolizedFrame> frames(addresses.size());
+  symbolizer->symbolize(addresses.data(), frames.data(), addresses.size());
+
+  std::vector<std::string> names(addresses.size());
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    if (frames[i].found && frames[i].name) {
+      names[i] = frames[i].demangledName().toStdString();
+    } else {
+      names[i] = sformat("{:#x}", addresses[i]);
+    }
+  }
+
+  std::string out;
+  for (auto& p : stacks) {
+    auto& stack = p.first;
+    for (size_t i = stack.size(); i-- > 0;) {
+      auto pos = std::lower_bound(
+          addresses.begin(), addresses.end(), lookupAddress(stack, i));
+      out += names[pos - addresses.begin()];
+      out += i == 0 ? ' ' : ';';
+    }
+    toAppend(p.second, '\n', &out);
+  }
+  return out;
+}
+
+std::string CpuProfile::toPprof() const {
+  std::string out;
+  // Header: header count, header words, version, period (us), padding
+  appendWord(out, 0);
+  appendWord(out, 3);
+  appendWord(out, 0);
+  appendWord(out, interval.count());
+  appendWord(out, 0);
+  for (auto& p : stacks) {
+    appendWord(out, p.second);
+    appendWord(out, p.first.size());
+    for (auto address : p.first) {
+      appendWord(out, address);
+    }
+  }
+  // Trailer: a single sample of depth 1 at address 0
+  appendWord(out, 0);
+  appendWord(out, 1);
+  appendWord(out, 0);
+
+  std::string maps;
+  readFile("/proc/self/maps", maps);
+  out += maps;
+  return out;
+}
+
+size_t CpuProfiler::StackHash::operator()(
+    const CpuProfile::Stack& stack) const {
+  return hash::hash_range(stack.begin(), stack.end());
+}
+
+CpuProfiler& CpuProfiler::get() {
+  // Leaked: the signal handler may run on other threads during exit.
+  static auto profiler = new CpuProfiler();
+  return *profiler;
+}
+
+CpuProfiler::CpuProfiler() {}
+
+void CpuProfiler::signalHandler(int signum, siginfo_t* info, void* uctx) {
+  gHandlersRunning.fetch_add(1, std::memory_order_acq_rel);
+  SCOPE_EXIT { gHandlersRunning.fetch_sub(1, std::memory_order_acq_rel); };
+
+  auto state = info->si_code == SI_TIMER
+      ? static_cast<ThreadState*>(info->si_value.sival_ptr)
+      : nullptr;
+  if (!state || state->magic != kThreadStateMagic) {
+    // Not one of our timers; pass it on.
+    if (gOldAction.sa_flags & SA_SIGINFO) {
+      if (gOldAction.sa_sigaction) {
+        gOldAction.sa_sigaction(signum, info, uctx);
+      }
+    } else if (
+        gOldAction.sa_handler != SIG_DFL && gOldAction.sa_handler != SIG_IGN) {
+      gOldAction.sa_handler(signum);
+    }
+    return;
+  }
+  if (!gEnabled.load(std::memory_order_acquire) ||
+      !state->active.load(std::memory_order_acquire) ||
+      state->tid.load(std::memory_order_relaxed) != currentTid()) {
+    // Queued before the timer was deleted
+    return;
+  }
+
+  int savedErrno = errno;
+  SCOPE_EXIT { errno = savedErrno; };
+
+  ThreadState::Sample sample;
+  ssize_t n = getStackTraceSafe(sample.frames, kMaxStackDepth);
+  if (n <= 0) {
+    return;
+  }
+  // Drop the frames of the handler itself and the signal trampoline.
+  auto pc = interruptedAddress(uctx);
+  auto begin = std::find(sample.frames, sample.frames + n, pc);
+  if (begin != sample.frames + n) {
+    n -= begin - sample.frames;
+    std::memmove(sample.frames, begin, n * sizeof(uintptr_t));
+  }
+  sample.depth = static_cast<uint32_t>(n);
+  state->buffer.write(sample);
+  state->written.fetch_add(1, std::memory_order_release);
+}
+
+void CpuProfiler::start(const Options& options) {
+  if (options.interval.count() <= 0 || options.bufferCapacity == 0) {
+    throw std::invalid_argument("CpuProfiler: invalid options");
+  }
+
+  static std::once_flag handlerInstalled;
+  std::call_once(handlerInstalled, [] {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    // SA_RESTART, so sampling doesn't make blocking calls fail with EINTR.
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sa.sa_sigaction = &CpuProfiler::signalHandler;
+    checkUnixError(
+        sigaction(SIGPROF, &sa, &gOldAction), "CpuProfiler: sigaction");
+  });
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (running_) {
+    throw std::logic_error("CpuProfiler already running");
+  }
+  options_ = options;
+  running_ = true;
+  collectorTid_ = 0;
+  gEnabled.store(true, std::memory_order_release);
+  collector_ = std::thread([this] { collectorLoop(); });
+  // Don't sample the collector thread
+  cv_.wait(lock, [this] { return collectorTid_ != 0; });
+
+  int err = updateThreads();
+  if (err != 0) {
+    lock.unlock();
+    stop();
+    throwSystemErrorExplicit(err, "CpuProfiler: timer_create");
+  }
+  cv_.notify_all();
+}
+
+void CpuProfiler::stop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  gEnabled.store(false, std::memory_order_release);
+  for (auto& p : threads_) {
+    if (p.second->hasTimer) {
+      timer_delete(p.second->timer);
+      p.second->hasTimer = false;
+    }
+  }
+  cv_.notify_all();
+  lock.unlock();
+  collector_.join();
+
+  // A handler may still be writing a sample. Signals still queued may come
+  // later, and find their states inactive.
+  while (gHandlersRunning.load(std::memory_order_acquire) != 0) {
+    sched_yield();
+  }
+
+  lock.lock();
+  for (auto& p : threads_) {
+    retireThread(p.second);
+  }
+  threads_.clear();
+}
+
+bool CpuProfiler::isRunning() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return running_;
+}
+
+CpuProfile CpuProfiler::getProfile() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  drainAll();
+  CpuProfile profile;
+  profile.interval = options_.interval;
+  profile.lostSamples = lostSamples_;
+  profile.stacks.assign(stacks_.begin(), stacks_.end());
+  std::sort(
+      profile.stacks.begin(),
+      profile.stacks.end(),
+      [](const std::pair<CpuProfile::Stack, uint64_t>& a,
+         const std::pair<CpuProfile::Stack, uint64_t>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+      });
+  return profile;
+}
+
+void CpuProfiler::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  drainAll();
+  stacks_.clear();
+  lostSamples_ = 0;
+}
+
+void CpuProfiler::collectorLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  collectorTid_ = currentTid();
+  cv_.notify_all();
+  // Let start() do the first scan, so it can report errors.
+  cv_.wait(lock, [this] { return !threads_.empty() || !running_; });
+
+  while (running_) {
+    if (cv_.wait_for(lock, options_.drainInterval, [this] {
+          return !running_;
+        })) {
+      break;
+    }
+    updateThreads();
+    drainAll();
+  }
+}
+
+int CpuProfiler::updateThreads() {
+  auto tids = listThreads();
+  std::sort(tids.begin(), tids.end());
+
+  // Threads that exited: their timers will never fire again.
+  for (auto it = threads_.begin(); it != threads_.end();) {
+    if (!std::binary_search(tids.begin(), tids.end(), it->first)) {
+      retireThread(it->second);
+      it = threads_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  int firstError = 0;
+  auto interval = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      options_.interval);
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = interval.count() / 1000000000;
+  spec.it_interval.tv_nsec = interval.count() % 1000000000;
+  spec.it_value = spec.it_interval;
+
+  for (auto tid : tids) {
+    if (tid == collectorTid_) {
+      continue;
+    }
+    auto& state = threads_[tid];
+    if (!state) {
+      state = newThread(tid);
+    }
+    if (state->hasTimer) {
+      // A timer whose thread went away (and whose tid was reused before we
+      // noticed) is disarmed by the kernel; re-create it for the new thread.
+      struct itimerspec current;
+      if (timer_gettime(state->timer, &current) == 0 &&
+          (current.it_value.tv_sec != 0 || current.it_value.tv_nsec != 0)) {
+        continue;
+      }
+      timer_delete(state->timer);
+      state->hasTimer = false;
+    }
+
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_value.sival_ptr = state;
+    event.sigev_notify_thread_id = tid;
+    if (timer_create(threadCpuClock(tid), &event, &state->timer) != 0) {
+      // EINVAL / ESRCH: the thread exited since we listed it.
+      if (errno != EINVAL && errno != ESRCH && firstError == 0) {
+        firstError = errno;
+      }
+      continue;
+    }
+    state->hasTimer = true;
+    if (timer_settime(state->timer, 0, &spec, nullptr) != 0) {
+      if (firstError == 0) {
+        firstError = errno;
+      }
+      timer_delete(state->timer);
+      state->hasTimer = false;
+    }
+  }
+  return firstError;
+}
+
+void CpuProfiler::drain(ThreadState& state) {
+  uint64_t head = state.written.load(std::memory_order_acquire);
+  uint64_t capacity = state.capacity;
+  if (head - state.read > capacity) {
+    lostSamples_ += head - state.read - capacity;
+    state.read = head - capacity;
+  }
+  ThreadState::Sample sample;
+  for (; state.read < head; ++state.read) {
+    typedef LockFreeRingBuffer<ThreadState::Sample>::Cursor Cursor;
+    if (!state.buffer.tryRead(sample, Cursor(state.read))) {
+      ++lostSamples_;
+      continue;
+    }
+    ++stacks_[CpuProfile::Stack(sample.frames, sample.frames + sample.depth)];
+  }
+}
+
+CpuProfiler::ThreadState* CpuProfiler::newThread(pid_t tid) {
+  ThreadState* state = nullptr;
+  for (auto it = freeStates_.begin(); it != freeStates_.end(); ++it) {
+    if ((*it)->capacity == options_.bufferCapacity) {
+      state = *it;
+      freeStates_.erase(it);
+      break;
+    }
+  }
+  if (!state) {
+    states_.push_back(std::make_unique<ThreadState>(options_.bufferCapacity));
+    state = states_.back().get();
+  }
+  state->read = state->written.load(std::memory_order_acquire);
+  state->tid.store(tid, std::memory_order_relaxed);
+  state->active.store(true, std::memory_order_release);
+  return state;
+}
+
+void CpuProfiler::retireThread(ThreadState* state) {
+  if (state->hasTimer) {
+    timer_delete(state->timer);
+    state->hasTimer = false;
+  }
+  state->active.store(false, std::memory_order_release);
+  drain(*state);
+  freeStates_.push_back(state);
+}
+
+void CpuProfiler::drainAll() {
+  for (auto& p : threads_) {
+    drain(*p.second);
+  }
+}
+
+}}  // namespaces
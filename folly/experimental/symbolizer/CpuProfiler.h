@@ -0,0 +1,175 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <signal.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace folly { namespace symbolizer {
+
+class IndexedSymbolizer;
+
+/**
+ * Aggregated result of a CpuProfiler run: distinct stack traces and the
+ * number of samples that landed in each.
+ */
+struct CpuProfile {
+  typedef std::vector<uintptr_t> Stack;
+
+  // Sampling interval, in CPU time per thread
+  std::chrono::microseconds interval{0};
+
+  // Stack traces, innermost frame first. The innermost frame is the
+  // interrupted instruction, all others are return addresses.
+  std::vector<std::pair<Stack, uint64_t>> stacks;
+
+  // Samples dropped because a thread's ring buffer overflowed between two
+  // drains, or because a sample was torn by a concurrent write.
+  uint64_t lostSamples{0};
+
+  uint64_t totalSamples() const;
+
+  /**
+   * Folded stack format, as consumed by flamegraph.pl: one line per stack,
+   * frames outermost first and separated by ';', followed by a space and
+   * the sample count.
+   *
+   * Symbolization uses the given symbolizer, or a temporary one if null.
+   */
+  std::string toFolded(IndexedSymbolizer* symbolizer = nullptr) const;
+
+  /**
+   * Legacy binary CPU profile format (as written by gperftools), readable
+   * by pprof together with the binary. Includes /proc/self/maps.
+   */
+  std::string toPprof() const;
+};
+
+/**
+ * In-process sampling CPU profiler.
+ *
+ * Every thread of the process gets a POSIX timer on its own CPU time
+ * clock that delivers SIGPROF to that thread. The signal handler captures
+ * the stack with getStackTraceSafe() into a per-thread LockFreeRingBuffer;
+ * it never allocates, locks, or symbolizes. A background thread drains the
+ * buffers, aggregates identical stacks, and picks up threads started after
+ * start().
+ *
+ * Only one profiler exists per process (SIGPROF is process-wide); it can
+ * be started and stopped any number of times at runtime. Symbolization
+ * happens lazily, when the profile is rendered.
+ *
+ * Linux only.
+ */
+class CpuProfiler {
+ public:
+  static constexpr size_t kMaxStackDepth = 64;
+
+  struct Options {
+    Options() {}
+
+    // CPU time between two samples of the same thread. CPU timers are
+    // checked on scheduler ticks, so intervals shorter than a tick (1-10ms
+    // depending on CONFIG_HZ) behave like one tick.
+    std::chrono::microseconds interval{10000};
+    // Per-thread ring buffer capacity, in samples (about 0.5KiB each); must
+    // hold drainInterval worth of samples to avoid losing any.
+    uint32_t bufferCapacity{64};
+    // How often buffers are drained and new threads are picked up
+    std::chrono::milliseconds drainInterval{100};
+  };
+
+  static CpuProfiler& get();
+
+  /**
+   * Start sampling all threads of the process. Throws std::logic_error if
+   * already running, std::system_error if timers cannot be created.
+   */
+  void start(const Options& options = Options());
+
+  /**
+   * Stop sampling. Samples collected so far remain available from
+   * getProfile() until reset().
+   */
+  void stop();
+
+  bool isRunning() const;
+
+  /**
+   * Return everything collected since the last reset(), including samples
+   * still sitting in the per-thread buffers.
+   */
+  CpuProfile getProfile();
+
+  /**
+   * Discard all collected samples.
+   */
+  void reset();
+
+  CpuProfiler(const CpuProfiler&) = delete;
+  CpuProfiler& operator=(const CpuProfiler&) = delete;
+
+ private:
+  struct ThreadState;
+
+  struct StackHash {
+    size_t operator()(const CpuProfile::Stack& stack) const;
+  };
+
+  CpuProfiler();
+  ~CpuProfiler() = delete;
+
+  static void signalHandler(int signum, siginfo_t* info, void* uctx);
+
+  void collectorLoop();
+  int updateThreads();
+  ThreadState* newThread(pid_t tid);
+  void retireThread(ThreadState* state);
+  void drain(ThreadState& state);
+  void drainAll();
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool running_{false};
+  Options options_;
+  pid_t collectorTid_{0};
+  std::thread collector_;
+
+  // Guarded by mutex_. A signal queued before its timer was deleted is
+  // still delivered, with a pointer to its ThreadState: states are never
+  // freed, only reused for new threads once retired, so they are bounded
+  // by the number of threads alive at once.
+  std::vector<std::unique_ptr<ThreadState>> states_;
+  std::vector<ThreadState*> freeStates_;
+  std::unordered_map<pid_t, ThreadState*> threads_;
+  std::unordered_map<CpuProfile::Stack, uint64_t, StackHash> stacks_;
+  uint64_t lostSamples_{0};
+};
+
+}}  // namespaces
@@ -478,9 +478,8 @@ bool Dwarf::findDebugInfoOffset(uintptr_t address,
  * Returns whether the address was found.
  * Advances @sp to the next entry in .debug_info.
  */
-bool Dwarf::findLocation(uintptr_t address,
-                         StringPiece& infoEntry,
-                         LocationInfo& locationInfo) const {
+Dwarf::CompilationUnit Dwarf::readCompilationUnit(
+    StringPiece& infoEntry) const {
   // For each compilation unit compiled with a DWARF producer, a
   // contribution is made to the .debug_info section of the object
   // file. Each such contribution consists of a compilation unit
@@ -517,11 +516,7 @@ bool Dwarf::findLocation(uintptr_t address,
   infoEntry.advance(chunk.end() - infoEntry.begin());
 
   // Read attributes, extracting the few we care about
-  bool foundLineOffset = false;
-  uint64_t lineOffset = 0;
-  folly::StringPiece compilationDirectory;
-  folly::StringPiece mainFileName;
-
+  CompilationUnit cu;
   DIEAbbreviation::Attribute attr;
   folly::StringPiece attributes = abbr.attributes;
   for (;;) {
@@ -535,32 +530,45 @@ bool Dwarf::findLocation(uintptr_t address,
     case DW_AT_stmt_list:
       // Offset in .debug_line for the line number VM program for this
       // compilation unit
-      lineOffset = boost::get<uint64_t>(val);
-      foundLineOffset = true;
+      cu.lineOffset = boost::get<uint64_t>(val);
+      cu.hasLineOffset = true;
       break;
     case DW_AT_comp_dir:
       // Compilation directory
-      compilationDirectory = boost::get<folly::StringPiece>(val);
+      cu.compilationDirectory = boost::get<folly::StringPiece>(val);
       break;
     case DW_AT_name:
       // File name of main file being compiled
-      mainFileName = boost::get<folly::StringPiece>(val);
+      cu.mainFileName = boost::get<folly::StringPiece>(val);
       break;
     }
   }
+  return cu;
+}
+
+/**
+ * Find the @locationInfo for @address in the compilation unit represented
+ * by the @sp .debug_info entry.
+ * Returns whether the address was found.
+ * Advances @sp to the next entry in .debug_info.
+ */
+bool Dwarf::findLocation(uintptr_t address,
+                         StringPiece& infoEntry,
+                         LocationInfo& locationInfo) const {
+  auto cu = readCompilationUnit(infoEntry);
 
-  if (!mainFileName.empty()) {
+  if (!cu.mainFileName.empty()) {
     locationInfo.hasMainFile = true;
-    locationInfo.mainFile = Path(compilationDirectory, "", mainFileName);
+    locationInfo.mainFile = Path(cu.compilationDirectory, "", cu.mainFileName);
   }
 
-  if (!foundLineOffset) {
+  if (!cu.hasLineOffset) {
     return false;
   }
 
   folly::StringPiece lineSection(line_);
-  lineSection.advance(lineOffset);
-  LineNumberVM lineVM(lineSection, compilationDirectory);
+  lineSection.advance(cu.lineOffset);
+  LineNumberVM lineVM(lineSection, cu.compilationDirectory);
 
   // Execute line number VM program to find file and line
   locationInfo.hasFileAndLine =
@@ -568,6 +576,50 @@ bool Dwarf::findLocation(uintptr_t address,
   return locationInfo.hasFileAndLine;
 }
 
+void Dwarf::forEachCompilationUnit(FunctionRef<void(uint64_t)> fn) const {
+  if (!elf_) {
+    return;
+  }
+  // Only the unit headers are read; their lengths lead to the next one.
+  Section debugInfoSection(info_);
+  folly::StringPiece chunk;
+  const char* begin = info_.begin();
+  const char* unit = begin;
+  while (debugInfoSection.next(chunk)) {
+    fn(uint64_t(unit - begin));
+    unit = chunk.end();
+  }
+}
+
+void Dwarf::forEachAddressRange(
+    uint64_t infoOffset,
+    FunctionRef<void(uintptr_t, uintptr_t)> fn) const {
+  if (!elf_) {
+    return;
+  }
+  folly::StringPiece infoEntry(info_);
+  infoEntry.advance(infoOffset);
+  auto cu = readCompilationUnit(infoEntry);
+  if (!cu.hasLineOffset) {
+    return;
+  }
+  folly::StringPiece lineSection(line_);
+  lineSection.advance(cu.lineOffset);
+  LineNumberVM(lineSection, cu.compilationDirectory).forEachSequence(fn);
+}
+
+bool Dwarf::findAddressInCompilationUnit(uintptr_t address,
+                                         uint64_t infoOffset,
+                                         LocationInfo& locationInfo) const {
+  locationInfo = LocationInfo();
+  if (!elf_) {
+    return false;
+  }
+  folly::StringPiece infoEntry(info_);
+  infoEntry.advance(infoOffset);
+  return findLocation(address, infoEntry, locationInfo);
+}
+
 bool Dwarf::findAddress(uintptr_t address,
                         LocationInfo& locationInfo,
                         LocationInfoMode mode) const {
@@ -945,5 +997,30 @@ bool Dwarf::LineNumberVM::findAddress(uintptr_t target, Path& file,
   return false;
 }
 
+void Dwarf::LineNumberVM::forEachSequence(
+    FunctionRef<void(uintptr_t, uintptr_t)> fn) {
+  folly::StringPiece program = data_;
+  reset();
+
+  // The first row of a sequence has its lowest address, and the row
+  // emitted by DW_LNE_end_sequence is one past its highest.
+  bool inSequence = false;
+  uint64_t begin = 0;
+  while (!program.empty()) {
+    bool seqEnd = !next(program);
+    if (!inSequence) {
+      begin = address_;
+      inSequence = true;
+    }
+    if (seqEnd) {
+      if (address_ > begin) {
+        fn(uintptr_t(begin), uintptr_t(address_));
+      }
+      inSequence = false;
+      reset();
+    }
+  }
+}
+
 }  // namespace symbolizer
 }  // namespace folly
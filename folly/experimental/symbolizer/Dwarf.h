@@ -20,6 +20,7 @@
 
 #include <boost/variant.hpp>
 
+#include <folly/Function.h>
 #include <folly/experimental/symbolizer/Elf.h>
 #include <folly/Range.h>
 
@@ -125,12 +126,50 @@ class Dwarf {
                    LocationInfo& info,
                    LocationInfoMode mode) const;
 
+  /**
+   * Call fn(offset) with the offset in .debug_info of each compilation
+   * unit, in order. Together with forEachAddressRange and
+   * findAddressInCompilationUnit, this allows building a lookup index
+   * over the whole file instead of scanning it for every address.
+   */
+  void forEachCompilationUnit(FunctionRef<void(uint64_t)> fn) const;
+
+  /**
+   * Call fn(begin, end) for each address range [begin, end) covered by
+   * the line number program of the compilation unit at the given offset
+   * in .debug_info.
+   */
+  void forEachAddressRange(
+      uint64_t infoOffset,
+      FunctionRef<void(uintptr_t, uintptr_t)> fn) const;
+
+  /**
+   * Like findAddress, but only look at the compilation unit at the given
+   * offset in .debug_info.
+   */
+  bool findAddressInCompilationUnit(uintptr_t address,
+                                    uint64_t infoOffset,
+                                    LocationInfo& info) const;
+
  private:
   static bool findDebugInfoOffset(uintptr_t address,
                                   StringPiece aranges,
                                   uint64_t& offset);
 
   void init();
+
+  // The attributes of a compilation unit that we care about.
+  struct CompilationUnit {
+    bool hasLineOffset = false;
+    uint64_t lineOffset = 0;   // in .debug_line
+    folly::StringPiece compilationDirectory;
+    folly::StringPiece mainFileName;
+  };
+
+  // Read the compilation unit at the start of infoEntry, advance
+  // infoEntry to the next one.
+  CompilationUnit readCompilationUnit(StringPiece& infoEntry) const;
+
   bool findLocation(uintptr_t address,
                     StringPiece& infoEntry,
                     LocationInfo& info) const;
@@ -182,6 +221,9 @@ class Dwarf {
 
     bool findAddress(uintptr_t address, Path& file, uint64_t& line);
 
+    // Call fn(begin, end) for each sequence of the program
+    void forEachSequence(FunctionRef<void(uintptr_t, uintptr_t)> fn);
+
    private:
     void init();
     void reset();
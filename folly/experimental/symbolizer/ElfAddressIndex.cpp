@@ -0,0 +1,189 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/symbolizer/ElfAddressIndex.h>
+
+#include <algorithm>
+#include <thread>
+#include <tuple>
+
+namespace folly {
+namespace symbolizer {
+
+namespace {
+
+// Below this many compilation units per thread, spawning threads costs
+// more than it saves.
+constexpr size_t kMinCompilationUnitsPerThread = 64;
+
+}  // namespace
+
+ElfAddressIndex::ElfAddressIndex(std::shared_ptr<ElfFile> file,
+                                 size_t buildThreads)
+  : file_(std::move(file)), dwarf_(file_.get()) {
+  buildSymbols();
+  buildCompilationUnits(std::max<size_t>(1, buildThreads));
+}
+
+template <class T>
+void ElfAddressIndex::sortRanges(std::vector<AddressRange<T>>& ranges) {
+  // Among identical ranges, keep the one added first.
+  std::sort(
+      ranges.begin(),
+      ranges.end(),
+      [](const AddressRange<T>& a, const AddressRange<T>& b) {
+        return std::tie(a.begin, a.end, a.order) <
+            std::tie(b.begin, b.end, b.order);
+      });
+  ranges.erase(
+      std::unique(
+          ranges.begin(),
+          ranges.end(),
+          [](const AddressRange<T>& a, const AddressRange<T>& b) {
+            return a.begin == b.begin && a.end == b.end;
+          }),
+      ranges.end());
+  uintptr_t maxEnd = 0;
+  for (auto& r : ranges) {
+    maxEnd = std::max(maxEnd, r.end);
+    r.maxEnd = maxEnd;
+  }
+  ranges.shrink_to_fit();
+}
+
+template <class T>
+auto ElfAddressIndex::findRange(
+    const std::vector<AddressRange<T>>& ranges,
+    uintptr_t address) -> const AddressRange<T>* {
+  auto pos = std::upper_bound(
+      ranges.begin(),
+      ranges.end(),
+      address,
+      [](uintptr_t a, const AddressRange<T>& r) { return a < r.begin; });
+  // Walk back over the ranges starting at or before address, for as long
+  // as any of them can still reach it, and pick the first added of those
+  // containing it. Without overlaps this is one step.
+  const AddressRange<T>* found = nullptr;
+  while (pos != ranges.begin()) {
+    --pos;
+    if (pos->maxEnd <= address) {
+      break;
+    }
+    if (address < pos->end && (!found || pos->order < found->order)) {
+      found = &*pos;
+    }
+  }
+  return found;
+}
+
+void ElfAddressIndex::buildSymbols() {
+  // Same symbols as ElfFile::getDefinitionByAddress, and same
+  // precedence: .dynsym before .symtab, objects before functions.
+  auto addSection = [&](const ElfW(Shdr)& section) {
+    auto addSymbol = [&](const ElfW(Sym)& sym) {
+      if (sym.st_shndx != SHN_UNDEF && sym.st_size != 0) {
+        auto name = file_->getSymbolName(ElfFile::Symbol(&section, &sym));
+        symbols_.push_back(AddressRange<const char*>{
+            uintptr_t(sym.st_value),
+            uintptr_t(sym.st_value + sym.st_size),
+            0,
+            name,
+            symbols_.size()});
+      }
+      return false;
+    };
+    file_->iterateSymbolsWithType(section, STT_OBJECT, addSymbol);
+    file_->iterateSymbolsWithType(section, STT_FUNC, addSymbol);
+    return false;
+  };
+  file_->iterateSectionsWithType(SHT_DYNSYM, addSection);
+  file_->iterateSectionsWithType(SHT_SYMTAB, addSection);
+  sortRanges(symbols_);
+}
+
+void ElfAddressIndex::buildCompilationUnits(size_t buildThreads) {
+  std::vector<uint64_t> offsets;
+  dwarf_.forEachCompilationUnit(
+      [&](uint64_t offset) { offsets.push_back(offset); });
+  if (offsets.empty()) {
+    return;
+  }
+
+  const size_t numThreads = std::min(
+      buildThreads, (offsets.size() + kMinCompilationUnitsPerThread - 1) /
+          kMinCompilationUnitsPerThread);
+  std::vector<std::vector<AddressRange<uint64_t>>> shards(numThreads);
+  auto build = [&](size_t shard) {
+    auto& out = shards[shard];
+    // Interleave so that threads get a similar mix of large and small
+    // units.
+    for (size_t i = shard; i < offsets.size(); i += numThreads) {
+      auto offset = offsets[i];
+      dwarf_.forEachAddressRange(offset, [&](uintptr_t begin, uintptr_t end) {
+        // Sequences of functions dropped by the linker are left at
+        // address 0; they would shadow nothing but waste space.
+        if (file_->getSectionContainingAddress(begin)) {
+          // Units are ordered as in .debug_info, whichever thread read
+          // them.
+          out.push_back(AddressRange<uint64_t>{begin, end, 0, offset, i});
+        }
+      });
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < numThreads; ++t) {
+    threads.emplace_back(build, t);
+  }
+  build(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  size_t total = 0;
+  for (auto& shard : shards) {
+    total += shard.size();
+  }
+  compilationUnits_.reserve(total);
+  for (auto& shard : shards) {
+    compilationUnits_.insert(
+        compilationUnits_.end(), shard.begin(), shard.end());
+  }
+  sortRanges(compilationUnits_);
+}
+
+const char* ElfAddressIndex::findSymbolName(uintptr_t address) const {
+  auto r = findRange(symbols_, address);
+  return r ? r->value : nullptr;
+}
+
+bool ElfAddressIndex::findLocation(uintptr_t address,
+                                   Dwarf::LocationInfo& info) const {
+  auto r = findRange(compilationUnits_, address);
+  if (!r) {
+    info = Dwarf::LocationInfo();
+    return false;
+  }
+  return dwarf_.findAddressInCompilationUnit(address, r->value, info);
+}
+
+size_t ElfAddressIndex::memoryUsage() const {
+  return symbols_.capacity() * sizeof(symbols_[0]) +
+      compilationUnits_.capacity() * sizeof(compilationUnits_[0]);
+}
+
+}  // namespace symbolizer
+}  // namespace folly
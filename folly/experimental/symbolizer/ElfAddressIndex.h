@@ -0,0 +1,108 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <folly/experimental/symbolizer/Dwarf.h>
+#include <folly/experimental/symbolizer/Elf.h>
+
+namespace folly {
+namespace symbolizer {
+
+/**
+ * Sorted lookup tables over one ELF file, so that resolving an address
+ * takes a couple of binary searches instead of a scan of the symbol
+ * tables and of the DWARF compilation units.
+ *
+ * Symbol names are resolved from the index alone. For file and line
+ * information the index maps address ranges to the compilation unit
+ * that covers them, and only that unit's line number program is run:
+ * keeping every row of every line table would take an order of
+ * magnitude more memory than the ranges.
+ *
+ * Building the index reads every compilation unit once; the work is
+ * split across up to buildThreads threads, the calling one included.
+ * Addresses are file-relative (see
+ * ElfFile::getDefinitionByAddress). MT-safe once constructed; not
+ * async-signal-safe.
+ */
+class ElfAddressIndex {
+ public:
+  explicit ElfAddressIndex(
+      std::shared_ptr<ElfFile> file,
+      size_t buildThreads = 1);
+
+  ElfAddressIndex(const ElfAddressIndex&) = delete;
+  ElfAddressIndex& operator=(const ElfAddressIndex&) = delete;
+
+  const std::shared_ptr<ElfFile>& file() const {
+    return file_;
+  }
+
+  /**
+   * Name of the function or object defined at address, or nullptr.
+   */
+  const char* findSymbolName(uintptr_t address) const;
+
+  /**
+   * Find the file and line number information corresponding to address.
+   */
+  bool findLocation(uintptr_t address, Dwarf::LocationInfo& info) const;
+
+  /**
+   * Bytes used by the lookup tables.
+   */
+  size_t memoryUsage() const;
+
+ private:
+  // [begin, end) -> value, sorted by begin. maxEnd is the largest end of
+  // this and all preceding entries, which bounds how far back a lookup
+  // has to look when ranges overlap. order is the position the range was
+  // added in: where ranges overlap, the one added first wins, as in a
+  // linear scan.
+  template <class T>
+  struct AddressRange {
+    uintptr_t begin;
+    uintptr_t end;
+    uintptr_t maxEnd;
+    T value;
+    size_t order;
+  };
+
+  template <class T>
+  static void sortRanges(std::vector<AddressRange<T>>& ranges);
+
+  template <class T>
+  static const AddressRange<T>* findRange(
+      const std::vector<AddressRange<T>>& ranges,
+      uintptr_t address);
+
+  void buildSymbols();
+  void buildCompilationUnits(size_t buildThreads);
+
+  std::shared_ptr<ElfFile> file_;
+  Dwarf dwarf_;
+  std::vector<AddressRange<const char*>> symbols_;
+  // Value is the offset of the compilation unit in .debug_info
+  std::vector<AddressRange<uint64_t>> compilationUnits_;
+};
+
+}  // namespace symbolizer
+}  // namespace folly
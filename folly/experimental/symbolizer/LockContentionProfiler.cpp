@@ -0,0 +1,306 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/symbolizer/LockContentionProfiler.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include <folly/Format.h>
+#include <folly/Hash.h>
+#include <folly/Portability.h>
+#include <folly/ScopeGuard.h>
+#include <folly/experimental/symbolizer/StackTrace.h>
+#include <folly/experimental/symbolizer/Symbolizer.h>
+
+namespace folly { namespace symbolizer {
+
+namespace {
+
+// Set while a hook runs on this thread, so locks taken by the hook itself
+// (e.g. in the unwinder or malloc) aren't reported recursively.
+FOLLY_TLS bool tInHook = false;
+FOLLY_TLS uint32_t tSampleCountdown = 0;
+
+// Frames of the hook itself and of reportDeferredLockContention(), called
+// as the lock is released
+constexpr size_t kSkipFrames = 3;
+constexpr size_t kMaxCapturedFrames = 128;
+
+const char* lockTypeName(LockType type) {
+  switch (type) {
+    case LockType::SharedMutex:
+      return "SharedMutex";
+    case LockType::MicroSpinLock:
+      return "MicroSpinLock";
+    case LockType::PicoSpinLock:
+      return "PicoSpinLock";
+    case LockType::RWSpinLock:
+      return "RWSpinLock";
+    case LockType::Other:
+      break;
+  }
+  return "other";
+}
+
+const char* contentionKindName(LockContentionKind kind) {
+  switch (kind) {
+    case LockContentionKind::Exclusive:
+      return "exclusive";
+    case LockContentionKind::Shared:
+      return "shared";
+    case LockContentionKind::Upgrade:
+      return "upgrade";
+  }
+  return "unknown";
+}
+
+} // namespace
+
+const folly::detail::LockContentionHooks LockContentionProfiler::kHooks = {
+    &LockContentionProfiler::onContended,
+    &LockContentionProfiler::onReleasedWithWaiters,
+};
+
+size_t LockContentionProfiler::KeyHash::operator()(const Key& key) const {
+  return hash::hash_combine(
+      key.lock, key.waiterStackId, uint8_t(key.kind), uint8_t(key.type));
+}
+
+LockContentionProfiler& LockContentionProfiler::get() {
+  // Leaked: locks may still be contended on other threads during exit.
+  static auto profiler = new LockContentionProfiler();
+  return *profiler;
+}
+
+LockContentionProfiler::LockContentionProfiler() {}
+
+void LockContentionProfiler::start(const Options& options) {
+  std::lock_guard<std::mutex> g(controlMutex_);
+  if (running_) {
+    throw std::logic_error("LockContentionProfiler already running");
+  }
+  sampleRate_.store(std::max<uint32_t>(options.sampleRate, 1));
+  maxStackDepth_.store(
+      std::min(std::max<size_t>(options.maxStackDepth, 1), kMaxCapturedFrames));
+  folly::detail::setLockContentionHooks(&kHooks);
+  running_ = true;
+}
+
+void LockContentionProfiler::stop() {
+  std::lock_guard<std::mutex> g(controlMutex_);
+  if (running_) {
+    folly::detail::setLockContentionHooks(nullptr);
+    running_ = false;
+  }
+}
+
+bool LockContentionProfiler::isRunning() const {
+  std::lock_guard<std::mutex> g(controlMutex_);
+  return running_;
+}
+
+bool LockContentionProfiler::sample() {
+  if (tSampleCountdown == 0) {
+    tSampleCountdown = sampleRate_.load(std::memory_order_relaxed);
+  }
+  return --tSampleCountdown == 0;
+}
+
+uint64_t LockContentionProfiler::captureStack(
+    std::vector<uintptr_t>& frames) const {
+  uintptr_t addresses[kMaxCapturedFrames + kSkipFrames];
+  ssize_t n = getStackTrace(
+      addresses,
+      maxStackDepth_.load(std::memory_order_relaxed) + kSkipFrames);
+  if (n <= ssize_t(kSkipFrames)) {
+    frames.clear();
+    return 0;
+  }
+  frames.assign(addresses + kSkipFrames, addresses + n);
+  return hash::hash_range(frames.begin(), frames.end());
+}
+
+LockContentionProfiler::Shard& LockContentionProfiler::shard(
+    const void* lock) const {
+  return shards_[hash::twang_mix64(uintptr_t(lock)) % kNumShards];
+}
+
+void LockContentionProfiler::onContended(
+    const void* lock,
+    LockType type,
+    LockContentionKind kind,
+    uint64_t waitNanos) {
+  if (tInHook) {
+    return;
+  }
+  auto& self = get();
+  if (!self.sample()) {
+    return;
+  }
+  tInHook = true;
+  SCOPE_EXIT { tInHook = false; };
+
+  uint64_t rate = self.sampleRate_.load(std::memory_order_relaxed);
+  std::vector<uintptr_t> frames;
+  Key key{lock, self.captureStack(frames), kind, type};
+
+  auto& shard = self.shard(lock);
+  std::lock_guard<std::mutex> g(shard.mutex);
+  auto& stats = shard.contended[key];
+  stats.count += rate;
+  stats.totalWaitNanos += waitNanos * rate;
+  stats.maxWaitNanos = std::max(stats.maxWaitNanos, waitNanos);
+  if (key.waiterStackId != 0) {
+    shard.stacks.emplace(key.waiterStackId, std::move(frames));
+  }
+}
+
+void LockContentionProfiler::onReleasedWithWaiters(
+    const void* lock,
+    LockType /* type */) {
+  if (tInHook) {
+    return;
+  }
+  auto& self = get();
+  if (!self.sample()) {
+    return;
+  }
+  tInHook = true;
+  SCOPE_EXIT { tInHook = false; };
+
+  std::vector<uintptr_t> frames;
+  uint64_t stackId = self.captureStack(frames);
+  if (stackId == 0) {
+    return;
+  }
+
+  auto& shard = self.shard(lock);
+  std::lock_guard<std::mutex> g(shard.mutex);
+  ++shard.holders[lock][stackId];
+  shard.stacks.emplace(stackId, std::move(frames));
+}
+
+std::vector<LockContentionProfiler::Entry> LockContentionProfiler::getTopN(
+    size_t n) const {
+  std::vector<Entry> entries;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> g(shard.mutex);
+    for (auto& p : shard.contended) {
+      Entry entry;
+      entry.lock = p.first.lock;
+      entry.type = p.first.type;
+      entry.kind = p.first.kind;
+      entry.count = p.second.count;
+      entry.totalWait = std::chrono::nanoseconds(p.second.totalWaitNanos);
+      entry.maxWait = std::chrono::nanoseconds(p.second.maxWaitNanos);
+      entry.waiterStackId = p.first.waiterStackId;
+      auto stack = shard.stacks.find(entry.waiterStackId);
+      if (stack != shard.stacks.end()) {
+        entry.waiterStack = stack->second;
+      }
+      auto holders = shard.holders.find(entry.lock);
+      if (holders != shard.holders.end()) {
+        auto top = std::max_element(
+            holders->second.begin(),
+            holders->second.end(),
+            [](const std::pair<const uint64_t, uint64_t>& a,
+               const std::pair<const uint64_t, uint64_t>& b) {
+              return a.second < b.second;
+            });
+        entry.holderStackId = top->first;
+        entry.holderStack = shard.stacks[top->first];
+      }
+      entries.push_back(std::move(entry));
+    }
+  }
+
+  auto byWait = [](const Entry& a, const Entry& b) {
+    return a.totalWait > b.totalWait;
+  };
+  if (entries.size() > n) {
+    std::partial_sort(
+        entries.begin(), entries.begin() + n, entries.end(), byWait);
+    entries.resize(n);
+  } else {
+    std::sort(entries.begin(), entries.end(), byWait);
+  }
+  return entries;
+}
+
+std::string LockContentionProfiler::reportTopN(
+    size_t n,
+    IndexedSymbolizer* symbolizer) const {
+  auto entries = getTopN(n);
+
+  std::unique_ptr<IndexedSymbolizer> ownSymbolizer;
+  if (!symbolizer) {
+    ownSymbolizer = std::make_unique<IndexedSymbolizer>(
+        nullptr, 0, Dwarf::LocationInfoMode::FAST);
+    symbolizer = ownSymbolizer.get();
+  }
+
+  std::string out;
+  auto appendStack = [&](const std::vector<uintptr_t>& stack) {
+    // All frames are return addresses; look up the call instruction.
+    std::vector<uintptr_t> addresses(stack.size());
+    for (size_t i = 0; i < stack.size(); ++i) {
+      addresses[i] = stack[i] - 1;
+    }
+    std::vector<SymbolizedFrame> frames(addresses.size());
+    symbolizer->symbolize(addresses.data(), frames.data(), addresses.size());
+    for (size_t i = 0; i < frames.size(); ++i) {
+      if (frames[i].found && frames[i].name) {
+        out += sformat("    {}\n", frames[i].demangledName());
+      } else {
+        out += sformat("    {:#x}\n", stack[i]);
+      }
+    }
+  };
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    auto& entry = entries[i];
+    out += sformat(
+        "#{} {} {} {} waits: count={} total={}us avg={}us max={}us\n",
+        i,
+        lockTypeName(entry.type),
+        entry.lock,
+        contentionKindName(entry.kind),
+        entry.count,
+        entry.totalWait.count() / 1000,
+        entry.count ? entry.totalWait.count() / entry.count / 1000 : 0,
+        entry.maxWait.count() / 1000);
+    out += "  waiter:\n";
+    appendStack(entry.waiterStack);
+    if (!entry.holderStack.empty()) {
+      out += "  holder:\n";
+      appendStack(entry.holderStack);
+    }
+  }
+  return out;
+}
+
+void LockContentionProfiler::reset() {
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> g(shard.mutex);
+    shard.contended.clear();
+    shard.holders.clear();
+    shard.stacks.clear();
+  }
+}
+
+}}  // namespaces
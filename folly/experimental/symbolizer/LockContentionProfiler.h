@@ -0,0 +1,169 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/detail/LockContention.h>
+
+namespace folly { namespace symbolizer {
+
+class IndexedSymbolizer;
+
+/**
+ * Opt-in lock contention profiler.
+ *
+ * While running, SharedMutex, MicroSpinLock, PicoSpinLock, RWSpinLock and
+ * any mutex locked through LockTraits (so every Synchronized) report
+ * acquisitions that could not complete right away, with the time spent
+ * waiting, once the waiter releases the lock so the profiler doesn't lengthen
+ * the critical section. A sample of them is attributed to the waiter's stack
+ * at release; for SharedMutex, the stacks that released the lock while others
+ * were waiting are recorded too. Whether or not the profiler runs, the
+ * uncontended paths of the locks only add a load of the hooks pointer on
+ * release.
+ *
+ * Entries are keyed by lock address and waiter stack, and reported by
+ * total wait time.
+ */
+class LockContentionProfiler {
+ public:
+  struct Options {
+    Options() {}
+
+    // Record one in sampleRate contended acquisitions (per thread); counts
+    // and wait times are scaled accordingly.
+    uint32_t sampleRate{1};
+    // Frames kept per stack
+    size_t maxStackDepth{32};
+  };
+
+  struct Entry {
+    const void* lock{nullptr};
+    LockType type{LockType::Other};
+    LockContentionKind kind{LockContentionKind::Exclusive};
+    uint64_t count{0};
+    std::chrono::nanoseconds totalWait{0};
+    std::chrono::nanoseconds maxWait{0};
+    uint64_t waiterStackId{0};
+    std::vector<uintptr_t> waiterStack;
+    // Most frequent stack releasing this lock under contention; 0 / empty
+    // if not known (only SharedMutex reports releases).
+    uint64_t holderStackId{0};
+    std::vector<uintptr_t> holderStack;
+  };
+
+  static LockContentionProfiler& get();
+
+  /**
+   * Install the hooks. Throws std::logic_error if already running.
+   */
+  void start(const Options& options = Options());
+
+  /**
+   * Remove the hooks. Data collected so far remains available until
+   * reset().
+   */
+  void stop();
+
+  bool isRunning() const;
+
+  /**
+   * The n entries with the highest total wait time.
+   */
+  std::vector<Entry> getTopN(size_t n) const;
+
+  /**
+   * Human-readable, symbolized report of getTopN(n).
+   */
+  std::string reportTopN(size_t n, IndexedSymbolizer* symbolizer = nullptr)
+      const;
+
+  void reset();
+
+  LockContentionProfiler(const LockContentionProfiler&) = delete;
+  LockContentionProfiler& operator=(const LockContentionProfiler&) = delete;
+
+ private:
+  struct Key {
+    const void* lock;
+    uint64_t waiterStackId;
+    LockContentionKind kind;
+    LockType type;
+
+    bool operator==(const Key& other) const {
+      return lock == other.lock && waiterStackId == other.waiterStackId &&
+          kind == other.kind && type == other.type;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  struct Stats {
+    uint64_t count{0};
+    uint64_t totalWaitNanos{0};
+    uint64_t maxWaitNanos{0};
+  };
+
+  // Contention data is sharded by lock address, so threads contending on
+  // different locks don't serialize here too.
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<Key, Stats, KeyHash> contended;
+    // lock -> releasing stack id -> count
+    std::unordered_map<const void*, std::unordered_map<uint64_t, uint64_t>>
+        holders;
+    std::unordered_map<uint64_t, std::vector<uintptr_t>> stacks;
+  };
+
+  static constexpr size_t kNumShards = 16;
+
+  LockContentionProfiler();
+  ~LockContentionProfiler() = delete;
+
+  static void onContended(
+      const void* lock,
+      LockType type,
+      LockContentionKind kind,
+      uint64_t waitNanos);
+  static void onReleasedWithWaiters(const void* lock, LockType type);
+
+  static const folly::detail::LockContentionHooks kHooks;
+
+  // Per-thread 1-in-N decision
+  bool sample();
+  // Captures the caller's stack and returns its id; fills frames.
+  uint64_t captureStack(std::vector<uintptr_t>& frames) const;
+
+  Shard& shard(const void* lock) const;
+
+  std::atomic<uint32_t> sampleRate_{1};
+  std::atomic<size_t> maxStackDepth_{32};
+  mutable std::mutex controlMutex_;
+  bool running_{false};
+  mutable Shard shards_[kNumShards];
+};
+
+}}  // namespaces
@@ -16,6 +16,7 @@
 
 #include <folly/experimental/symbolizer/Symbolizer.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
@@ -30,6 +31,7 @@
 
 #include <folly/Conv.h>
 #include <folly/FileUtil.h>
+#include <folly/Hash.h>
 #include <folly/Memory.h>
 #include <folly/ScopeGuard.h>
 #include <folly/String.h>
@@ -78,6 +80,23 @@ void SymbolizedFrame::set(const std::shared_ptr<ElfFile>& file,
   Dwarf(file.get()).findAddress(address, location, mode);
 }
 
+void SymbolizedFrame::set(const ElfAddressIndex& index,
+                          uintptr_t address,
+                          Dwarf::LocationInfoMode mode) {
+  clear();
+  found = true;
+
+  name = index.findSymbolName(address);
+  if (!name) {
+    return;
+  }
+
+  file_ = index.file();
+  if (mode != Dwarf::LocationInfoMode::DISABLED) {
+    index.findLocation(address, location);
+  }
+}
+
 Symbolizer::Symbolizer(ElfCacheBase* cache, Dwarf::LocationInfoMode mode)
   : cache_(cache ? cache : defaultElfCache()), mode_(mode) {
 }
@@ -151,6 +170,204 @@ void Symbolizer::symbolize(const uintptr_t* addresses,
   }
 }
 
+constexpr size_t IndexedSymbolizer::kDefaultCacheCapacity;
+constexpr size_t IndexedSymbolizer::kCacheShards;
+
+namespace {
+
+struct LoadedObject {
+  std::string path;
+  // Difference between the run-time and the file-relative addresses
+  uintptr_t loadBias;
+  bool resolved = false;
+  std::shared_ptr<ElfAddressIndex> index;
+};
+
+// One PT_LOAD segment of a loaded object
+struct LoadedSegment {
+  uintptr_t begin;
+  uintptr_t end;
+  size_t object;
+};
+
+struct LoadedObjects {
+  std::vector<LoadedObject>* objects;
+  std::vector<LoadedSegment>* segments;
+};
+
+}  // namespace
+
+IndexedSymbolizer::IndexedSymbolizer(ElfCacheBase* cache,
+                                     size_t cacheCapacity,
+                                     Dwarf::LocationInfoMode mode,
+                                     size_t indexBuildThreads)
+  : cache_(cache ? cache : defaultElfCache()),
+    mode_(mode),
+    indexBuildThreads_(indexBuildThreads) {
+  if (cacheCapacity > 0) {
+    auto shardCapacity = std::max<size_t>(1, cacheCapacity / kCacheShards);
+    for (size_t i = 0; i < kCacheShards; ++i) {
+      cacheShards_.push_back(make_unique<CacheShard>(shardCapacity));
+    }
+  }
+}
+
+std::shared_ptr<ElfAddressIndex> IndexedSymbolizer::getIndex(
+    const std::string& path) {
+  std::shared_ptr<IndexSlot> slot;
+  {
+    std::lock_guard<std::mutex> lock(indexesMutex_);
+    auto& s = indexes_[path];
+    if (!s) {
+      s = std::make_shared<IndexSlot>();
+    }
+    slot = s;
+  }
+  // Other threads needing the same file wait for the first one to build
+  // its index instead of building their own.
+  std::call_once(slot->once, [&] {
+    auto file = cache_->getFile(path);
+    if (file) {
+      slot->index = std::make_shared<ElfAddressIndex>(
+          std::move(file), indexBuildThreads_);
+    }
+  });
+  return slot->index;
+}
+
+IndexedSymbolizer::CacheShard* IndexedSymbolizer::cacheShard(
+    uintptr_t address) {
+  return cacheShards_[hash::twang_mix64(address) % kCacheShards].get();
+}
+
+bool IndexedSymbolizer::findInCache(uintptr_t address,
+                                    SymbolizedFrame& frame) {
+  if (cacheShards_.empty()) {
+    return false;
+  }
+  auto shard = cacheShard(address);
+  std::lock_guard<std::mutex> lock(shard->mutex);
+  auto pos = shard->frames.find(address);
+  if (pos == shard->frames.end()) {
+    return false;
+  }
+  frame = pos->second;
+  return true;
+}
+
+void IndexedSymbolizer::addToCache(uintptr_t address,
+                                   const SymbolizedFrame& frame) {
+  if (cacheShards_.empty()) {
+    return;
+  }
+  auto shard = cacheShard(address);
+  std::lock_guard<std::mutex> lock(shard->mutex);
+  shard->frames.set(address, frame);
+}
+
+void IndexedSymbolizer::clearCache() {
+  for (auto& shard : cacheShards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    shard->frames.clear();
+  }
+}
+
+void IndexedSymbolizer::symbolize(const uintptr_t* addresses,
+                                  SymbolizedFrame* frames,
+                                  size_t addrCount) {
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < addrCount; ++i) {
+    auto& frame = frames[i];
+    if (frame.found) {
+      continue;
+    }
+    frame.clear();
+    if (!findInCache(addresses[i], frame)) {
+      pending.push_back(i);
+    }
+  }
+
+  if (pending.empty()) {  // we're done
+    return;
+  }
+
+  auto byAddress = [&](size_t a, size_t b) {
+    return addresses[a] < addresses[b];
+  };
+  if (!std::is_sorted(pending.begin(), pending.end(), byAddress)) {
+    std::sort(pending.begin(), pending.end(), byAddress);
+  }
+
+  // Snapshot the loaded objects; files are only opened afterwards, as
+  // dl_iterate_phdr holds the loader lock while calling us.
+  std::vector<LoadedObject> objects;
+  std::vector<LoadedSegment> segments;
+  LoadedObjects loaded{&objects, &segments};
+  dl_iterate_phdr(
+      [](struct dl_phdr_info* info, size_t, void* data) {
+        auto& out = *static_cast<LoadedObjects*>(data);
+        LoadedObject object;
+        object.path = info->dlpi_name ? info->dlpi_name : "";
+        object.loadBias = info->dlpi_addr;
+        for (size_t i = 0; i < info->dlpi_phnum; ++i) {
+          auto& phdr = info->dlpi_phdr[i];
+          if (phdr.p_type == PT_LOAD) {
+            auto begin = info->dlpi_addr + phdr.p_vaddr;
+            out.segments->push_back(LoadedSegment{
+                begin, begin + phdr.p_memsz, out.objects->size()});
+          }
+        }
+        out.objects->push_back(std::move(object));
+        return 0;
+      },
+      &loaded);
+  std::sort(
+      segments.begin(),
+      segments.end(),
+      [](const LoadedSegment& a, const LoadedSegment& b) {
+        return a.begin < b.begin;
+      });
+
+  // Both the addresses and the segments are sorted now, so one pass over
+  // each matches them up.
+  size_t seg = 0;
+  for (size_t k = 0; k < pending.size(); ++k) {
+    auto i = pending[k];
+    auto const addr = addresses[i];
+    auto& frame = frames[i];
+    if (k != 0 && addresses[pending[k - 1]] == addr) {
+      frame = frames[pending[k - 1]];
+      continue;
+    }
+
+    while (seg < segments.size() && segments[seg].end <= addr) {
+      ++seg;
+    }
+    if (seg < segments.size() && segments[seg].begin <= addr) {
+      auto& object = objects[segments[seg].object];
+      if (!object.resolved) {
+        object.resolved = true;
+        // The empty name stands for the running executable.
+        if (object.path.empty()) {
+          char selfPath[PATH_MAX + 8];
+          ssize_t selfSize =
+              readlink("/proc/self/exe", selfPath, PATH_MAX + 1);
+          if (selfSize != -1) {
+            object.path.assign(selfPath, size_t(selfSize));
+          }
+        }
+        if (!object.path.empty()) {
+          object.index = getIndex(object.path);
+        }
+      }
+      if (object.index) {
+        frame.set(*object.index, addr - object.loadBias, mode_);
+      }
+    }
+    addToCache(addr, frame);
+  }
+}
+
 namespace {
 constexpr char kHexChars[] = "0123456789abcdef";
 constexpr auto kAddressColor = SymbolizePrinter::Color::BLUE;
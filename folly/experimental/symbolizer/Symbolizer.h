@@ -19,13 +19,18 @@
 #include <array>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include <folly/EvictingCacheMap.h>
 #include <folly/FBString.h>
 #include <folly/Range.h>
 #include <folly/String.h>
 #include <folly/io/IOBuf.h>
 #include <folly/experimental/symbolizer/Elf.h>
+#include <folly/experimental/symbolizer/ElfAddressIndex.h>
 #include <folly/experimental/symbolizer/ElfCache.h>
 #include <folly/experimental/symbolizer/Dwarf.h>
 #include <folly/experimental/symbolizer/StackTrace.h>
@@ -45,6 +50,13 @@ struct SymbolizedFrame {
            uintptr_t address,
            Dwarf::LocationInfoMode mode);
 
+  /**
+   * Same as above, resolving the (file-relative) address with an index.
+   */
+  void set(const ElfAddressIndex& index,
+           uintptr_t address,
+           Dwarf::LocationInfoMode mode);
+
   void clear() { *this = SymbolizedFrame(); }
 
   bool found = false;
@@ -145,6 +157,97 @@ class Symbolizer {
   const Dwarf::LocationInfoMode mode_;
 };
 
+/**
+ * Symbolizer for large volumes of addresses, e.g. when processing crash
+ * dumps or profiles. MT-safe: a single instance is meant to be shared by
+ * all threads. Not async-signal-safe.
+ *
+ * Compared to Symbolizer:
+ * - every ELF file gets an ElfAddressIndex, built the first time one of
+ *   its addresses is looked up, so that lookups don't scan symbol tables
+ *   or compilation units (LocationInfoMode::FAST and FULL both find
+ *   every location FULL would);
+ * - resolved addresses are kept in an LRU cache shared by all threads;
+ * - symbolize() sorts the addresses it is given and matches them against
+ *   the segments of the loaded objects in a single pass.
+ *
+ * Cached frames assume that objects stay loaded at the same address, so
+ * call clearCache() after unloading shared libraries.
+ */
+class IndexedSymbolizer {
+ public:
+  static constexpr size_t kDefaultCacheCapacity = 1 << 16;
+
+  /**
+   * A cacheCapacity of 0 disables the address cache. Indexes are built
+   * by the thread that needs them first, with the help of up to
+   * indexBuildThreads - 1 more threads.
+   */
+  explicit IndexedSymbolizer(
+      ElfCacheBase* cache = nullptr,
+      size_t cacheCapacity = kDefaultCacheCapacity,
+      Dwarf::LocationInfoMode mode = Symbolizer::kDefaultLocationInfoMode,
+      size_t indexBuildThreads = 1);
+
+  IndexedSymbolizer(const IndexedSymbolizer&) = delete;
+  IndexedSymbolizer& operator=(const IndexedSymbolizer&) = delete;
+
+  /**
+   * Symbolize given addresses.
+   */
+  void symbolize(const uintptr_t* addresses,
+                 SymbolizedFrame* frames,
+                 size_t frameCount);
+
+  template <size_t N>
+  void symbolize(FrameArray<N>& fa) {
+    symbolize(fa.addresses, fa.frames, fa.frameCount);
+  }
+
+  /**
+   * Shortcut to symbolize one address.
+   */
+  bool symbolize(uintptr_t address, SymbolizedFrame& frame) {
+    symbolize(&address, &frame, 1);
+    return frame.found;
+  }
+
+  /**
+   * Drop all cached addresses. The indexes are kept.
+   */
+  void clearCache();
+
+ private:
+  // Built at most once per path, on first use
+  struct IndexSlot {
+    std::once_flag once;
+    std::shared_ptr<ElfAddressIndex> index;
+  };
+
+  struct CacheShard {
+    explicit CacheShard(size_t capacity) : frames(capacity) {}
+
+    std::mutex mutex;
+    EvictingCacheMap<uintptr_t, SymbolizedFrame> frames;
+  };
+
+  static constexpr size_t kCacheShards = 16;
+
+  std::shared_ptr<ElfAddressIndex> getIndex(const std::string& path);
+  CacheShard* cacheShard(uintptr_t address);
+  bool findInCache(uintptr_t address, SymbolizedFrame& frame);
+  void addToCache(uintptr_t address, const SymbolizedFrame& frame);
+
+  ElfCacheBase* const cache_;
+  const Dwarf::LocationInfoMode mode_;
+  const size_t indexBuildThreads_;
+
+  std::mutex indexesMutex_;
+  std::unordered_map<std::string, std::shared_ptr<IndexSlot>> indexes_;
+
+  std::vector<std::unique_ptr<CacheShard>> cacheShards_;
+};
+
 /**
  * Format one address in the way it's usually printed by SymbolizePrinter.
  * Async-signal-safe.
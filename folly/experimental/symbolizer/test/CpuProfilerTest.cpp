@@ -0,0 +1,128 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/symbolizer/CpuProfiler.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <folly/experimental/symbolizer/Symbolizer.h>
+#include <folly/portability/GTest.h>
+
+namespace folly { namespace symbolizer { namespace test {
+
+namespace {
+
+std::chrono::nanoseconds threadCpuTime() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+FOLLY_NOINLINE uint64_t burnCpu(std::chrono::milliseconds duration) {
+  auto end = threadCpuTime() + duration;
+  uint64_t x = 0;
+  while (threadCpuTime() < end) {
+    for (int i = 0; i < 10000; ++i) {
+      x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+  }
+  return x;
+}
+
+// CPU timers fire on scheduler ticks, so expect at most one sample per
+// tick (as long as 10ms with HZ=100) whatever the interval.
+CpuProfiler::Options fastOptions() {
+  CpuProfiler::Options options;
+  options.interval = std::chrono::milliseconds(5);
+  options.drainInterval = std::chrono::milliseconds(10);
+  return options;
+}
+
+}  // namespace
+
+TEST(CpuProfiler, Basic) {
+  auto& profiler = CpuProfiler::get();
+  profiler.reset();
+  EXPECT_FALSE(profiler.isRunning());
+  profiler.start(fastOptions());
+  EXPECT_TRUE(profiler.isRunning());
+  EXPECT_THROW(profiler.start(), std::logic_error);
+  burnCpu(std::chrono::milliseconds(300));
+  profiler.stop();
+  EXPECT_FALSE(profiler.isRunning());
+
+  auto profile = profiler.getProfile();
+  EXPECT_EQ(std::chrono::microseconds(5000), profile.interval);
+  EXPECT_GT(profile.totalSamples(), 15);
+
+  auto folded = profile.toFolded();
+  EXPECT_NE(std::string::npos, folded.find("burnCpu")) << folded;
+
+  auto pprof = profile.toPprof();
+  ASSERT_GT(pprof.size(), 5 * sizeof(uintptr_t));
+  auto words = reinterpret_cast<const uintptr_t*>(pprof.data());
+  EXPECT_EQ(0, words[0]);
+  EXPECT_EQ(3, words[1]);
+  EXPECT_EQ(5000, words[3]);
+
+  profiler.reset();
+  EXPECT_EQ(0, profiler.getProfile().totalSamples());
+}
+
+TEST(CpuProfiler, Threads) {
+  auto& profiler = CpuProfiler::get();
+  profiler.reset();
+  profiler.start(fastOptions());
+
+  // Started after the profiler, so picked up by the collector
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 4; ++i) {
+    threads.emplace_back([] { burnCpu(std::chrono::milliseconds(300)); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  profiler.stop();
+
+  // Some of the first few milliseconds of each thread may be missed.
+  EXPECT_GT(profiler.getProfile().totalSamples(), 60);
+  profiler.reset();
+}
+
+TEST(CpuProfiler, Restart) {
+  auto& profiler = CpuProfiler::get();
+  profiler.reset();
+  for (size_t i = 0; i < 3; ++i) {
+    profiler.start(fastOptions());
+    burnCpu(std::chrono::milliseconds(100));
+    profiler.stop();
+  }
+  EXPECT_GT(profiler.getProfile().totalSamples(), 15);
+  profiler.reset();
+}
+
+TEST(CpuProfiler, NotRunningIsIdle) {
+  auto& profiler = CpuProfiler::get();
+  profiler.reset();
+  burnCpu(std::chrono::milliseconds(50));
+  EXPECT_EQ(0, profiler.getProfile().totalSamples());
+  profiler.stop();
+}
+
+}}}  // namespaces
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/symbolizer/LockContentionProfiler.h>
+
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <folly/Baton.h>
+#include <folly/MicroSpinLock.h>
+#include <folly/PicoSpinLock.h>
+#include <folly/SharedMutex.h>
+#include <folly/SpinLock.h>
+#include <folly/Synchronized.h>
+#include <folly/portability/GTest.h>
+
+namespace folly { namespace symbolizer { namespace test {
+
+namespace {
+
+// Holds lock on another thread until the returned thread is joined, and
+// makes the calling thread contend for it.
+template <class Lock, class LockFn, class UnlockFn>
+void contendOnce(Lock& lock, LockFn lockFn, UnlockFn unlockFn) {
+  Baton<> locked;
+  std::thread holder([&] {
+    lock.lock();
+    locked.post();
+    /* sleep override */
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    lock.unlock();
+  });
+  locked.wait();
+  lockFn();
+  unlockFn();
+  holder.join();
+}
+
+class LockContentionProfilerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    LockContentionProfiler::get().reset();
+  }
+
+  void TearDown() override {
+    LockContentionProfiler::get().stop();
+    LockContentionProfiler::get().reset();
+  }
+};
+
+const LockContentionProfiler::Entry* findEntry(
+    const std::vector<LockContentionProfiler::Entry>& entries,
+    const void* lock) {
+  for (auto& entry : entries) {
+    if (entry.lock == lock) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+TEST_F(LockContentionProfilerTest, NotRunning) {
+  SharedMutex lock;
+  contendOnce(lock, [&] { lock.lock(); }, [&] { lock.unlock(); });
+  EXPECT_TRUE(LockContentionProfiler::get().getTopN(10).empty());
+}
+
+TEST_F(LockContentionProfilerTest, StartTwice) {
+  auto& profiler = LockContentionProfiler::get();
+  profiler.start();
+  EXPECT_TRUE(profiler.isRunning());
+  EXPECT_THROW(profiler.start(), std::logic_error);
+  profiler.stop();
+  EXPECT_FALSE(profiler.isRunning());
+}
+
+TEST_F(LockContentionProfilerTest, SharedMutex) {
+  auto& profiler = LockContentionProfiler::get();
+  profiler.start();
+  SharedMutex lock;
+  contendOnce(
+      lock, [&] { lock.lock_shared(); }, [&] { lock.unlock_shared(); });
+  profiler.stop();
+
+  auto entries = profiler.getTopN(10);
+  auto entry = findEntry(entries, &lock);
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(LockType::SharedMutex, entry->type);
+  EXPECT_EQ(LockContentionKind::Shared, entry->kind);
+  EXPECT_EQ(1, entry->count);
+  EXPECT_GE(entry->totalWait, std::chrono::milliseconds(5));
+  EXPECT_EQ(entry->totalWait, entry->maxWait);
+  EXPECT_FALSE(entry->waiterStack.empty());
+  EXPECT_FALSE(entry->holderStack.empty());
+
+  auto report = profiler.reportTopN(10);
+  EXPECT_NE(std::string::npos, report.find("SharedMutex")) << report;
+  EXPECT_NE(std::string::npos, report.find("holder:")) << report;
+}
+
+TEST_F(LockContentionProfilerTest, MicroSpinLock) {
+  auto& profiler = LockContentionProfiler::get();
+  profiler.start();
+  MicroSpinLock lock;
+  lock.init();
+  contendOnce(lock, [&] { lock.lock(); }, [&] { lock.unlock(); });
+  profiler.stop();
+
+  auto entries = profiler.getTopN(10);
+  auto entry = findEntry(entries, &lock);
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(LockType::MicroSpinLock, entry->type);
+  EXPECT_EQ(LockContentionKind::Exclusive, entry->kind);
+  EXPECT_EQ(1, entry->count);
+  EXPECT_TRUE(entry->holderStack.empty());
+}
+
+TEST_F(LockContentionProfilerTest, Synchronized) {
+  auto& profiler = LockContentionProfiler::get();
+  profiler.start();
+  Synchronized<int, std::mutex> value(0);
+  Baton<> locked;
+  std::thread holder([&] {
+    auto locked_value = value.lock();
+    locked.post();
+    /* sleep override */
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  });
+  locked.wait();
+  ++*value.lock();
+  holder.join();
+  profiler.stop();
+
+  auto entries = profiler.getTopN(10);
+  ASSERT_EQ(1, entries.size());
+  EXPECT_EQ(LockType::Other, entries[0].type);
+  EXPECT_EQ(1, entries[0].count);
+}
+
+TEST_F(LockContentionProfilerTest, SynchronizedReacquire) {
+  auto& profiler = LockContentionProfiler::get();
+  profiler.start();
+  Synchronized<int, std::mutex> value(0);
+  Baton<> locked;
+  std::thread holder;
+  {
+    auto locked_value = value.lock();
+    {
+      auto unlocker = locked_value.scopedUnlock();
+      holder = std::thread([&] {
+        auto other = value.lock();
+        locked.post();
+        /* sleep override */
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      });
+      locked.wait();
+    }
+    ++*locked_value;
+  }
+  holder.join();
+  profiler.stop();
+
+  auto entries = profiler.getTopN(10);
+  ASSERT_EQ(1, entries.size());
+  EXPECT_EQ(LockType::Other, entries[0].type);
+  EXPECT_EQ(1, entries[0].count);
+}
+
+TEST_F(LockContentionProfilerTest, ReleasedOnAnotherThread) {
+  auto& profiler = LockContentionProfiler::get();
+  profiler.start();
+  union Storage {
+    MicroSpinLock micro;
+    PicoSpinLock<uint64_t> pico;
+  } storage;
+  storage.micro.init();
+  Baton<> locked;
+  std::thread holder([&] {
+    storage.micro.lock();
+    locked.post();
+    /* sleep override */
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    storage.micro.unlock();
+  });
+  locked.wait();
+  storage.micro.lock();
+  holder.join();
+  std::thread([&] { storage.micro.unlock(); }).join();
+
+  // A lock of another type at the same address doesn't inherit the pending
+  // acquisition.
+  storage.pico.init();
+  storage.pico.lock();
+  storage.pico.unlock();
+  profiler.stop();
+  EXPECT_TRUE(profiler.getTopN(10).empty());
+}
+
+TEST_F(LockContentionProfilerTest, SynchronizedSpinLock) {
+  auto& profiler = LockContentionProfiler::get();
+  profiler.start();
+  Synchronized<int, SpinLock> value(0);
+  Baton<> locked;
+  std::thread holder([&] {
+    auto locked_value = value.lock();
+    locked.post();
+    /* sleep override */
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  });
+  locked.wait();
+  ++*value.lock();
+  holder.join();
+  profiler.stop();
+
+  // Reported by the inner MicroSpinLock only
+  auto entries = profiler.getTopN(10);
+  ASSERT_EQ(1, entries.size());
+  EXPECT_EQ(LockType::MicroSpinLock, entries[0].type);
+  EXPECT_EQ(1, entries[0].count);
+}
+
+TEST_F(LockContentionProfilerTest, ReportedOnRelease) {
+  auto& profiler = LockContentionProfiler::get();
+  profiler.start();
+  SharedMutex lock;
+  contendOnce(
+      lock,
+      [&] {
+        lock.lock();
+        EXPECT_TRUE(profiler.getTopN(10).empty());
+      },
+      [&] { lock.unlock(); });
+  profiler.stop();
+
+  auto entries = profiler.getTopN(10);
+  auto entry = findEntry(entries, &lock);
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(1, entry->count);
+}
+
+TEST_F(LockContentionProfilerTest, Sampling) {
+  auto& profiler = LockContentionProfiler::get();
+  LockContentionProfiler::Options options;
+  options.sampleRate = 2;
+  profiler.start(options);
+  SharedMutex lock;
+  for (int i = 0; i < 4; ++i) {
+    contendOnce(lock, [&] { lock.lock(); }, [&] { lock.unlock(); });
+  }
+  profiler.stop();
+
+  // Every other contended acquisition is recorded, with weight 2
+  uint64_t count = 0;
+  for (auto& entry : profiler.getTopN(10)) {
+    if (entry.lock == &lock) {
+      count += entry.count;
+    }
+  }
+  EXPECT_EQ(4, count);
+}
+
+TEST_F(LockContentionProfilerTest, TopN) {
+  auto& profiler = LockContentionProfiler::get();
+  profiler.start();
+  SharedMutex locks[3];
+  for (auto& lock : locks) {
+    contendOnce(lock, [&] { lock.lock(); }, [&] { lock.unlock(); });
+  }
+  profiler.stop();
+
+  auto entries = profiler.getTopN(2);
+  ASSERT_EQ(2, entries.size());
+  EXPECT_GE(entries[0].totalWait, entries[1].totalWait);
+}
+
+}}}  // namespaces
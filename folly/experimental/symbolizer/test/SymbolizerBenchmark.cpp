@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/experimental/symbolizer/Symbolizer.h>
+#include <folly/portability/GFlags.h>
+
+namespace {
+
+using namespace folly::symbolizer;
+
+FrameArray<100> frames;
+
+FOLLY_NOINLINE void captureStackTrace() {
+  getStackTrace(frames);
+}
+
+// What a profiler hands over: the same few stacks, many times.
+std::vector<uintptr_t> makeBatch() {
+  std::vector<uintptr_t> addresses;
+  for (size_t i = 0; i < 64; ++i) {
+    addresses.insert(
+        addresses.end(),
+        frames.addresses,
+        frames.addresses + frames.frameCount);
+  }
+  return addresses;
+}
+
+template <class S>
+void run(S& symbolizer, size_t n) {
+  folly::BenchmarkSuspender suspender;
+  auto addresses = makeBatch();
+  std::vector<SymbolizedFrame> results(addresses.size());
+  suspender.dismiss();
+  for (size_t i = 0; i < n; i++) {
+    suspender.dismissing([&] {
+      for (auto& frame : results) {
+        frame.clear();
+      }
+    });
+    symbolizer.symbolize(addresses.data(), results.data(), addresses.size());
+  }
+}
+
+} // namespace
+
+BENCHMARK(SymbolizerFast, n) {
+  Symbolizer symbolizer(Dwarf::LocationInfoMode::FAST);
+  run(symbolizer, n);
+}
+
+BENCHMARK_RELATIVE(IndexedSymbolizerFastNoCache, n) {
+  IndexedSymbolizer symbolizer(nullptr, 0, Dwarf::LocationInfoMode::FAST);
+  run(symbolizer, n);
+}
+
+BENCHMARK_RELATIVE(IndexedSymbolizerFastCached, n) {
+  IndexedSymbolizer symbolizer(
+      nullptr,
+      IndexedSymbolizer::kDefaultCacheCapacity,
+      Dwarf::LocationInfoMode::FAST);
+  run(symbolizer, n);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(SymbolizerFull, n) {
+  Symbolizer symbolizer(Dwarf::LocationInfoMode::FULL);
+  run(symbolizer, n);
+}
+
+BENCHMARK_RELATIVE(IndexedSymbolizerFullNoCache, n) {
+  IndexedSymbolizer symbolizer(nullptr, 0, Dwarf::LocationInfoMode::FULL);
+  run(symbolizer, n);
+}
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  captureStackTrace();
+  folly::runBenchmarksOnFlag();
+  return 0;
+}
@@ -16,7 +16,11 @@
 
 #include <folly/experimental/symbolizer/Symbolizer.h>
 
+#include <algorithm>
 #include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include <folly/Range.h>
 #include <folly/String.h>
@@ -52,6 +56,31 @@ TEST(Symbolizer, Single) {
   }
 }
 
+TEST(IndexedSymbolizer, Single) {
+  Symbolizer symbolizer;
+  SymbolizedFrame expected;
+  ASSERT_TRUE(symbolizer.symbolize(reinterpret_cast<uintptr_t>(foo), expected));
+
+  IndexedSymbolizer indexedSymbolizer;
+  // Second round is served from the address cache.
+  for (size_t i = 0; i < 2; ++i) {
+    SymbolizedFrame a;
+    ASSERT_TRUE(
+        indexedSymbolizer.symbolize(reinterpret_cast<uintptr_t>(foo), a));
+    EXPECT_EQ("folly::symbolizer::test::foo()", a.demangledName());
+    EXPECT_EQ(expected.location.hasFileAndLine, a.location.hasFileAndLine);
+    EXPECT_EQ(expected.location.file.toString(), a.location.file.toString());
+    EXPECT_EQ(expected.location.line, a.location.line);
+  }
+}
+
+TEST(IndexedSymbolizer, Unmapped) {
+  IndexedSymbolizer symbolizer;
+  SymbolizedFrame a;
+  EXPECT_FALSE(symbolizer.symbolize(0, a));
+  EXPECT_EQ(nullptr, a.name);
+}
+
 FrameArray<100> goldenFrames;
 
 int comparator(const void* ap, const void* bp) {
@@ -85,7 +114,8 @@ void ElfCacheTest::SetUp() {
   ASSERT_LE(4, goldenFrames.frameCount);
 }
 
-void runElfCacheTest(Symbolizer& symbolizer) {
+template <class S>
+void runElfCacheTest(S& symbolizer) {
   FrameArray<100> frames = goldenFrames;
   for (size_t i = 0; i < frames.frameCount; ++i) {
     frames.frames[i].clear();
@@ -114,6 +144,110 @@ TEST_F(ElfCacheTest, SignalSafeElfCache) {
   }
 }
 
+TEST_F(ElfCacheTest, IndexedSymbolizer) {
+  IndexedSymbolizer symbolizer;
+  for (size_t i = 0; i < 2; ++i) {
+    runElfCacheTest(symbolizer);
+  }
+}
+
+TEST_F(ElfCacheTest, IndexedSymbolizerNoCache) {
+  IndexedSymbolizer symbolizer(nullptr, 0);
+  for (size_t i = 0; i < 2; ++i) {
+    runElfCacheTest(symbolizer);
+  }
+}
+
+TEST_F(ElfCacheTest, IndexedSymbolizerBatch) {
+  // Unsorted, with duplicates
+  std::vector<uintptr_t> addresses;
+  for (size_t i = goldenFrames.frameCount; i-- > 0;) {
+    addresses.push_back(goldenFrames.addresses[i]);
+    addresses.push_back(goldenFrames.addresses[0]);
+  }
+  std::vector<SymbolizedFrame> frames(addresses.size());
+  IndexedSymbolizer symbolizer;
+  symbolizer.symbolize(addresses.data(), frames.data(), addresses.size());
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    auto pos = std::find(
+        goldenFrames.addresses,
+        goldenFrames.addresses + goldenFrames.frameCount,
+        addresses[i]);
+    auto& golden = goldenFrames.frames[pos - goldenFrames.addresses];
+    EXPECT_EQ(golden.found, frames[i].found);
+    if (golden.name) {
+      EXPECT_STREQ(golden.name, frames[i].name);
+    }
+  }
+}
+
+// An object with a smaller one defined inside of it. The outer one is
+// local, so it comes first in .symtab.
+asm(".pushsection .data\n"
+    ".type follyOverlapOuter, STT_OBJECT\n"
+    ".size follyOverlapOuter, 64\n"
+    "follyOverlapOuter:\n"
+    ".zero 64\n"
+    ".globl follyOverlapInner\n"
+    ".type follyOverlapInner, STT_OBJECT\n"
+    ".set follyOverlapInner, follyOverlapOuter + 16\n"
+    ".size follyOverlapInner, 8\n"
+    ".popsection\n");
+
+TEST(ElfAddressIndex, SameSymbolsAsElfFile) {
+  auto file = std::make_shared<ElfFile>("/proc/self/exe");
+  ElfAddressIndex index(file, 4);
+  // Aliases and overlapping symbols must resolve to the symbol a linear
+  // scan finds first.
+  std::vector<uintptr_t> addresses;
+  file->iterateSectionsWithType(SHT_SYMTAB, [&](const ElfW(Shdr)& section) {
+    file->iterateSymbols(section, [&](const ElfW(Sym)& sym) {
+      if (sym.st_shndx != SHN_UNDEF && sym.st_size != 0) {
+        addresses.push_back(sym.st_value);
+        addresses.push_back(sym.st_value + sym.st_size - 1);
+      }
+      return false;
+    });
+    return false;
+  });
+  ASSERT_FALSE(addresses.empty());
+  // getDefinitionByAddress() is a linear scan; check a sample.
+  const size_t step = std::max<size_t>(1, addresses.size() / 2000);
+  std::vector<uintptr_t> sample;
+  for (size_t i = 0; i < addresses.size(); i += step) {
+    sample.push_back(addresses[i]);
+  }
+  auto outer = file->getSymbolByName("follyOverlapOuter");
+  ASSERT_NE(nullptr, outer.second);
+  sample.push_back(outer.second->st_value + 20);
+
+  for (auto address : sample) {
+    EXPECT_EQ(
+        file->getSymbolName(file->getDefinitionByAddress(address)),
+        index.findSymbolName(address))
+        << "address " << address;
+  }
+}
+
+TEST_F(ElfCacheTest, IndexedSymbolizerThreads) {
+  IndexedSymbolizer symbolizer(
+      nullptr,
+      IndexedSymbolizer::kDefaultCacheCapacity,
+      Symbolizer::kDefaultLocationInfoMode,
+      4);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 8; ++t) {
+    threads.emplace_back([&] {
+      for (size_t i = 0; i < 10; ++i) {
+        runElfCacheTest(symbolizer);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 }}}  // namespaces
 
 // Can't use initFacebookLight since that would install its own signal handlers
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/ConcurrentBTreeMap.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/ConcurrentSkipList.h>
+#include <folly/portability/GFlags.h>
+
+using namespace folly;
+
+namespace {
+
+typedef ConcurrentBTreeMap<int64_t, int64_t> BTreeMap;
+typedef ConcurrentSkipList<int64_t> SkipList;
+
+constexpr size_t kSize = 1 << 20;
+constexpr size_t kScanLength = 100;
+
+// Both containers hold the even numbers in [0, 2 * kSize); lookups are
+// for random numbers in that range, so half of them hit.
+struct Data {
+  Data() : skipList(SkipList::createInstance()) {
+    std::mt19937_64 rng(0);
+    std::vector<int64_t> keys(kSize);
+    for (size_t i = 0; i < kSize; ++i) {
+      keys[i] = 2 * i;
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+    SkipList::Accessor accessor(skipList);
+    for (auto k : keys) {
+      btree.insert(k, k);
+      accessor.add(k);
+    }
+    lookups.resize(1 << 16);
+    for (auto& k : lookups) {
+      k = rng() % (2 * kSize);
+    }
+  }
+
+  BTreeMap btree;
+  std::shared_ptr<SkipList> skipList;
+  std::vector<int64_t> lookups;
+};
+
+Data& data() {
+  static Data d;
+  return d;
+}
+
+// Runs fn(lookupKey) iters times in total, spread over nthreads threads.
+template <typename Fn>
+void runThreads(size_t iters, size_t nthreads, Fn fn) {
+  auto& lookups = data().lookups;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < nthreads; ++t) {
+    threads.emplace_back([&, t] {
+      auto mask = lookups.size() - 1;
+      for (size_t i = t; i < iters; i += nthreads) {
+        fn(lookups[(i * 7919) & mask]);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+void lookupBTree(size_t iters, size_t nthreads) {
+  auto& btree = data().btree;
+  runThreads(iters, nthreads, [&](int64_t k) {
+    doNotOptimizeAway(btree.get(k));
+  });
+}
+
+void lookupSkipList(size_t iters, size_t nthreads) {
+  auto& skipList = data().skipList;
+  runThreads(iters, nthreads, [&](int64_t k) {
+    SkipList::Accessor accessor(skipList);
+    doNotOptimizeAway(accessor.find(k) != accessor.end());
+  });
+}
+
+void scanBTree(size_t iters, size_t nthreads) {
+  auto& btree = data().btree;
+  runThreads(iters, nthreads, [&](int64_t k) {
+    int64_t sum = 0;
+    auto it = btree.lower_bound(k);
+    for (size_t i = 0; i < kScanLength && it != btree.end(); ++i, ++it) {
+      sum += it->second;
+    }
+    doNotOptimizeAway(sum);
+  });
+}
+
+void scanSkipList(size_t iters, size_t nthreads) {
+  auto& skipList = data().skipList;
+  runThreads(iters, nthreads, [&](int64_t k) {
+    SkipList::Accessor accessor(skipList);
+    int64_t sum = 0;
+    auto it = accessor.lower_bound(k);
+    for (size_t i = 0; i < kScanLength && it != accessor.end(); ++i, ++it) {
+      sum += *it;
+    }
+    doNotOptimizeAway(sum);
+  });
+}
+
+void build(size_t iters, bool btree) {
+  BenchmarkSuspender susp;
+  std::vector<int64_t> keys(kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    keys[i] = i;
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(0));
+  for (size_t iter = 0; iter < iters; ++iter) {
+    if (btree) {
+      BTreeMap map;
+      susp.dismiss();
+      for (auto k : keys) {
+        map.insert(k, k);
+      }
+      susp.rehire();
+    } else {
+      SkipList::Accessor accessor(SkipList::createInstance());
+      susp.dismiss();
+      for (auto k : keys) {
+        accessor.add(k);
+      }
+      susp.rehire();
+    }
+  }
+}
+
+} // namespace
+
+BENCHMARK(warmup, n) {
+  BenchmarkSuspender susp;
+  doNotOptimizeAway(data().lookups.size() + n);
+}
+
+BENCHMARK_DRAW_LINE();
+
+#define THREADS_BENCHMARK(name, nthreads)                     \
+  BENCHMARK(name##SkipList_##nthreads##thread, iters) {       \
+    name##SkipList(iters, nthreads);                          \
+  }                                                           \
+  BENCHMARK_RELATIVE(name##BTree_##nthreads##thread, iters) { \
+    name##BTree(iters, nthreads);                             \
+  }
+
+THREADS_BENCHMARK(lookup, 1)
+THREADS_BENCHMARK(lookup, 2)
+THREADS_BENCHMARK(lookup, 4)
+THREADS_BENCHMARK(lookup, 8)
+BENCHMARK_DRAW_LINE();
+THREADS_BENCHMARK(scan, 1)
+THREADS_BENCHMARK(scan, 2)
+THREADS_BENCHMARK(scan, 4)
+THREADS_BENCHMARK(scan, 8)
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(buildSkipList_1M, iters) {
+  build(iters, false);
+}
+
+BENCHMARK_RELATIVE(buildBTree_1M, iters) {
+  build(iters, true);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
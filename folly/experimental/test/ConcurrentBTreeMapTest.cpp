@@ -0,0 +1,230 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/ConcurrentBTreeMap.h>
+
+#include <atomic>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+
+namespace {
+
+// Small nodes, so that a few thousand elements make a deep tree.
+typedef ConcurrentBTreeMap<int, int, std::less<int>, 4> SmallMap;
+
+template <class Map>
+void expectEqual(const std::map<int, int>& expected, const Map& map) {
+  auto it = map.begin();
+  for (auto& p : expected) {
+    ASSERT_TRUE(it != map.end());
+    EXPECT_EQ(p.first, it->first);
+    EXPECT_EQ(p.second, it->second);
+    ++it;
+  }
+  EXPECT_TRUE(it == map.end());
+}
+
+} // namespace
+
+TEST(ConcurrentBTreeMap, Empty) {
+  SmallMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.begin() == map.end());
+  EXPECT_TRUE(map.lower_bound(0) == map.end());
+  EXPECT_FALSE(map.contains(0));
+  EXPECT_FALSE(map.get(0).hasValue());
+  EXPECT_EQ(0, map.erase(0));
+}
+
+TEST(ConcurrentBTreeMap, InsertGetErase) {
+  SmallMap map;
+  EXPECT_TRUE(map.insert(1, 10));
+  EXPECT_FALSE(map.insert(1, 11));
+  EXPECT_EQ(10, map.get(1).value());
+  EXPECT_FALSE(map.insert_or_assign(1, 12));
+  EXPECT_EQ(12, map.get(1).value());
+  EXPECT_TRUE(map.insert_or_assign(2, 20));
+  EXPECT_TRUE(map.contains(2));
+  EXPECT_FALSE(map.contains(3));
+  EXPECT_EQ(1, map.erase(1));
+  EXPECT_EQ(0, map.erase(1));
+  EXPECT_FALSE(map.contains(1));
+  EXPECT_EQ(20, map.find(2)->second);
+  EXPECT_TRUE(map.find(1) == map.end());
+}
+
+TEST(ConcurrentBTreeMap, RandomOperations) {
+  SmallMap map;
+  std::map<int, int> expected;
+  std::mt19937 rng(1234);
+  for (int i = 0; i < 50000; ++i) {
+    int k = rng() % 3000;
+    switch (rng() % 4) {
+      case 0:
+      case 1:
+        EXPECT_EQ(expected.emplace(k, i).second, map.insert(k, i));
+        break;
+      case 2:
+        EXPECT_EQ(expected.count(k) == 0, map.insert_or_assign(k, i));
+        expected[k] = i;
+        break;
+      default:
+        EXPECT_EQ(expected.erase(k), map.erase(k));
+    }
+  }
+  expectEqual(expected, map);
+
+  for (int k = -1; k <= 3000; ++k) {
+    auto value = map.get(k);
+    auto eit = expected.find(k);
+    ASSERT_EQ(eit != expected.end(), value.hasValue());
+    if (value) {
+      EXPECT_EQ(eit->second, *value);
+    }
+
+    auto lower = map.lower_bound(k);
+    auto elower = expected.lower_bound(k);
+    ASSERT_EQ(elower == expected.end(), lower == map.end());
+    if (elower != expected.end()) {
+      EXPECT_EQ(elower->first, lower->first);
+    }
+
+    auto upper = map.upper_bound(k);
+    auto eupper = expected.upper_bound(k);
+    ASSERT_EQ(eupper == expected.end(), upper == map.end());
+    if (eupper != expected.end()) {
+      EXPECT_EQ(eupper->first, upper->first);
+    }
+  }
+
+  // Emptying the map unlinks leaves; what is left must still work.
+  for (auto& p : expected) {
+    EXPECT_EQ(1, map.erase(p.first));
+  }
+  EXPECT_TRUE(map.empty());
+  for (int k = 0; k < 3000; k += 3) {
+    EXPECT_TRUE(map.insert(k, k));
+  }
+  int n = 0;
+  for (auto& p : map) {
+    EXPECT_EQ(3 * n++, p.first);
+  }
+  EXPECT_EQ(1000, n);
+}
+
+TEST(ConcurrentBTreeMap, CustomCompare) {
+  ConcurrentBTreeMap<int, int, std::greater<int>> map;
+  for (int i = 0; i < 1000; ++i) {
+    map.insert(i, -i);
+  }
+  EXPECT_EQ(999, map.begin()->first);
+  EXPECT_EQ(499, map.lower_bound(499)->first);
+  EXPECT_EQ(498, map.upper_bound(499)->first);
+}
+
+TEST(ConcurrentBTreeMap, IteratorsSurviveWrites) {
+  SmallMap map;
+  for (int i = 0; i < 1000; ++i) {
+    map.insert(2 * i, i);
+  }
+  auto it = map.lower_bound(1000);
+  for (int i = 0; i < 1000; ++i) {
+    map.insert(2 * i + 1, i);
+    if (i % 3) {
+      map.erase(2 * i);
+    }
+  }
+  // Elements that were never erased are all visited, in order.
+  int prev = -1;
+  int kept = 0;
+  for (; it != map.end(); ++it) {
+    EXPECT_LT(prev, it->first);
+    prev = it->first;
+    kept += it->first % 6 == 0;
+  }
+  EXPECT_EQ(167, kept);
+}
+
+TEST(ConcurrentBTreeMap, ConcurrentReadersAndWriters) {
+  constexpr int kStable = 5000;
+  constexpr int kWriters = 4;
+  SmallMap map;
+  // Multiples of kWriters + 1 are never touched by the writers.
+  for (int i = 0; i < kStable; ++i) {
+    map.insert(i * (kWriters + 1), i);
+  }
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> threads;
+  for (int r = 0; r < 4; ++r) {
+    threads.emplace_back([&, r] {
+      std::mt19937 rng(r);
+      while (!done.load()) {
+        int stable = 0;
+        int prev = -1;
+        for (auto& p : map) {
+          EXPECT_LT(prev, p.first);
+          prev = p.first;
+          stable += p.first % (kWriters + 1) == 0;
+        }
+        EXPECT_EQ(kStable, stable);
+        for (int i = 0; i < 100; ++i) {
+          int k = rng() % kStable;
+          EXPECT_EQ(k, map.get(k * (kWriters + 1)).value());
+          // The first stable key at or after the previous writer keys.
+          auto it = map.upper_bound(k * (kWriters + 1) - kWriters - 1);
+          while (it->first % (kWriters + 1) != 0) {
+            ++it;
+          }
+          EXPECT_EQ(k * (kWriters + 1), it->first);
+        }
+      }
+    });
+  }
+  std::vector<std::thread> writers;
+  for (int w = 0; w < kWriters; ++w) {
+    writers.emplace_back([&, w] {
+      std::mt19937 rng(100 + w);
+      for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < kStable; ++i) {
+          EXPECT_TRUE(map.insert(i * (kWriters + 1) + w + 1, round));
+        }
+        for (int i = 0; i < kStable; ++i) {
+          EXPECT_EQ(1, map.erase(i * (kWriters + 1) + w + 1));
+        }
+      }
+    });
+  }
+  for (auto& t : writers) {
+    t.join();
+  }
+  done = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  std::map<int, int> expected;
+  for (int i = 0; i < kStable; ++i) {
+    expected[i * (kWriters + 1)] = i;
+  }
+  expectEqual(expected, map);
+}
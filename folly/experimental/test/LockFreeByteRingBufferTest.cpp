@@ -0,0 +1,265 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/Baton.h>
+#include <folly/experimental/LockFreeByteRingBuffer.h>
+#include <folly/portability/GTest.h>
+
+namespace folly {
+
+namespace {
+
+typedef LockFreeByteRingBuffer<> RB;
+typedef RB::ReadResult ReadResult;
+
+// A record whose contents can be checked from the record alone: a writer
+// id, a sequence number, and a run of bytes derived from both.
+std::string makeRecord(uint32_t writer, uint32_t seq) {
+  size_t length = 8 + (writer * 7 + seq * 13) % 100;
+  std::string record(length, '\0');
+  memcpy(&record[0], &writer, 4);
+  memcpy(&record[4], &seq, 4);
+  for (size_t i = 8; i < length; i++) {
+    record[i] = char(writer + seq + i);
+  }
+  return record;
+}
+
+bool checkRecord(const std::string& record, uint32_t& writer, uint32_t& seq) {
+  if (record.size() < 8) {
+    return false;
+  }
+  memcpy(&writer, &record[0], 4);
+  memcpy(&seq, &record[4], 4);
+  return record == makeRecord(writer, seq);
+}
+
+// Once armed, makes the next store wait until released, to stop a writer
+// between claiming its space and filling it in.
+std::atomic<bool> gateArmed(false);
+Baton<> gateReached;
+Baton<> gateOpened;
+
+template <typename T>
+struct GatedAtom : std::atomic<T> {
+  GatedAtom() = default;
+  /* implicit */ GatedAtom(T v) : std::atomic<T>(v) {}
+
+  void store(T v, std::memory_order order = std::memory_order_seq_cst) {
+    if (gateArmed.exchange(false)) {
+      gateReached.post();
+      gateOpened.wait();
+    }
+    std::atomic<T>::store(v, order);
+  }
+};
+
+} // namespace
+
+namespace detail {
+template <>
+int Futex<GatedAtom>::futexWake(int, uint32_t) {
+  return 0;
+}
+} // namespace detail
+
+TEST(LockFreeByteRingBuffer, writeReadSequentially) {
+  RB rb(1000);
+  auto cursor = rb.currentHead();
+  std::string dest;
+  for (uint32_t turn = 0; turn < 20; turn++) {
+    // Records of all sizes, including empty ones, wrapping around the end
+    // of the buffer.
+    for (uint32_t i = 0; i < 10; i++) {
+      rb.write(StringPiece(std::string(turn * 3 + i, char('a' + i))));
+    }
+    for (uint32_t i = 0; i < 10; i++) {
+      ASSERT_EQ(ReadResult::SUCCESS, rb.tryRead(dest, cursor));
+      EXPECT_EQ(std::string(turn * 3 + i, char('a' + i)), dest);
+    }
+    EXPECT_EQ(ReadResult::FUTURE, rb.tryRead(dest, cursor));
+  }
+}
+
+TEST(LockFreeByteRingBuffer, readerCanDetectSkips) {
+  RB rb(256);
+  auto cursor = rb.currentHead();
+  std::string dest;
+  for (int i = 0; i < 100; i++) {
+    rb.write(StringPiece("0123456789"));
+  }
+  EXPECT_EQ(ReadResult::PAST, rb.tryRead(dest, cursor));
+  EXPECT_EQ(ReadResult::PAST, rb.waitAndTryRead(dest, cursor));
+
+  // Starting over from the head, the reader catches up.
+  cursor = rb.currentHead();
+  auto written = rb.writeAndGetCursor(StringPiece("last"));
+  ASSERT_EQ(ReadResult::SUCCESS, rb.tryRead(dest, written));
+  EXPECT_EQ("last", dest);
+  ASSERT_EQ(ReadResult::SUCCESS, rb.tryRead(dest, cursor));
+  EXPECT_EQ("last", dest);
+  EXPECT_EQ(ReadResult::FUTURE, rb.tryRead(dest, cursor));
+}
+
+// 8 words. The first record's payload spans words 2 to 6, the second
+// record words 7 to 1, so the next record starts at position 10, in word
+// 2. Make the first record's payload look like that record's header.
+template <typename Buffer>
+void writeRecordsThatLookCommitted(Buffer& rb) {
+  uint64_t payload[5] = {~uint64_t(10), 8, 0, 0, 0};
+  rb.write(ByteRange(reinterpret_cast<const uint8_t*>(payload), 35));
+  rb.write(StringPiece("0123456"));
+}
+
+TEST(LockFreeByteRingBuffer, unwrittenRecordLooksCommitted) {
+  RB rb(64);
+  writeRecordsThatLookCommitted(rb);
+
+  auto cursor = rb.currentHead();
+  std::string dest;
+  EXPECT_EQ(ReadResult::FUTURE, rb.tryRead(dest, cursor));
+  rb.write(StringPiece("x"));
+  ASSERT_EQ(ReadResult::SUCCESS, rb.tryRead(dest, cursor));
+  EXPECT_EQ("x", dest);
+}
+
+TEST(LockFreeByteRingBuffer, claimedRecordLooksCommitted) {
+  typedef LockFreeByteRingBuffer<GatedAtom> GatedRB;
+  GatedRB rb(64);
+  writeRecordsThatLookCommitted(rb);
+
+  auto cursor = rb.currentHead();
+  gateArmed = true;
+  // Claims the space of the next record, then waits before writing to it.
+  std::thread writer([&] { rb.write(StringPiece("x")); });
+  gateReached.wait();
+  std::string dest;
+  EXPECT_EQ(GatedRB::ReadResult::FUTURE, rb.tryRead(dest, cursor));
+  gateOpened.post();
+  writer.join();
+  ASSERT_EQ(GatedRB::ReadResult::SUCCESS, rb.tryRead(dest, cursor));
+  EXPECT_EQ("x", dest);
+}
+
+TEST(LockFreeByteRingBuffer, recordsAreTruncated) {
+  RB rb(64);
+  EXPECT_EQ(42, rb.maxRecordSize());
+  auto cursor = rb.currentHead();
+  rb.write(StringPiece(std::string(100, 'x')));
+  std::string dest;
+  ASSERT_EQ(ReadResult::SUCCESS, rb.tryRead(dest, cursor));
+  EXPECT_EQ(std::string(42, 'x'), dest);
+}
+
+TEST(LockFreeByteRingBuffer, readsCanBlock) {
+  RB rb(256);
+  auto cursor = rb.currentHead();
+  std::string dest;
+
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+  EXPECT_EQ(ReadResult::FUTURE, rb.waitAndTryRead(dest, cursor, deadline));
+  EXPECT_GE(std::chrono::steady_clock::now(), deadline);
+
+  std::atomic<bool> readerHasRun(false);
+  auto reader = std::thread([&]() {
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ(ReadResult::SUCCESS, rb.waitAndTryRead(dest, cursor));
+      EXPECT_EQ(std::string(i, 'a'), dest);
+    }
+    readerHasRun = true;
+  });
+  for (int i = 0; i < 3; i++) {
+    EXPECT_FALSE(readerHasRun);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    rb.write(StringPiece(std::string(i, 'a')));
+  }
+  reader.join();
+  EXPECT_TRUE(readerHasRun);
+}
+
+TEST(LockFreeByteRingBuffer, concurrentWritersAndReaders) {
+  const uint32_t writers = 4;
+  const uint32_t writes = 20000;
+  // Small enough for readers to fall behind now and then
+  RB rb(4096);
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> readers;
+  std::atomic<uint64_t> totalRead(0);
+  for (int r = 0; r < 2; r++) {
+    readers.emplace_back([&]() {
+      auto cursor = rb.currentHead();
+      std::string dest;
+      std::vector<int64_t> lastSeq(writers, -1);
+      while (true) {
+        auto result = rb.waitAndTryRead(
+            dest,
+            cursor,
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(1));
+        if (result == ReadResult::PAST) {
+          cursor = rb.currentHead();
+        } else if (result == ReadResult::SUCCESS) {
+          // Every record read is intact, and each writer's records are
+          // read in order.
+          uint32_t writer;
+          uint32_t seq;
+          ASSERT_TRUE(checkRecord(dest, writer, seq));
+          ASSERT_LT(writer, writers);
+          EXPECT_LT(lastSeq[writer], int64_t(seq));
+          lastSeq[writer] = seq;
+          ++totalRead;
+        } else if (done) {
+          return;
+        }
+      }
+    });
+  }
+
+  std::vector<std::thread> threads;
+  for (uint32_t w = 0; w < writers; w++) {
+    threads.emplace_back([&, w]() {
+      for (uint32_t seq = 0; seq < writes; seq++) {
+        rb.write(StringPiece(makeRecord(w, seq)));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  done = true;
+  for (auto& t : readers) {
+    t.join();
+  }
+  EXPECT_LT(0, totalRead.load());
+
+  // Once writers are done, the window can be read back in full.
+  auto cursor = rb.currentHead();
+  rb.write(StringPiece(makeRecord(0, writes)));
+  std::string dest;
+  uint32_t writer;
+  uint32_t seq;
+  ASSERT_EQ(ReadResult::SUCCESS, rb.tryRead(dest, cursor));
+  EXPECT_TRUE(checkRecord(dest, writer, seq));
+  EXPECT_EQ(writes, seq);
+}
+
+} // namespace folly
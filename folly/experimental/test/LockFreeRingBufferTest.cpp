@@ -257,4 +257,63 @@ TEST(LockFreeRingBuffer, moveBackwardsCanFail) {
   EXPECT_FALSE(cursor.moveBackward()); // moving back does nothing
 }
 
+TEST(LockFreeRingBuffer, readBatch) {
+  const int capacity = 8;
+  LockFreeRingBuffer<int> rb(capacity);
+  auto cursor = rb.currentHead();
+  int dest[16];
+
+  EXPECT_EQ(0, rb.tryReadBatch(dest, 16, cursor));
+  for (int i = 0; i < 5; i++) {
+    rb.write(i);
+  }
+  // Stops at the first write that has not occurred yet
+  ASSERT_EQ(5, rb.tryReadBatch(dest, 16, cursor));
+  for (int i = 0; i < 5; i++) {
+    EXPECT_EQ(i, dest[i]);
+  }
+  ASSERT_EQ(2, rb.tryReadBatch(dest, 2, cursor));
+  cursor.moveForward(5);
+  EXPECT_EQ(0, rb.tryReadBatch(dest, 16, cursor));
+
+  // Fails from the start once the window has moved past the cursor
+  for (int i = 5; i < 20; i++) {
+    rb.write(i);
+  }
+  EXPECT_EQ(0, rb.tryReadBatch(dest, 16, cursor));
+  cursor = rb.currentTail();
+  ASSERT_EQ(capacity, rb.tryReadBatch(dest, 16, cursor));
+  for (int i = 0; i < capacity; i++) {
+    EXPECT_EQ(20 - capacity + i, dest[i]);
+  }
+}
+
+TEST(LockFreeRingBuffer, readsCanTimeOut) {
+  LockFreeRingBuffer<int> rb(4);
+  auto cursor = rb.currentHead();
+  int dest[4] = {-1, -1, -1, -1};
+
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+  EXPECT_FALSE(rb.waitAndTryRead(dest[0], cursor, deadline));
+  EXPECT_GE(std::chrono::steady_clock::now(), deadline);
+  EXPECT_EQ(0, rb.waitAndTryReadBatch(dest, 4, cursor, deadline));
+
+  const int sentinel = 0xfaceb00c;
+  auto reader = std::thread([&]() {
+    // Wakes up for the first write, then takes whatever else is there
+    EXPECT_LE(
+        1,
+        rb.waitAndTryReadBatch(
+            dest,
+            4,
+            cursor,
+            std::chrono::steady_clock::now() + std::chrono::hours(1)));
+  });
+  int val = sentinel;
+  rb.write(val);
+  reader.join();
+  EXPECT_EQ(sentinel, dest[0]);
+}
+
 } // namespace folly
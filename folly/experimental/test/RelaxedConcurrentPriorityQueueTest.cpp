@@ -0,0 +1,377 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/RelaxedConcurrentPriorityQueue.h>
+#include <folly/Benchmark.h>
+#include <folly/experimental/FlatCombiningPriorityQueue.h>
+#include <folly/portability/GTest.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+DEFINE_bool(bench, false, "run benchmark");
+DEFINE_int32(reps, 10, "number of reps");
+DEFINE_int32(ops, 100000, "number of operations per rep");
+DEFINE_int32(size, 64, "initial size of the priority queue");
+DEFINE_int32(work, 1000, "amount of unrelated work per operation");
+
+using RPQ = folly::RelaxedConcurrentPriorityQueue<int>;
+using FCPQ = folly::FlatCombiningPriorityQueue<int>;
+
+void doWork(int work) {
+  uint64_t a = 0;
+  for (int i = work; i > 0; --i) {
+    a += i;
+  }
+  folly::doNotOptimizeAway(a);
+}
+
+#if FOLLY_SANITIZE_THREAD
+static std::vector<int> nthr = {1, 2, 3, 4, 6, 8, 12, 16};
+#else
+static std::vector<int> nthr = {1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64};
+#endif
+static uint32_t nthreads;
+
+template <typename PriorityQueue, typename Func>
+static uint64_t run_once(PriorityQueue& pq, const Func& fn) {
+  int ops = FLAGS_ops;
+  int size = FLAGS_size;
+  std::atomic<bool> start{false};
+  std::atomic<uint32_t> started{0};
+
+  for (int i = 0; i < size; ++i) {
+    pq.push(i * (ops / size));
+  }
+
+  std::vector<std::thread> threads(nthreads);
+  for (uint32_t tid = 0; tid < nthreads; ++tid) {
+    threads[tid] = std::thread([&, tid] {
+      started.fetch_add(1);
+      while (!start.load())
+        /* nothing */;
+      fn(tid);
+    });
+  }
+
+  while (started.load() < nthreads)
+    /* nothing */;
+  auto tbegin = std::chrono::steady_clock::now();
+
+  // begin time measurement
+  start.store(true);
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // end time measurement
+  auto tend = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(tend - tbegin)
+      .count();
+}
+
+TEST(RelaxedPriQueue, basic) {
+  RPQ pq(4);
+  EXPECT_TRUE(pq.empty());
+  EXPECT_EQ(pq.size(), 0);
+  int v;
+  EXPECT_FALSE(pq.tryPop(v));
+
+  pq.push(1);
+  pq.push(2);
+  EXPECT_FALSE(pq.empty());
+  EXPECT_EQ(pq.size(), 2);
+
+  EXPECT_TRUE(pq.tryPop(v));
+  EXPECT_TRUE(v == 1 || v == 2);
+  int w;
+  pq.pop(w);
+  EXPECT_EQ(v + w, 3);
+  EXPECT_TRUE(pq.empty());
+  EXPECT_EQ(pq.size(), 0);
+}
+
+TEST(RelaxedPriQueue, single_queue_is_exact) {
+  RPQ pq(1);
+  for (int i = 0; i < 1000; ++i) {
+    pq.push((i * 7919) % 1000);
+  }
+  for (int i = 999; i >= 0; --i) {
+    int v;
+    EXPECT_TRUE(pq.tryPop(v));
+    EXPECT_EQ(v, i);
+  }
+  EXPECT_TRUE(pq.empty());
+}
+
+TEST(RelaxedPriQueue, strict) {
+  // Pushes spread over the heaps by several threads, then exact pops.
+  folly::RelaxedConcurrentPriorityQueue<int, std::greater<int>> pq(16, true);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = t; i < 20000; i += 4) {
+        pq.push(i);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(pq.size(), 20000);
+  for (int i = 0; i < 20000; ++i) {
+    int v;
+    EXPECT_TRUE(pq.tryPop(v));
+    EXPECT_EQ(v, i);
+  }
+  EXPECT_TRUE(pq.empty());
+}
+
+TEST(RelaxedPriQueue, rank_error) {
+  // With k heaps, pops should come from near the top: the expected rank
+  // of a popped element among the remaining ones is O(k).
+  constexpr int kQueues = 8;
+  constexpr int kElements = 100000;
+  RPQ pq(kQueues);
+  for (int i = 0; i < kElements; ++i) {
+    pq.push(i);
+  }
+  // Popped values, to find the rank of each pop among the remaining ones.
+  std::vector<bool> popped(kElements, false);
+  int top = kElements - 1;
+  uint64_t totalRank = 0;
+  for (int i = 0; i < kElements; ++i) {
+    int v;
+    EXPECT_TRUE(pq.tryPop(v));
+    EXPECT_FALSE(popped[v]);
+    popped[v] = true;
+    // Rank of v: the number of remaining values above it, bounded by
+    // walking down from the largest remaining one.
+    int rank = 0;
+    for (int u = top; u > v; --u) {
+      rank += !popped[u];
+    }
+    totalRank += rank;
+    while (top >= 0 && popped[top]) {
+      --top;
+    }
+  }
+  EXPECT_TRUE(pq.empty());
+  EXPECT_LT(totalRank / kElements, 4 * kQueues);
+}
+
+TEST(RelaxedPriQueue, timeout) {
+  RPQ pq;
+  int v;
+  auto begin = std::chrono::steady_clock::now();
+  EXPECT_FALSE(pq.tryPop(v, begin + std::chrono::microseconds(1000)));
+  EXPECT_GE(
+      std::chrono::steady_clock::now() - begin,
+      std::chrono::microseconds(1000));
+  pq.push(10);
+  EXPECT_TRUE(pq.tryPop(
+      v, std::chrono::steady_clock::now() + std::chrono::microseconds(1000)));
+  EXPECT_EQ(v, 10);
+}
+
+TEST(RelaxedPriQueue, blocking_pop) {
+  for (bool strict : {false, true}) {
+    RPQ pq(0, strict);
+    constexpr int kConsumers = 4;
+    constexpr int kItems = 10000;
+    std::atomic<int64_t> sum{0};
+    std::atomic<int> consumed{0};
+    std::vector<std::thread> consumers;
+    for (int t = 0; t < kConsumers; ++t) {
+      consumers.emplace_back([&] {
+        while (true) {
+          int v;
+          pq.pop(v);
+          if (v < 0) {
+            return;
+          }
+          sum += v;
+          ++consumed;
+        }
+      });
+    }
+    // Producers start while the consumers are likely blocked.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 2; ++t) {
+      producers.emplace_back([&, t] {
+        for (int i = t; i < kItems; i += 2) {
+          pq.push(i);
+          if (i % 1000 == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+          }
+        }
+      });
+    }
+    for (auto& t : producers) {
+      t.join();
+    }
+    // Relaxed pops may prefer a low priority sentinel over the remaining
+    // items, so only stop the consumers once they have taken everything.
+    while (consumed.load() < kItems) {
+      std::this_thread::yield();
+    }
+    for (int t = 0; t < kConsumers; ++t) {
+      pq.push(-1);
+    }
+    for (auto& t : consumers) {
+      t.join();
+    }
+    EXPECT_EQ(sum.load(), int64_t(kItems) * (kItems - 1) / 2);
+    EXPECT_TRUE(pq.empty());
+  }
+}
+
+TEST(RelaxedPriQueue, push_pop) {
+  int ops = 1000;
+  int work = 0;
+  std::chrono::steady_clock::time_point when =
+      std::chrono::steady_clock::now() + std::chrono::hours(24);
+  for (auto n : nthr) {
+    nthreads = n;
+    RPQ pq;
+    std::atomic<int64_t> pushed{0};
+    std::atomic<int64_t> popped{0};
+    auto fn = [&](uint32_t tid) {
+      for (int i = tid; i < ops; i += nthreads) {
+        pq.push(i);
+        pq.push(i);
+        pushed += 2 * i;
+        doWork(work);
+        int v;
+        EXPECT_TRUE(pq.tryPop(v, when));
+        popped += v;
+        pq.pop(v);
+        popped += v;
+        doWork(work);
+      }
+    };
+    run_once(pq, fn);
+    // What is left is the initial elements plus what was pushed but not
+    // popped.
+    int64_t left = 0;
+    int v;
+    while (pq.tryPop(v)) {
+      left += v;
+    }
+    int64_t initial = 0;
+    for (int i = 0; i < FLAGS_size; ++i) {
+      initial += i * (FLAGS_ops / FLAGS_size);
+    }
+    EXPECT_EQ(initial + pushed.load(), popped.load() + left);
+  }
+}
+
+enum Exp {
+  FCNonBlock,
+  FCBlock,
+  RelaxedNonBlock,
+  RelaxedBlock,
+  StrictNonBlock,
+};
+
+template <typename PriorityQueue>
+static uint64_t run_exp(PriorityQueue& pq, bool block) {
+  int ops = FLAGS_ops;
+  int work = FLAGS_work;
+  auto fn = [&](uint32_t tid) {
+    for (int i = tid; i < ops; i += nthreads) {
+      pq.push(i);
+      doWork(work);
+      int v;
+      if (block) {
+        pq.pop(v);
+      } else {
+        EXPECT_TRUE(pq.tryPop(v));
+      }
+      doWork(work);
+    }
+  };
+  return run_once(pq, fn);
+}
+
+static uint64_t test(std::string name, Exp exp, uint64_t base) {
+  uint64_t min = UINTMAX_MAX;
+  uint64_t max = 0;
+  uint64_t sum = 0;
+
+  for (int r = 0; r < FLAGS_reps; ++r) {
+    uint64_t dur;
+    switch (exp) {
+      case FCNonBlock:
+      case FCBlock: {
+        FCPQ pq;
+        dur = run_exp(pq, exp == FCBlock);
+      } break;
+      case RelaxedNonBlock:
+      case RelaxedBlock: {
+        RPQ pq;
+        dur = run_exp(pq, exp == RelaxedBlock);
+      } break;
+      case StrictNonBlock: {
+        RPQ pq(0, true);
+        dur = run_exp(pq, false);
+      } break;
+      default:
+        ADD_FAILURE();
+    }
+
+    sum += dur;
+    min = std::min(min, dur);
+    max = std::max(max, dur);
+  }
+
+  uint64_t avg = sum / FLAGS_reps;
+  uint64_t res = min;
+  std::cout << name;
+  std::cout << "   " << std::setw(4) << max / FLAGS_ops << " ns";
+  std::cout << "   " << std::setw(4) << avg / FLAGS_ops << " ns";
+  std::cout << "   " << std::setw(4) << res / FLAGS_ops << " ns";
+  if (base) {
+    std::cout << " " << std::setw(3) << 100 * base / res << "%";
+  }
+  std::cout << std::endl;
+  return res;
+}
+
+TEST(RelaxedPriQueue, bench) {
+  if (!FLAGS_bench) {
+    return;
+  }
+
+  std::cout << "Test_name, Max time, Avg time, Min time, % base min / min"
+            << std::endl;
+  for (int i : nthr) {
+    nthreads = i;
+    std::cout << "\n------------------------------------ Number of threads = "
+              << i << std::endl;
+    uint64_t base =
+    test("fc non-blocking             ", FCNonBlock, 0);
+    test("fc blocking                 ", FCBlock, base);
+    std::cout << "---- relaxed --------------------------" << std::endl;
+    test("relaxed non-blocking        ", RelaxedNonBlock, base);
+    test("relaxed blocking            ", RelaxedBlock, base);
+    test("strict non-blocking         ", StrictNonBlock, base);
+  }
+}
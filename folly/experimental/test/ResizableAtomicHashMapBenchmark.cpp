@@ -0,0 +1,263 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/ResizableAtomicHashMap.h>
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <folly/AtomicHashMap.h>
+#include <folly/Benchmark.h>
+#include <folly/Hash.h>
+#include <folly/portability/GFlags.h>
+
+using namespace folly;
+
+// Mirrors the benchmarks in folly/test/AtomicHashMapTest.cpp. AtomicHashMap
+// is measured both sized for its final element count ("ahm"), which is its
+// best case, and grown from an eighth of it ("ahm_grown"), which leaves
+// it with several submaps to probe. ResizableAtomicHashMap ("rahm") always
+// starts from the small size.
+
+namespace {
+
+typedef int32_t KeyT;
+typedef int32_t ValueT;
+typedef AtomicHashMap<KeyT, ValueT> AHMapT;
+typedef ResizableAtomicHashMap<KeyT, ValueT> RAHMapT;
+
+constexpr int kElements = 2 * 1000 * 1000;
+constexpr int kGrowth = 8;
+
+// As in AtomicHashMapTest, avoids the pathological patterns of
+// std::hash<int32_t>, which is the identity.
+KeyT randomizeKey(int key) {
+  return hash::jenkins_rev_mix32(key);
+}
+
+struct Data {
+  Data()
+      : ahm(kElements / 0.75),
+        ahmGrown(kElements / kGrowth),
+        rahm(kElements / kGrowth) {
+    for (int i = 0; i < kElements; ++i) {
+      keys.push_back(randomizeKey(i));
+      misses.push_back(randomizeKey(kElements + i));
+    }
+    for (auto k : keys) {
+      ahm.insert(k, k);
+      ahmGrown.insert(k, k);
+      rahm.insert(k, k);
+    }
+  }
+
+  std::vector<KeyT> keys;
+  std::vector<KeyT> misses;
+  AHMapT ahm;
+  AHMapT ahmGrown;
+  RAHMapT rahm;
+};
+
+Data& data() {
+  static Data d;
+  return d;
+}
+
+// Runs fn(i) for i in [0, iters), spread over nthreads threads.
+template <typename Fn>
+void runThreads(size_t iters, size_t nthreads, Fn fn) {
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < nthreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (size_t i = t; i < iters; i += nthreads) {
+        fn(i);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+// AtomicHashMap cannot grow at all from very small sizes.
+size_t grownInitialSize(size_t iters) {
+  return std::max<size_t>(iters / kGrowth, 1000);
+}
+
+size_t numThreads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void findAhm(size_t iters, size_t nthreads, AHMapT& map, bool hit) {
+  auto& keys = hit ? data().keys : data().misses;
+  runThreads(iters, nthreads, [&](size_t i) {
+    auto it = map.find(keys[i % kElements]);
+    doNotOptimizeAway(it == map.end() ? 0 : it->second);
+  });
+}
+
+void findRahm(size_t iters, size_t nthreads, bool hit) {
+  auto& keys = hit ? data().keys : data().misses;
+  auto& map = data().rahm;
+  runThreads(iters, nthreads, [&](size_t i) {
+    doNotOptimizeAway(map.get(keys[i % kElements]));
+  });
+}
+
+template <typename Map>
+void insert(size_t iters, Map& map) {
+  auto& keys = data().keys;
+  for (size_t i = 0; i < iters; ++i) {
+    map.insert(keys[i % kElements], 0);
+  }
+}
+
+} // namespace
+
+BENCHMARK(warmup, n) {
+  BenchmarkSuspender susp;
+  doNotOptimizeAway(data().keys.size() + n);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(st_ahm_find, iters) {
+  findAhm(iters, 1, data().ahm, true);
+}
+
+BENCHMARK_RELATIVE(st_ahm_grown_find, iters) {
+  findAhm(iters, 1, data().ahmGrown, true);
+}
+
+BENCHMARK_RELATIVE(st_rahm_find, iters) {
+  findRahm(iters, 1, true);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(st_ahm_miss, iters) {
+  findAhm(iters, 1, data().ahm, false);
+}
+
+BENCHMARK_RELATIVE(st_ahm_grown_miss, iters) {
+  findAhm(iters, 1, data().ahmGrown, false);
+}
+
+BENCHMARK_RELATIVE(st_rahm_miss, iters) {
+  findRahm(iters, 1, false);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(mt_ahm_find, iters) {
+  findAhm(iters, numThreads(), data().ahm, true);
+}
+
+BENCHMARK_RELATIVE(mt_ahm_grown_find, iters) {
+  findAhm(iters, numThreads(), data().ahmGrown, true);
+}
+
+BENCHMARK_RELATIVE(mt_rahm_find, iters) {
+  findRahm(iters, numThreads(), true);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(st_ahm_insert, iters) {
+  BenchmarkSuspender susp;
+  AHMapT map(iters / 0.75);
+  susp.dismiss();
+  insert(iters, map);
+}
+
+BENCHMARK_RELATIVE(st_ahm_grown_insert, iters) {
+  BenchmarkSuspender susp;
+  AHMapT map(grownInitialSize(iters));
+  susp.dismiss();
+  insert(iters, map);
+}
+
+BENCHMARK_RELATIVE(st_rahm_insert, iters) {
+  BenchmarkSuspender susp;
+  RAHMapT map(grownInitialSize(iters));
+  susp.dismiss();
+  insert(iters, map);
+}
+
+BENCHMARK_DRAW_LINE();
+
+// A sliding window of 1000 live keys. AtomicHashMap never reuses erased
+// cells, so it is sized for every key ever inserted; the resizable map stays
+// at the window's size.
+BENCHMARK(st_ahm_churn, iters) {
+  BenchmarkSuspender susp;
+  AHMapT map(iters / 0.75 + 1000);
+  susp.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    map.insert(randomizeKey(i), 0);
+    if (i >= 1000) {
+      map.erase(randomizeKey(i - 1000));
+    }
+  }
+}
+
+BENCHMARK_RELATIVE(st_rahm_churn, iters) {
+  BenchmarkSuspender susp;
+  RAHMapT map(1000);
+  susp.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    map.insert(randomizeKey(i), 0);
+    if (i >= 1000) {
+      map.erase(randomizeKey(i - 1000));
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
+
+/*
+1 logical core; the mt benchmarks use one thread per core.
+============================================================================
+ResizableAtomicHashMapBenchmark.cpp             relative  time/iter  iters/s
+============================================================================
+warmup                                                       0.00fs      inf
+----------------------------------------------------------------------------
+st_ahm_find                                                  7.36ns  135.79M
+st_ahm_grown_find                                 74.89%     9.83ns  101.70M
+st_rahm_find                                      51.87%    14.20ns   70.43M
+----------------------------------------------------------------------------
+st_ahm_miss                                                 32.06ns   31.19M
+st_ahm_grown_miss                                  7.86%   407.70ns    2.45M
+st_rahm_miss                                     104.87%    30.57ns   32.71M
+----------------------------------------------------------------------------
+mt_ahm_find                                                  7.30ns  136.97M
+mt_ahm_grown_find                                 79.02%     9.24ns  108.22M
+mt_rahm_find                                      53.45%    13.66ns   73.21M
+----------------------------------------------------------------------------
+st_ahm_insert                                               27.51ns   36.35M
+st_ahm_grown_insert                                7.62%   361.02ns    2.77M
+st_rahm_insert                                    28.28%    97.31ns   10.28M
+----------------------------------------------------------------------------
+st_ahm_churn                                                34.27ns   29.18M
+st_rahm_churn                                     35.13%    97.55ns   10.25M
+============================================================================
+*/
@@ -0,0 +1,265 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/ResizableAtomicHashMap.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+
+namespace {
+
+typedef ResizableAtomicHashMap<int, int> IntMap;
+
+// Small chunks, so that rehashes overlap with many operations.
+IntMap::Config smallChunks() {
+  IntMap::Config config;
+  config.migrationChunkSize = 8;
+  return config;
+}
+
+std::map<int, int> contents(const IntMap& map) {
+  std::map<int, int> result;
+  map.forEach([&](const std::pair<const int, int>& entry) {
+    EXPECT_TRUE(result.insert(entry).second);
+  });
+  return result;
+}
+
+} // namespace
+
+TEST(ResizableAtomicHashMap, Basic) {
+  IntMap map(10);
+  EXPECT_TRUE(map.empty());
+  EXPECT_FALSE(map.get(1).hasValue());
+  EXPECT_EQ(0, map.erase(1));
+
+  EXPECT_TRUE(map.insert(1, 10));
+  EXPECT_FALSE(map.insert(1, 11));
+  EXPECT_EQ(10, map.get(1).value());
+  EXPECT_TRUE(map.contains(1));
+  EXPECT_FALSE(map.contains(2));
+  EXPECT_EQ(1, map.size());
+
+  EXPECT_EQ(1, map.erase(1));
+  EXPECT_EQ(0, map.erase(1));
+  EXPECT_FALSE(map.contains(1));
+  EXPECT_TRUE(map.insert(1, 12));
+  EXPECT_EQ(12, map.get(1).value());
+  EXPECT_EQ(1, map.size());
+
+  // Operations on the map from within forEach().
+  for (int i = 2; i < 100; ++i) {
+    map.insert(i, 10 * i);
+  }
+  int visited = 0;
+  map.forEach([&](const std::pair<const int, int>& entry) {
+    EXPECT_EQ(entry.second, map.get(entry.first).value());
+    ++visited;
+  });
+  EXPECT_EQ(99, visited);
+}
+
+TEST(ResizableAtomicHashMap, NonIntegralKeys) {
+  ResizableAtomicHashMap<std::string, std::unique_ptr<int>> map(4);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(map.emplace(std::to_string(i), new int(i)));
+  }
+  EXPECT_FALSE(map.emplace("7", nullptr));
+  // The empty string needs no reserved key.
+  EXPECT_TRUE(map.emplace("", new int(-1)));
+  EXPECT_EQ(1001, map.size());
+  for (int i = 0; i < 1000; ++i) {
+    bool found = false;
+    map.forEach([&](const std::pair<const std::string, std::unique_ptr<int>>&
+                        entry) {
+      if (entry.first == std::to_string(i)) {
+        found = true;
+        EXPECT_EQ(i, *entry.second);
+      }
+    });
+    EXPECT_TRUE(found);
+    if (i % 100 == 0) {
+      EXPECT_EQ(1, map.erase(std::to_string(i)));
+    }
+  }
+  EXPECT_TRUE(map.contains(""));
+  EXPECT_FALSE(map.contains("100"));
+  EXPECT_EQ(991, map.size());
+}
+
+TEST(ResizableAtomicHashMap, GrowsFromSmallSize) {
+  IntMap map(1, smallChunks());
+  auto initialCapacity = map.capacity();
+  for (int i = 0; i < 100000; ++i) {
+    ASSERT_TRUE(map.insert(i, -i));
+  }
+  EXPECT_EQ(100000, map.size());
+  EXPECT_LT(initialCapacity, map.capacity());
+  // A single table, filled within the load factor.
+  EXPECT_GE(map.capacity(), 100000 / 0.8);
+  EXPECT_LE(map.capacity(), 4 * 100000 / 0.8);
+  for (int i = 0; i < 100000; ++i) {
+    ASSERT_EQ(-i, map.get(i).value());
+  }
+  EXPECT_FALSE(map.contains(100000));
+}
+
+TEST(ResizableAtomicHashMap, ErasedSlotsAreReclaimed) {
+  IntMap map(1000, smallChunks());
+  auto capacity = map.capacity();
+  // Far more distinct keys than the map ever holds at once: without
+  // reclaiming erased cells the table would fill up, or keep growing.
+  for (int i = 0; i < 200000; ++i) {
+    ASSERT_TRUE(map.insert(i, i));
+    if (i >= 500) {
+      ASSERT_EQ(1, map.erase(i - 500));
+    }
+  }
+  EXPECT_EQ(500, map.size());
+  EXPECT_EQ(capacity, map.capacity());
+
+  // Erasing most of a large map compacts it again, down to the initial
+  // capacity.
+  for (int i = 0; i < 100000; ++i) {
+    map.insert(1000000 + i, i);
+  }
+  EXPECT_LT(capacity, map.capacity());
+  for (int i = 0; i < 100000; ++i) {
+    ASSERT_EQ(1, map.erase(1000000 + i));
+  }
+  // The erased cells stay claimed until new keys force a rehash.
+  for (int i = 0; i < 1000000 && map.capacity() != capacity; ++i) {
+    ASSERT_TRUE(map.insert(2000000 + i, i));
+    ASSERT_EQ(1, map.erase(2000000 + i));
+  }
+  EXPECT_EQ(capacity, map.capacity());
+  EXPECT_EQ(500, map.size());
+}
+
+TEST(ResizableAtomicHashMap, RandomOperations) {
+  IntMap map(16, smallChunks());
+  std::map<int, int> expected;
+  std::mt19937 rng(1234);
+  for (int i = 0; i < 200000; ++i) {
+    int k = rng() % 5000;
+    if (rng() % 3) {
+      EXPECT_EQ(expected.emplace(k, i).second, map.insert(k, i));
+    } else {
+      EXPECT_EQ(expected.erase(k), map.erase(k));
+    }
+  }
+  EXPECT_EQ(expected, contents(map));
+  EXPECT_EQ(expected.size(), map.size());
+  for (int k = 0; k < 5000; ++k) {
+    auto value = map.get(k);
+    auto it = expected.find(k);
+    ASSERT_EQ(it != expected.end(), value.hasValue());
+    if (value) {
+      EXPECT_EQ(it->second, *value);
+    }
+  }
+}
+
+TEST(ResizableAtomicHashMap, ConcurrentReadersAndWriters) {
+  constexpr int kStable = 20000;
+  constexpr int kWriters = 4;
+  IntMap map(64, smallChunks());
+  // Multiples of kWriters + 1 are never touched by the writers.
+  for (int i = 0; i < kStable; ++i) {
+    map.insert(i * (kWriters + 1), i);
+  }
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 2; ++r) {
+    readers.emplace_back([&, r] {
+      std::mt19937 rng(r);
+      while (!done.load()) {
+        for (int i = 0; i < 1000; ++i) {
+          int k = rng() % kStable;
+          auto value = map.get(k * (kWriters + 1));
+          ASSERT_TRUE(value.hasValue());
+          EXPECT_EQ(k, *value);
+        }
+        int stable = 0;
+        map.forEach([&](const std::pair<const int, int>& entry) {
+          stable += entry.first % (kWriters + 1) == 0;
+        });
+        EXPECT_LE(kStable, stable);
+      }
+    });
+  }
+  std::vector<std::thread> writers;
+  for (int w = 0; w < kWriters; ++w) {
+    writers.emplace_back([&, w] {
+      // Growing and shrinking the writer keys makes the map rehash in both
+      // directions while readers run.
+      for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < kStable; ++i) {
+          EXPECT_TRUE(map.insert(i * (kWriters + 1) + w + 1, round));
+        }
+        for (int i = 0; i < kStable; ++i) {
+          EXPECT_EQ(1, map.erase(i * (kWriters + 1) + w + 1));
+        }
+      }
+    });
+  }
+  for (auto& t : writers) {
+    t.join();
+  }
+  done = true;
+  for (auto& t : readers) {
+    t.join();
+  }
+
+  std::map<int, int> expected;
+  for (int i = 0; i < kStable; ++i) {
+    expected[i * (kWriters + 1)] = i;
+  }
+  EXPECT_EQ(expected, contents(map));
+  EXPECT_EQ(kStable, map.size());
+}
+
+TEST(ResizableAtomicHashMap, ConcurrentInsertSameKeys) {
+  constexpr int kThreads = 4;
+  constexpr int kKeys = 50000;
+  IntMap map(1, smallChunks());
+  std::atomic<int> inserted{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kKeys; ++i) {
+        inserted += map.insert((i * 7 + t) % kKeys, t);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  // Every key went in exactly once, though the map grew while it happened.
+  EXPECT_EQ(kKeys, inserted.load());
+  EXPECT_EQ(kKeys, map.size());
+  EXPECT_EQ(kKeys, contents(map).size());
+}
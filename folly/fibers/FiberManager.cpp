@@ -28,6 +28,7 @@
 #include <folly/SingletonThreadLocal.h>
 #include <folly/portability/SysSyscall.h>
 #include <folly/portability/Unistd.h>
+#include <folly/tracing/StaticTracepoint.h>
 
 #ifdef FOLLY_SANITIZE_ADDRESS
 
@@ -127,6 +128,7 @@ Fiber* FiberManager::getFiber() {
   bool recordStack = (options_.recordStackEvery != 0) &&
       (fiberId_ % options_.recordStackEvery == 0);
   fiber->init(recordStack);
+  FOLLY_SDT(folly, fibers_create, this, fiber, fibersActive_);
   return fiber;
 }
 
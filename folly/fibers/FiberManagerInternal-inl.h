@@ -30,6 +30,8 @@
 #include <folly/fibers/LoopController.h>
 #include <folly/fibers/Promise.h>
 #include <folly/Try.h>
+#include <folly/io/async/RequestTraceHook.h>
+#include <folly/tracing/StaticTracepoint.h>
 
 namespace folly {
 namespace fibers {
@@ -75,7 +77,9 @@ inline void FiberManager::activateFiber(Fiber* fiber) {
 #endif
 
   activeFiber_ = fiber;
+  FOLLY_SDT(folly, fibers_switch_in, this, fiber);
   fiber->fiberImpl_.activate();
+  FOLLY_SDT(folly, fibers_switch_out, this, fiber, int(fiber->state_));
 }
 
 inline void FiberManager::deactivateFiber(Fiber* fiber) {
@@ -113,6 +117,7 @@ inline void FiberManager::runReadyFiber(Fiber* fiber) {
       fiber->state_ == Fiber::READY_TO_RUN);
   currentFiber_ = fiber;
   fiber->rcontext_ = RequestContext::setContext(std::move(fiber->rcontext_));
+  RequestTraceHook::record(RequestTraceEventType::FiberResume);
   if (observer_) {
     observer_->starting(reinterpret_cast<uintptr_t>(fiber));
   }
@@ -138,10 +143,12 @@ inline void FiberManager::runReadyFiber(Fiber* fiber) {
       observer_->stopped(reinterpret_cast<uintptr_t>(fiber));
     }
     currentFiber_ = nullptr;
+    RequestTraceHook::record(RequestTraceEventType::FiberSuspend);
     fiber->rcontext_ = RequestContext::setContext(std::move(fiber->rcontext_));
   } else if (fiber->state_ == Fiber::INVALID) {
     assert(fibersActive_ > 0);
     --fibersActive_;
+    FOLLY_SDT(folly, fibers_finish, this, fiber, fibersActive_);
     // Making sure that task functor is deleted once task is complete.
     // NOTE: we must do it on main context, as the fiber is not
     // running at this point.
@@ -160,6 +167,7 @@ inline void FiberManager::runReadyFiber(Fiber* fiber) {
       observer_->stopped(reinterpret_cast<uintptr_t>(fiber));
     }
     currentFiber_ = nullptr;
+    RequestTraceHook::record(RequestTraceEventType::FiberFinish);
     fiber->rcontext_ = RequestContext::setContext(std::move(fiber->rcontext_));
     fiber->localData_.reset();
     fiber->rcontext_.reset();
@@ -178,6 +186,7 @@ inline void FiberManager::runReadyFiber(Fiber* fiber) {
       observer_->stopped(reinterpret_cast<uintptr_t>(fiber));
     }
     currentFiber_ = nullptr;
+    RequestTraceHook::record(RequestTraceEventType::FiberSuspend);
     fiber->rcontext_ = RequestContext::setContext(std::move(fiber->rcontext_));
     fiber->state_ = Fiber::READY_TO_RUN;
     yieldedFibers_.push_back(*fiber);
@@ -29,8 +29,10 @@
 #include <folly/Try.h>
 #include <folly/futures/FutureException.h>
 #include <folly/futures/detail/FSM.h>
+#include <folly/tracing/StaticTracepoint.h>
 
 #include <folly/io/async/Request.h>
+#include <folly/io/async/RequestTraceHook.h>
 
 namespace folly { namespace detail {
 
@@ -162,6 +164,9 @@ class Core final {
   /// Call only from Promise thread
   void setResult(Try<T>&& t) {
     bool transitionToArmed = false;
+    // Read before the callback can run, and consume result_
+    bool hasException = t.hasException();
+    (void)hasException;
     auto setResult_ = [&]{ result_ = std::move(t); };
     FSM_START(fsm_)
       case State::Start:
@@ -179,6 +184,12 @@ class Core final {
         throw std::logic_error("setResult called twice");
     FSM_END
 
+    FOLLY_SDT(
+        folly,
+        futures_core_fulfilled,
+        this,
+        transitionToArmed,
+        hasException);
     if (transitionToArmed) {
       maybeCallback();
     }
@@ -356,6 +367,7 @@ class Core final {
             auto cr = std::move(core_ref);
             Core* const core = cr.getCore();
             RequestContextScopeGuard rctx(core->context_);
+            RequestTraceHook::record(RequestTraceEventType::FutureContinuation);
             core->callback_(std::move(*core->result_));
           });
         } else {
@@ -364,6 +376,8 @@ class Core final {
                 auto cr = std::move(core_ref);
                 Core* const core = cr.getCore();
                 RequestContextScopeGuard rctx(core->context_);
+                RequestTraceHook::record(
+                    RequestTraceEventType::FutureContinuation);
                 core->callback_(std::move(*core->result_));
               },
               priority);
@@ -385,6 +399,7 @@ class Core final {
         detachOne();
       };
       RequestContextScopeGuard rctx(context_);
+      RequestTraceHook::record(RequestTraceEventType::FutureContinuation);
       callback_(std::move(*result_));
     }
   }
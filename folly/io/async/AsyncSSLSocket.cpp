@@ -203,6 +203,43 @@ void* initsslBioMethod(void) {
 
 namespace folly {
 
+constexpr size_t AsyncSSLSocket::kDefaultSmallRecordSize;
+constexpr size_t AsyncSSLSocket::kDefaultSmallRecordBytes;
+constexpr std::chrono::milliseconds
+    AsyncSSLSocket::kDefaultRecordSizingIdleTimeout;
+
+/**
+ * Completes the writes coalesced into one by AsyncSSLSocket::coalesceWrite(),
+ * then deletes itself.
+ */
+class AsyncSSLSocket::CoalescedWriteCallback
+    : public AsyncSSLSocket::WriteCallback {
+ public:
+  explicit CoalescedWriteCallback(std::vector<CoalescedWrite> writes)
+      : writes_(std::move(writes)) {}
+
+  void writeSuccess() noexcept override {
+    std::unique_ptr<CoalescedWriteCallback> guard(this);
+    for (const auto& write : writes_) {
+      write.callback->writeSuccess();
+    }
+  }
+
+  void writeErr(size_t bytesWritten, const AsyncSocketException& ex) noexcept
+      override {
+    std::unique_ptr<CoalescedWriteCallback> guard(this);
+    for (const auto& write : writes_) {
+      size_t written = bytesWritten > write.offset
+          ? std::min(bytesWritten - write.offset, write.length)
+          : 0;
+      write.callback->writeErr(written, ex);
+    }
+  }
+
+ private:
+  std::vector<CoalescedWrite> writes_;
+};
+
 /**
  * Create a client AsyncSSLSocket
  */
@@ -308,15 +345,34 @@ void AsyncSSLSocket::init() {
   setup_SSL_CTX(ctx_->getSSLCtx());
 }
 
+void AsyncSSLSocket::close() {
+  // AsyncSocket::close() waits for the pending writes: make these part of them
+  flushCoalescedWrites();
+  AsyncSocket::close();
+}
+
 void AsyncSSLSocket::closeNow() {
+#if FOLLY_OPENSSL_HAS_ASYNC
+  releaseAsyncJob();
+#endif
+
   // Close the SSL connection.
   if (ssl_ != nullptr && fd_ != -1) {
-    int rc = SSL_shutdown(ssl_);
-    if (rc == 0) {
-      rc = SSL_shutdown(ssl_);
-    }
-    if (rc < 0) {
-      ERR_clear_error();
+    if (kernelTlsTx_) {
+#if FOLLY_HAVE_KERNEL_TLS
+      // OpenSSL can't write any more. Telling it we did keeps the session
+      // resumable.
+      ssl::sendKernelTlsCloseNotify(fd_);
+      SSL_set_shutdown(ssl_, SSL_get_shutdown(ssl_) | SSL_SENT_SHUTDOWN);
+#endif
+    } else {
+      int rc = SSL_shutdown(ssl_);
+      if (rc == 0) {
+        rc = SSL_shutdown(ssl_);
+      }
+      if (rc < 0) {
+        ERR_clear_error();
+      }
     }
   }
 
@@ -345,6 +401,11 @@ void AsyncSSLSocket::closeNow() {
 
   // Close the socket.
   AsyncSocket::closeNow();
+
+  if (coalescedWrites_) {
+    failCoalescedWrites(AsyncSocketException(
+        AsyncSocketException::END_OF_FILE, "socket closed locally"));
+  }
 }
 
 void AsyncSSLSocket::shutdownWrite() {
@@ -997,6 +1058,22 @@ bool AsyncSSLSocket::willBlock(int ret,
 
     // The timeout (if set) keeps running here
     return true;
+#if FOLLY_OPENSSL_HAS_ASYNC
+  } else if (error == SSL_ERROR_WANT_ASYNC && server_ && waitForAsyncJob()) {
+    // An async job, e.g. an offloaded private key operation (see
+    // SSLContext::offloadPrivateKeyOperations), paused the handshake.
+    // asyncJobHandler_ re-calls handleAccept once it can resume.
+    sslState_ = STATE_ASYNC_PENDING;
+
+    // Unregister for all events while blocked here
+    updateEventRegistration(
+      EventHandler::NONE,
+      EventHandler::READ | EventHandler::WRITE
+    );
+
+    // The timeout (if set) keeps running here
+    return true;
+#endif
   } else {
     unsigned long lastError = *errErrorOut = ERR_get_error();
     VLOG(6) << "AsyncSSLSocket(fd=" << fd_ << ", "
@@ -1014,6 +1091,35 @@ bool AsyncSSLSocket::willBlock(int ret,
   }
 }
 
+#if FOLLY_OPENSSL_HAS_ASYNC
+bool AsyncSSLSocket::waitForAsyncJob() noexcept {
+  // The job signals that it can resume by making an fd readable. Engines
+  // may use several fds, or none, to be polled: we only handle one.
+  OSSL_ASYNC_FD asyncFd;
+  size_t numFds = 0;
+  if (SSL_get_all_async_fds(ssl_, nullptr, &numFds) != 1 || numFds != 1 ||
+      SSL_get_all_async_fds(ssl_, &asyncFd, &numFds) != 1) {
+    return false;
+  }
+  asyncJobHandler_.reset(new AsyncJobHandler(this, eventBase_, asyncFd));
+  return asyncJobHandler_->registerHandler(EventHandler::READ);
+}
+
+void AsyncSSLSocket::releaseAsyncJob() noexcept {
+  asyncJobHandler_.reset();
+  // A paused job can only be released by resuming it, from the same SSL
+  // function. Operations that are not done yet then fail, and so does the
+  // handshake.
+  while (ssl_ != nullptr && SSL_waiting_for_async(ssl_)) {
+    int ret = SSL_accept(ssl_);
+    if (ret > 0 || SSL_get_error(ssl_, ret) != SSL_ERROR_WANT_ASYNC) {
+      break;
+    }
+  }
+  ERR_clear_error();
+}
+#endif
+
 void AsyncSSLSocket::checkForImmediateRead() noexcept {
   // openssl may have buffered data that it read from the socket already.
   // In this case we have to process it immediately, rather than waiting for
@@ -1112,6 +1218,8 @@ AsyncSSLSocket::handleAccept() noexcept {
   // STATE_ACCEPTING.
   sslState_ = STATE_ESTABLISHED;
 
+  startKernelTls();
+
   VLOG(3) << "AsyncSSLSocket " << this << ": fd " << fd_
           << " successfully accepted; state=" << int(state_)
           << ", sslState=" << sslState_ << ", events=" << eventFlags_;
@@ -1184,6 +1292,8 @@ AsyncSSLSocket::handleConnect() noexcept {
   // STATE_CONNECTING.
   sslState_ = STATE_ESTABLISHED;
 
+  startKernelTls();
+
   VLOG(3) << "AsyncSSLSocket " << this << ": "
           << "fd " << fd_ << " successfully connected; "
           << "state=" << int(state_) << ", sslState=" << sslState_
@@ -1321,6 +1431,9 @@ AsyncSSLSocket::performRead(void** buf, size_t* buflen, size_t* offset) {
   if (sslState_ == STATE_UNENCRYPTED) {
     return AsyncSocket::performRead(buf, buflen, offset);
   }
+  if (kernelTlsRx_) {
+    return performKernelTlsRead(*buf, *buflen);
+  }
 
   int bytes = 0;
   if (!isBufferMovable_) {
@@ -1383,6 +1496,58 @@ AsyncSSLSocket::performRead(void** buf, size_t* buflen, size_t* offset) {
   }
 }
 
+void AsyncSSLSocket::startKernelTls() {
+#if FOLLY_HAVE_KERNEL_TLS
+  if (!kernelTlsEnabled_ || isBufferMovable_ ||
+      (preReceivedData_ && !preReceivedData_->empty())) {
+    return;
+  }
+  // RX first: should TX then fail, OpenSSL keeps writing as before, whereas
+  // with TX alone it could still want to write in reaction to something it
+  // read, e.g. a renegotiation.
+  kernelTlsRx_ = ssl::enableKernelTls(ssl_, fd_, ssl::KernelTlsDirection::RX);
+  kernelTlsTx_ = kernelTlsRx_ &&
+      ssl::enableKernelTls(ssl_, fd_, ssl::KernelTlsDirection::TX);
+  VLOG(3) << "AsyncSSLSocket " << this << ": fd " << fd_
+          << " kernel TLS rx=" << kernelTlsRx_ << ", tx=" << kernelTlsTx_;
+#endif
+}
+
+AsyncSocket::ReadResult
+AsyncSSLSocket::performKernelTlsRead(void* buf, size_t buflen) {
+#if FOLLY_HAVE_KERNEL_TLS
+  uint8_t contentType;
+  ssize_t bytes =
+      ssl::recvKernelTls(fd_, buf, buflen, MSG_DONTWAIT, &contentType);
+  if (bytes < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return ReadResult(READ_BLOCKING);
+    } else {
+      return ReadResult(READ_ERROR);
+    }
+  }
+  if (contentType == ssl::kTlsApplicationData) {
+    appBytesReceived_ += bytes;
+    return ReadResult(bytes);
+  }
+  auto record = static_cast<const uint8_t*>(buf);
+  if (contentType == ssl::kTlsAlert && bytes == 2 &&
+      record[1] == ssl::kTlsAlertCloseNotify) {
+    return ReadResult(0);
+  }
+  // A fatal alert, or a handshake message we can't answer
+  LOG(ERROR) << "AsyncSSLSocket(fd=" << fd_ << ", state=" << int(state_)
+             << ", sslState=" << sslState_ << ", events=" << eventFlags_
+             << "): unexpected TLS record of type " << int(contentType);
+  return ReadResult(
+      READ_ERROR, std::make_unique<SSLException>(SSLError::SSL_ERROR));
+#else
+  (void)buf;
+  (void)buflen;
+  return ReadResult(READ_ERROR);
+#endif
+}
+
 void AsyncSSLSocket::handleWrite() noexcept {
   VLOG(5) << "AsyncSSLSocket::handleWrite() this=" << this << ", fd=" << fd_
           << ", state=" << int(state_) << ", "
@@ -1441,7 +1606,7 @@ AsyncSocket::WriteResult AsyncSSLSocket::performWrite(
     WriteFlags flags,
     uint32_t* countWritten,
     uint32_t* partialWritten) {
-  if (sslState_ == STATE_UNENCRYPTED) {
+  if (sslState_ == STATE_UNENCRYPTED || kernelTlsTx_) {
     return AsyncSocket::performWrite(
       vec, count, flags, countWritten, partialWritten);
   }
@@ -1539,12 +1704,10 @@ AsyncSocket::WriteResult AsyncSSLSocket::performWrite(
       }
     }
 
-    corkCurrentWrite_ =
-        isSet(flags, WriteFlags::CORK) || (i + buffersStolen + 1 < count);
-    bytes = eorAwareSSLWrite(
-        ssl_,
+    bytes = sslWriteRecords(
         sslWriteBuf,
-        int(len),
+        len,
+        isSet(flags, WriteFlags::CORK) || (i + buffersStolen + 1 < count),
         (isSet(flags, WriteFlags::EOR) && i + buffersStolen + 1 == count));
 
     if (bytes <= 0) {
@@ -1617,6 +1780,61 @@ int AsyncSSLSocket::eorAwareSSLWrite(SSL *ssl, const void *buf, int n,
   return n;
 }
 
+ssize_t AsyncSSLSocket::sslWriteRecords(
+    const void* buf,
+    size_t len,
+    bool cork,
+    bool eor) {
+  // With SSL_MODE_ENABLE_PARTIAL_WRITE, SSL_write() writes a single record
+  // of up to the bytes it is passed: pass it a record's worth at a time, for
+  // as long as the socket takes them, rather than a record per write event.
+  size_t written = 0;
+  do {
+    size_t remaining = len - written;
+    size_t n = std::min(remaining, nextRecordSize());
+    if (blockedWriteLength_ != 0) {
+      // SSL_write() must be retried with at least the bytes of the record
+      // it has pending
+      n = std::min(remaining, std::max(n, blockedWriteLength_));
+    }
+    corkCurrentWrite_ = cork || n < remaining;
+    int bytes = eorAwareSSLWrite(
+        ssl_,
+        static_cast<const char*>(buf) + written,
+        int(n),
+        eor && n == remaining);
+    if (bytes <= 0) {
+      blockedWriteLength_ = n;
+      // Report the records written; SSL_write() fails again on the retry if
+      // it wasn't just the socket blocking.
+      return written > 0 ? ssize_t(written) : bytes;
+    }
+    blockedWriteLength_ = 0;
+    written += size_t(bytes);
+    smallRecordBytesLeft_ -= std::min(smallRecordBytesLeft_, size_t(bytes));
+    if (size_t(bytes) < n) {
+      // A partial write, e.g. with a smaller max_send_fragment: leave it to
+      // the caller
+      break;
+    }
+  } while (written < len);
+  return ssize_t(written);
+}
+
+size_t AsyncSSLSocket::nextRecordSize() {
+  if (smallRecordSize_ == 0) {
+    return SSL3_RT_MAX_PLAIN_LENGTH;
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (now - lastWriteTime_ >= recordSizingIdleTimeout_) {
+    // The congestion window may have shrunk while idle
+    smallRecordBytesLeft_ = smallRecordBytes_;
+  }
+  lastWriteTime_ = now;
+  return smallRecordBytesLeft_ > 0 ? smallRecordSize_
+                                   : SSL3_RT_MAX_PLAIN_LENGTH;
+}
+
 void AsyncSSLSocket::sslInfoCallback(const SSL* ssl, int where, int ret) {
   AsyncSSLSocket *sslSocket = AsyncSSLSocket::getFromSSL(ssl);
   if (sslSocket->handshakeComplete_ && (where & SSL_CB_HANDSHAKE_START)) {
@@ -1730,6 +1948,123 @@ void AsyncSSLSocket::enableClientHelloParsing()  {
     clientHelloInfo_.reset(new ssl::ClientHelloInfo());
 }
 
+void AsyncSSLSocket::enableKernelTls() {
+  kernelTlsEnabled_ = true;
+}
+
+void AsyncSSLSocket::enableDynamicRecordSizing(
+    size_t smallRecordSize,
+    size_t smallRecordBytes,
+    std::chrono::milliseconds idleTimeout) {
+  smallRecordSize_ = std::min<size_t>(
+      std::max<size_t>(smallRecordSize, 1), SSL3_RT_MAX_PLAIN_LENGTH);
+  smallRecordBytes_ = smallRecordBytes;
+  recordSizingIdleTimeout_ = idleTimeout;
+  smallRecordBytesLeft_ = smallRecordBytes;
+  lastWriteTime_ = std::chrono::steady_clock::now();
+}
+
+void AsyncSSLSocket::disableDynamicRecordSizing() {
+  smallRecordSize_ = 0;
+  smallRecordBytesLeft_ = 0;
+}
+
+void AsyncSSLSocket::setWriteCoalescingEnabled(bool enabled) {
+  writeCoalescingEnabled_ = enabled;
+  if (!enabled) {
+    flushCoalescedWrites();
+  }
+}
+
+void AsyncSSLSocket::write(
+    WriteCallback* callback,
+    const void* buf,
+    size_t bytes,
+    WriteFlags flags) {
+  flushCoalescedWrites();
+  AsyncSocket::write(callback, buf, bytes, flags);
+}
+
+void AsyncSSLSocket::writev(
+    WriteCallback* callback,
+    const iovec* vec,
+    size_t count,
+    WriteFlags flags) {
+  flushCoalescedWrites();
+  AsyncSocket::writev(callback, vec, count, flags);
+}
+
+void AsyncSSLSocket::writeChain(
+    WriteCallback* callback,
+    unique_ptr<IOBuf>&& buf,
+    WriteFlags flags) {
+  if (writeCoalescingEnabled_ && buf && eventBase_ != nullptr &&
+      (flags == WriteFlags::NONE || flags == WriteFlags::CORK) &&
+      sslState_ == STATE_ESTABLISHED && AsyncSocket::good()) {
+    size_t length = buf->computeChainDataLength();
+    if (length < minWriteSize_) {
+      coalesceWrite(callback, *buf, length, flags);
+      return;
+    }
+  }
+  flushCoalescedWrites();
+  AsyncSocket::writeChain(callback, std::move(buf), flags);
+}
+
+void AsyncSSLSocket::coalesceWrite(
+    WriteCallback* callback,
+    const IOBuf& buf,
+    size_t length,
+    WriteFlags flags) {
+  if (coalescedWrites_ && coalescedWrites_->tailroom() < length) {
+    flushCoalescedWrites();
+  }
+  if (!coalescedWrites_) {
+    coalescedWrites_ = IOBuf::create(
+        std::max<size_t>(SSL3_RT_MAX_PLAIN_LENGTH, minWriteSize_));
+    // Runs at the end of this loop iteration, even when called from a loop
+    // callback
+    eventBase_->runInLoop(&writeCoalescer_, true);
+  }
+  if (callback) {
+    coalescedCallbacks_.push_back(
+        CoalescedWrite{callback, coalescedWrites_->length(), length});
+  }
+  for (ByteRange range : buf) {
+    if (!range.empty()) {
+      memcpy(coalescedWrites_->writableTail(), range.data(), range.size());
+      coalescedWrites_->append(range.size());
+    }
+  }
+  // Later writes decide whether to cork what is written before them
+  coalescedFlags_ = flags;
+}
+
+void AsyncSSLSocket::flushCoalescedWrites() {
+  if (!coalescedWrites_) {
+    return;
+  }
+  writeCoalescer_.cancelLoopCallback();
+  WriteCallback* callback = nullptr;
+  if (!coalescedCallbacks_.empty()) {
+    callback = new CoalescedWriteCallback(std::move(coalescedCallbacks_));
+    coalescedCallbacks_.clear();
+  }
+  // The callbacks may coalesce new writes
+  auto buf = std::move(coalescedWrites_);
+  AsyncSocket::writeChain(callback, std::move(buf), coalescedFlags_);
+}
+
+void AsyncSSLSocket::failCoalescedWrites(const AsyncSocketException& ex) {
+  writeCoalescer_.cancelLoopCallback();
+  coalescedWrites_.reset();
+  auto writes = std::move(coalescedCallbacks_);
+  coalescedCallbacks_.clear();
+  for (const auto& write : writes) {
+    write.callback->writeErr(0, ex);
+  }
+}
+
 void AsyncSSLSocket::resetClientHelloParsing(SSL *ssl)  {
   SSL_set_msg_callback(ssl, nullptr);
   SSL_set_msg_callback_arg(ssl, nullptr);
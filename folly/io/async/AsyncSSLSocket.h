@@ -25,6 +25,7 @@
 #include <folly/io/async/SSLContext.h>
 #include <folly/io/async/TimeoutManager.h>
 #include <folly/ssl/OpenSSLPtrTypes.h>
+#include <folly/io/async/ssl/KernelTLS.h>
 #include <folly/io/async/ssl/OpenSSLUtils.h>
 #include <folly/io/async/ssl/SSLErrors.h>
 #include <folly/io/async/ssl/TLSDefinitions.h>
@@ -275,6 +276,7 @@ class AsyncSSLSocket : public virtual AsyncSocket {
   // See the documentation in TAsyncTransport.h
   // TODO: implement graceful shutdown in close()
   // TODO: implement detachSSL() that returns the SSL connection
+  void close() override;
   void closeNow() override;
   void shutdownWrite() override;
   void shutdownWriteNow() override;
@@ -313,7 +315,8 @@ class AsyncSSLSocket : public virtual AsyncSocket {
           folly::SSLContext::SSLVerifyPeerEnum::USE_CTX);
 
   /**
-   * Invoke SSL accept following an asynchronous session cache lookup
+   * Invoke SSL accept following an asynchronous session cache lookup or
+   * private key operation
    */
   void restartSSLAccept();
 
@@ -524,13 +527,21 @@ class AsyncSSLSocket : public virtual AsyncSocket {
   }
 
   void detachEventBase() override {
+    flushCoalescedWrites();
     AsyncSocket::detachEventBase();
     handshakeTimeout_.detachEventBase();
     connectionTimeout_.detachEventBase();
   }
 
   bool isDetachable() const override {
-    return AsyncSocket::isDetachable() && !handshakeTimeout_.isScheduled();
+    // Coalesced writes are flushed from a loop callback of the current
+    // EventBase
+    return AsyncSocket::isDetachable() && !handshakeTimeout_.isScheduled() &&
+        !coalescedWrites_
+#if FOLLY_OPENSSL_HAS_ASYNC
+        && !(asyncJobHandler_ && asyncJobHandler_->isHandlerRegistered())
+#endif
+        ;
   }
 
   virtual void attachTimeoutManager(TimeoutManager* manager) {
@@ -674,6 +685,86 @@ class AsyncSSLSocket : public virtual AsyncSocket {
    */
   void setBufferMovableEnabled(bool enabled);
 
+  /**
+   * Once the handshake completes, hands the encryption and decryption of
+   * records to the kernel (see ssl::enableKernelTls()): writes and reads
+   * then go through the AsyncSocket path, without copies in and out of
+   * OpenSSL, and the fd may be written to directly, e.g. with sendfile().
+   *
+   * Falls back to OpenSSL, silently, if the connection or the kernel don't
+   * support it: see isKernelTlsActive(). Must be called before the
+   * handshake. getRawBytesWritten() and getRawBytesReceived() only count
+   * the handshake when it is active.
+   */
+  void enableKernelTls();
+
+  /**
+   * Whether the kernel encrypts and decrypts records, see enableKernelTls().
+   */
+  bool isKernelTlsActive() const {
+    return kernelTlsTx_;
+  }
+
+  // A record that fits in a single TCP segment on a 1500 byte MTU path,
+  // after the IPv6 and TCP headers with timestamps (72 bytes) and the record
+  // header, explicit IV, MAC and padding.
+  static constexpr size_t kDefaultSmallRecordSize = 1369;
+  static constexpr size_t kDefaultSmallRecordBytes = 64 * 1024;
+  static constexpr std::chrono::milliseconds kDefaultRecordSizingIdleTimeout{
+      1000};
+
+  /**
+   * Writes records of at most smallRecordSize bytes at the start of the
+   * connection, and again after nothing was written for idleTimeout, until
+   * smallRecordBytes were written: the peer can decrypt the first bytes, e.g.
+   * the headers of a response, as soon as their TCP segment arrives, rather
+   * than waiting for a full 16KB record spread over several round trips of
+   * TCP slow start. Bulk transfers then use full size records, which cost
+   * less per byte.
+   *
+   * Has no effect once the kernel encrypts records, see enableKernelTls().
+   */
+  void enableDynamicRecordSizing(
+      size_t smallRecordSize = kDefaultSmallRecordSize,
+      size_t smallRecordBytes = kDefaultSmallRecordBytes,
+      std::chrono::milliseconds idleTimeout = kDefaultRecordSizingIdleTimeout);
+
+  /**
+   * Goes back to writing full size records.
+   */
+  void disableDynamicRecordSizing();
+
+  /**
+   * Buffers writeChain() calls smaller than getMinWriteSize(), with no flags
+   * other than CORK, made during the same event loop iteration and writes
+   * them together at the end of it: they then share records, and syscalls,
+   * rather than each getting its own. Their callbacks are invoked in order
+   * once the combined write completes or fails.
+   *
+   * Only applies once the handshake completed; any other write, close() or
+   * detachEventBase() writes the buffered data first.
+   */
+  void setWriteCoalescingEnabled(bool enabled);
+
+  bool getWriteCoalescingEnabled() const {
+    return writeCoalescingEnabled_;
+  }
+
+  void write(
+      WriteCallback* callback,
+      const void* buf,
+      size_t bytes,
+      WriteFlags flags = WriteFlags::NONE) override;
+  void writev(
+      WriteCallback* callback,
+      const iovec* vec,
+      size_t count,
+      WriteFlags flags = WriteFlags::NONE) override;
+  void writeChain(
+      WriteCallback* callback,
+      std::unique_ptr<folly::IOBuf>&& buf,
+      WriteFlags flags = WriteFlags::NONE) override;
+
   /**
    * Returns the peer certificate, or nullptr if no peer certificate received.
    */
@@ -750,6 +841,10 @@ class AsyncSSLSocket : public virtual AsyncSocket {
   bool willBlock(int ret,
                  int* sslErrorOut,
                  unsigned long* errErrorOut) noexcept;
+#if FOLLY_OPENSSL_HAS_ASYNC
+  bool waitForAsyncJob() noexcept;
+  void releaseAsyncJob() noexcept;
+#endif
 
   void checkForImmediateRead() noexcept override;
   // AsyncSocket calls this at the wrong time for SSL
@@ -764,6 +859,10 @@ class AsyncSSLSocket : public virtual AsyncSocket {
       uint32_t* countWritten,
       uint32_t* partialWritten) override;
 
+  // Tries to hand records to the kernel, if enableKernelTls() was called
+  void startKernelTls();
+  ReadResult performKernelTlsRead(void* buf, size_t buflen);
+
   ssize_t performWriteIovec(const iovec* vec, uint32_t count,
                             WriteFlags flags, uint32_t* countWritten,
                             uint32_t* partialWritten);
@@ -801,6 +900,26 @@ class AsyncSSLSocket : public virtual AsyncSocket {
    */
   int eorAwareSSLWrite(SSL *ssl, const void *buf, int n, bool eor);
 
+  /**
+   * Writes buf a record at a time, until it is all written or SSL_write()
+   * would block or only partially writes a record.
+   *
+   * @return: The number of app bytes written, if any, or else the return
+   *          value of SSL_write()
+   */
+  ssize_t sslWriteRecords(const void* buf, size_t len, bool cork, bool eor);
+
+  // The size of the next record, for dynamic record sizing
+  size_t nextRecordSize();
+
+  void coalesceWrite(
+      WriteCallback* callback,
+      const folly::IOBuf& buf,
+      size_t length,
+      WriteFlags flags);
+  void flushCoalescedWrites();
+  void failCoalescedWrites(const AsyncSocketException& ex);
+
   // Inherit error handling methods from AsyncSocket, plus the following.
   void failHandshake(const char* fn, const AsyncSocketException& ex);
 
@@ -835,6 +954,28 @@ class AsyncSSLSocket : public virtual AsyncSocket {
   SSL_SESSION *sslSession_{nullptr};
   Timeout handshakeTimeout_;
   Timeout connectionTimeout_;
+
+#if FOLLY_OPENSSL_HAS_ASYNC
+  // Waits for the fd of a paused OpenSSL async job (SSL_ERROR_WANT_ASYNC),
+  // e.g. of an offloaded private key operation, to resume the handshake.
+  class AsyncJobHandler : public EventHandler {
+   public:
+    AsyncJobHandler(AsyncSSLSocket* sslSocket, EventBase* eventBase, int fd)
+        : EventHandler(eventBase, fd), sslSocket_(sslSocket) {}
+
+    void handlerReady(uint16_t /* events */) noexcept override {
+      unregisterHandler();
+      // May destroy this handler
+      sslSocket_->restartSSLAccept();
+    }
+
+   private:
+    AsyncSSLSocket* sslSocket_;
+  };
+
+  std::unique_ptr<AsyncJobHandler> asyncJobHandler_;
+#endif
+
   // whether the SSL session was resumed using session ID or not
   bool sessionIDResumed_{false};
 
@@ -866,6 +1007,48 @@ class AsyncSSLSocket : public virtual AsyncSocket {
   bool parseClientHello_{false};
   bool cacheAddrOnFailure_{false};
   bool bufferMovableEnabled_{false};
+  bool kernelTlsEnabled_{false};
+  // Whether records are decrypted (RX), and encrypted (TX), by the kernel
+  bool kernelTlsRx_{false};
+  bool kernelTlsTx_{false};
+
+  // Dynamic record sizing, disabled while smallRecordSize_ is 0
+  size_t smallRecordSize_{0};
+  size_t smallRecordBytes_{0};
+  std::chrono::milliseconds recordSizingIdleTimeout_{0};
+  // How much more to write in small records
+  size_t smallRecordBytesLeft_{0};
+  std::chrono::steady_clock::time_point lastWriteTime_;
+  // The bytes passed to the last SSL_write(), if it would have blocked
+  size_t blockedWriteLength_{0};
+
+  class WriteCoalescer : public EventBase::LoopCallback {
+   public:
+    explicit WriteCoalescer(AsyncSSLSocket* sslSocket)
+        : sslSocket_(sslSocket) {}
+    void runLoopCallback() noexcept override {
+      DestructorGuard dg(sslSocket_);
+      sslSocket_->flushCoalescedWrites();
+    }
+
+   private:
+    AsyncSSLSocket* sslSocket_;
+  };
+
+  // A write buffered by coalesceWrite(), at offset in coalescedWrites_
+  struct CoalescedWrite {
+    WriteCallback* callback;
+    size_t offset;
+    size_t length;
+  };
+  class CoalescedWriteCallback;
+
+  bool writeCoalescingEnabled_{false};
+  WriteCoalescer writeCoalescer_{this};
+  std::unique_ptr<folly::IOBuf> coalescedWrites_;
+  std::vector<CoalescedWrite> coalescedCallbacks_;
+  WriteFlags coalescedFlags_{WriteFlags::NONE};
+
   bool certCacheHit_{false};
   std::unique_ptr<ssl::ClientHelloInfo> clientHelloInfo_;
   std::vector<std::pair<char, StringPiece>> alertsReceived_;
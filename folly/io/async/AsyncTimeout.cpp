@@ -153,6 +153,8 @@ void AsyncTimeout::libeventCallback(libevent_fd_t fd, short events, void* arg) {
 
   RequestContextScopeGuard rctx(timeout->context_);
 
+  detail::EventBaseCallbackScope profile(
+      EventBaseCallbackType::Timeout, timeout);
   timeout->timeoutExpired();
 }
 
@@ -25,6 +25,7 @@
 #include <folly/ThreadName.h>
 #include <folly/io/async/NotificationQueue.h>
 #include <folly/portability/Unistd.h>
+#include <folly/tracing/StaticTracepoint.h>
 
 #include <condition_variable>
 #include <fcntl.h>
@@ -54,6 +55,8 @@ class EventBase::FunctionRunner
       // wake up the loop.  We can ignore these messages.
       return;
     }
+    detail::EventBaseCallbackScope profile(
+        EventBaseCallbackType::Function, msg.getInvokerAddress());
     msg();
   }
 };
@@ -280,6 +283,9 @@ bool EventBase::loopBody(int flags) {
   while (!stop_.load(std::memory_order_acquire)) {
     applyLoopKeepAlive();
     ++nextLoopCnt_;
+    FOLLY_SDT(folly, event_base_loop_begin, this, nextLoopCnt_);
+    detail::EventBaseLoopProfiler::Iteration profiledIteration(
+        loopProfiler_.get(), observer_.get());
 
     // Run the before loop callbacks
     LoopCallbackList callbacks;
@@ -288,6 +294,8 @@ bool EventBase::loopBody(int flags) {
     while(!callbacks.empty()) {
       auto* item = &callbacks.front();
       callbacks.pop_front();
+      detail::EventBaseCallbackScope profile(
+          EventBaseCallbackType::LoopCallback, item);
       item->runLoopCallback();
     }
 
@@ -300,12 +308,15 @@ bool EventBase::loopBody(int flags) {
     }
 
     ranLoopCallbacks = runLoopCallbacks();
+    FOLLY_SDT(folly, event_base_loop_end, this, nextLoopCnt_, res);
 
     if (enableTimeMeasurement_) {
       busy = std::chrono::duration_cast<std::chrono::microseconds>(
           std::chrono::steady_clock::now() - startWork_);
       idle = std::chrono::duration_cast<std::chrono::microseconds>(
           startWork_ - idleStart);
+      FOLLY_SDT(
+          folly, event_base_loop_busy, this, busy.count(), idle.count());
 
       avgLoopTime_.addSample(std::chrono::microseconds(idle),
         std::chrono::microseconds(busy));
@@ -456,6 +467,20 @@ void EventBase::bumpHandlingTime() {
   }
 }
 
+void EventBase::setLoopProfiling(const LoopProfilingOptions& options) {
+  if (!loopProfiler_) {
+    loopProfiler_ = std::make_unique<detail::EventBaseLoopProfiler>();
+  }
+  loopProfiler_->setOptions(options);
+  loopProfiler_->setEnabled(true);
+}
+
+void EventBase::disableLoopProfiling() {
+  if (loopProfiler_) {
+    loopProfiler_->setEnabled(false);
+  }
+}
+
 void EventBase::terminateLoopSoon() {
   VLOG(5) << "EventBase(): Received terminateLoopSoon() command.";
 
@@ -603,6 +628,8 @@ bool EventBase::runLoopCallbacks() {
       LoopCallback* callback = &currentCallbacks.front();
       currentCallbacks.pop_front();
       folly::RequestContextScopeGuard rctx(callback->context_);
+      detail::EventBaseCallbackScope profile(
+          EventBaseCallbackType::LoopCallback, callback);
       callback->runLoopCallback();
     }
 
@@ -42,6 +42,7 @@
 #include <folly/experimental/ExecutionObserver.h>
 #include <folly/futures/DrivableExecutor.h>
 #include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBaseLoopProfile.h>
 #include <folly/io/async/HHWheelTimer.h>
 #include <folly/io/async/Request.h>
 #include <folly/io/async/TimeoutManager.h>
@@ -75,6 +76,22 @@ class EventBaseObserver {
 
   virtual void loopSample(
     int64_t busyTime, int64_t idleTime) = 0;
+
+  /**
+   * Called at the end of each profiled loop iteration when loop profiling
+   * is enabled (see EventBase::setLoopProfiling()), with the time spent in
+   * each type of callback during the iteration, and the callback run time
+   * histograms aggregated so far.
+   */
+  virtual void loopProfileSample(
+      const EventBaseLoopBreakdown& /* iteration */,
+      const EventBaseLoopProfile& /* profile */) {}
+
+  /**
+   * Called at the end of a profiled loop iteration for each callback that
+   * ran longer than the slow callback threshold.
+   */
+  virtual void slowCallback(const EventBaseSlowCallback& /* callback */) {}
 };
 
 // Helper class that sets and retrieves the EventBase associated with a given
@@ -83,7 +100,7 @@ class RequestEventBase : public RequestData {
  public:
   static EventBase* get() {
     auto data = dynamic_cast<RequestEventBase*>(
-        RequestContext::get()->getContextData(kContextDataName));
+        RequestContext::get()->getContextData(token()));
     if (!data) {
       return nullptr;
     }
@@ -92,14 +109,23 @@ class RequestEventBase : public RequestData {
 
   static void set(EventBase* eb) {
     RequestContext::get()->setContextData(
-        kContextDataName,
+        token(),
         std::unique_ptr<RequestEventBase>(new RequestEventBase(eb)));
   }
 
+  bool hasCallback() override {
+    return false;
+  }
+
  private:
   explicit RequestEventBase(EventBase* eb) : eb_(eb) {}
+
+  static const RequestToken& token() {
+    static const RequestToken token("EventBase");
+    return token;
+  }
+
   EventBase* eb_;
-  static constexpr const char* kContextDataName{"EventBase"};
 };
 
 class VirtualEventBase;
@@ -443,6 +469,37 @@ class EventBase : private boost::noncopyable,
     maxLatencyCob_ = std::move(maxLatencyCob);
   }
 
+  typedef detail::EventBaseLoopProfiler::Options LoopProfilingOptions;
+
+  /**
+   * Enable loop profiling: for one in options.sampleRate loop iterations,
+   * time every I/O handler, timeout, loop callback and runInEventBaseThread()
+   * function run, aggregate the times per callback type, and report
+   * callbacks slower than options.slowCallbackThreshold.  Results are
+   * passed to the observer (if any) and available from getLoopProfile().
+   *
+   * Unprofiled iterations pay one thread-local load per callback.  Must be
+   * called from the EventBase thread, or before the loop runs.
+   */
+  void setLoopProfiling(const LoopProfilingOptions& options);
+
+  void disableLoopProfiling();
+
+  /**
+   * Callback run times aggregated over the profiled iterations so far, or
+   * nullptr if loop profiling was never enabled.  Must be called from the
+   * EventBase thread.
+   */
+  const EventBaseLoopProfile* getLoopProfile() const {
+    return loopProfiler_ ? &loopProfiler_->profile() : nullptr;
+  }
+
+  void resetLoopProfile() {
+    if (loopProfiler_) {
+      loopProfiler_->reset();
+    }
+  }
+
   /**
    * Set smoothing coefficient for loop load average; # of milliseconds
    * for exp(-1) (1/2.71828...) decay.
@@ -734,6 +791,10 @@ class EventBase : private boost::noncopyable,
   // EventHandler's execution observer.
   ExecutionObserver* executionObserver_;
 
+  // Allocated when loop profiling is first enabled, and kept until
+  // destruction so iterations in progress can keep using it.
+  std::unique_ptr<detail::EventBaseLoopProfiler> loopProfiler_;
+
   // Name of the thread running this EventBase
   std::string name_;
 
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/EventBaseLoopProfile.h>
+
+#include <algorithm>
+
+#include <folly/Bits.h>
+#include <folly/Demangle.h>
+#include <folly/Format.h>
+#include <folly/io/async/EventBase.h>
+
+namespace folly {
+
+const char* eventBaseCallbackTypeName(EventBaseCallbackType type) {
+  switch (type) {
+    case EventBaseCallbackType::IoHandler:
+      return "IoHandler";
+    case EventBaseCallbackType::Timeout:
+      return "Timeout";
+    case EventBaseCallbackType::LoopCallback:
+      return "LoopCallback";
+    case EventBaseCallbackType::Function:
+      return "Function";
+  }
+  return "Unknown";
+}
+
+void EventBaseCallbackHistogram::add(std::chrono::nanoseconds duration) {
+  auto us = uint64_t(
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+  // findLastSet(0) == 0, findLastSet(1) == 1, findLastSet(2..3) == 2, ...
+  size_t bucket = std::min<size_t>(findLastSet(us), kNumBuckets - 1);
+  ++buckets[bucket];
+  ++count;
+  total += duration;
+  max = std::max(max, duration);
+}
+
+std::chrono::microseconds EventBaseCallbackHistogram::percentileUpperBound(
+    double pct) const {
+  if (count == 0) {
+    return std::chrono::microseconds(0);
+  }
+  auto target = uint64_t(std::max(1.0, pct / 100.0 * double(count)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets - 1; ++i) {
+    seen += buckets[i];
+    if (seen >= target) {
+      return std::chrono::microseconds(uint64_t(1) << i);
+    }
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(max);
+}
+
+std::string EventBaseSlowCallback::describe() const {
+  auto us =
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  if (objectType) {
+    return sformat(
+        "{} {} ({}) took {}us",
+        eventBaseCallbackTypeName(type),
+        demangle(objectType->name()),
+        object,
+        us);
+  }
+  return sformat(
+      "{} {} took {}us", eventBaseCallbackTypeName(type), function, us);
+}
+
+namespace detail {
+
+FOLLY_TLS EventBaseLoopProfiler* EventBaseLoopProfiler::current_ = nullptr;
+
+void EventBaseLoopProfiler::setOptions(const Options& options) {
+  options_ = options;
+  options_.sampleRate = std::max<uint32_t>(options_.sampleRate, 1);
+  countdown_ = 0;
+}
+
+EventBaseLoopProfiler::Iteration::Iteration(
+    EventBaseLoopProfiler* profiler,
+    EventBaseObserver* observer)
+    : observer_(observer), previous_(current_) {
+  if (profiler && profiler->enabled_) {
+    if (profiler->countdown_ == 0) {
+      profiler->countdown_ = profiler->options_.sampleRate;
+    }
+    if (--profiler->countdown_ == 0) {
+      profiler_ = profiler;
+    }
+  }
+  // Also hides the profiler of an enclosing loop on this thread, if any.
+  current_ = profiler_;
+}
+
+EventBaseLoopProfiler::Iteration::~Iteration() {
+  current_ = previous_;
+  if (!profiler_) {
+    return;
+  }
+
+  auto& p = *profiler_;
+  ++p.profile_.iterations;
+  p.profile_.slowCallbacks += p.slowCallbacks_.size();
+  if (observer_) {
+    observer_->loopProfileSample(p.iteration_, p.profile_);
+    for (auto& callback : p.slowCallbacks_) {
+      observer_->slowCallback(callback);
+    }
+  }
+  p.iteration_ = EventBaseLoopBreakdown();
+  p.slowCallbacks_.clear();
+}
+
+void EventBaseLoopProfiler::exitCallback(EventBaseCallbackScope& scope) {
+  auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - scope.start_);
+  innermost_ = scope.parent_;
+
+  iteration_.timeOf(scope.type_) += duration - scope.childTime_;
+  if (scope.parent_) {
+    scope.parent_->childTime_ += duration;
+  }
+  // Dispatchers are only charged for their own time; only the callbacks
+  // they run are counted and attributed.
+  if (scope.hasChildren_) {
+    return;
+  }
+  ++iteration_.countOf(scope.type_);
+  profile_.callbacks[size_t(scope.type_)].add(duration);
+
+  if (options_.slowCallbackThreshold.count() > 0 &&
+      duration >= options_.slowCallbackThreshold) {
+    EventBaseSlowCallback callback;
+    callback.type = scope.type_;
+    callback.objectType = scope.objectType_;
+    callback.object = scope.object_;
+    callback.function = scope.function_;
+    callback.duration = duration;
+    slowCallbacks_.push_back(callback);
+  }
+}
+
+void EventBaseCallbackScope::enter(
+    EventBaseCallbackType type,
+    const std::type_info* objectType,
+    const void* object,
+    const void* function) noexcept {
+  type_ = type;
+  objectType_ = objectType;
+  object_ = object;
+  function_ = function;
+  parent_ = profiler_->innermost_;
+  if (parent_) {
+    parent_->hasChildren_ = true;
+  }
+  profiler_->innermost_ = this;
+  start_ = std::chrono::steady_clock::now();
+}
+
+} // namespace detail
+} // namespace folly
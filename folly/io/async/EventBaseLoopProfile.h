@@ -0,0 +1,248 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include <folly/Likely.h>
+#include <folly/Portability.h>
+
+namespace folly {
+
+class EventBaseObserver;
+
+/**
+ * The kinds of callbacks an EventBase loop runs.
+ */
+enum class EventBaseCallbackType : uint8_t {
+  // EventHandler::handlerReady()
+  IoHandler,
+  // AsyncTimeout::timeoutExpired() and HHWheelTimer callbacks
+  Timeout,
+  // runInLoop() and runBeforeLoop() callbacks
+  LoopCallback,
+  // Functions passed to runInEventBaseThread()
+  Function,
+};
+
+constexpr size_t kNumEventBaseCallbackTypes = 4;
+
+const char* eventBaseCallbackTypeName(EventBaseCallbackType type);
+
+/**
+ * Time spent running each type of callback during one loop iteration.
+ * Callbacks that dispatch to other callbacks (e.g. the I/O handler of the
+ * runInEventBaseThread() queue, or an HHWheelTimer) are only charged for
+ * their own time.
+ */
+struct EventBaseLoopBreakdown {
+  std::array<std::chrono::nanoseconds, kNumEventBaseCallbackTypes> time{};
+  std::array<uint32_t, kNumEventBaseCallbackTypes> count{};
+
+  std::chrono::nanoseconds& timeOf(EventBaseCallbackType type) {
+    return time[size_t(type)];
+  }
+  uint32_t& countOf(EventBaseCallbackType type) {
+    return count[size_t(type)];
+  }
+};
+
+/**
+ * Distribution of callback run times, in power-of-two microsecond buckets.
+ */
+struct EventBaseCallbackHistogram {
+  static constexpr size_t kNumBuckets = 24;
+
+  // buckets[0] counts callbacks that took less than 1us, buckets[i] those
+  // that took [2^(i-1), 2^i) us; the last bucket also counts anything longer.
+  std::array<uint64_t, kNumBuckets> buckets{};
+  uint64_t count{0};
+  std::chrono::nanoseconds total{0};
+  std::chrono::nanoseconds max{0};
+
+  void add(std::chrono::nanoseconds duration);
+
+  /**
+   * Upper bound of the bucket the given percentile (0-100) falls into.
+   */
+  std::chrono::microseconds percentileUpperBound(double pct) const;
+};
+
+/**
+ * A callback that ran for at least the configured slow callback threshold.
+ */
+struct EventBaseSlowCallback {
+  EventBaseCallbackType type{EventBaseCallbackType::IoHandler};
+  // Dynamic type of the handler, timeout or loop callback; nullptr for
+  // functions.
+  const std::type_info* objectType{nullptr};
+  const void* object{nullptr};
+  // For functions, the address of the stored callable's invoker (see
+  // Function::getInvokerAddress()), which symbolizes to the lambda.
+  const void* function{nullptr};
+  std::chrono::nanoseconds duration{0};
+
+  std::string describe() const;
+};
+
+/**
+ * Aggregated over the profiled iterations of a loop.
+ */
+struct EventBaseLoopProfile {
+  uint64_t iterations{0};
+  std::array<EventBaseCallbackHistogram, kNumEventBaseCallbackTypes>
+      callbacks{};
+  uint64_t slowCallbacks{0};
+
+  const EventBaseCallbackHistogram& of(EventBaseCallbackType type) const {
+    return callbacks[size_t(type)];
+  }
+};
+
+namespace detail {
+
+class EventBaseCallbackScope;
+
+/**
+ * Per-EventBase state of loop profiling; see EventBase::setLoopProfiling().
+ * Only used from the loop thread.
+ */
+class EventBaseLoopProfiler {
+ public:
+  struct Options {
+    Options() {}
+
+    // Profile one in sampleRate loop iterations
+    uint32_t sampleRate{1};
+    // Report callbacks running at least this long through
+    // EventBaseObserver::slowCallback(); zero disables.
+    std::chrono::microseconds slowCallbackThreshold{10000};
+  };
+
+  void setOptions(const Options& options);
+  void setEnabled(bool enabled) {
+    enabled_ = enabled;
+  }
+  bool enabled() const {
+    return enabled_;
+  }
+
+  const EventBaseLoopProfile& profile() const {
+    return profile_;
+  }
+  void reset() {
+    profile_ = EventBaseLoopProfile();
+  }
+
+  // Brackets one loop iteration; callbacks run in between are timed if the
+  // iteration is sampled.
+  class Iteration {
+   public:
+    Iteration(EventBaseLoopProfiler* profiler, EventBaseObserver* observer);
+    ~Iteration();
+
+    Iteration(const Iteration&) = delete;
+    Iteration& operator=(const Iteration&) = delete;
+
+   private:
+    EventBaseLoopProfiler* profiler_{nullptr};
+    EventBaseObserver* observer_;
+    EventBaseLoopProfiler* previous_;
+  };
+
+  // Profiler of the iteration running on this thread, if it is sampled
+  static EventBaseLoopProfiler* current() {
+    return current_;
+  }
+
+ private:
+  friend class EventBaseCallbackScope;
+
+  void exitCallback(EventBaseCallbackScope& scope);
+
+  static FOLLY_TLS EventBaseLoopProfiler* current_;
+
+  Options options_;
+  bool enabled_{false};
+  uint32_t countdown_{0};
+  EventBaseCallbackScope* innermost_{nullptr};
+  EventBaseLoopBreakdown iteration_;
+  std::vector<EventBaseSlowCallback> slowCallbacks_;
+  EventBaseLoopProfile profile_;
+};
+
+/**
+ * Times a callback run by an EventBase loop, if the current iteration is
+ * profiled. Otherwise costs a thread-local load.
+ */
+class EventBaseCallbackScope {
+ public:
+  template <class T>
+  EventBaseCallbackScope(EventBaseCallbackType type, T* object) noexcept
+      : profiler_(EventBaseLoopProfiler::current()) {
+    if (UNLIKELY(profiler_ != nullptr)) {
+      // The callback may destroy the object, so look its type up now.
+      enter(type, &typeid(*object), object, nullptr);
+    }
+  }
+
+  EventBaseCallbackScope(
+      EventBaseCallbackType type,
+      const void* function) noexcept
+      : profiler_(EventBaseLoopProfiler::current()) {
+    if (UNLIKELY(profiler_ != nullptr)) {
+      enter(type, nullptr, nullptr, function);
+    }
+  }
+
+  ~EventBaseCallbackScope() {
+    if (UNLIKELY(profiler_ != nullptr)) {
+      profiler_->exitCallback(*this);
+    }
+  }
+
+  EventBaseCallbackScope(const EventBaseCallbackScope&) = delete;
+  EventBaseCallbackScope& operator=(const EventBaseCallbackScope&) = delete;
+
+ private:
+  friend class EventBaseLoopProfiler;
+
+  void enter(
+      EventBaseCallbackType type,
+      const std::type_info* objectType,
+      const void* object,
+      const void* function) noexcept;
+
+  EventBaseLoopProfiler* profiler_;
+  EventBaseCallbackScope* parent_{nullptr};
+  EventBaseCallbackType type_{EventBaseCallbackType::IoHandler};
+  bool hasChildren_{false};
+  const std::type_info* objectType_{nullptr};
+  const void* object_{nullptr};
+  const void* function_{nullptr};
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::nanoseconds childTime_{0};
+};
+
+} // namespace detail
+} // namespace folly
@@ -15,11 +15,13 @@
  */
 
 #include <folly/io/async/HHWheelTimer.h>
+#include <folly/io/async/EventBaseLoopProfile.h>
 #include <folly/io/async/Request.h>
 
 #include <folly/Memory.h>
 #include <folly/Optional.h>
 #include <folly/ScopeGuard.h>
+#include <folly/tracing/StaticTracepoint.h>
 
 #include <folly/Bits.h>
 
@@ -227,10 +229,23 @@ void HHWheelTimer::timeoutExpired() noexcept {
     auto* cb = &timeouts.front();
     timeouts.pop_front();
     count_--;
+    // Expiration is in steady_clock nanoseconds, for measuring lateness.
+    FOLLY_SDT(
+        folly,
+        hhwheel_timer_expire,
+        this,
+        cb,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            cb->expiration_.time_since_epoch())
+            .count());
     cb->wheel_ = nullptr;
     cb->expiration_ = {};
-    RequestContextScopeGuard rctx(cb->context_);
-    cb->timeoutExpired();
+    {
+      RequestContextScopeGuard rctx(cb->context_);
+      detail::EventBaseCallbackScope profile(
+          EventBaseCallbackType::Timeout, cb);
+      cb->timeoutExpired();
+    }
     if (isDestroyed) {
       // The HHWheelTimer itself has been destroyed. The other callbacks
       // will have been cancelled from the destructor. Bail before causing
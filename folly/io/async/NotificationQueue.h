@@ -34,6 +34,7 @@
 #include <folly/Likely.h>
 #include <folly/ScopeGuard.h>
 #include <folly/SpinLock.h>
+#include <folly/tracing/StaticTracepoint.h>
 #include <folly/portability/Fcntl.h>
 #include <folly/portability/Sockets.h>
 #include <folly/portability/Unistd.h>
@@ -428,6 +429,7 @@ class NotificationQueue {
     RequestContext::setContext(std::move(data.second));
 
     queue_.pop_front();
+    FOLLY_SDT(folly, notification_queue_dequeue, this, queue_.size());
 
     return true;
   }
@@ -584,6 +586,7 @@ class NotificationQueue {
         signal = true;
       }
       queue_.emplace_back(std::move(message), RequestContext::saveContext());
+      FOLLY_SDT(folly, notification_queue_enqueue, this, queue_.size());
       if (signal) {
         ensureSignalLocked();
       }
@@ -604,6 +607,7 @@ class NotificationQueue {
         signal = true;
       }
       queue_.emplace_back(message, RequestContext::saveContext());
+      FOLLY_SDT(folly, notification_queue_enqueue, this, queue_.size());
       if (signal) {
         ensureSignalLocked();
       }
@@ -625,6 +629,7 @@ class NotificationQueue {
         ++first;
         ++numAdded;
       }
+      FOLLY_SDT(folly, notification_queue_enqueue, this, queue_.size());
       if (numActiveConsumers_ < numConsumers_) {
         signal = true;
       }
@@ -708,6 +713,11 @@ void NotificationQueue<MessageT>::Consumer::consumeMessages(
       MessageT msg(std::move(data.first));
       RequestContextScopeGuard rctx(std::move(data.second));
       queue_->queue_.pop_front();
+      FOLLY_SDT(
+          folly,
+          notification_queue_dequeue,
+          queue_,
+          queue_->queue_.size());
 
       // Check to see if the queue is empty now.
       // We use this as an optimization to see if we should bother trying to
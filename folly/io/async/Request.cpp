@@ -19,90 +19,263 @@
 
 #include <glog/logging.h>
 
-#include <folly/MapUtil.h>
+#include <algorithm>
+
+#include <folly/Indestructible.h>
 #include <folly/SingletonThreadLocal.h>
+#include <folly/experimental/hazptr/hazptr.h>
 
 namespace folly {
 
+RequestToken::RequestToken(const std::string& str) {
+  auto& cache = getCache();
+  {
+    auto c = cache.rlock();
+    auto res = c->find(str);
+    if (res != c->end()) {
+      token_ = res->second;
+      return;
+    }
+  }
+  auto c = cache.wlock();
+  auto res = c->find(str);
+  if (res != c->end()) {
+    token_ = res->second;
+    return;
+  }
+  token_ = uint32_t(c->size());
+  c->emplace(str, token_);
+}
+
+std::string RequestToken::getDebugString() const {
+  auto c = getCache().rlock();
+  for (const auto& ent : *c) {
+    if (ent.second == token_) {
+      return ent.first;
+    }
+  }
+  throw std::logic_error("Could not find debug string in RequestToken");
+}
+
+Synchronized<std::unordered_map<std::string, uint32_t>>&
+RequestToken::getCache() {
+  static Indestructible<
+      Synchronized<std::unordered_map<std::string, uint32_t>>>
+      cache;
+  return *cache;
+}
+
+struct RequestContext::State : hazptr::hazptr_obj_base<State> {
+  // Sorted by token. Entries may hold nullptr, see setContextData().
+  std::vector<std::pair<uint32_t, RequestData*>> entries;
+  // The non-null entries whose hasCallback() is true
+  std::vector<RequestData*> callbacks;
+  // Data removed by the next state. Readers of this one may still be using
+  // it, so it is destroyed along with this state.
+  std::unique_ptr<RequestData> removed;
+
+  const std::pair<uint32_t, RequestData*>* find(uint32_t token) const;
+};
+
+const std::pair<uint32_t, RequestData*>* RequestContext::State::find(
+    uint32_t token) const {
+  auto it = std::lower_bound(
+      entries.begin(),
+      entries.end(),
+      token,
+      [](const std::pair<uint32_t, RequestData*>& ent, uint32_t t) {
+        return ent.first < t;
+      });
+  if (it == entries.end() || it->first != token) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+RequestContext::~RequestContext() {
+  // Destroy the data while it can still be looked up, in case a destructor
+  // accesses the context.
+  data_.clear();
+  delete state_.load(std::memory_order_relaxed);
+}
+
+RequestContext::State* RequestContext::publish(
+    const std::vector<std::pair<uint32_t, RequestData*>>& entries,
+    std::unique_ptr<RequestData> removed) {
+  std::unique_ptr<State> next(new State);
+  next->entries = entries;
+  for (const auto& ent : entries) {
+    if (ent.second && ent.second->hasCallback()) {
+      next->callbacks.push_back(ent.second);
+    }
+  }
+  hasCallbacks_.store(!next->callbacks.empty(), std::memory_order_relaxed);
+  auto old = state_.exchange(next.release(), std::memory_order_acq_rel);
+  if (old) {
+    old->removed = std::move(removed);
+  }
+  return old;
+}
+
 void RequestContext::setContextData(
-    const std::string& val,
+    const RequestToken& val,
     std::unique_ptr<RequestData> data) {
-  auto wlock = data_.wlock();
-  if (wlock->count(val)) {
-    LOG_FIRST_N(WARNING, 1)
-        << "Called RequestContext::setContextData with data already set";
+  State* retired;
+  {
+    std::lock_guard<std::mutex> g(writeMutex_);
+    auto cur = state();
+    auto entries =
+        cur ? cur->entries : std::vector<std::pair<uint32_t, RequestData*>>();
+    auto it = std::lower_bound(
+        entries.begin(),
+        entries.end(),
+        std::make_pair(val.token_, static_cast<RequestData*>(nullptr)));
+    std::unique_ptr<RequestData> old;
+    if (it != entries.end() && it->first == val.token_) {
+      LOG_FIRST_N(WARNING, 1)
+          << "Called RequestContext::setContextData with data already set";
 
-    (*wlock)[val] = nullptr;
-  } else {
-    (*wlock)[val] = std::move(data);
+      if (it->second) {
+        auto owner = std::find_if(
+            data_.begin(),
+            data_.end(),
+            [&](const std::unique_ptr<RequestData>& d) {
+              return d.get() == it->second;
+            });
+        old = std::move(*owner);
+        data_.erase(owner);
+      }
+      it->second = nullptr;
+    } else {
+      entries.insert(it, std::make_pair(val.token_, data.get()));
+      data_.push_back(std::move(data));
+    }
+    retired = publish(entries, std::move(old));
+  }
+  // Retiring may destroy the data removed earlier, whose destructor may
+  // access the context, so only do it after releasing the lock.
+  if (retired) {
+    retired->retire();
   }
 }
 
 bool RequestContext::setContextDataIfAbsent(
-    const std::string& val,
+    const RequestToken& val,
     std::unique_ptr<RequestData> data) {
-  auto ulock = data_.ulock();
-  if (ulock->count(val)) {
+  if (hasContextData(val)) {
     return false;
   }
-
-  auto wlock = ulock.moveFromUpgradeToWrite();
-  (*wlock)[val] = std::move(data);
+  State* retired;
+  {
+    std::lock_guard<std::mutex> g(writeMutex_);
+    auto cur = state();
+    if (cur && cur->find(val.token_)) {
+      return false;
+    }
+    auto entries =
+        cur ? cur->entries : std::vector<std::pair<uint32_t, RequestData*>>();
+    entries.insert(
+        std::lower_bound(
+            entries.begin(),
+            entries.end(),
+            std::make_pair(val.token_, static_cast<RequestData*>(nullptr))),
+        std::make_pair(val.token_, data.get()));
+    data_.push_back(std::move(data));
+    retired = publish(entries, nullptr);
+  }
+  if (retired) {
+    retired->retire();
+  }
   return true;
 }
 
-bool RequestContext::hasContextData(const std::string& val) const {
-  return data_.rlock()->count(val);
+bool RequestContext::hasContextData(const RequestToken& val) const {
+  hazptr::hazptr_owner<State> hptr;
+  auto cur = hptr.get_protected(state_);
+  return cur && cur->find(val.token_);
 }
 
-RequestData* RequestContext::getContextData(const std::string& val) {
-  const std::unique_ptr<RequestData> dflt{nullptr};
-  return get_ref_default(*data_.rlock(), val, dflt).get();
+RequestData* RequestContext::getContextData(const RequestToken& val) {
+  hazptr::hazptr_owner<State> hptr;
+  auto cur = hptr.get_protected(state_);
+  auto ent = cur ? cur->find(val.token_) : nullptr;
+  return ent ? ent->second : nullptr;
 }
 
 const RequestData* RequestContext::getContextData(
-    const std::string& val) const {
-  const std::unique_ptr<RequestData> dflt{nullptr};
-  return get_ref_default(*data_.rlock(), val, dflt).get();
+    const RequestToken& val) const {
+  hazptr::hazptr_owner<State> hptr;
+  auto cur = hptr.get_protected(state_);
+  auto ent = cur ? cur->find(val.token_) : nullptr;
+  return ent ? ent->second : nullptr;
 }
 
 void RequestContext::onSet() {
-  auto rlock = data_.rlock();
-  for (auto const& ent : *rlock) {
-    if (auto& data = ent.second) {
+  if (!hasCallbacks_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  hazptr::hazptr_owner<State> hptr;
+  if (auto cur = hptr.get_protected(state_)) {
+    for (auto data : cur->callbacks) {
       data->onSet();
     }
   }
 }
 
 void RequestContext::onUnset() {
-  auto rlock = data_.rlock();
-  for (auto const& ent : *rlock) {
-    if (auto& data = ent.second) {
+  if (!hasCallbacks_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  hazptr::hazptr_owner<State> hptr;
+  if (auto cur = hptr.get_protected(state_)) {
+    for (auto data : cur->callbacks) {
       data->onUnset();
     }
   }
 }
 
-void RequestContext::clearContextData(const std::string& val) {
-  std::unique_ptr<RequestData> requestData;
-  // Delete the RequestData after giving up the wlock just in case one of the
-  // RequestData destructors will try to grab the lock again.
+void RequestContext::clearContextData(const RequestToken& val) {
+  State* retired;
   {
-    auto wlock = data_.wlock();
-    auto it = wlock->find(val);
-    if (it != wlock->end()) {
-      requestData = std::move(it->second);
-      wlock->erase(it);
+    std::lock_guard<std::mutex> g(writeMutex_);
+    auto cur = state();
+    auto ent = cur ? cur->find(val.token_) : nullptr;
+    if (!ent) {
+      return;
     }
+    auto entries = cur->entries;
+    entries.erase(entries.begin() + (ent - cur->entries.data()));
+    std::unique_ptr<RequestData> requestData;
+    auto owner = std::find_if(
+        data_.begin(),
+        data_.end(),
+        [&](const std::unique_ptr<RequestData>& d) {
+          return d.get() == ent->second;
+        });
+    if (owner != data_.end()) {
+      requestData = std::move(*owner);
+      data_.erase(owner);
+    }
+    retired = publish(entries, std::move(requestData));
+  }
+  // Retire after giving up the lock just in case one of the RequestData
+  // destructors will try to grab the lock again.
+  if (retired) {
+    retired->retire();
   }
 }
 
 std::shared_ptr<RequestContext> RequestContext::setContext(
     std::shared_ptr<RequestContext> ctx) {
-  auto& curCtx = getStaticContext();
+  auto& cur = getStaticContext();
+  auto& curCtx = cur.ctx;
   if (ctx != curCtx) {
     FOLLY_SDT(folly, request_context_switch_before, curCtx.get(), ctx.get());
+    if (cur.deferred) {
+      cur.saved.push_back({cur.epoch, curCtx, cur.deferred});
+      cur.deferred = 0;
+      ++cur.epoch;
+    }
     using std::swap;
     if (curCtx) {
       curCtx->onUnset();
@@ -115,15 +288,32 @@ std::shared_ptr<RequestContext> RequestContext::setContext(
   return ctx;
 }
 
-std::shared_ptr<RequestContext>& RequestContext::getStaticContext() {
-  using SingletonT = SingletonThreadLocal<std::shared_ptr<RequestContext>>;
+void RequestContext::restoreDeferred(uint64_t epoch) {
+  auto& cur = getStaticContext();
+  auto it = std::find_if(
+      cur.saved.begin(), cur.saved.end(), [&](const StaticContext::Saved& s) {
+        return s.epoch == epoch;
+      });
+  DCHECK(it != cur.saved.end());
+  std::shared_ptr<RequestContext> ctx;
+  if (--it->guards == 0) {
+    ctx = std::move(it->ctx);
+    cur.saved.erase(it);
+  } else {
+    ctx = it->ctx;
+  }
+  setContext(std::move(ctx));
+}
+
+RequestContext::StaticContext& RequestContext::getStaticContext() {
+  using SingletonT = SingletonThreadLocal<StaticContext>;
   static SingletonT singleton;
 
   return singleton.get();
 }
 
 RequestContext* RequestContext::get() {
-  auto context = getStaticContext();
+  auto& context = getStaticContext().ctx;
   if (!context) {
     static RequestContext defaultContext;
     return std::addressof(defaultContext);
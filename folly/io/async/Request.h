@@ -16,8 +16,12 @@
 
 #pragma once
 
-#include <map>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <folly/SharedMutex.h>
 #include <folly/Synchronized.h>
@@ -36,6 +40,36 @@ class RequestData {
   // just don't do it!
   virtual void onSet() {}
   virtual void onUnset() {}
+  // Return false if onSet() and onUnset() need not be called. Switching to
+  // or from a context none of whose data has callbacks is cheaper.
+  virtual bool hasCallback() {
+    return true;
+  }
+};
+
+// Interned key of RequestContext data. Constructing a token looks up a
+// global registry under a lock, so create tokens once (e.g. as
+// function-local statics) and reuse them; lookups by token are cheap.
+class RequestToken {
+ public:
+  explicit RequestToken(const std::string& str);
+
+  bool operator==(const RequestToken& other) const {
+    return token_ == other.token_;
+  }
+  bool operator!=(const RequestToken& other) const {
+    return token_ != other.token_;
+  }
+
+  // Slow, use only for debugging purposes.
+  std::string getDebugString() const;
+
+ private:
+  friend class RequestContext;
+
+  static Synchronized<std::unordered_map<std::string, uint32_t>>& getCache();
+
+  uint32_t token_;
 };
 
 class RequestContext;
@@ -43,8 +77,20 @@ class RequestContext;
 // If you do not call create() to create a unique request context,
 // this default request context will always be returned, and is never
 // copied between threads.
+//
+// Context data is kept in a small sorted array that is never modified once
+// published: readers (getContextData() and the onSet()/onUnset() callbacks
+// run on context switches) are lock-free, while writers copy the array
+// under a mutex. Replaced arrays, and the data removed from them, are
+// reclaimed through hazard pointers.
 class RequestContext {
  public:
+  RequestContext() = default;
+  ~RequestContext();
+
+  RequestContext(const RequestContext&) = delete;
+  RequestContext& operator=(const RequestContext&) = delete;
+
   // Create a unique request context for this request.
   // It will be passed between queues / threads (where implemented),
   // so it should be valid for the lifetime of the request.
@@ -57,26 +103,51 @@ class RequestContext {
 
   // The following API may be used to set per-request data in a thread-safe way.
   // This access is still performance sensitive, so please ask if you need help
-  // profiling any use of these functions.
+  // profiling any use of these functions. The std::string overloads intern
+  // the key on every call, prefer the RequestToken ones on hot paths.
   void setContextData(
-      const std::string& val,
+      const RequestToken& val,
       std::unique_ptr<RequestData> data);
+  void setContextData(
+      const std::string& val,
+      std::unique_ptr<RequestData> data) {
+    setContextData(RequestToken(val), std::move(data));
+  }
 
   // Unlike setContextData, this method does not panic if the key is already
   // present. Returns true iff the new value has been inserted.
   bool setContextDataIfAbsent(
-      const std::string& val,
+      const RequestToken& val,
       std::unique_ptr<RequestData> data);
+  bool setContextDataIfAbsent(
+      const std::string& val,
+      std::unique_ptr<RequestData> data) {
+    return setContextDataIfAbsent(RequestToken(val), std::move(data));
+  }
 
-  bool hasContextData(const std::string& val) const;
+  bool hasContextData(const RequestToken& val) const;
+  bool hasContextData(const std::string& val) const {
+    return hasContextData(RequestToken(val));
+  }
 
-  RequestData* getContextData(const std::string& val);
-  const RequestData* getContextData(const std::string& val) const;
+  RequestData* getContextData(const RequestToken& val);
+  const RequestData* getContextData(const RequestToken& val) const;
+  RequestData* getContextData(const std::string& val) {
+    return getContextData(RequestToken(val));
+  }
+  const RequestData* getContextData(const std::string& val) const {
+    return getContextData(RequestToken(val));
+  }
 
   void onSet();
   void onUnset();
 
-  void clearContextData(const std::string& val);
+  // The data is destroyed once no concurrent lookup or onSet()/onUnset() can
+  // still be using it, which may be after this returns, on any thread.
+  void clearContextData(const RequestToken& val);
+  void clearContextData(const std::string& val) {
+    clearContextData(RequestToken(val));
+  }
 
   // The following API is used to pass the context through queues / threads.
   // saveContext is called to get a shared_ptr to the context, and
@@ -92,19 +163,67 @@ class RequestContext {
       std::shared_ptr<RequestContext> ctx);
 
   static std::shared_ptr<RequestContext> saveContext() {
-    return getStaticContext();
+    return getStaticContext().ctx;
   }
 
  private:
-  static std::shared_ptr<RequestContext>& getStaticContext();
+  friend class RequestContextScopeGuard;
+
+  // Immutable once published
+  struct State;
 
-  using Data = std::map<std::string, std::unique_ptr<RequestData>>;
-  folly::Synchronized<Data, folly::SharedMutex> data_;
+  // Per-thread state. A RequestContextScopeGuard created for the context that
+  // is already current does not copy it: if that context gets replaced while
+  // such guards are alive, setContext() saves it on their behalf instead.
+  struct StaticContext {
+    struct Saved {
+      uint64_t epoch;
+      std::shared_ptr<RequestContext> ctx;
+      // Number of deferred guards of that epoch still alive
+      size_t guards;
+    };
+
+    std::shared_ptr<RequestContext> ctx;
+    // Bumped whenever ctx is replaced while deferred guards are alive
+    uint64_t epoch{0};
+    // Number of deferred guards of the current epoch still alive
+    size_t deferred{0};
+    // The contexts that ended the past epochs, not in any particular order
+    // as guards may be interleaved by fibers.
+    std::vector<Saved> saved;
+  };
+
+  static StaticContext& getStaticContext();
+
+  // Restore the context saved for a deferred guard of a past epoch.
+  static void restoreDeferred(uint64_t epoch);
+
+  // Must be called with writeMutex_ held.
+  State* state() const {
+    return state_.load(std::memory_order_acquire);
+  }
+
+  // Must be called with writeMutex_ held. Returns the replaced state, which
+  // now owns `removed' and must be retired once the lock is released.
+  State* publish(
+      const std::vector<std::pair<uint32_t, RequestData*>>& entries,
+      std::unique_ptr<RequestData> removed);
+
+  std::atomic<State*> state_{nullptr};
+  // Whether the current state has callbacks, so that switching to or from a
+  // context without any does not need to protect its state.
+  std::atomic<bool> hasCallbacks_{false};
+  std::mutex writeMutex_;
+  std::vector<std::unique_ptr<RequestData>> data_;
 };
 
 class RequestContextScopeGuard {
  private:
   std::shared_ptr<RequestContext> prev_;
+  // Set if the guard was created for the context that was already current,
+  // prev_ is then unused. See RequestContext::StaticContext.
+  RequestContext::StaticContext* deferred_{nullptr};
+  uint64_t epoch_{0};
 
  public:
   RequestContextScopeGuard(const RequestContextScopeGuard&) = delete;
@@ -120,12 +239,35 @@ class RequestContextScopeGuard {
 
   // Set a RequestContext that was previously captured by saveContext(). It will
   // be automatically reset to the original value when this goes out of scope.
-  explicit RequestContextScopeGuard(std::shared_ptr<RequestContext> ctx)
+  explicit RequestContextScopeGuard(std::shared_ptr<RequestContext>&& ctx)
       : prev_(RequestContext::setContext(std::move(ctx))) {
   }
 
+  // As above, but does not touch any reference count when `ctx' is already
+  // the current context, as is common when running callbacks. It is still
+  // restored if it gets replaced within the scope.
+  explicit RequestContextScopeGuard(
+      const std::shared_ptr<RequestContext>& ctx) {
+    auto& cur = RequestContext::getStaticContext();
+    if (ctx == cur.ctx) {
+      deferred_ = &cur;
+      epoch_ = cur.epoch;
+      ++cur.deferred;
+    } else {
+      prev_ = RequestContext::setContext(ctx);
+    }
+  }
+
   ~RequestContextScopeGuard() {
-    RequestContext::setContext(std::move(prev_));
+    if (!deferred_) {
+      RequestContext::setContext(std::move(prev_));
+      return;
+    }
+    if (epoch_ == deferred_->epoch) {
+      --deferred_->deferred;
+    } else {
+      RequestContext::restoreDeferred(epoch_);
+    }
   }
 };
 }
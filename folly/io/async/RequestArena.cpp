@@ -0,0 +1,80 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/RequestArena.h>
+
+#include <vector>
+
+#include <folly/ThreadLocal.h>
+
+namespace folly {
+
+namespace {
+
+const RequestToken& requestArenaToken() {
+  static const RequestToken token("folly::RequestArena");
+  return token;
+}
+
+struct ArenaCacheTag {};
+using ArenaCache =
+    ThreadLocal<std::vector<std::unique_ptr<SysArena>>, ArenaCacheTag>;
+
+// Leak this intentionally, request contexts (and their arenas) may be
+// destroyed during shutdown.
+ArenaCache& arenaCache() {
+  static auto cache = new ArenaCache();
+  return *cache;
+}
+
+} // namespace
+
+constexpr size_t RequestArena::kMaxCachedArenas;
+constexpr size_t RequestArena::kMaxCachedArenaSize;
+
+RequestArena* RequestArena::get() {
+  auto ctx = RequestContext::saveContext();
+  if (!ctx) {
+    return nullptr;
+  }
+  if (auto data = ctx->getContextData(requestArenaToken())) {
+    return static_cast<RequestArena*>(data);
+  }
+  ctx->setContextDataIfAbsent(
+      requestArenaToken(), std::unique_ptr<RequestArena>(new RequestArena()));
+  return static_cast<RequestArena*>(ctx->getContextData(requestArenaToken()));
+}
+
+RequestArena::RequestArena() {
+  auto& cache = *arenaCache();
+  if (!cache.empty()) {
+    arena_ = std::move(cache.back());
+    cache.pop_back();
+  } else {
+    arena_.reset(new SysArena());
+  }
+}
+
+RequestArena::~RequestArena() {
+  arena_->reset();
+  auto& cache = *arenaCache();
+  if (cache.size() < kMaxCachedArenas &&
+      arena_->totalSize() <= kMaxCachedArenaSize) {
+    cache.push_back(std::move(arena_));
+  }
+}
+
+} // namespace folly
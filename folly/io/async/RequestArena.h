@@ -0,0 +1,96 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+
+#include <folly/Arena.h>
+#include <folly/io/async/Request.h>
+
+namespace folly {
+
+/**
+ * Arena whose lifetime is that of the current RequestContext: everything
+ * allocated from it is freed at once when the request's context is
+ * destroyed, so allocations made while handling a request cost a pointer
+ * bump and nothing to free.
+ *
+ *   auto arena = RequestArena::get();
+ *   std::vector<Foo, RequestArenaAllocator<Foo>> foos{
+ *       RequestArenaAllocator<Foo>(arena)};
+ *
+ * Memory allocated from a RequestArena must not be used after the request
+ * is done, i.e. it must not be reachable from anything that outlives the
+ * RequestContext.
+ *
+ * Arenas of finished requests are reset (keeping their largest block) and
+ * cached on the thread that destroyed the context, so a steady stream of
+ * requests doesn't hit malloc for the first block of each one.
+ *
+ * A request may run on several threads at once, so allocate() takes a
+ * lock; it is uncontended in the common case.
+ */
+class RequestArena : public RequestData {
+ public:
+  // Number of reset arenas each thread keeps for reuse.
+  static constexpr size_t kMaxCachedArenas = 4;
+  // Arenas holding on to more memory than this after reset() are freed
+  // rather than cached.
+  static constexpr size_t kMaxCachedArenaSize = 1 << 20;
+
+  // Returns the arena of the current request, creating it on first use, or
+  // nullptr if no RequestContext is set.
+  static RequestArena* get();
+
+  ~RequestArena() override;
+
+  void* allocate(size_t size) {
+    std::lock_guard<std::mutex> g(mutex_);
+    return arena_->allocate(size);
+  }
+
+  void deallocate(void* /* p */) {}
+
+  size_t totalSize() const {
+    std::lock_guard<std::mutex> g(mutex_);
+    return arena_->totalSize();
+  }
+
+  size_t bytesUsed() const {
+    std::lock_guard<std::mutex> g(mutex_);
+    return arena_->bytesUsed();
+  }
+
+  bool hasCallback() override {
+    return false;
+  }
+
+ private:
+  RequestArena();
+
+  mutable std::mutex mutex_;
+  std::unique_ptr<SysArena> arena_;
+};
+
+template <>
+struct IsArenaAllocator<RequestArena> : std::true_type {};
+
+template <class T>
+using RequestArenaAllocator = ArenaAllocator<T, RequestArena>;
+
+} // namespace folly
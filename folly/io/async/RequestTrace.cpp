@@ -0,0 +1,267 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/RequestTrace.h>
+
+#include <algorithm>
+
+#include <folly/Format.h>
+#include <folly/Random.h>
+
+namespace folly {
+
+namespace {
+
+const RequestToken& requestTraceToken() {
+  static const RequestToken token("folly::RequestTrace");
+  return token;
+}
+
+std::atomic<uint32_t> gSampleRate{RequestTrace::Options().sampleRate};
+std::atomic<uint32_t> gMaxEvents{RequestTrace::Options().maxEvents};
+std::atomic<RequestTraceSink*> gSink{nullptr};
+
+std::atomic<uint32_t> gNextThreadIndex{0};
+FOLLY_TLS uint32_t tThreadIndex = 0;
+
+uint32_t currentThreadIndex() {
+  // 0 means "not assigned yet"
+  if (UNLIKELY(tThreadIndex == 0)) {
+    tThreadIndex = ++gNextThreadIndex;
+  }
+  return tThreadIndex;
+}
+} // namespace
+
+const char* requestTraceEventTypeName(RequestTraceEventType type) {
+  switch (type) {
+    case RequestTraceEventType::Start:
+      return "Start";
+    case RequestTraceEventType::ContextSet:
+      return "ContextSet";
+    case RequestTraceEventType::ContextUnset:
+      return "ContextUnset";
+    case RequestTraceEventType::FutureContinuation:
+      return "FutureContinuation";
+    case RequestTraceEventType::FiberResume:
+      return "FiberResume";
+    case RequestTraceEventType::FiberSuspend:
+      return "FiberSuspend";
+    case RequestTraceEventType::FiberFinish:
+      return "FiberFinish";
+    case RequestTraceEventType::Annotation:
+      return "Annotation";
+    case RequestTraceEventType::Finish:
+      return "Finish";
+  }
+  return "Unknown";
+}
+
+std::chrono::nanoseconds RequestTimeline::duration() const {
+  return events.empty() ? std::chrono::nanoseconds(0) : events.back().time;
+}
+
+std::chrono::nanoseconds RequestTimeline::activeTime() const {
+  std::chrono::nanoseconds active{0};
+  std::chrono::nanoseconds last{0};
+  size_t installed = 0;
+  for (const auto& event : events) {
+    if (installed > 0) {
+      active += event.time - last;
+    }
+    last = event.time;
+    switch (event.type) {
+      case RequestTraceEventType::Start:
+        // start() requires the context to be installed on the caller's thread
+        installed = 1;
+        break;
+      case RequestTraceEventType::ContextSet:
+        ++installed;
+        break;
+      case RequestTraceEventType::ContextUnset:
+        // Tolerate unbalanced events caused by dropping
+        installed -= installed > 0;
+        break;
+      default:
+        break;
+    }
+  }
+  return active;
+}
+
+std::string RequestTimeline::toString() const {
+  using std::chrono::duration_cast;
+  using us = std::chrono::duration<double, std::micro>;
+  auto out = sformat(
+      "request {} took {:.1f}us ({:.1f}us active), {} events, {} dropped\n",
+      name ? name : "(unnamed)",
+      duration_cast<us>(duration()).count(),
+      duration_cast<us>(activeTime()).count(),
+      events.size(),
+      droppedEvents);
+  for (const auto& event : events) {
+    out += sformat(
+        "  +{:10.1f}us  T{:<4} {}{}{}\n",
+        duration_cast<us>(event.time).count(),
+        event.thread,
+        requestTraceEventTypeName(event.type),
+        event.label ? " " : "",
+        event.label ? event.label : "");
+  }
+  return out;
+}
+
+void RequestTraceSink::write(RequestTimeline&& timeline) noexcept {
+  if (!queue_.write(std::move(timeline))) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+FOLLY_TLS RequestTrace* RequestTraceHook::current_ = nullptr;
+
+void RequestTraceHook::add(
+    RequestTrace* trace,
+    RequestTraceEventType type,
+    const char* label) noexcept {
+  trace->add(type, label);
+}
+
+void RequestTrace::setOptions(const Options& options) {
+  gSampleRate.store(options.sampleRate, std::memory_order_relaxed);
+  gMaxEvents.store(options.maxEvents, std::memory_order_relaxed);
+}
+
+RequestTrace::Options RequestTrace::getOptions() {
+  Options options;
+  options.sampleRate = gSampleRate.load(std::memory_order_relaxed);
+  options.maxEvents = gMaxEvents.load(std::memory_order_relaxed);
+  return options;
+}
+
+void RequestTrace::setSink(RequestTraceSink* sink) {
+  gSink.store(sink, std::memory_order_release);
+}
+
+bool RequestTrace::maybeStart(const char* name) {
+  auto rate = gSampleRate.load(std::memory_order_relaxed);
+  if (rate == 0 || gSink.load(std::memory_order_relaxed) == nullptr) {
+    return false;
+  }
+  if (RequestTraceHook::current_ != nullptr) {
+    // Already traced
+    return true;
+  }
+  return Random::oneIn(rate) && start(name);
+}
+
+bool RequestTrace::start(const char* name) {
+  auto sink = gSink.load(std::memory_order_acquire);
+  auto ctx = RequestContext::saveContext();
+  if (!sink || !ctx) {
+    return false;
+  }
+  if (RequestTraceHook::current_ != nullptr ||
+      ctx->hasContextData(requestTraceToken())) {
+    return true;
+  }
+  std::unique_ptr<RequestTrace> trace(new RequestTrace(
+      name, gMaxEvents.load(std::memory_order_relaxed), sink));
+  auto raw = trace.get();
+  if (!ctx->setContextDataIfAbsent(requestTraceToken(), std::move(trace))) {
+    return true;
+  }
+  // The context is already installed, so onSet() will not be called for
+  // this thread.
+  RequestTraceHook::current_ = raw;
+  raw->add(RequestTraceEventType::Start, name);
+  return true;
+}
+
+RequestTrace::RequestTrace(
+    const char* name,
+    uint32_t maxEvents,
+    RequestTraceSink* sink)
+    : sink_(sink),
+      start_(std::chrono::steady_clock::now()),
+      capacity_(maxEvents) {
+  timeline_.name = name;
+  timeline_.start = start_;
+  timeline_.events.reserve(size_t(maxEvents) + 1);
+  timeline_.events.resize(maxEvents);
+}
+
+RequestTrace::~RequestTrace() {
+  // The context is destroyed on the thread that dropped the last reference
+  // to it, which might still have it installed (e.g. at thread exit).
+  if (RequestTraceHook::current_ == this) {
+    RequestTraceHook::current_ = nullptr;
+  }
+
+  // Nothing below allocates, so destroying a traced context can't fail.
+  auto now = std::chrono::steady_clock::now();
+  auto size = size_.load(std::memory_order_relaxed);
+  if (size == 0) {
+    // Lost the race to attach to the context in start()
+    return;
+  }
+  auto& events = timeline_.events;
+  timeline_.droppedEvents = size > capacity_ ? size - capacity_ : 0;
+  events.resize(std::min(size, capacity_));
+  // Slots are claimed in order, but clocks are read before claiming, so
+  // events from different threads may be slightly out of order. Insertion
+  // sort is stable, doesn't need a buffer, and is linear when the events
+  // are almost sorted.
+  for (auto it = events.begin(); it != events.end(); ++it) {
+    auto pos = std::upper_bound(
+        events.begin(),
+        it,
+        *it,
+        [](const RequestTraceEvent& a, const RequestTraceEvent& b) {
+          return a.time < b.time;
+        });
+    std::rotate(pos, it, it + 1);
+  }
+  events.push_back(RequestTraceEvent{now - start_,
+                                     currentThreadIndex(),
+                                     RequestTraceEventType::Finish,
+                                     nullptr});
+  sink_->write(std::move(timeline_));
+}
+
+void RequestTrace::onSet() {
+  RequestTraceHook::current_ = this;
+  add(RequestTraceEventType::ContextSet, nullptr);
+}
+
+void RequestTrace::onUnset() {
+  add(RequestTraceEventType::ContextUnset, nullptr);
+  if (RequestTraceHook::current_ == this) {
+    RequestTraceHook::current_ = nullptr;
+  }
+}
+
+void RequestTrace::add(
+    RequestTraceEventType type,
+    const char* label) noexcept {
+  auto now = std::chrono::steady_clock::now();
+  auto index = size_.fetch_add(1, std::memory_order_relaxed);
+  if (index >= capacity_) {
+    return;
+  }
+  timeline_.events[index] = RequestTraceEvent{
+      now - start_, currentThreadIndex(), type, label};
+}
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <folly/MPMCQueue.h>
+#include <folly/Portability.h>
+#include <folly/io/async/Request.h>
+#include <folly/io/async/RequestTraceHook.h>
+
+namespace folly {
+
+const char* requestTraceEventTypeName(RequestTraceEventType type);
+
+struct RequestTraceEvent {
+  // Monotonic time since the trace was started
+  std::chrono::nanoseconds time;
+  // Small process-unique index of the thread that recorded the event
+  uint32_t thread;
+  RequestTraceEventType type;
+  // Static string passed to start() or annotate(), or nullptr
+  const char* label;
+};
+
+/**
+ * The timeline of one traced request, as handed to a RequestTraceSink.
+ */
+struct RequestTimeline {
+  const char* name{nullptr};
+  std::chrono::steady_clock::time_point start;
+  // Ordered by time. The last event is always Finish.
+  std::vector<RequestTraceEvent> events;
+  // Events that did not fit in Options::maxEvents
+  uint32_t droppedEvents{0};
+
+  // Time from start() until the request context was destroyed.
+  std::chrono::nanoseconds duration() const;
+
+  // Time during which the request context was installed on at least one
+  // thread. The rest of the duration() was spent waiting: sitting in
+  // executor queues, on timers, or on I/O.
+  std::chrono::nanoseconds activeTime() const;
+
+  std::string toString() const;
+};
+
+/**
+ * A bounded multi-producer multi-consumer queue of finished timelines.
+ * Writing never blocks; when the queue is full the timeline is dropped and
+ * counted instead.
+ */
+class RequestTraceSink {
+ public:
+  explicit RequestTraceSink(size_t capacity = 1024) : queue_(capacity) {}
+
+  void write(RequestTimeline&& timeline) noexcept;
+
+  // Returns false if there is no timeline to read.
+  bool read(RequestTimeline& timeline) noexcept {
+    return queue_.read(timeline);
+  }
+
+  uint64_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  MPMCQueue<RequestTimeline> queue_;
+  std::atomic<uint64_t> dropped_{0};
+};
+
+/**
+ * Request-scoped latency tracing.
+ *
+ * A RequestTrace attaches to the current RequestContext and records a
+ * timestamped event whenever the context is installed on or removed from a
+ * thread, a Future continuation of the request runs, or one of its fibers
+ * is resumed or suspended. Since the context follows the request through
+ * executors, EventBase callbacks, futures and fibers, this yields the
+ * request's timeline across all the threads it touched, which is written
+ * to the RequestTraceSink when the context is destroyed.
+ *
+ *   RequestContextScopeGuard rctx;
+ *   RequestTrace::maybeStart("handleGet");
+ *
+ * Recording is lock-free. When the current request is not traced, the
+ * instrumentation points cost one thread-local load. Code that only
+ * records events can include RequestTraceHook.h instead of this header.
+ *
+ * Do not clear the trace from the context with clearContextData() while
+ * the request may still be running on other threads.
+ */
+class RequestTrace : public RequestData {
+ public:
+  struct Options {
+    // Trace one in this many requests passed to maybeStart(); 0 disables
+    // sampled tracing
+    uint32_t sampleRate{1000};
+    // Events beyond this many per request are counted but not recorded
+    uint32_t maxEvents{128};
+  };
+
+  static void setOptions(const Options& options);
+  static Options getOptions();
+
+  // Timelines of requests traced from now on are written to `sink', which
+  // must outlive them. Tracing is disabled while no sink is set.
+  static void setSink(RequestTraceSink* sink);
+
+  // Starts tracing the current request with probability
+  // 1 / Options::sampleRate. Returns true if the request is traced.
+  // `name' must be a string literal or otherwise outlive the trace.
+  static bool maybeStart(const char* name);
+
+  // Starts tracing the current request unconditionally. Returns false if
+  // there is no current request context (see RequestContext::create()) or
+  // no sink.
+  static bool start(const char* name);
+
+  // The trace of the request running on this thread, if it is traced.
+  static RequestTrace* get() {
+    return RequestTraceHook::current_;
+  }
+
+  static void record(
+      RequestTraceEventType type,
+      const char* label = nullptr) noexcept {
+    RequestTraceHook::record(type, label);
+  }
+
+  // Adds an event with a caller-supplied static label to the current
+  // request's timeline, if it is traced.
+  static void annotate(const char* label) noexcept {
+    record(RequestTraceEventType::Annotation, label);
+  }
+
+  ~RequestTrace() override;
+
+  void onSet() override;
+  void onUnset() override;
+
+  void add(RequestTraceEventType type, const char* label) noexcept;
+
+ private:
+  RequestTrace(const char* name, uint32_t maxEvents, RequestTraceSink* sink);
+
+  RequestTraceSink* const sink_;
+  const std::chrono::steady_clock::time_point start_;
+  const uint32_t capacity_;
+  std::atomic<uint32_t> size_{0};
+  // Events are recorded in place. Room for the Finish event is reserved
+  // as well, so that handing the timeline to the sink doesn't allocate.
+  RequestTimeline timeline_;
+};
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <folly/Likely.h>
+#include <folly/Portability.h>
+
+namespace folly {
+
+/**
+ * Points in the life of a request at which a RequestTrace takes a
+ * timestamp.
+ */
+enum class RequestTraceEventType : uint8_t {
+  // RequestTrace::start() was called
+  Start,
+  // The request context was installed on a thread, e.g. after an executor
+  // hop or when an EventBase callback belonging to the request is run
+  ContextSet,
+  // The request context was removed from a thread
+  ContextUnset,
+  // A Future continuation of the request is about to run
+  FutureContinuation,
+  // A fiber of the request is about to run or continue running
+  FiberResume,
+  // A fiber of the request blocked or yielded
+  FiberSuspend,
+  // A fiber of the request ran to completion
+  FiberFinish,
+  // RequestTrace::annotate() was called
+  Annotation,
+  // The request context was destroyed
+  Finish,
+};
+
+class RequestTrace;
+
+/**
+ * The instrumentation point of RequestTrace, for code such as futures and
+ * fibers that records events but shouldn't depend on the rest of it (see
+ * RequestTrace.h).
+ */
+class RequestTraceHook {
+ public:
+  static void record(
+      RequestTraceEventType type,
+      const char* label = nullptr) noexcept {
+    if (UNLIKELY(current_ != nullptr)) {
+      add(current_, type, label);
+    }
+  }
+
+ private:
+  friend class RequestTrace;
+
+  static void add(
+      RequestTrace* trace,
+      RequestTraceEventType type,
+      const char* label) noexcept;
+
+  // The trace of the request running on this thread, if it is traced
+  static FOLLY_TLS RequestTrace* current_;
+};
+}
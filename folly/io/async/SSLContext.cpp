@@ -665,6 +665,135 @@ void SSLContext::setSessionCacheContext(const std::string& context) {
           SSL_MAX_SSL_SESSION_ID_LENGTH));
 }
 
+int SSLContext::getSSLCtxExDataIndex() {
+  static auto index = SSL_CTX_get_ex_new_index(
+      0, (void*)"SSLContext data index", nullptr, nullptr, nullptr);
+  return index;
+}
+
+SSLContext* SSLContext::getFromSSLCtx(const SSL_CTX* ctx) {
+  return static_cast<SSLContext*>(
+      SSL_CTX_get_ex_data(ctx, getSSLCtxExDataIndex()));
+}
+
+void SSLContext::setSessionCache(std::shared_ptr<ssl::SSLSessionCache> cache) {
+  sessionCache_ = std::move(cache);
+  SSL_CTX_set_ex_data(ctx_, getSSLCtxExDataIndex(), this);
+  if (sessionCache_) {
+    SSL_CTX_set_session_cache_mode(
+        ctx_, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(ctx_, newSessionCallback);
+    SSL_CTX_sess_set_get_cb(ctx_, getSessionCallback);
+    SSL_CTX_sess_set_remove_cb(ctx_, removeSessionCallback);
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_new_cb(ctx_, nullptr);
+    SSL_CTX_sess_set_get_cb(ctx_, nullptr);
+    SSL_CTX_sess_set_remove_cb(ctx_, nullptr);
+  }
+}
+
+int SSLContext::newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+  auto context = getFromSSLCtx(SSL_get_SSL_CTX(ssl));
+  if (!context || !context->sessionCache_) {
+    return 0;
+  }
+  unsigned int idLength = 0;
+  auto id = SSL_SESSION_get_id(session, &idLength);
+  auto length = i2d_SSL_SESSION(session, nullptr);
+  if (length <= 0) {
+    return 0;
+  }
+  std::unique_ptr<unsigned char[]> serialized(new unsigned char[length]);
+  auto p = serialized.get();
+  if (i2d_SSL_SESSION(session, &p) != length) {
+    return 0;
+  }
+  context->sessionCache_->store(
+      ByteRange(id, idLength),
+      ByteRange(serialized.get(), size_t(length)),
+      std::chrono::seconds(SSL_SESSION_get_timeout(session)));
+  // We keep no reference to the session
+  return 0;
+}
+
+SSL_SESSION* SSLContext::getSessionCallback(
+    SSL* ssl,
+    SessionIdPtr id,
+    int idLength,
+    int* copy) {
+  *copy = 0;
+  auto context = getFromSSLCtx(SSL_get_SSL_CTX(ssl));
+  if (!context || !context->sessionCache_) {
+    return nullptr;
+  }
+  std::string serialized;
+  if (!context->sessionCache_->lookup(
+          ByteRange(id, size_t(idLength)), serialized)) {
+    return nullptr;
+  }
+  auto p = reinterpret_cast<const unsigned char*>(serialized.data());
+  // The caller owns the reference we return
+  return d2i_SSL_SESSION(nullptr, &p, long(serialized.size()));
+}
+
+void SSLContext::removeSessionCallback(SSL_CTX* ctx, SSL_SESSION* session) {
+  auto context = getFromSSLCtx(ctx);
+  if (!context || !context->sessionCache_) {
+    return;
+  }
+  unsigned int idLength = 0;
+  auto id = SSL_SESSION_get_id(session, &idLength);
+  context->sessionCache_->remove(ByteRange(id, idLength));
+}
+
+void SSLContext::setTicketKeyManager(
+    std::shared_ptr<ssl::TLSTicketKeyManager> manager) {
+  ticketKeyManager_ = std::move(manager);
+  SSL_CTX_set_ex_data(ctx_, getSSLCtxExDataIndex(), this);
+  if (ticketKeyManager_) {
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx_, ticketKeyCallback);
+  } else {
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx_, nullptr);
+  }
+}
+
+void SSLContext::offloadPrivateKeyOperations(
+    std::shared_ptr<Executor> executor) {
+#if FOLLY_OPENSSL_HAS_ASYNC
+  auto key = SSL_CTX_get0_privatekey(ctx_);
+  if (!key) {
+    throw std::runtime_error(
+        "offloadPrivateKeyOperations: no private key loaded");
+  }
+  auto asyncKey = ssl::makeAsyncPrivateKey(key, std::move(executor));
+  if (SSL_CTX_use_PrivateKey(ctx_, asyncKey.get()) == 0) {
+    throw std::runtime_error("SSL_CTX_use_PrivateKey: " + getErrors());
+  }
+  SSL_CTX_set_mode(ctx_, SSL_MODE_ASYNC);
+#else
+  (void)executor;
+  throw std::runtime_error(
+      "offloadPrivateKeyOperations: OpenSSL async jobs are not supported");
+#endif
+}
+
+int SSLContext::ticketKeyCallback(
+    SSL* ssl,
+    unsigned char* keyName,
+    unsigned char* iv,
+    EVP_CIPHER_CTX* cipherCtx,
+    HMAC_CTX* hmacCtx,
+    int encrypt) {
+  auto context = getFromSSLCtx(SSL_get_SSL_CTX(ssl));
+  if (!context || !context->ticketKeyManager_) {
+    // Tickets can't be issued nor resumed without keys
+    return encrypt ? -1 : 0;
+  }
+  return context->ticketKeyManager_->processTicket(
+      keyName, iv, cipherCtx, hmacCtx, encrypt);
+}
+
 /**
  * Match a name with a pattern. The pattern may include wildcard. A single
  * wildcard "*" can match up to one component in the domain name.
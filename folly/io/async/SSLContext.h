@@ -30,9 +30,13 @@
 #include <folly/folly-config.h>
 #endif
 
+#include <folly/Executor.h>
 #include <folly/Range.h>
 #include <folly/ssl/OpenSSLPtrTypes.h>
+#include <folly/io/async/ssl/AsyncPrivateKey.h>
 #include <folly/io/async/ssl/OpenSSLUtils.h>
+#include <folly/io/async/ssl/SSLSessionCache.h>
+#include <folly/io/async/ssl/TLSTicketKeyManager.h>
 #include <folly/portability/OpenSSL.h>
 
 namespace folly {
@@ -342,6 +346,47 @@ class SSLContext {
    */
   void setSessionCacheContext(const std::string& context);
 
+  /**
+   * Keep server side sessions in the given cache instead of in OpenSSL's
+   * internal one, which is private to this context and takes a global
+   * lock. The cache can be shared with other contexts, and, depending on
+   * the cache, with other processes.
+   *
+   * When switching contexts from the ServerNameCallback, set the same
+   * cache on all of them.
+   */
+  void setSessionCache(std::shared_ptr<ssl::SSLSessionCache> cache);
+
+  std::shared_ptr<ssl::SSLSessionCache> getSessionCache() const {
+    return sessionCache_;
+  }
+
+  /**
+   * Encrypt and decrypt session tickets with keys from the given manager
+   * instead of with a random key per context, so that clients can resume
+   * their session on any context or process using the same seeds.
+   */
+  void setTicketKeyManager(std::shared_ptr<ssl::TLSTicketKeyManager> manager);
+
+  std::shared_ptr<ssl::TLSTicketKeyManager> getTicketKeyManager() const {
+    return ticketKeyManager_;
+  }
+
+  /**
+   * Run the private key operations of server handshakes (signing, or
+   * decrypting the premaster secret) on executor instead of on the thread
+   * doing the handshake, which meanwhile goes on with other connections:
+   * AsyncSSLSocket::sslAccept() resumes the handshake once the operation
+   * is done. See ssl::makeAsyncPrivateKey().
+   *
+   * Call after loading the private key. Requires OpenSSL 1.1.0 or later.
+   *
+   * @throw std::runtime_error if no private key is loaded, or if OpenSSL
+   *        doesn't support async jobs
+   * @throw std::invalid_argument if the key is not an RSA or EC key
+   */
+  void offloadPrivateKeyOperations(std::shared_ptr<Executor> executor);
+
   /**
    * Set the options on the SSL_CTX object.
    */
@@ -533,6 +578,9 @@ class SSLContext {
 
   ClientProtocolFilterCallback clientProtoFilter_{nullptr};
 
+  std::shared_ptr<ssl::SSLSessionCache> sessionCache_;
+  std::shared_ptr<ssl::TLSTicketKeyManager> ticketKeyManager_;
+
   static bool initialized_;
 
   // To provide control over choice of server ciphersuites
@@ -574,6 +622,31 @@ class SSLContext {
 
   static int passwordCallback(char* password, int size, int, void* data);
 
+  static int getSSLCtxExDataIndex();
+  static SSLContext* getFromSSLCtx(const SSL_CTX* ctx);
+
+#if FOLLY_OPENSSL_IS_110 || OPENSSL_IS_BORINGSSL
+  using SessionIdPtr = const unsigned char*;
+#else
+  using SessionIdPtr = unsigned char*;
+#endif
+
+  /**
+   * External session cache callbacks, see SSL_CTX_sess_set_new_cb.
+   */
+  static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
+  static SSL_SESSION*
+  getSessionCallback(SSL* ssl, SessionIdPtr id, int idLength, int* copy);
+  static void removeSessionCallback(SSL_CTX* ctx, SSL_SESSION* session);
+
+  static int ticketKeyCallback(
+      SSL* ssl,
+      unsigned char* keyName,
+      unsigned char* iv,
+      EVP_CIPHER_CTX* cipherCtx,
+      HMAC_CTX* hmacCtx,
+      int encrypt);
+
 #if FOLLY_OPENSSL_HAS_SNI
   /**
    * The function that will be called directly from openssl
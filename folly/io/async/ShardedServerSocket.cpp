@@ -0,0 +1,164 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/ShardedServerSocket.h>
+
+#include <exception>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/String.h>
+#include <folly/portability/Sockets.h>
+
+#ifdef __linux__
+#include <linux/filter.h>
+
+// Linux 4.5
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#endif
+
+namespace folly {
+
+ShardedServerSocket::ShardedServerSocket(
+    const std::vector<EventBase*>& eventBases) {
+  if (eventBases.empty()) {
+    throw std::invalid_argument("ShardedServerSocket needs an EventBase");
+  }
+  shards_.reserve(eventBases.size());
+  for (auto* eventBase : eventBases) {
+    shards_.emplace_back(new AsyncServerSocket(eventBase));
+  }
+}
+
+template <class F>
+void ShardedServerSocket::runInShard(size_t shard, F&& fn) {
+  auto& socket = shards_.at(shard);
+  std::exception_ptr ex;
+  socket->getEventBase()->runInEventBaseThreadAndWait([&] {
+    try {
+      fn(socket);
+    } catch (...) {
+      ex = std::current_exception();
+    }
+  });
+  if (ex) {
+    std::rethrow_exception(ex);
+  }
+}
+
+template <class F>
+void ShardedServerSocket::forEachShard(F&& fn) {
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    runInShard(shard, fn);
+  }
+}
+
+ShardedServerSocket::~ShardedServerSocket() {
+  forEachShard([](AsyncServerSocket::UniquePtr& shard) { shard.reset(); });
+}
+
+void ShardedServerSocket::bind(const SocketAddress& address) {
+  address_ = address;
+  forEachShard([&](AsyncServerSocket::UniquePtr& shard) {
+    shard->setReusePortEnabled(true);
+    shard->bind(address_);
+    if (address_.getPort() == 0) {
+      shard->getAddress(&address_);
+    }
+  });
+}
+
+void ShardedServerSocket::listen(int backlog) {
+  forEachShard(
+      [&](AsyncServerSocket::UniquePtr& shard) { shard->listen(backlog); });
+}
+
+bool ShardedServerSocket::enableCpuSteering() {
+#ifdef __linux__
+  // A = the current CPU; return A % size(), the index of the socket in the
+  // SO_REUSEPORT group. The kernel falls back to the hash for an index past
+  // the group's end, e.g. while a shard is closed.
+  sock_filter code[] = {
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0, uint32_t(SKF_AD_OFF + SKF_AD_CPU)},
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, uint32_t(shards_.size())},
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  sock_fprog program;
+  program.len = sizeof(code) / sizeof(code[0]);
+  program.filter = code;
+
+  // The program applies to the whole group, whichever socket it is set on
+  bool attached = true;
+  runInShard(0, [&](AsyncServerSocket::UniquePtr& socket) {
+    for (int fd : socket->getSockets()) {
+      if (setsockopt(
+              fd,
+              SOL_SOCKET,
+              SO_ATTACH_REUSEPORT_CBPF,
+              &program,
+              sizeof(program)) != 0) {
+        VLOG(2) << "failed to set SO_ATTACH_REUSEPORT_CBPF: "
+                << errnoStr(errno);
+        attached = false;
+      }
+    }
+  });
+  return attached;
+#else
+  return false;
+#endif
+}
+
+void ShardedServerSocket::addAcceptCallback(
+    size_t shard,
+    AsyncServerSocket::AcceptCallback* cb) {
+  runInShard(shard, [&](AsyncServerSocket::UniquePtr& socket) {
+    socket->addAcceptCallback(cb, nullptr);
+  });
+}
+
+void ShardedServerSocket::removeAcceptCallback(
+    size_t shard,
+    AsyncServerSocket::AcceptCallback* cb) {
+  runInShard(shard, [&](AsyncServerSocket::UniquePtr& socket) {
+    socket->removeAcceptCallback(cb, nullptr);
+  });
+}
+
+void ShardedServerSocket::setMaxAcceptAtOnce(uint32_t numConns) {
+  forEachShard([&](AsyncServerSocket::UniquePtr& shard) {
+    shard->setMaxAcceptAtOnce(numConns);
+  });
+}
+
+void ShardedServerSocket::startAccepting() {
+  forEachShard(
+      [](AsyncServerSocket::UniquePtr& shard) { shard->startAccepting(); });
+}
+
+void ShardedServerSocket::pauseAccepting() {
+  forEachShard(
+      [](AsyncServerSocket::UniquePtr& shard) { shard->pauseAccepting(); });
+}
+
+SocketAddress ShardedServerSocket::getAddress() const {
+  return address_;
+}
+
+} // namespace folly
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <folly/SocketAddress.h>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/EventBase.h>
+
+namespace folly {
+
+/**
+ * A listening address served by one AsyncServerSocket per EventBase, all
+ * bound to it with SO_REUSEPORT.
+ *
+ * The kernel spreads the incoming connections across the listening sockets,
+ * and each EventBase thread accepts the connections of its own socket, up to
+ * AsyncServerSocket::setMaxAcceptAtOnce() per wakeup, and hands them to its
+ * own AcceptCallbacks. Unlike a single AsyncServerSocket with AcceptCallbacks
+ * in other threads, no thread accepts on behalf of the others and no
+ * connection goes through a NotificationQueue.
+ *
+ * A connection only ever goes to the shard whose socket it was queued on:
+ * one that is stopped (or slow) leaves its connections waiting, and the ones
+ * still queued when it is destroyed are reset.
+ *
+ * All methods must be called from a thread other than the shards' EventBase
+ * threads (which must be running): each shard's socket is driven in its own
+ * EventBase thread.
+ */
+class ShardedServerSocket {
+ public:
+  /**
+   * One shard per EventBase, in this order.
+   */
+  explicit ShardedServerSocket(const std::vector<EventBase*>& eventBases);
+
+  /**
+   * Destroys the shards' sockets, in their EventBase threads. acceptStopped()
+   * is called on the AcceptCallbacks still installed.
+   */
+  ~ShardedServerSocket();
+
+  ShardedServerSocket(const ShardedServerSocket&) = delete;
+  ShardedServerSocket& operator=(const ShardedServerSocket&) = delete;
+
+  /**
+   * Binds every shard to address. If its port is 0, the first shard picks
+   * one, which the others then bind to.
+   */
+  void bind(const SocketAddress& address);
+
+  /**
+   * Starts listening, shard by shard: the kernel numbers the sockets of a
+   * SO_REUSEPORT group in the order they listen.
+   */
+  void listen(int backlog);
+
+  /**
+   * Steers each new connection to shard (c % size()), where c is the CPU
+   * that processed its SYN, i.e. the CPU handling the receive queue its
+   * flow is hashed to. So if shard i's EventBase thread runs on CPU i,
+   * connections are accepted and served where their packets arrive, without
+   * crossing to another CPU's cache.
+   *
+   * Without steering, the kernel picks the shard by a hash of the
+   * connection's addresses and ports.
+   *
+   * Must be called after listen(), and again after a shard's socket was
+   * closed and reopened. Returns false, leaving the hash based choice, if
+   * the kernel doesn't support it (Linux before 4.5, and other platforms).
+   */
+  bool enableCpuSteering();
+
+  /**
+   * Installs callback on the given shard. callback is only ever invoked in
+   * that shard's EventBase thread.
+   */
+  void addAcceptCallback(size_t shard, AsyncServerSocket::AcceptCallback* cb);
+
+  /**
+   * Removes callback from the given shard, calling its acceptStopped() in
+   * that shard's EventBase thread before returning.
+   */
+  void removeAcceptCallback(
+      size_t shard,
+      AsyncServerSocket::AcceptCallback* cb);
+
+  /**
+   * Sets how many connections each shard accepts at most per wakeup (see
+   * AsyncServerSocket::setMaxAcceptAtOnce()).
+   */
+  void setMaxAcceptAtOnce(uint32_t numConns);
+
+  void startAccepting();
+  void pauseAccepting();
+
+  /**
+   * The address the shards are bound to.
+   */
+  SocketAddress getAddress() const;
+
+  size_t size() const {
+    return shards_.size();
+  }
+
+  EventBase* getEventBase(size_t shard) const {
+    return shards_[shard]->getEventBase();
+  }
+
+  /**
+   * The given shard's socket, to only be used in its EventBase thread.
+   */
+  AsyncServerSocket* getSocket(size_t shard) const {
+    return shards_[shard].get();
+  }
+
+ private:
+  // Runs fn(socket) in the shard's EventBase thread, and rethrows what it
+  // throws
+  template <class F>
+  void runInShard(size_t shard, F&& fn);
+
+  // runInShard() for each shard, one after the other
+  template <class F>
+  void forEachShard(F&& fn);
+
+  std::vector<AsyncServerSocket::UniquePtr> shards_;
+  SocketAddress address_;
+};
+
+} // namespace folly
@@ -0,0 +1,386 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/ssl/AsyncPrivateKey.h>
+
+#include <string.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/Function.h>
+#include <folly/portability/Fcntl.h>
+#include <folly/portability/Unistd.h>
+
+#if FOLLY_OPENSSL_HAS_ASYNC
+
+namespace folly {
+namespace ssl {
+
+namespace {
+
+// An operation running on the executor. It is shared by the executor and
+// the ASYNC_WAIT_CTX of the paused job, so that either can go first.
+struct Operation {
+  std::vector<unsigned char> output;
+  unsigned int length{0};
+  int result{-1};
+  std::atomic<bool> done{false};
+  // A byte is written to writeEnd once done, to make readEnd, which is the
+  // fd the SSL's user waits on, readable.
+  File readEnd;
+  File writeEnd;
+};
+
+using OperationPtr = std::shared_ptr<Operation>;
+using OperationFn = Function<int(unsigned char* out, unsigned int* length)>;
+
+// Identifies our fd in ASYNC_WAIT_CTX
+const char kWaitCtxKey = 0;
+
+void cleanupOperation(
+    ASYNC_WAIT_CTX* /* waitCtx */,
+    const void* /* key */,
+    OSSL_ASYNC_FD /* fd */,
+    void* data) {
+  delete static_cast<OperationPtr*>(data);
+}
+
+/**
+ * Run fn(out, length) on executor, with the current async job paused until
+ * it is done.
+ *
+ * Whatever lives on the job's stack while it is paused is leaked if the job
+ * is never resumed, so everything that owns resources is handed to the
+ * ASYNC_WAIT_CTX (which cleans up its fds when freed) or to the executor
+ * beforehand.
+ */
+int runOnExecutor(
+    Executor& executor,
+    size_t outputSize,
+    OperationFn fn,
+    unsigned char* out,
+    unsigned int* length) {
+  ASYNC_WAIT_CTX* waitCtx = ASYNC_get_wait_ctx(ASYNC_get_current_job());
+  int fds[2];
+  if (!waitCtx || pipe(fds) != 0) {
+    return -1;
+  }
+  auto operation = std::make_shared<Operation>();
+  operation->readEnd = File(fds[0], true);
+  operation->writeEnd = File(fds[1], true);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  operation->output.resize(outputSize);
+
+  Operation* op = operation.get();
+  auto holder = new OperationPtr(operation);
+  if (ASYNC_WAIT_CTX_set_wait_fd(
+          waitCtx, &kWaitCtxKey, fds[0], holder, cleanupOperation) != 1) {
+    delete holder;
+    return -1;
+  }
+  try {
+    executor.add([
+      operation = std::move(operation),
+      fn = std::move(fn)
+    ]() mutable {
+      operation->result = fn(operation->output.data(), &operation->length);
+      operation->done.store(true, std::memory_order_release);
+      char c = 0;
+      writeNoInt(operation->writeEnd.fd(), &c, 1);
+    });
+  } catch (const std::exception&) {
+    ASYNC_WAIT_CTX_clear_fd(waitCtx, &kWaitCtxKey);
+    delete holder;
+    return -1;
+  }
+
+  ASYNC_pause_job();
+
+  // Resumed, normally because readEnd became readable. Otherwise the job is
+  // being released before the operation completed: fail it.
+  int result = -1;
+  if (op->done.load(std::memory_order_acquire)) {
+    result = op->result;
+    if (result > 0) {
+      memcpy(out, op->output.data(), op->length);
+      *length = op->length;
+    }
+  }
+  // Unlike freeing the ASYNC_WAIT_CTX, clearing the fd doesn't call
+  // cleanupOperation.
+  ASYNC_WAIT_CTX_clear_fd(waitCtx, &kWaitCtxKey);
+  delete holder;
+  return result;
+}
+
+void freeExecutor(
+    void* /* parent */,
+    void* ptr,
+    CRYPTO_EX_DATA* /* ad */,
+    int /* idx */,
+    long /* argl */,
+    void* /* argp */) {
+  delete static_cast<std::shared_ptr<Executor>*>(ptr);
+}
+
+Executor* getExecutor(void* exData) {
+  auto executor = static_cast<std::shared_ptr<Executor>*>(exData);
+  return executor ? executor->get() : nullptr;
+}
+
+// RSA
+
+using RsaPrivateOp =
+    int (*)(int flen, const unsigned char* from, unsigned char* to, RSA* rsa,
+            int padding);
+
+int rsaExDataIndex() {
+  static int index =
+      RSA_get_ex_new_index(0, nullptr, nullptr, nullptr, freeExecutor);
+  return index;
+}
+
+int runRsaOp(
+    RsaPrivateOp base,
+    int flen,
+    const unsigned char* from,
+    unsigned char* to,
+    RSA* rsa,
+    int padding) {
+  auto executor = getExecutor(RSA_get_ex_data(rsa, rsaExDataIndex()));
+  if (!executor || !ASYNC_get_current_job()) {
+    return base(flen, from, to, rsa, padding);
+  }
+  RSA_up_ref(rsa);
+  unsigned int length = 0;
+  return runOnExecutor(
+      *executor,
+      size_t(RSA_size(rsa)),
+      [
+        base,
+        padding,
+        input = std::vector<unsigned char>(from, from + flen),
+        key = RsaUniquePtr(rsa)
+      ](unsigned char* out, unsigned int* outLength) {
+        int n = base(int(input.size()), input.data(), out, key.get(), padding);
+        *outLength = n > 0 ? unsigned(n) : 0;
+        return n;
+      },
+      to,
+      &length);
+}
+
+int asyncRsaPrivEnc(
+    int flen,
+    const unsigned char* from,
+    unsigned char* to,
+    RSA* rsa,
+    int padding) {
+  return runRsaOp(
+      RSA_meth_get_priv_enc(RSA_PKCS1_OpenSSL()),
+      flen,
+      from,
+      to,
+      rsa,
+      padding);
+}
+
+int asyncRsaPrivDec(
+    int flen,
+    const unsigned char* from,
+    unsigned char* to,
+    RSA* rsa,
+    int padding) {
+  return runRsaOp(
+      RSA_meth_get_priv_dec(RSA_PKCS1_OpenSSL()),
+      flen,
+      from,
+      to,
+      rsa,
+      padding);
+}
+
+const RSA_METHOD* asyncRsaMethod() {
+  static RSA_METHOD* method = [] {
+    auto m = RSA_meth_dup(RSA_PKCS1_OpenSSL());
+    if (!m) {
+      throw std::bad_alloc();
+    }
+    RSA_meth_set1_name(m, "folly async RSA");
+    RSA_meth_set_priv_enc(m, asyncRsaPrivEnc);
+    RSA_meth_set_priv_dec(m, asyncRsaPrivDec);
+    return m;
+  }();
+  return method;
+}
+
+// EC
+
+#ifndef OPENSSL_NO_EC
+
+using EcSignOp = int (*)(
+    int type,
+    const unsigned char* dgst,
+    int dlen,
+    unsigned char* sig,
+    unsigned int* siglen,
+    const BIGNUM* kinv,
+    const BIGNUM* r,
+    EC_KEY* eckey);
+
+int ecExDataIndex() {
+  static int index =
+      EC_KEY_get_ex_new_index(0, nullptr, nullptr, nullptr, freeExecutor);
+  return index;
+}
+
+EcSignOp ecSignOp() {
+  EcSignOp sign = nullptr;
+  EC_KEY_METHOD_get_sign(
+      const_cast<EC_KEY_METHOD*>(EC_KEY_OpenSSL()), &sign, nullptr, nullptr);
+  return sign;
+}
+
+int asyncEcSign(
+    int type,
+    const unsigned char* dgst,
+    int dlen,
+    unsigned char* sig,
+    unsigned int* siglen,
+    const BIGNUM* kinv,
+    const BIGNUM* r,
+    EC_KEY* eckey) {
+  auto base = ecSignOp();
+  auto executor = getExecutor(EC_KEY_get_ex_data(eckey, ecExDataIndex()));
+  // Precomputed (kinv, r) belong to the caller, and TLS never passes them
+  if (!executor || !ASYNC_get_current_job() || kinv || r) {
+    return base(type, dgst, dlen, sig, siglen, kinv, r, eckey);
+  }
+  EC_KEY_up_ref(eckey);
+  return runOnExecutor(
+      *executor,
+      size_t(ECDSA_size(eckey)),
+      [
+        base,
+        type,
+        digest = std::vector<unsigned char>(dgst, dgst + dlen),
+        key = EcKeyUniquePtr(eckey)
+      ](unsigned char* out, unsigned int* outLength) {
+        return base(
+            type,
+            digest.data(),
+            int(digest.size()),
+            out,
+            outLength,
+            nullptr,
+            nullptr,
+            key.get());
+      },
+      sig,
+      siglen);
+}
+
+const EC_KEY_METHOD* asyncEcMethod() {
+  static EC_KEY_METHOD* method = [] {
+    auto m = EC_KEY_METHOD_new(EC_KEY_OpenSSL());
+    if (!m) {
+      throw std::bad_alloc();
+    }
+    int (*setup)(EC_KEY*, BN_CTX*, BIGNUM**, BIGNUM**) = nullptr;
+    ECDSA_SIG* (*signSig)(
+        const unsigned char*, int, const BIGNUM*, const BIGNUM*, EC_KEY*) =
+        nullptr;
+    EC_KEY_METHOD_get_sign(
+        const_cast<EC_KEY_METHOD*>(EC_KEY_OpenSSL()),
+        nullptr,
+        &setup,
+        &signSig);
+    EC_KEY_METHOD_set_sign(m, asyncEcSign, setup, signSig);
+    return m;
+  }();
+  return method;
+}
+
+#endif // OPENSSL_NO_EC
+
+} // namespace
+
+EvpPkeyUniquePtr makeAsyncPrivateKey(
+    EVP_PKEY* key,
+    std::shared_ptr<Executor> executor) {
+  if (!key || !executor) {
+    throw std::invalid_argument("makeAsyncPrivateKey: no key or executor");
+  }
+  EvpPkeyUniquePtr asyncKey(EVP_PKEY_new());
+  if (!asyncKey) {
+    throw std::bad_alloc();
+  }
+
+  switch (EVP_PKEY_base_id(key)) {
+    case EVP_PKEY_RSA: {
+      auto rsa = EVP_PKEY_get0_RSA(key);
+      if (!rsa || RSA_get0_engine(rsa)) {
+        throw std::invalid_argument(
+            "makeAsyncPrivateKey: not an OpenSSL RSA key");
+      }
+      RsaUniquePtr copy(RSAPrivateKey_dup(rsa));
+      if (!copy || RSA_set_method(copy.get(), asyncRsaMethod()) != 1 ||
+          RSA_set_ex_data(
+              copy.get(),
+              rsaExDataIndex(),
+              new std::shared_ptr<Executor>(std::move(executor))) != 1 ||
+          EVP_PKEY_assign_RSA(asyncKey.get(), copy.get()) != 1) {
+        throw std::runtime_error("makeAsyncPrivateKey: cannot copy RSA key");
+      }
+      copy.release();
+      break;
+    }
+#ifndef OPENSSL_NO_EC
+    case EVP_PKEY_EC: {
+      auto ec = EVP_PKEY_get0_EC_KEY(key);
+      if (!ec || EC_KEY_get0_engine(ec)) {
+        throw std::invalid_argument(
+            "makeAsyncPrivateKey: not an OpenSSL EC key");
+      }
+      EcKeyUniquePtr copy(EC_KEY_dup(ec));
+      if (!copy || EC_KEY_set_method(copy.get(), asyncEcMethod()) != 1 ||
+          EC_KEY_set_ex_data(
+              copy.get(),
+              ecExDataIndex(),
+              new std::shared_ptr<Executor>(std::move(executor))) != 1 ||
+          EVP_PKEY_assign_EC_KEY(asyncKey.get(), copy.get()) != 1) {
+        throw std::runtime_error("makeAsyncPrivateKey: cannot copy EC key");
+      }
+      copy.release();
+      break;
+    }
+#endif
+    default:
+      throw std::invalid_argument(
+          "makeAsyncPrivateKey: only RSA and EC keys are supported");
+  }
+  return asyncKey;
+}
+
+} // namespace ssl
+} // namespace folly
+
+#endif // FOLLY_OPENSSL_HAS_ASYNC
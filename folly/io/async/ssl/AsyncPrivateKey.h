@@ -0,0 +1,56 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <folly/Executor.h>
+#include <folly/portability/OpenSSL.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
+
+namespace folly {
+namespace ssl {
+
+#if FOLLY_OPENSSL_HAS_ASYNC
+
+/**
+ * Returns a copy of an RSA or EC private key, whose private key operations
+ * (signing, and RSA decryption) run on executor when they are called from
+ * an OpenSSL async job, i.e. in the handshake of an SSL in SSL_MODE_ASYNC.
+ *
+ * The job pauses until the operation is done: SSL_accept() returns
+ * SSL_ERROR_WANT_ASYNC in the meantime, and SSL_get_all_async_fds() gives
+ * a file descriptor that becomes readable once SSL_accept() should be
+ * called again to resume the handshake. If the handshake is resumed
+ * earlier, e.g. to release the job when closing the connection, the
+ * operation fails.
+ *
+ * Outside of async jobs, operations run inline as usual.
+ *
+ * Use SSLContext::offloadPrivateKeyOperations() rather than this directly.
+ *
+ * @throw std::invalid_argument if key is neither an RSA nor an EC key, or
+ *        doesn't use OpenSSL's own implementation (e.g. an ENGINE key).
+ */
+EvpPkeyUniquePtr makeAsyncPrivateKey(
+    EVP_PKEY* key,
+    std::shared_ptr<Executor> executor);
+
+#endif // FOLLY_OPENSSL_HAS_ASYNC
+
+} // namespace ssl
+} // namespace folly
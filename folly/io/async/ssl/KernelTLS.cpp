@@ -0,0 +1,291 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/ssl/KernelTLS.h>
+
+#if FOLLY_HAVE_KERNEL_TLS
+
+#include <errno.h>
+#include <string.h>
+
+#include <linux/tls.h>
+#include <openssl/kdf.h>
+
+#include <folly/portability/Sockets.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+namespace folly {
+namespace ssl {
+
+namespace {
+
+// Right after a TLS 1.2 handshake, the Finished messages have used the
+// first sequence number of each direction.
+const unsigned char kFirstSequenceNumber[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+const uint8_t kAlertLevelWarning = 1;
+
+union CryptoInfo {
+  tls_crypto_info info;
+  tls12_crypto_info_aes_gcm_128 aesGcm128;
+#ifdef TLS_CIPHER_AES_GCM_256
+  tls12_crypto_info_aes_gcm_256 aesGcm256;
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+  tls12_crypto_info_chacha20_poly1305 chacha20Poly1305;
+#endif
+};
+
+// The largest key block we need: two 32 byte keys and two 12 byte IVs
+constexpr size_t kMaxKeyBlockLength = 2 * 32 + 2 * 12;
+
+template <class T>
+socklen_t setCryptoInfo(
+    T& info,
+    uint16_t cipherType,
+    const unsigned char* key,
+    const unsigned char* fixedIv) {
+  info.info.version = TLS_1_2_VERSION;
+  info.info.cipher_type = cipherType;
+  memcpy(info.key, key, sizeof(info.key));
+  if (sizeof(info.salt) > 0) {
+    // AES-GCM: the salt is the fixed part of the nonce, and the iv the
+    // explicit part, sent along with each record. The explicit part only
+    // needs to be unique: the kernel increments it along with the sequence
+    // number.
+    memcpy(info.salt, fixedIv, sizeof(info.salt));
+    memcpy(info.iv, kFirstSequenceNumber, sizeof(info.iv));
+  } else {
+    // ChaCha20-Poly1305: the nonce is the iv xor the sequence number
+    memcpy(info.iv, fixedIv, sizeof(info.iv));
+  }
+  memcpy(info.rec_seq, kFirstSequenceNumber, sizeof(info.rec_seq));
+  return socklen_t(sizeof(info));
+}
+
+struct KernelCipher {
+  uint16_t cipherType;
+  size_t keyLength;
+  size_t fixedIvLength;
+  const EVP_MD* md;
+};
+
+bool getKernelCipher(const SSL_CIPHER* cipher, KernelCipher* out) {
+  if (!cipher) {
+    return false;
+  }
+  // The TLS 1.2 suites with these AEADs all use the PRF with SHA-256,
+  // except for AES-256-GCM's with SHA-384.
+  switch (SSL_CIPHER_get_cipher_nid(cipher)) {
+    case NID_aes_128_gcm:
+      *out = {TLS_CIPHER_AES_GCM_128, 16, 4, EVP_sha256()};
+      return true;
+#ifdef TLS_CIPHER_AES_GCM_256
+    case NID_aes_256_gcm:
+      *out = {TLS_CIPHER_AES_GCM_256, 32, 4, EVP_sha384()};
+      return true;
+#endif
+#if defined(TLS_CIPHER_CHACHA20_POLY1305) && !defined(OPENSSL_NO_CHACHA)
+    case NID_chacha20_poly1305:
+      *out = {TLS_CIPHER_CHACHA20_POLY1305, 32, 12, EVP_sha256()};
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+socklen_t setCryptoInfo(
+    CryptoInfo& info,
+    const KernelCipher& cipher,
+    const unsigned char* key,
+    const unsigned char* fixedIv) {
+  switch (cipher.cipherType) {
+    case TLS_CIPHER_AES_GCM_128:
+      return setCryptoInfo(info.aesGcm128, cipher.cipherType, key, fixedIv);
+#ifdef TLS_CIPHER_AES_GCM_256
+    case TLS_CIPHER_AES_GCM_256:
+      return setCryptoInfo(info.aesGcm256, cipher.cipherType, key, fixedIv);
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case TLS_CIPHER_CHACHA20_POLY1305:
+      return setCryptoInfo(
+          info.chacha20Poly1305, cipher.cipherType, key, fixedIv);
+#endif
+    default:
+      return 0;
+  }
+}
+
+/**
+ * The TLS 1.2 key block (RFC 5246, section 6.3), which for AEAD ciphers is
+ * client_write_key, server_write_key, client_write_IV, server_write_IV.
+ */
+bool deriveKeyBlock(
+    SSL* ssl,
+    const EVP_MD* md,
+    unsigned char* out,
+    size_t length) {
+  SSL_SESSION* session = SSL_get_session(ssl);
+  unsigned char masterKey[SSL_MAX_MASTER_KEY_LENGTH];
+  unsigned char clientRandom[SSL3_RANDOM_SIZE];
+  unsigned char serverRandom[SSL3_RANDOM_SIZE];
+  size_t masterKeyLength = session
+      ? SSL_SESSION_get_master_key(session, masterKey, sizeof(masterKey))
+      : 0;
+  if (masterKeyLength == 0 ||
+      SSL_get_client_random(ssl, clientRandom, sizeof(clientRandom)) !=
+          sizeof(clientRandom) ||
+      SSL_get_server_random(ssl, serverRandom, sizeof(serverRandom)) !=
+          sizeof(serverRandom)) {
+    return false;
+  }
+
+  static const char kLabel[] = "key expansion";
+  EvpPkeyCtxUniquePtr ctx(EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, nullptr));
+  bool derived = ctx && EVP_PKEY_derive_init(ctx.get()) > 0 &&
+      EVP_PKEY_CTX_set_tls1_prf_md(ctx.get(), md) > 0 &&
+      EVP_PKEY_CTX_set1_tls1_prf_secret(
+          ctx.get(), masterKey, int(masterKeyLength)) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(
+          ctx.get(),
+          reinterpret_cast<const unsigned char*>(kLabel),
+          int(sizeof(kLabel) - 1)) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(
+          ctx.get(), serverRandom, int(sizeof(serverRandom))) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(
+          ctx.get(), clientRandom, int(sizeof(clientRandom))) > 0 &&
+      EVP_PKEY_derive(ctx.get(), out, &length) > 0;
+  OPENSSL_cleanse(masterKey, sizeof(masterKey));
+  return derived;
+}
+
+bool attachTlsUlp(int fd) {
+  static const char kUlp[] = "tls";
+  // EEXIST: attached already, for the other direction
+  return setsockopt(fd, IPPROTO_TCP, TCP_ULP, kUlp, sizeof(kUlp)) == 0 ||
+      errno == EEXIST;
+}
+
+} // namespace
+
+bool enableKernelTls(SSL* ssl, int fd, KernelTlsDirection direction) {
+  KernelCipher cipher;
+  if (SSL_version(ssl) != TLS1_2_VERSION ||
+      !getKernelCipher(SSL_get_current_cipher(ssl), &cipher)) {
+    return false;
+  }
+  if (direction == KernelTlsDirection::RX && SSL_has_pending(ssl)) {
+    return false;
+  }
+
+  unsigned char keyBlock[kMaxKeyBlockLength];
+  size_t keyBlockLength = 2 * (cipher.keyLength + cipher.fixedIvLength);
+  if (!deriveKeyBlock(ssl, cipher.md, keyBlock, keyBlockLength)) {
+    return false;
+  }
+  // We write with the client keys if we are the client
+  bool clientKeys = bool(SSL_is_server(ssl)) ==
+      (direction == KernelTlsDirection::RX);
+  const unsigned char* key =
+      keyBlock + (clientKeys ? 0 : cipher.keyLength);
+  const unsigned char* fixedIv = keyBlock + 2 * cipher.keyLength +
+      (clientKeys ? 0 : cipher.fixedIvLength);
+
+  CryptoInfo info;
+  memset(&info, 0, sizeof(info));
+  socklen_t infoLength = setCryptoInfo(info, cipher, key, fixedIv);
+  OPENSSL_cleanse(keyBlock, sizeof(keyBlock));
+
+  bool enabled = infoLength > 0 && attachTlsUlp(fd) &&
+      setsockopt(
+          fd,
+          SOL_TLS,
+          direction == KernelTlsDirection::TX ? TLS_TX : TLS_RX,
+          &info,
+          infoLength) == 0;
+  OPENSSL_cleanse(&info, sizeof(info));
+  return enabled;
+}
+
+ssize_t
+recvKernelTls(int fd, void* buf, size_t len, int flags, uint8_t* contentType) {
+  union {
+    cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(uint8_t))];
+  } control;
+  iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t bytes = recvmsg(fd, &msg, flags);
+  *contentType = kTlsApplicationData;
+  if (bytes > 0) {
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_TLS &&
+          cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+        *contentType = *CMSG_DATA(cmsg);
+      }
+    }
+  }
+  return bytes;
+}
+
+bool sendKernelTlsCloseNotify(int fd) {
+  unsigned char alert[2] = {kAlertLevelWarning, kTlsAlertCloseNotify};
+  union {
+    cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(uint8_t))];
+  } control;
+  iovec iov;
+  iov.iov_base = alert;
+  iov.iov_len = sizeof(alert);
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_TLS;
+  cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+  *CMSG_DATA(cmsg) = kTlsAlert;
+
+  return sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) ==
+      ssize_t(sizeof(alert));
+}
+
+} // namespace ssl
+} // namespace folly
+
+#endif // FOLLY_HAVE_KERNEL_TLS
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+#include <folly/portability/OpenSSL.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/tls.h>)
+#define FOLLY_HAVE_KERNEL_TLS FOLLY_OPENSSL_IS_110
+#endif
+#endif
+
+#ifndef FOLLY_HAVE_KERNEL_TLS
+#define FOLLY_HAVE_KERNEL_TLS 0
+#endif
+
+namespace folly {
+namespace ssl {
+
+#if FOLLY_HAVE_KERNEL_TLS
+
+// TLS record content types
+constexpr uint8_t kTlsAlert = 21;
+constexpr uint8_t kTlsApplicationData = 23;
+
+// The alert description of a clean close
+constexpr uint8_t kTlsAlertCloseNotify = 0;
+
+enum class KernelTlsDirection {
+  TX,
+  RX,
+};
+
+/**
+ * Hands the encryption (TX) or the decryption (RX) of the records of ssl's
+ * connection over the TCP socket fd to the kernel (Linux kTLS), after which
+ * plain send() or sendfile() and recv() on fd write and read application
+ * data.
+ *
+ * ssl must have just completed a TLS 1.2 handshake, with nothing written
+ * or read since, using an AES-GCM or ChaCha20-Poly1305 cipher. For RX, ssl
+ * must not have buffered anything beyond the handshake either.
+ *
+ * Returns false, leaving ssl and fd to be used as before, if that isn't the
+ * case or the kernel doesn't support it (e.g. the tls module isn't loaded).
+ * Otherwise, ssl must not be used to write (TX) or read (RX) any more.
+ */
+bool enableKernelTls(SSL* ssl, int fd, KernelTlsDirection direction);
+
+/**
+ * Like recv(), for a socket with kernel TLS RX enabled. Sets *contentType
+ * to the type of the record the data comes from: when it isn't
+ * kTlsApplicationData (e.g. an alert), the data is that record alone.
+ */
+ssize_t
+recvKernelTls(int fd, void* buf, size_t len, int flags, uint8_t* contentType);
+
+/**
+ * Sends a close_notify alert, for a socket with kernel TLS TX enabled.
+ */
+bool sendKernelTlsCloseNotify(int fd);
+
+#endif // FOLLY_HAVE_KERNEL_TLS
+
+} // namespace ssl
+} // namespace folly
@@ -0,0 +1,366 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/ssl/SSLSessionCache.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+#include <stdexcept>
+
+#include <folly/File.h>
+#include <folly/Format.h>
+#include <folly/SpookyHashV2.h>
+#include <folly/detail/CacheLocality.h>
+#include <folly/detail/Sleeper.h>
+#include <folly/portability/Unistd.h>
+
+namespace folly {
+namespace ssl {
+
+namespace {
+
+// "fsslsc02", bumped with any change to the table layout
+constexpr uint64_t kMagic = 0x3230637373737366ULL;
+
+// SSL_MAX_SSL_SESSION_ID_LENGTH
+constexpr size_t kMaxIdLength = 32;
+
+int64_t nowSeconds() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+size_t roundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+bool processExists(pid_t pid) {
+#ifndef _WIN32
+  return kill(pid, 0) == 0 || errno != ESRCH;
+#else
+  // No cheap way to probe a pid here; assume the owner is alive, so a lock
+  // is never taken over.
+  (void)pid;
+  return true;
+#endif
+}
+
+/**
+ * A lock in the mapped table: the pid of the process holding it, 0 if
+ * free. Threads of the same process exclude each other as well, since
+ * only one of them can swap 0 for the pid.
+ *
+ * A process that dies while holding the lock (a worker crashing in the
+ * middle of a store, say) doesn't leave the others spinning forever: a
+ * waiter that finds the owner gone takes the lock over, and is told so,
+ * since what the lock protected may be half written.
+ */
+class TableLockGuard {
+ public:
+  explicit TableLockGuard(std::atomic<pid_t>& owner) : owner_(owner) {
+    pid_t self = pid_t(getpid());
+    pid_t expected = 0;
+    if (owner_.compare_exchange_strong(
+            expected, self, std::memory_order_acquire)) {
+      return;
+    }
+    detail::Sleeper sleeper;
+    for (uint32_t spins = 1;; ++spins) {
+      sleeper.wait();
+      expected = 0;
+      if (owner_.compare_exchange_weak(
+              expected, self, std::memory_order_acquire)) {
+        return;
+      }
+      // Past the active spinning, the sleeper waits 0.5ms each time
+      if (spins % kSpinsBetweenChecks == 0 && expected != self &&
+          !processExists(expected) &&
+          owner_.compare_exchange_strong(
+              expected, self, std::memory_order_acquire)) {
+        recovered_ = true;
+        return;
+      }
+    }
+  }
+
+  ~TableLockGuard() {
+    owner_.store(0, std::memory_order_release);
+  }
+
+  TableLockGuard(const TableLockGuard&) = delete;
+  TableLockGuard& operator=(const TableLockGuard&) = delete;
+
+  // True if the lock was taken over from a dead process
+  bool recovered() const {
+    return recovered_;
+  }
+
+ private:
+  static constexpr uint32_t kSpinsBetweenChecks = 1024;
+
+  std::atomic<pid_t>& owner_;
+  bool recovered_{false};
+};
+
+} // namespace
+
+// Everything below lives in the mapped table, so it is plain data, and an
+// all zero table is a valid empty one.
+
+struct ShardedSSLSessionCache::Header {
+  // Held to fill in, or check, the geometry below
+  std::atomic<pid_t> lock;
+  uint64_t magic;
+  uint32_t numShards;
+  uint32_t bucketsPerShard;
+  uint32_t maxSessionSize;
+};
+
+struct ShardedSSLSessionCache::Shard {
+  std::atomic<pid_t> lock;
+  // Bumped on each use of a slot, to find the least recently used one
+  uint64_t clock;
+};
+
+struct ShardedSSLSessionCache::Slot {
+  // Hash of the session ID, 0 if the slot is free
+  uint64_t hash;
+  // In seconds since the epoch
+  int64_t expiration;
+  uint64_t lastUse;
+  uint32_t sessionLength;
+  uint8_t idLength;
+  unsigned char id[kMaxIdLength];
+
+  // The serialized session follows the slot
+  unsigned char* session() {
+    return reinterpret_cast<unsigned char*>(this + 1);
+  }
+
+  bool matches(uint64_t h, ByteRange sessionId) const {
+    return hash == h && idLength == sessionId.size() &&
+        memcmp(id, sessionId.data(), idLength) == 0;
+  }
+};
+
+namespace {
+
+constexpr size_t kHeaderSize = detail::CacheLocality::kFalseSharingRange;
+constexpr size_t kShardSize = detail::CacheLocality::kFalseSharingRange;
+
+MemoryMapping mapTable(const std::string& path, off_t size) {
+  auto options = MemoryMapping::Options().setWritable(true);
+  if (path.empty()) {
+    return MemoryMapping(MemoryMapping::kAnonymous, size, options);
+  }
+  return MemoryMapping(
+      File(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600),
+      0,
+      size,
+      options.setGrow(true));
+}
+
+} // namespace
+
+constexpr size_t ShardedSSLSessionCache::kSlotsPerBucket;
+
+ShardedSSLSessionCache::ShardedSSLSessionCache(Options options)
+    : options_(std::move(options)),
+      slotSize_(roundUp(sizeof(Slot) + options_.maxSessionSize, 8)),
+      mapping_(mapTable(options_.sharedMemoryPath, off_t(tableSize()))) {
+  static_assert(sizeof(Header) <= kHeaderSize, "");
+  static_assert(sizeof(Shard) <= kShardSize, "");
+  if (options_.numShards == 0 || options_.bucketsPerShard == 0) {
+    throw std::invalid_argument("ShardedSSLSessionCache: empty table");
+  }
+  auto table = mapping_.writableRange();
+  if (table.size() < tableSize()) {
+    throw std::runtime_error(sformat(
+        "ShardedSSLSessionCache: {} is too small", options_.sharedMemoryPath));
+  }
+  header_ = reinterpret_cast<Header*>(table.data());
+  shards_ = reinterpret_cast<Shard*>(table.data() + kHeaderSize);
+  slots_ = table.data() + kHeaderSize + options_.numShards * kShardSize;
+  attach();
+}
+
+size_t ShardedSSLSessionCache::tableSize() const {
+  return kHeaderSize + options_.numShards * kShardSize +
+      capacity() * slotSize_;
+}
+
+void ShardedSSLSessionCache::attach() {
+  // The first process to map the table fills in its geometry, and the
+  // others check that they agree with it. The magic number goes last, so
+  // if the first process died before it was done, the next one starts
+  // over.
+  TableLockGuard g(header_->lock);
+  if (header_->magic == 0) {
+    header_->numShards = options_.numShards;
+    header_->bucketsPerShard = options_.bucketsPerShard;
+    header_->maxSessionSize = options_.maxSessionSize;
+    header_->magic = kMagic;
+    return;
+  }
+  if (header_->magic != kMagic ||
+      header_->numShards != options_.numShards ||
+      header_->bucketsPerShard != options_.bucketsPerShard ||
+      header_->maxSessionSize != options_.maxSessionSize) {
+    throw std::runtime_error(sformat(
+        "ShardedSSLSessionCache: {} holds a different table",
+        options_.sharedMemoryPath));
+  }
+}
+
+ShardedSSLSessionCache::Slot& ShardedSSLSessionCache::slot(
+    size_t index) const {
+  return *reinterpret_cast<Slot*>(slots_ + index * slotSize_);
+}
+
+ShardedSSLSessionCache::Location ShardedSSLSessionCache::locate(
+    ByteRange id) const {
+  Location loc;
+  loc.hash = hash::SpookyHashV2::Hash64(id.data(), id.size(), 0) | 1;
+  auto shardIndex = loc.hash % options_.numShards;
+  loc.shard = &shards_[shardIndex];
+  loc.bucket = (shardIndex * options_.bucketsPerShard +
+                (loc.hash / options_.numShards) % options_.bucketsPerShard) *
+      kSlotsPerBucket;
+  return loc;
+}
+
+void ShardedSSLSessionCache::clearShard(const Location& loc) const {
+  size_t shardSlots = options_.bucketsPerShard * kSlotsPerBucket;
+  size_t first = loc.bucket / shardSlots * shardSlots;
+  for (size_t i = first; i < first + shardSlots; ++i) {
+    slot(i).hash = 0;
+  }
+}
+
+ShardedSSLSessionCache::Slot* ShardedSSLSessionCache::find(
+    const Location& loc,
+    ByteRange id) const {
+  for (size_t i = 0; i < kSlotsPerBucket; ++i) {
+    auto& s = slot(loc.bucket + i);
+    if (s.matches(loc.hash, id)) {
+      s.lastUse = ++loc.shard->clock;
+      return &s;
+    }
+  }
+  return nullptr;
+}
+
+void ShardedSSLSessionCache::store(
+    ByteRange id,
+    ByteRange session,
+    std::chrono::seconds timeout) {
+  if (id.empty() || id.size() > kMaxIdLength ||
+      session.size() > options_.maxSessionSize) {
+    return;
+  }
+  auto loc = locate(id);
+  auto& shard = *loc.shard;
+  auto now = nowSeconds();
+
+  TableLockGuard g(shard.lock);
+  if (g.recovered()) {
+    clearShard(loc);
+  }
+  // Overwrite the same session, or else a free or expired slot, or else
+  // the least recently used one.
+  Slot* victim = find(loc, id);
+  for (size_t i = 0; !victim && i < kSlotsPerBucket; ++i) {
+    auto& s = slot(loc.bucket + i);
+    if (s.hash == 0 || s.expiration <= now) {
+      victim = &s;
+    }
+  }
+  if (!victim) {
+    victim = &slot(loc.bucket);
+    for (size_t i = 1; i < kSlotsPerBucket; ++i) {
+      auto& s = slot(loc.bucket + i);
+      if (s.lastUse < victim->lastUse) {
+        victim = &s;
+      }
+    }
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+  }
+  victim->hash = loc.hash;
+  victim->expiration = now + timeout.count();
+  victim->lastUse = ++shard.clock;
+  victim->sessionLength = uint32_t(session.size());
+  victim->idLength = uint8_t(id.size());
+  memcpy(victim->id, id.data(), id.size());
+  memcpy(victim->session(), session.data(), session.size());
+  stores_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool ShardedSSLSessionCache::lookup(ByteRange id, std::string& session) {
+  auto loc = locate(id);
+  auto& shard = *loc.shard;
+
+  {
+    TableLockGuard g(shard.lock);
+    if (g.recovered()) {
+      clearShard(loc);
+    }
+    auto s = find(loc, id);
+    if (s && s->expiration > nowSeconds()) {
+      session.assign(
+          reinterpret_cast<const char*>(s->session()), s->sessionLength);
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    if (s) {
+      s->hash = 0;
+    }
+  }
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void ShardedSSLSessionCache::remove(ByteRange id) {
+  auto loc = locate(id);
+  auto& shard = *loc.shard;
+
+  TableLockGuard g(shard.lock);
+  if (g.recovered()) {
+    clearShard(loc);
+  }
+  auto s = find(loc, id);
+  if (s) {
+    s->hash = 0;
+  }
+}
+
+ShardedSSLSessionCache::Stats ShardedSSLSessionCache::getStats() const {
+  Stats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.stores = stores_.load(std::memory_order_relaxed);
+  stats.evictions = evictions_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+} // namespace ssl
+} // namespace folly
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include <folly/MemoryMapping.h>
+#include <folly/Range.h>
+
+namespace folly {
+namespace ssl {
+
+/**
+ * Server side store for TLS sessions, for resumption by session ID.
+ *
+ * Install one on an SSLContext with SSLContext::setSessionCache(), which
+ * replaces OpenSSL's internal per-SSL_CTX cache with it. Sessions are
+ * passed in their serialized (DER) form, so implementations are free to
+ * keep them out of process, e.g. in shared memory or on a cache server.
+ *
+ * All methods may be called concurrently, from any thread doing
+ * handshakes.
+ */
+class SSLSessionCache {
+ public:
+  virtual ~SSLSessionCache() = default;
+
+  /**
+   * Store a session. The cache may drop it at any time, and should drop
+   * it once it is older than timeout.
+   *
+   * @param id       Session ID
+   * @param session  Serialized session
+   * @param timeout  Lifetime of the session
+   */
+  virtual void store(
+      ByteRange id,
+      ByteRange session,
+      std::chrono::seconds timeout) = 0;
+
+  /**
+   * Look up a session.
+   *
+   * @param id       Session ID
+   * @param session  Set to the serialized session on a hit
+   * @return true on a hit
+   */
+  virtual bool lookup(ByteRange id, std::string& session) = 0;
+
+  /**
+   * Remove a session, when OpenSSL finds that it must not be resumed.
+   */
+  virtual void remove(ByteRange id) = 0;
+};
+
+/**
+ * SSLSessionCache that keeps sessions in a fixed-size table, split into
+ * shards with a lock each so that lookups from many threads rarely
+ * contend.
+ *
+ * The table can live in shared memory, to share sessions between worker
+ * processes: either a file mapped by each of them (typically on
+ * /dev/shm), or an anonymous mapping inherited from the process that
+ * created the cache before forking them. Either way, the table is sized
+ * up front, and a session that doesn't fit in a slot isn't cached.
+ *
+ * The table is set associative: a session can only go in one bucket of
+ * a few slots, picked by hashing its ID, and replaces the least recently
+ * used session in there once all of them are taken. So the table holds
+ * up to numShards * bucketsPerShard * kSlotsPerBucket sessions, and each
+ * of them takes about maxSessionSize bytes.
+ *
+ * The locks in the table hold the pid of their owner. If a process dies
+ * while holding one, the next process that needs it takes it over after
+ * a few milliseconds (unless the pid was reused by then) and drops the
+ * sessions of that shard, which may have been half written.
+ */
+class ShardedSSLSessionCache : public SSLSessionCache {
+ public:
+  static constexpr size_t kSlotsPerBucket = 4;
+
+  struct Options {
+    Options() {}
+
+    Options& setNumShards(uint32_t v) { numShards = v; return *this; }
+    Options& setBucketsPerShard(uint32_t v) {
+      bucketsPerShard = v;
+      return *this;
+    }
+    Options& setMaxSessionSize(uint32_t v) { maxSessionSize = v; return *this; }
+    Options& setSharedMemoryPath(std::string v) {
+      sharedMemoryPath = std::move(v);
+      return *this;
+    }
+
+    // Shards, each with its own lock
+    uint32_t numShards = 64;
+    // Buckets of kSlotsPerBucket slots in each shard
+    uint32_t bucketsPerShard = 256;
+    // Largest serialized session stored. Sessions with a client
+    // certificate can be much larger than the usual few hundred bytes.
+    uint32_t maxSessionSize = 2048;
+    // If not empty, the file to map the table from, created if needed.
+    // Every process mapping it must use the same options, and be in the
+    // same pid namespace: a lock held by a process that another one can't
+    // see is taken over as if its owner had died (except on Windows,
+    // where locks are never taken over). If empty, the table is
+    // shared only with the children forked from here on.
+    std::string sharedMemoryPath;
+  };
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+  };
+
+  explicit ShardedSSLSessionCache(Options options = Options());
+
+  void store(ByteRange id, ByteRange session, std::chrono::seconds timeout)
+      override;
+  bool lookup(ByteRange id, std::string& session) override;
+  void remove(ByteRange id) override;
+
+  /**
+   * Number of sessions the table can hold.
+   */
+  size_t capacity() const {
+    return size_t(options_.numShards) * options_.bucketsPerShard *
+        kSlotsPerBucket;
+  }
+
+  /**
+   * Counts of operations done by this process since the cache was
+   * created.
+   */
+  Stats getStats() const;
+
+ private:
+  struct Header;
+  struct Shard;
+  struct Slot;
+
+  // Where a session ID goes: its hash, and its shard and the index of the
+  // first slot of its bucket.
+  struct Location {
+    uint64_t hash;
+    Shard* shard;
+    size_t bucket;
+  };
+
+  Options options_;
+  size_t slotSize_;
+  MemoryMapping mapping_;
+  Header* header_;
+  Shard* shards_;
+  unsigned char* slots_;
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> stores_{0};
+  std::atomic<uint64_t> evictions_{0};
+
+  size_t tableSize() const;
+  void attach();
+  Slot& slot(size_t index) const;
+  // Frees all slots of loc's shard
+  void clearShard(const Location& loc) const;
+  Location locate(ByteRange id) const;
+  Slot* find(const Location& loc, ByteRange id) const;
+};
+
+} // namespace ssl
+} // namespace folly
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/ssl/TLSTicketKeyManager.h>
+
+#include <string.h>
+
+#include <mutex>
+#include <stdexcept>
+
+#include <folly/Random.h>
+#include <folly/ssl/OpenSSLHash.h>
+
+namespace folly {
+namespace ssl {
+
+namespace {
+
+constexpr size_t kSeedLength = 32;
+
+void deriveBytes(
+    const std::string& seed,
+    StringPiece label,
+    unsigned char* out,
+    size_t size) {
+  std::array<unsigned char, 32> digest;
+  OpenSSLHash::hmac_sha256(
+      range(digest), StringPiece(seed), ByteRange(label));
+  memcpy(out, digest.data(), size);
+}
+
+} // namespace
+
+constexpr size_t TLSTicketKeyManager::kKeyNameLength;
+
+TLSTicketKeyManager::TLSTicketKeyManager() {
+  std::string seed(kSeedLength, '\0');
+  Random::secureRandom(&seed[0], seed.size());
+  rotate(seed);
+}
+
+TLSTicketKeyManager::TicketKey TLSTicketKeyManager::deriveKey(
+    const std::string& seed,
+    bool current) {
+  TicketKey key;
+  deriveBytes(seed, "folly ticket key name", key.name.data(), key.name.size());
+  deriveBytes(
+      seed, "folly ticket aes key", key.aesKey.data(), key.aesKey.size());
+  deriveBytes(
+      seed, "folly ticket hmac key", key.hmacKey.data(), key.hmacKey.size());
+  key.current = current;
+  return key;
+}
+
+void TLSTicketKeyManager::setTLSTicketKeySeeds(
+    const std::vector<std::string>& oldSeeds,
+    const std::vector<std::string>& currentSeeds,
+    const std::vector<std::string>& newSeeds) {
+  if (currentSeeds.empty()) {
+    throw std::invalid_argument("TLSTicketKeyManager: no current seed");
+  }
+  std::vector<TicketKey> keys;
+  for (const auto& seed : currentSeeds) {
+    keys.push_back(deriveKey(seed, true));
+  }
+  for (const auto& seed : oldSeeds) {
+    keys.push_back(deriveKey(seed, false));
+  }
+  for (const auto& seed : newSeeds) {
+    keys.push_back(deriveKey(seed, false));
+  }
+
+  std::lock_guard<SharedMutex> g(mutex_);
+  keys_ = std::move(keys);
+}
+
+void TLSTicketKeyManager::rotate(const std::string& seed) {
+  auto key = deriveKey(seed, true);
+
+  std::lock_guard<SharedMutex> g(mutex_);
+  std::vector<TicketKey> keys{key};
+  for (auto& k : keys_) {
+    if (k.current) {
+      k.current = false;
+      keys.push_back(k);
+    }
+  }
+  keys_ = std::move(keys);
+}
+
+int TLSTicketKeyManager::processTicket(
+    unsigned char* keyName,
+    unsigned char* iv,
+    EVP_CIPHER_CTX* cipherCtx,
+    HMAC_CTX* hmacCtx,
+    int encrypt) {
+  SharedMutex::ReadHolder g(mutex_);
+  const TicketKey* key = nullptr;
+  if (encrypt) {
+    key = &keys_.front();
+    memcpy(keyName, key->name.data(), key->name.size());
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_128_cbc())) != 1 ||
+        EVP_EncryptInit_ex(
+            cipherCtx, EVP_aes_128_cbc(), nullptr, key->aesKey.data(), iv) !=
+            1) {
+      return -1;
+    }
+  } else {
+    for (const auto& k : keys_) {
+      if (memcmp(keyName, k.name.data(), k.name.size()) == 0) {
+        key = &k;
+        break;
+      }
+    }
+    if (!key) {
+      return 0;
+    }
+    if (EVP_DecryptInit_ex(
+            cipherCtx, EVP_aes_128_cbc(), nullptr, key->aesKey.data(), iv) !=
+        1) {
+      return -1;
+    }
+  }
+  if (HMAC_Init_ex(
+          hmacCtx,
+          key->hmacKey.data(),
+          int(key->hmacKey.size()),
+          EVP_sha256(),
+          nullptr) != 1) {
+    return -1;
+  }
+  return encrypt || key->current ? 1 : 2;
+}
+
+} // namespace ssl
+} // namespace folly
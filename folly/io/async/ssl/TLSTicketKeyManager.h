@@ -0,0 +1,108 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <folly/SharedMutex.h>
+#include <folly/portability/OpenSSL.h>
+
+namespace folly {
+namespace ssl {
+
+/**
+ * Keys for encrypting and decrypting TLS session tickets (RFC 5077), so
+ * that a client can resume its session with any server holding the same
+ * keys, without any server side state.
+ *
+ * Keys are derived from secret seeds. Servers configured with the same
+ * seeds, in any number of processes or hosts, accept each other's
+ * tickets. Seeds come in three sets, so that they can be rotated across
+ * a fleet without ever rejecting a valid ticket:
+ *
+ *  - current seeds: the first one encrypts new tickets, and all of them
+ *    decrypt
+ *  - old seeds: decrypt tickets issued before the last rotation
+ *  - new seeds: decrypt tickets from servers that already rotated
+ *
+ * A client presenting a ticket under an old or new seed gets a fresh one
+ * under the current seed.
+ *
+ * Until seeds are set, a random seed known only to this object is used,
+ * which is what OpenSSL does by default.
+ *
+ * Install it on an SSLContext with SSLContext::setTicketKeyManager(). All
+ * methods are thread safe.
+ */
+class TLSTicketKeyManager {
+ public:
+  TLSTicketKeyManager();
+
+  /**
+   * Replace all the seeds.
+   *
+   * @throw std::invalid_argument if currentSeeds is empty
+   */
+  void setTLSTicketKeySeeds(
+      const std::vector<std::string>& oldSeeds,
+      const std::vector<std::string>& currentSeeds,
+      const std::vector<std::string>& newSeeds);
+
+  /**
+   * Rotate to a new seed in this process: encrypt with seed from now on,
+   * and keep accepting tickets under the current seeds, as old seeds,
+   * until the next rotation.
+   */
+  void rotate(const std::string& seed);
+
+  /**
+   * The OpenSSL ticket key callback (see
+   * SSL_CTX_set_tlsext_ticket_key_cb): sets up encryption of a new ticket
+   * with the current key if encrypt is 1, or decryption of the ticket
+   * with the given key name otherwise.
+   *
+   * @return 1 on success, 2 if the ticket was decrypted but should be
+   *         renewed, 0 if its key is unknown, and -1 on error.
+   */
+  int processTicket(
+      unsigned char* keyName,
+      unsigned char* iv,
+      EVP_CIPHER_CTX* cipherCtx,
+      HMAC_CTX* hmacCtx,
+      int encrypt);
+
+  static constexpr size_t kKeyNameLength = 16;
+
+ private:
+  struct TicketKey {
+    std::array<unsigned char, kKeyNameLength> name;
+    std::array<unsigned char, 16> aesKey;
+    std::array<unsigned char, 32> hmacKey;
+    bool current;
+  };
+
+  static TicketKey deriveKey(const std::string& seed, bool current);
+
+  SharedMutex mutex_;
+  // All keys, starting with the one to encrypt with
+  std::vector<TicketKey> keys_;
+};
+
+} // namespace ssl
+} // namespace folly
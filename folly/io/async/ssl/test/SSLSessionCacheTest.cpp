@@ -0,0 +1,210 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/ssl/SSLSessionCache.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <folly/portability/GTest.h>
+
+using namespace testing;
+using namespace folly;
+using namespace folly::ssl;
+
+namespace {
+
+ByteRange br(const std::string& s) {
+  return StringPiece(s);
+}
+
+} // namespace
+
+TEST(SSLSessionCacheTest, StoreLookupRemove) {
+  ShardedSSLSessionCache cache;
+  std::string session;
+  EXPECT_FALSE(cache.lookup(br("id1"), session));
+
+  cache.store(br("id1"), br("session1"), std::chrono::seconds(60));
+  cache.store(br("id2"), br("session2"), std::chrono::seconds(60));
+  EXPECT_TRUE(cache.lookup(br("id1"), session));
+  EXPECT_EQ("session1", session);
+  EXPECT_TRUE(cache.lookup(br("id2"), session));
+  EXPECT_EQ("session2", session);
+
+  // Storing again replaces the session
+  cache.store(br("id1"), br("session1bis"), std::chrono::seconds(60));
+  EXPECT_TRUE(cache.lookup(br("id1"), session));
+  EXPECT_EQ("session1bis", session);
+
+  cache.remove(br("id1"));
+  EXPECT_FALSE(cache.lookup(br("id1"), session));
+  EXPECT_TRUE(cache.lookup(br("id2"), session));
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(4, stats.hits);
+  EXPECT_EQ(2, stats.misses);
+  EXPECT_EQ(3, stats.stores);
+  EXPECT_EQ(0, stats.evictions);
+}
+
+TEST(SSLSessionCacheTest, Expiration) {
+  ShardedSSLSessionCache cache;
+  std::string session;
+  cache.store(br("id"), br("session"), std::chrono::seconds(0));
+  EXPECT_FALSE(cache.lookup(br("id"), session));
+}
+
+TEST(SSLSessionCacheTest, OversizedSessions) {
+  ShardedSSLSessionCache cache(
+      ShardedSSLSessionCache::Options().setMaxSessionSize(16));
+  std::string session;
+  cache.store(br("id1"), br(std::string(16, 'x')), std::chrono::seconds(60));
+  cache.store(br("id2"), br(std::string(17, 'x')), std::chrono::seconds(60));
+  cache.store(br(std::string(33, 'i')), br("x"), std::chrono::seconds(60));
+  EXPECT_TRUE(cache.lookup(br("id1"), session));
+  EXPECT_EQ(std::string(16, 'x'), session);
+  EXPECT_FALSE(cache.lookup(br("id2"), session));
+  EXPECT_FALSE(cache.lookup(br(std::string(33, 'i')), session));
+}
+
+TEST(SSLSessionCacheTest, EvictsLeastRecentlyUsed) {
+  // A single bucket
+  ShardedSSLSessionCache cache(
+      ShardedSSLSessionCache::Options().setNumShards(1).setBucketsPerShard(1));
+  ASSERT_EQ(ShardedSSLSessionCache::kSlotsPerBucket, cache.capacity());
+  std::string session;
+  for (size_t i = 0; i < cache.capacity(); ++i) {
+    auto id = to<std::string>("id", i);
+    cache.store(br(id), br(id), std::chrono::seconds(60));
+  }
+  // Use the first one, so that the second one is the oldest
+  EXPECT_TRUE(cache.lookup(br("id0"), session));
+  cache.store(br("new"), br("new"), std::chrono::seconds(60));
+  EXPECT_EQ(1, cache.getStats().evictions);
+  EXPECT_TRUE(cache.lookup(br("new"), session));
+  EXPECT_TRUE(cache.lookup(br("id0"), session));
+  EXPECT_FALSE(cache.lookup(br("id1"), session));
+  for (size_t i = 2; i < cache.capacity(); ++i) {
+    EXPECT_TRUE(cache.lookup(br(to<std::string>("id", i)), session));
+  }
+}
+
+TEST(SSLSessionCacheTest, Concurrent) {
+  ShardedSSLSessionCache cache(
+      ShardedSSLSessionCache::Options().setNumShards(4).setBucketsPerShard(
+          1024));
+  std::vector<std::thread> threads;
+  std::atomic<size_t> hits{0};
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      std::string session;
+      for (int i = 0; i < 1000; ++i) {
+        auto id = to<std::string>(t, "-", i);
+        cache.store(br(id), br(id + "-session"), std::chrono::seconds(60));
+        if (cache.lookup(br(id), session)) {
+          EXPECT_EQ(id + "-session", session);
+          ++hits;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  // 4000 sessions in 16384 slots: there may be a few evictions, but no
+  // more than the misses.
+  EXPECT_LE(4000 - cache.getStats().evictions, hits.load());
+  EXPECT_GT(hits.load(), 3900);
+}
+
+TEST(SSLSessionCacheTest, SharedMemoryFile) {
+  test::TemporaryDirectory dir;
+  auto path = (dir.path() / "sessions").string();
+  auto options =
+      ShardedSSLSessionCache::Options().setNumShards(4).setSharedMemoryPath(
+          path);
+  ShardedSSLSessionCache cache1(options);
+  ShardedSSLSessionCache cache2(options);
+
+  std::string session;
+  cache1.store(br("id"), br("session"), std::chrono::seconds(60));
+  EXPECT_TRUE(cache2.lookup(br("id"), session));
+  EXPECT_EQ("session", session);
+  cache2.remove(br("id"));
+  EXPECT_FALSE(cache1.lookup(br("id"), session));
+
+  // The table outlives the processes using it
+  cache1.store(br("id"), br("session"), std::chrono::seconds(60));
+  ShardedSSLSessionCache cache3(options);
+  EXPECT_TRUE(cache3.lookup(br("id"), session));
+
+  // All processes must agree on the layout of the table
+  EXPECT_THROW(
+      ShardedSSLSessionCache(options.setNumShards(2)), std::runtime_error);
+}
+
+TEST(SSLSessionCacheTest, LockHeldByDeadProcess) {
+  auto pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    _exit(0);
+  }
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+
+  // A table whose header lock (its first word) is held by a process that
+  // died before filling it in
+  test::TemporaryDirectory dir;
+  auto path = (dir.path() / "sessions").string();
+  {
+    File file(path, O_WRONLY | O_CREAT, 0600);
+    pid_t owner = pid;
+    ASSERT_EQ(sizeof(owner), writeFull(file.fd(), &owner, sizeof(owner)));
+  }
+
+  auto options =
+      ShardedSSLSessionCache::Options().setNumShards(4).setSharedMemoryPath(
+          path);
+  ShardedSSLSessionCache cache(options);
+  std::string session;
+  cache.store(br("id"), br("session"), std::chrono::seconds(60));
+  EXPECT_TRUE(cache.lookup(br("id"), session));
+}
+
+TEST(SSLSessionCacheTest, SharedAcrossFork) {
+  ShardedSSLSessionCache cache;
+  auto pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    cache.store(br("id"), br("from child"), std::chrono::seconds(60));
+    _exit(0);
+  }
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+
+  std::string session;
+  EXPECT_TRUE(cache.lookup(br("id"), session));
+  EXPECT_EQ("from child", session);
+}
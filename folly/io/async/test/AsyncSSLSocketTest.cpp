@@ -19,6 +19,7 @@
 #include <folly/io/Cursor.h>
 #include <folly/io/async/AsyncSSLSocket.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
 #include <folly/portability/GMock.h>
 #include <folly/portability/GTest.h>
 #include <folly/portability/OpenSSL.h>
@@ -976,6 +977,496 @@ TEST(AsyncSSLSocketTest, SSLServerCacheCloseTest) {
 }
 #endif // !SSL_ERROR_WANT_SESS_CACHE_LOOKUP
 
+#if FOLLY_OPENSSL_HAS_ASYNC
+/**
+ * Executor for offloaded private key operations, which either hands them
+ * to another executor, or queues them until run() is called.
+ */
+class KeyOperationExecutor : public Executor {
+ public:
+  explicit KeyOperationExecutor(Executor* executor = nullptr)
+      : executor_(executor) {}
+
+  void add(Func f) override {
+    ++added;
+    if (executor_) {
+      executor_->add(std::move(f));
+    } else {
+      std::lock_guard<std::mutex> g(mutex_);
+      queue_.push_back(std::move(f));
+    }
+  }
+
+  size_t run() {
+    std::vector<Func> queue;
+    {
+      std::lock_guard<std::mutex> g(mutex_);
+      queue.swap(queue_);
+    }
+    for (auto& f : queue) {
+      f();
+    }
+    return queue.size();
+  }
+
+  std::atomic<size_t> added{0};
+
+ private:
+  Executor* executor_;
+  std::mutex mutex_;
+  std::vector<Func> queue_;
+};
+
+/**
+ * Test a handshake with the server's private key operation running on
+ * another thread.
+ */
+TEST(AsyncSSLSocketTest, OffloadPrivateKeyOperations) {
+  EventBase eventBase;
+  ScopedEventBaseThread keyThread;
+  auto clientCtx = std::make_shared<SSLContext>();
+  auto serverCtx = std::make_shared<SSLContext>();
+  int fds[2];
+  getfds(fds);
+  getctx(clientCtx, serverCtx);
+  auto executor =
+      std::make_shared<KeyOperationExecutor>(keyThread.getEventBase());
+  serverCtx->offloadPrivateKeyOperations(executor);
+
+  AsyncSSLSocket::UniquePtr clientSock(
+      new AsyncSSLSocket(clientCtx, &eventBase, fds[0], false));
+  AsyncSSLSocket::UniquePtr serverSock(
+      new AsyncSSLSocket(serverCtx, &eventBase, fds[1], true));
+  SSLHandshakeClient client(std::move(clientSock), false, true);
+  SSLHandshakeServer server(std::move(serverSock), true, true);
+
+  eventBase.loop();
+
+  EXPECT_TRUE(client.handshakeSuccess_);
+  EXPECT_FALSE(client.handshakeError_);
+  EXPECT_TRUE(server.handshakeSuccess_);
+  EXPECT_FALSE(server.handshakeError_);
+  EXPECT_LE(1, executor->added.load());
+}
+
+/**
+ * Test that the handshake waits for the private key operation, and that
+ * closing the socket meanwhile releases it.
+ */
+TEST(AsyncSSLSocketTest, OffloadPrivateKeyOperationsPending) {
+  for (bool close : {false, true}) {
+    EventBase eventBase;
+    auto clientCtx = std::make_shared<SSLContext>();
+    auto serverCtx = std::make_shared<SSLContext>();
+    int fds[2];
+    getfds(fds);
+    getctx(clientCtx, serverCtx);
+    auto executor = std::make_shared<KeyOperationExecutor>();
+    serverCtx->offloadPrivateKeyOperations(executor);
+
+    AsyncSSLSocket::UniquePtr clientSock(
+        new AsyncSSLSocket(clientCtx, &eventBase, fds[0], false));
+    AsyncSSLSocket::UniquePtr serverSock(
+        new AsyncSSLSocket(serverCtx, &eventBase, fds[1], true));
+    auto serverSockPtr = serverSock.get();
+    SSLHandshakeClient client(std::move(clientSock), false, true);
+    SSLHandshakeServer server(std::move(serverSock), true, true);
+
+    for (int i = 0; i < 100 && executor->added == 0; ++i) {
+      eventBase.loopOnce();
+    }
+    ASSERT_EQ(1, executor->added.load());
+    EXPECT_FALSE(server.handshakeSuccess_ || server.handshakeError_);
+    EXPECT_FALSE(serverSockPtr->isDetachable());
+
+    if (close) {
+      serverSockPtr->closeNow();
+      eventBase.loop();
+      EXPECT_TRUE(server.handshakeError_);
+      EXPECT_TRUE(client.handshakeError_);
+      // The operation may still complete after its handshake is gone
+      EXPECT_EQ(1, executor->run());
+    } else {
+      EXPECT_EQ(1, executor->run());
+      eventBase.loop();
+      EXPECT_TRUE(server.handshakeSuccess_);
+      EXPECT_TRUE(client.handshakeSuccess_);
+    }
+  }
+}
+#endif // FOLLY_OPENSSL_HAS_ASYNC
+
+namespace {
+
+class StringReadCallback : public AsyncTransportWrapper::ReadCallback {
+ public:
+  void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+    *bufReturn = buf_;
+    *lenReturn = sizeof(buf_);
+  }
+
+  void readDataAvailable(size_t len) noexcept override {
+    data.append(buf_, len);
+  }
+
+  void readEOF() noexcept override {
+    eof = true;
+  }
+
+  void readErr(const AsyncSocketException& ex) noexcept override {
+    ADD_FAILURE() << "read error: " << ex.what();
+    eof = true;
+  }
+
+  std::string data;
+  bool eof{false};
+
+ private:
+  char buf_[4096];
+};
+
+// Records the order in which writes complete, and whether they succeeded
+class OrderedWriteCallback : public AsyncTransportWrapper::WriteCallback {
+ public:
+  OrderedWriteCallback(int id, std::vector<int>* completed)
+      : id_(id), completed_(completed) {}
+
+  void writeSuccess() noexcept override {
+    completed_->push_back(id_);
+    succeeded = true;
+  }
+
+  void writeErr(size_t bytes, const AsyncSocketException&) noexcept override {
+    completed_->push_back(id_);
+    failed = true;
+    bytesWritten = bytes;
+  }
+
+  bool succeeded{false};
+  bool failed{false};
+  size_t bytesWritten{0};
+
+ private:
+  int id_;
+  std::vector<int>* completed_;
+};
+
+// SSL msg callback recording the length of each record written
+void recordLengthCallback(
+    int writeP,
+    int /* version */,
+    int contentType,
+    const void* buf,
+    size_t len,
+    SSL* /* ssl */,
+    void* arg) {
+  if (writeP && contentType == SSL3_RT_HEADER &&
+      len == SSL3_RT_HEADER_LENGTH) {
+    auto header = static_cast<const uint8_t*>(buf);
+    static_cast<std::vector<size_t>*>(arg)->push_back(
+        size_t(header[3]) << 8 | header[4]);
+  }
+}
+
+// Handshakes, then records the length of the records the client writes
+void getEstablishedSockets(
+    EventBase* eventBase,
+    AsyncSSLSocket::UniquePtr* clientSock,
+    AsyncSSLSocket::UniquePtr* serverSock,
+    std::vector<size_t>* recordLengths) {
+  auto clientCtx = std::make_shared<SSLContext>();
+  auto serverCtx = std::make_shared<SSLContext>();
+  int fds[2];
+  getfds(fds);
+  getctx(clientCtx, serverCtx);
+  SSLHandshakeClient client(
+      AsyncSSLSocket::UniquePtr(
+          new AsyncSSLSocket(clientCtx, eventBase, fds[0], false)),
+      false,
+      true);
+  SSLHandshakeServer server(
+      AsyncSSLSocket::UniquePtr(
+          new AsyncSSLSocket(serverCtx, eventBase, fds[1], true)),
+      true,
+      true);
+  eventBase->loop();
+  ASSERT_TRUE(client.handshakeSuccess_);
+  ASSERT_TRUE(server.handshakeSuccess_);
+  *clientSock = std::move(client).moveSocket();
+  *serverSock = std::move(server).moveSocket();
+  SSL* ssl = const_cast<SSL*>((*clientSock)->getSSL());
+  SSL_set_msg_callback(ssl, recordLengthCallback);
+  SSL_set_msg_callback_arg(ssl, recordLengths);
+}
+
+void readAtLeast(
+    EventBase* eventBase,
+    StringReadCallback* readCallback,
+    size_t length) {
+  EventBaseAborter eba(eventBase, 3000);
+  while (readCallback->data.size() < length && eba.isScheduled()) {
+    eventBase->loopOnce();
+  }
+  ASSERT_EQ(length, readCallback->data.size());
+}
+
+} // namespace
+
+/**
+ * Test that with dynamic record sizing, small records are written at the start
+ * and after being idle, and full size ones otherwise.
+ */
+TEST(AsyncSSLSocketTest, DynamicRecordSizing) {
+  EventBase eventBase;
+  std::vector<size_t> recordLengths;
+  StringReadCallback serverRead;
+  AsyncSSLSocket::UniquePtr clientSock;
+  AsyncSSLSocket::UniquePtr serverSock;
+  getEstablishedSockets(&eventBase, &clientSock, &serverSock, &recordLengths);
+  serverSock->setReadCB(&serverRead);
+  clientSock->enableDynamicRecordSizing(
+      1000, 4000, std::chrono::milliseconds(500));
+
+  std::string data(40000, 'x');
+  clientSock->write(nullptr, data.data(), data.size());
+  readAtLeast(&eventBase, &serverRead, data.size());
+  // 4 records of 1000 bytes, then records of 16384 for the other 36000
+  ASSERT_EQ(7, recordLengths.size());
+  size_t overhead = recordLengths[0] - 1000;
+  for (size_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(1000 + overhead, recordLengths[i]);
+  }
+  EXPECT_EQ(16384 + overhead, recordLengths[4]);
+  EXPECT_EQ(16384 + overhead, recordLengths[5]);
+  EXPECT_EQ(3232 + overhead, recordLengths[6]);
+
+  // Not idle: full size records
+  recordLengths.clear();
+  clientSock->write(nullptr, data.data(), 20000);
+  readAtLeast(&eventBase, &serverRead, data.size() + 20000);
+  EXPECT_EQ(
+      std::vector<size_t>({16384 + overhead, 3616 + overhead}),
+      recordLengths);
+
+  // Idle: small records again
+  recordLengths.clear();
+  /* sleep override */ std::this_thread::sleep_for(
+      std::chrono::milliseconds(600));
+  clientSock->write(nullptr, data.data(), 20000);
+  readAtLeast(&eventBase, &serverRead, data.size() + 40000);
+  ASSERT_EQ(5, recordLengths.size());
+  EXPECT_EQ(1000 + overhead, recordLengths[0]);
+  EXPECT_EQ(16000 + overhead, recordLengths[4]);
+
+  recordLengths.clear();
+  clientSock->disableDynamicRecordSizing();
+  /* sleep override */ std::this_thread::sleep_for(
+      std::chrono::milliseconds(600));
+  clientSock->write(nullptr, data.data(), 20000);
+  readAtLeast(&eventBase, &serverRead, data.size() + 60000);
+  EXPECT_EQ(
+      std::vector<size_t>({16384 + overhead, 3616 + overhead}),
+      recordLengths);
+}
+
+/**
+ * Test that small writeChain() calls made in the same loop iteration are
+ * written as one record, in order with the others, and their callbacks
+ * invoked in order.
+ */
+TEST(AsyncSSLSocketTest, WriteCoalescing) {
+  EventBase eventBase;
+  std::vector<size_t> recordLengths;
+  std::vector<int> completed;
+  std::vector<std::unique_ptr<OrderedWriteCallback>> callbacks;
+  StringReadCallback serverRead;
+  AsyncSSLSocket::UniquePtr clientSock;
+  AsyncSSLSocket::UniquePtr serverSock;
+  getEstablishedSockets(&eventBase, &clientSock, &serverSock, &recordLengths);
+  serverSock->setReadCB(&serverRead);
+  clientSock->setWriteCoalescingEnabled(true);
+
+  std::string expected;
+  for (int i = 0; i < 10; ++i) {
+    callbacks.push_back(std::make_unique<OrderedWriteCallback>(i, &completed));
+    auto hello = folly::to<std::string>("hello", i);
+    auto buf = IOBuf::copyBuffer(hello);
+    buf->prependChain(IOBuf::copyBuffer(", "));
+    expected += hello + ", ";
+    clientSock->writeChain(callbacks.back().get(), std::move(buf));
+  }
+  EXPECT_TRUE(completed.empty());
+  EXPECT_FALSE(clientSock->isDetachable());
+  readAtLeast(&eventBase, &serverRead, expected.size());
+  EXPECT_EQ(expected, serverRead.data);
+  EXPECT_EQ(1, recordLengths.size());
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), completed);
+  EXPECT_TRUE(clientSock->isDetachable());
+
+  // A large write goes after the coalesced ones before it
+  serverRead.data.clear();
+  completed.clear();
+  std::string large(4000, 'l');
+  callbacks.push_back(std::make_unique<OrderedWriteCallback>(10, &completed));
+  clientSock->writeChain(callbacks.back().get(), IOBuf::copyBuffer("a"));
+  callbacks.push_back(std::make_unique<OrderedWriteCallback>(11, &completed));
+  clientSock->writeChain(callbacks.back().get(), IOBuf::copyBuffer(large));
+  callbacks.push_back(std::make_unique<OrderedWriteCallback>(12, &completed));
+  clientSock->writeChain(callbacks.back().get(), IOBuf::copyBuffer("b"));
+  readAtLeast(&eventBase, &serverRead, large.size() + 2);
+  EXPECT_EQ("a" + large + "b", serverRead.data);
+  EXPECT_EQ(std::vector<int>({10, 11, 12}), completed);
+}
+
+/**
+ * Test that closeNow() fails the coalesced writes, and close() writes them.
+ */
+TEST(AsyncSSLSocketTest, WriteCoalescingClose) {
+  EventBase eventBase;
+  std::vector<size_t> recordLengths;
+  StringReadCallback serverRead;
+  AsyncSSLSocket::UniquePtr clientSock;
+  AsyncSSLSocket::UniquePtr serverSock;
+  getEstablishedSockets(&eventBase, &clientSock, &serverSock, &recordLengths);
+  serverSock->setReadCB(&serverRead);
+  clientSock->setWriteCoalescingEnabled(true);
+
+  std::vector<int> completed;
+  OrderedWriteCallback first(0, &completed);
+  OrderedWriteCallback second(1, &completed);
+  clientSock->writeChain(&first, IOBuf::copyBuffer("first"));
+  clientSock->writeChain(&second, IOBuf::copyBuffer("second"));
+  clientSock->close();
+  EXPECT_TRUE(first.succeeded);
+  EXPECT_TRUE(second.succeeded);
+  readAtLeast(&eventBase, &serverRead, 11);
+  EXPECT_EQ("firstsecond", serverRead.data);
+
+  getEstablishedSockets(&eventBase, &clientSock, &serverSock, &recordLengths);
+  clientSock->setWriteCoalescingEnabled(true);
+  completed.clear();
+  OrderedWriteCallback third(2, &completed);
+  OrderedWriteCallback fourth(3, &completed);
+  clientSock->writeChain(&third, IOBuf::copyBuffer("third"));
+  clientSock->writeChain(&fourth, IOBuf::copyBuffer("fourth"));
+  clientSock->closeNow();
+  EXPECT_EQ(std::vector<int>({2, 3}), completed);
+  EXPECT_TRUE(third.failed);
+  EXPECT_TRUE(fourth.failed);
+  EXPECT_EQ(0, fourth.bytesWritten);
+  eventBase.loop();
+}
+
+#if FOLLY_HAVE_KERNEL_TLS
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+namespace {
+
+// A connected pair of loopback TCP sockets, as kernel TLS needs TCP
+void getTcpFds(int fds[2]) {
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrLen = sizeof(addr);
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(-1, listener);
+  ASSERT_EQ(0, bind(listener, (sockaddr*)&addr, addrLen));
+  ASSERT_EQ(0, listen(listener, 1));
+  ASSERT_EQ(0, getsockname(listener, (sockaddr*)&addr, &addrLen));
+  fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_EQ(0, connect(fds[0], (sockaddr*)&addr, addrLen));
+  fds[1] = accept(listener, nullptr, nullptr);
+  ASSERT_NE(-1, fds[1]);
+  close(listener);
+  for (int idx = 0; idx < 2; ++idx) {
+    fcntl(fds[idx], F_SETFL, fcntl(fds[idx], F_GETFL, 0) | O_NONBLOCK);
+  }
+}
+
+bool kernelSupportsTls() {
+  int fds[2];
+  getTcpFds(fds);
+  bool supported = setsockopt(fds[0], IPPROTO_TCP, TCP_ULP, "tls", 4) == 0;
+  close(fds[0]);
+  close(fds[1]);
+  return supported;
+}
+
+// Handshakes with kernel TLS enabled, then exchanges data and closes
+void testKernelTls(const char* ciphers, bool expectActive) {
+  EventBase eventBase;
+  StringReadCallback clientRead;
+  StringReadCallback serverRead;
+  auto clientCtx = std::make_shared<SSLContext>();
+  auto serverCtx = std::make_shared<SSLContext>();
+  int fds[2];
+  getTcpFds(fds);
+  getctx(clientCtx, serverCtx);
+  clientCtx->ciphers(ciphers);
+  SSL_CTX_set_max_proto_version(clientCtx->getSSLCtx(), TLS1_2_VERSION);
+
+  AsyncSSLSocket::UniquePtr clientSock(
+      new AsyncSSLSocket(clientCtx, &eventBase, fds[0], false));
+  AsyncSSLSocket::UniquePtr serverSock(
+      new AsyncSSLSocket(serverCtx, &eventBase, fds[1], true));
+  clientSock->enableKernelTls();
+  serverSock->enableKernelTls();
+  SSLHandshakeClient client(std::move(clientSock), false, true);
+  SSLHandshakeServer server(std::move(serverSock), true, true);
+  eventBase.loop();
+  ASSERT_TRUE(client.handshakeSuccess_);
+  ASSERT_TRUE(server.handshakeSuccess_);
+
+  clientSock = std::move(client).moveSocket();
+  serverSock = std::move(server).moveSocket();
+  EXPECT_EQ(expectActive, clientSock->isKernelTlsActive());
+  EXPECT_EQ(expectActive, serverSock->isKernelTlsActive());
+
+  EventBaseAborter eba(&eventBase, 3000);
+  clientSock->setReadCB(&clientRead);
+  serverSock->setReadCB(&serverRead);
+  std::string request(100000, 'q');
+  std::string response("response");
+  clientSock->write(nullptr, request.data(), request.size());
+  serverSock->write(nullptr, response.data(), response.size());
+  while ((serverRead.data.size() < request.size() ||
+          clientRead.data.size() < response.size()) &&
+         eba.isScheduled()) {
+    eventBase.loopOnce();
+  }
+  EXPECT_EQ(request, serverRead.data);
+  EXPECT_EQ(response, clientRead.data);
+
+  clientSock->closeNow();
+  while (!serverRead.eof && eba.isScheduled()) {
+    eventBase.loopOnce();
+  }
+  EXPECT_EQ(request.size(), serverRead.data.size());
+}
+
+} // namespace
+
+/**
+ * Test that the kernel takes over the records after a TLS 1.2 handshake
+ * with AES-GCM, if it supports it, and that the connection works either way.
+ */
+TEST(AsyncSSLSocketTest, KernelTls) {
+  bool supported = kernelSupportsTls();
+  testKernelTls("ECDHE-RSA-AES128-GCM-SHA256", supported);
+  testKernelTls("ECDHE-RSA-AES256-GCM-SHA384", supported);
+}
+
+/**
+ * Test falling back to OpenSSL when the kernel can't handle the cipher.
+ */
+TEST(AsyncSSLSocketTest, KernelTlsUnsupportedCipher) {
+  testKernelTls("ECDHE-RSA-AES128-SHA", false);
+}
+#endif // FOLLY_HAVE_KERNEL_TLS
+
 /**
  * Verify Client Ciphers obtained using SSL MSG Callback.
  */
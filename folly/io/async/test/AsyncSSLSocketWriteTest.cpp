@@ -396,4 +396,27 @@ TEST_F(AsyncSSLSocketWriteTest, write_with_eor3) {
   sock_->checkEor(0, 0);
 }
 
+// buffers are written a record at a time, in small records at first with
+// dynamic record sizing
+TEST_F(AsyncSSLSocketWriteTest, write_records) {
+  int n = 2;
+  auto vec = makeVec({9000, 3000});
+  int pos = 0;
+  sock_->enableDynamicRecordSizing(4000, 6000);
+  InSequence seq;
+  for (int size : {4000, 4000, 1000, 3000}) {
+    EXPECT_CALL(*(sock_.get()), sslWriteImpl(_, _, size))
+      .WillOnce(Invoke([this, &pos] (SSL *, const void *buf, int m) {
+            verifyVec(buf, m, pos);
+            pos += m;
+            return m; }));
+  }
+  uint32_t countWritten = 0;
+  uint32_t partialWritten = 0;
+  sock_->testPerformWrite(vec.get(), n, WriteFlags::NONE, &countWritten,
+                          &partialWritten);
+  EXPECT_EQ(countWritten, n);
+  EXPECT_EQ(partialWritten, 0);
+}
+
 }
@@ -22,6 +22,8 @@
 #include <folly/io/async/AsyncSocket.h>
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <folly/io/async/ShardedServerSocket.h>
 
 #include <folly/experimental/TestUtil.h>
 #include <folly/io/IOBuf.h>
@@ -35,7 +37,9 @@
 
 #include <boost/scoped_array.hpp>
 #include <fcntl.h>
+#include <sched.h>
 #include <sys/types.h>
+#include <atomic>
 #include <iostream>
 #include <thread>
 
@@ -2265,6 +2269,133 @@ TEST(AsyncSocketTest, NumPendingMessagesInQueue) {
   eventBase.loop();
 }
 
+namespace {
+
+// Connects count blocking clients to address, and closes them once the
+// server accepted all of them
+void connectClients(
+    const folly::SocketAddress& address,
+    size_t count,
+    const std::atomic<size_t>& accepted) {
+  sockaddr_storage addr;
+  socklen_t addrLen = address.getAddress(&addr);
+  std::vector<int> clients;
+  for (size_t i = 0; i < count; ++i) {
+    int fd = fsp::socket(address.getFamily(), SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    clients.push_back(fd);
+    ASSERT_EQ(0, fsp::connect(fd, reinterpret_cast<sockaddr*>(&addr), addrLen));
+  }
+  for (int i = 0; i < 5000 && accepted.load() < count; ++i) {
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  for (int fd : clients) {
+    close(fd);
+  }
+}
+
+struct ShardAcceptCallback : public TestAcceptCallback {
+  ShardAcceptCallback(EventBase* eventBase, std::atomic<size_t>* accepted) {
+    setConnectionAcceptedFn(
+        [=](int fd, const folly::SocketAddress& /* addr */) {
+          EXPECT_TRUE(eventBase->isInEventBaseThread());
+          close(fd);
+          ++count;
+          ++*accepted;
+        });
+  }
+
+  std::atomic<size_t> count{0};
+};
+
+} // namespace
+
+/**
+ * Test ShardedServerSocket: each shard accepts its own connections, in its
+ * own thread
+ */
+TEST(AsyncSocketTest, ShardedServerSocket) {
+  ScopedEventBaseThread thread1;
+  ScopedEventBaseThread thread2;
+  std::atomic<size_t> accepted{0};
+  ShardAcceptCallback cb1(thread1.getEventBase(), &accepted);
+  ShardAcceptCallback cb2(thread2.getEventBase(), &accepted);
+  {
+    ShardedServerSocket serverSocket(
+        {thread1.getEventBase(), thread2.getEventBase()});
+    serverSocket.bind(folly::SocketAddress("127.0.0.1", 0));
+    serverSocket.listen(128);
+    auto serverAddress = serverSocket.getAddress();
+    ASSERT_NE(0, serverAddress.getPort());
+    folly::SocketAddress shardAddress;
+    thread2.getEventBase()->runInEventBaseThreadAndWait(
+        [&] { serverSocket.getSocket(1)->getAddress(&shardAddress); });
+    ASSERT_EQ(serverAddress, shardAddress);
+
+    serverSocket.addAcceptCallback(0, &cb1);
+    serverSocket.addAcceptCallback(1, &cb2);
+    serverSocket.startAccepting();
+
+    // The kernel hashes the connections across the shards: all of these
+    // going to one shard is vanishingly unlikely
+    const size_t kConnections = 64;
+    connectClients(serverAddress, kConnections, accepted);
+    ASSERT_EQ(kConnections, accepted.load());
+    EXPECT_GT(cb1.count.load(), 0);
+    EXPECT_GT(cb2.count.load(), 0);
+
+    serverSocket.removeAcceptCallback(1, &cb2);
+    ASSERT_EQ(TestAcceptCallback::TYPE_STOP, cb2.getEvents()->back().type);
+  }
+  ASSERT_EQ(TestAcceptCallback::TYPE_STOP, cb1.getEvents()->back().type);
+  ASSERT_EQ(1 + cb1.count.load() + 1, cb1.getEvents()->size());
+}
+
+#ifdef __linux__
+/**
+ * Test ShardedServerSocket::enableCpuSteering(): connections made from a
+ * thread pinned to CPU c go to shard c % 2
+ */
+TEST(AsyncSocketTest, ShardedServerSocketCpuSteering) {
+  ScopedEventBaseThread thread1;
+  ScopedEventBaseThread thread2;
+  std::atomic<size_t> accepted{0};
+  ShardAcceptCallback cb1(thread1.getEventBase(), &accepted);
+  ShardAcceptCallback cb2(thread2.getEventBase(), &accepted);
+  ShardedServerSocket serverSocket(
+      {thread1.getEventBase(), thread2.getEventBase()});
+  serverSocket.bind(folly::SocketAddress("127.0.0.1", 0));
+  serverSocket.listen(128);
+  if (!serverSocket.enableCpuSteering()) {
+    LOG(INFO) << "SO_ATTACH_REUSEPORT_CBPF is not supported, skipping";
+    return;
+  }
+  serverSocket.addAcceptCallback(0, &cb1);
+  serverSocket.addAcceptCallback(1, &cb2);
+  serverSocket.startAccepting();
+
+  // Over loopback, the SYN is processed on the connecting thread's CPU
+  cpu_set_t allowed;
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(allowed), &allowed));
+  int cpu = 0;
+  while (!CPU_ISSET(cpu, &allowed)) {
+    ++cpu;
+  }
+  const size_t kConnections = 16;
+  std::thread client([&] {
+    cpu_set_t pinned;
+    CPU_ZERO(&pinned);
+    CPU_SET(cpu, &pinned);
+    ASSERT_EQ(0, sched_setaffinity(0, sizeof(pinned), &pinned));
+    connectClients(serverSocket.getAddress(), kConnections, accepted);
+  });
+  client.join();
+  ASSERT_EQ(kConnections, accepted.load());
+  EXPECT_EQ(cpu % 2 == 0 ? kConnections : 0, cb1.count.load());
+  EXPECT_EQ(cpu % 2 == 1 ? kConnections : 0, cb2.count.load());
+}
+#endif
+
 /**
  * Test AsyncTransport::BufferCallback
  */
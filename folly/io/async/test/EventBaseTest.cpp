@@ -1924,3 +1924,159 @@ TEST(EventBaseTest, RequestContextTest) {
   evb.loop();
   EXPECT_EQ(defaultCtx, RequestContext::get());
 }
+
+///////////////////////////////////////////////////////////////////////////
+// Tests for loop profiling
+///////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+class ProfilingObserver : public EventBaseObserver {
+ public:
+  uint32_t getSampleRate() const override {
+    return 1;
+  }
+
+  void loopSample(int64_t, int64_t) override {}
+
+  void loopProfileSample(
+      const EventBaseLoopBreakdown& iteration,
+      const EventBaseLoopProfile&) override {
+    for (size_t i = 0; i < kNumEventBaseCallbackTypes; ++i) {
+      callbacks[i] += iteration.count[i];
+    }
+  }
+
+  void slowCallback(const EventBaseSlowCallback& callback) override {
+    slow.push_back(callback);
+  }
+
+  std::array<uint64_t, kNumEventBaseCallbackTypes> callbacks{};
+  std::vector<EventBaseSlowCallback> slow;
+};
+
+class SleepingLoopCallback : public EventBase::LoopCallback {
+ public:
+  void runLoopCallback() noexcept override {
+    /* sleep override */
+    std::this_thread::sleep_for(milliseconds(20));
+  }
+};
+
+} // namespace
+
+TEST(EventBaseTest, LoopProfilingDisabled) {
+  EventBase eb;
+  EXPECT_EQ(nullptr, eb.getLoopProfile());
+  eb.runInLoop([] {});
+  eb.loop();
+  EXPECT_EQ(nullptr, eb.getLoopProfile());
+}
+
+TEST(EventBaseTest, LoopProfilingCallbackTypes) {
+  EventBase eb;
+  auto observer = std::make_shared<ProfilingObserver>();
+  eb.setObserver(observer);
+  eb.setLoopProfiling(EventBase::LoopProfilingOptions());
+
+  // One of each type
+  SocketPair sp;
+  TestHandler handler(&eb, sp[0]);
+  handler.registerHandler(EventHandler::READ);
+  writeUntilFull(sp[1]);
+
+  TestTimeout timeout(&eb);
+  timeout.scheduleTimeout(1);
+  eb.runAfterDelay([] {}, 1);
+  eb.runInLoop([] {});
+  eb.runInEventBaseThread([] {});
+  eb.runInEventBaseThread([] {});
+  eb.loop();
+
+  auto profile = eb.getLoopProfile();
+  ASSERT_NE(nullptr, profile);
+  EXPECT_GT(profile->iterations, 0);
+  // The runInEventBaseThread() queue handler and the wheel timer's own
+  // timeout dispatch to other callbacks, and are not counted.
+  EXPECT_EQ(1, profile->of(EventBaseCallbackType::IoHandler).count);
+  EXPECT_EQ(2, profile->of(EventBaseCallbackType::Timeout).count);
+  EXPECT_EQ(1, profile->of(EventBaseCallbackType::LoopCallback).count);
+  EXPECT_EQ(2, profile->of(EventBaseCallbackType::Function).count);
+  EXPECT_EQ(1, observer->callbacks[size_t(EventBaseCallbackType::IoHandler)]);
+  EXPECT_EQ(2, observer->callbacks[size_t(EventBaseCallbackType::Function)]);
+  EXPECT_TRUE(observer->slow.empty());
+
+  eb.resetLoopProfile();
+  EXPECT_EQ(0, eb.getLoopProfile()->iterations);
+}
+
+TEST(EventBaseTest, LoopProfilingSlowCallbacks) {
+  EventBase eb;
+  auto observer = std::make_shared<ProfilingObserver>();
+  eb.setObserver(observer);
+  EventBase::LoopProfilingOptions options;
+  options.slowCallbackThreshold = milliseconds(10);
+  eb.setLoopProfiling(options);
+
+  SleepingLoopCallback callback;
+  eb.runInLoop(&callback);
+  Func slowFunction([] {
+    /* sleep override */
+    std::this_thread::sleep_for(milliseconds(20));
+  });
+  auto slowFunctionAddress = slowFunction.getInvokerAddress();
+  eb.runInEventBaseThread(std::move(slowFunction));
+  eb.runInEventBaseThread([] {});
+  eb.loop();
+
+  ASSERT_EQ(2, observer->slow.size());
+  EXPECT_EQ(2, eb.getLoopProfile()->slowCallbacks);
+
+  auto& slowLoopCallback = observer->slow[0].type ==
+          EventBaseCallbackType::LoopCallback
+      ? observer->slow[0]
+      : observer->slow[1];
+  auto& slowFunctionCallback = observer->slow[0].type ==
+          EventBaseCallbackType::Function
+      ? observer->slow[0]
+      : observer->slow[1];
+  EXPECT_EQ(EventBaseCallbackType::LoopCallback, slowLoopCallback.type);
+  ASSERT_NE(nullptr, slowLoopCallback.objectType);
+  EXPECT_EQ(typeid(SleepingLoopCallback), *slowLoopCallback.objectType);
+  EXPECT_EQ(&callback, slowLoopCallback.object);
+  EXPECT_GE(slowLoopCallback.duration, milliseconds(20));
+  EXPECT_NE(
+      std::string::npos,
+      slowLoopCallback.describe().find("SleepingLoopCallback"));
+
+  EXPECT_EQ(EventBaseCallbackType::Function, slowFunctionCallback.type);
+  EXPECT_EQ(nullptr, slowFunctionCallback.objectType);
+  EXPECT_EQ(slowFunctionAddress, slowFunctionCallback.function);
+
+  auto& functions = eb.getLoopProfile()->of(EventBaseCallbackType::Function);
+  EXPECT_EQ(2, functions.count);
+  EXPECT_GE(functions.max, milliseconds(20));
+  EXPECT_GE(functions.percentileUpperBound(100), milliseconds(20));
+  EXPECT_LT(functions.percentileUpperBound(50), milliseconds(10));
+}
+
+TEST(EventBaseTest, LoopProfilingSampleRate) {
+  EventBase eb;
+  EventBase::LoopProfilingOptions options;
+  options.sampleRate = 2;
+  eb.setLoopProfiling(options);
+
+  CountedLoopCallback callback(&eb, 10);
+  eb.runInLoop(&callback);
+  eb.loop();
+  EXPECT_EQ(0, callback.getCount());
+
+  auto profile = eb.getLoopProfile();
+  EXPECT_EQ(5, profile->of(EventBaseCallbackType::LoopCallback).count);
+
+  eb.disableLoopProfiling();
+  CountedLoopCallback callback2(&eb, 10);
+  eb.runInLoop(&callback2);
+  eb.loop();
+  EXPECT_EQ(5, profile->of(EventBaseCallbackType::LoopCallback).count);
+}
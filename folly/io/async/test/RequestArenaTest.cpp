@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/RequestArena.h>
+
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <folly/FBVector.h>
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+
+TEST(RequestArena, NeedsContext) {
+  EXPECT_EQ(nullptr, RequestArena::get());
+}
+
+TEST(RequestArena, SameArenaWithinRequest) {
+  RequestContextScopeGuard g;
+  auto arena = RequestArena::get();
+  ASSERT_NE(nullptr, arena);
+  EXPECT_EQ(arena, RequestArena::get());
+
+  auto ctx = RequestContext::saveContext();
+  std::thread([&] {
+    RequestContextScopeGuard g2(ctx);
+    EXPECT_EQ(arena, RequestArena::get());
+  }).join();
+
+  {
+    RequestContextScopeGuard g3;
+    EXPECT_NE(arena, RequestArena::get());
+  }
+  EXPECT_EQ(arena, RequestArena::get());
+}
+
+TEST(RequestArena, Containers) {
+  RequestContextScopeGuard g;
+  auto arena = RequestArena::get();
+
+  fbvector<int, RequestArenaAllocator<int>> v{
+      RequestArenaAllocator<int>(arena)};
+  std::map<
+      int,
+      int,
+      std::less<int>,
+      RequestArenaAllocator<std::pair<const int, int>>>
+      m{std::less<int>(),
+        RequestArenaAllocator<std::pair<const int, int>>(arena)};
+  for (int i = 0; i < 1000; ++i) {
+    v.push_back(i);
+    m[i] = i;
+  }
+  EXPECT_EQ(999, v.back());
+  EXPECT_EQ(999, m.rbegin()->second);
+  EXPECT_GE(
+      arena->bytesUsed(),
+      1000 * (sizeof(int) + sizeof(std::pair<const int, int>)));
+}
+
+TEST(RequestArena, ArenasAreRecycled) {
+  void* first;
+  {
+    RequestContextScopeGuard g;
+    first = RequestArena::get()->allocate(64);
+  }
+  // The next request on this thread gets the same (reset) arena back.
+  {
+    RequestContextScopeGuard g;
+    auto arena = RequestArena::get();
+    EXPECT_EQ(0, arena->bytesUsed());
+    EXPECT_EQ(first, arena->allocate(64));
+  }
+}
+
+TEST(RequestArena, LargeArenasAreNotCached) {
+  void* first;
+  {
+    RequestContextScopeGuard g;
+    auto arena = RequestArena::get();
+    first = arena->allocate(2 * RequestArena::kMaxCachedArenaSize);
+  }
+  {
+    RequestContextScopeGuard g;
+    auto arena = RequestArena::get();
+    EXPECT_LT(arena->totalSize(), RequestArena::kMaxCachedArenaSize);
+    EXPECT_NE(first, arena->allocate(64));
+  }
+}
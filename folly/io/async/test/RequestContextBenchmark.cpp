@@ -0,0 +1,155 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/Request.h>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/portability/GFlags.h>
+
+using namespace folly;
+
+namespace {
+
+class TestData : public RequestData {
+ public:
+  explicit TestData(bool callback) : callback_(callback) {}
+  void onSet() override {
+    ++sets_;
+  }
+  bool hasCallback() override {
+    return callback_;
+  }
+
+ private:
+  const bool callback_;
+  size_t sets_{0};
+};
+
+std::shared_ptr<RequestContext> makeContext(size_t numData, bool callback) {
+  auto ctx = std::make_shared<RequestContext>();
+  for (size_t i = 0; i < numData; ++i) {
+    ctx->setContextData(
+        to<std::string>("data", i), std::make_unique<TestData>(callback));
+  }
+  return ctx;
+}
+
+void getContextData(size_t iters, bool byToken) {
+  std::shared_ptr<RequestContext> ctx;
+  std::string key = "data3";
+  BENCHMARK_SUSPEND {
+    ctx = makeContext(8, false);
+  }
+  RequestToken token(key);
+  for (size_t i = 0; i < iters; ++i) {
+    auto data = byToken ? ctx->getContextData(token) : ctx->getContextData(key);
+    doNotOptimizeAway(data);
+  }
+}
+
+void switchContexts(size_t iters, size_t numData, bool callback) {
+  std::shared_ptr<RequestContext> ctx1, ctx2;
+  BENCHMARK_SUSPEND {
+    ctx1 = makeContext(numData, callback);
+    ctx2 = makeContext(numData, callback);
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    RequestContextScopeGuard g(i % 2 ? ctx1 : ctx2);
+  }
+}
+
+// Runs `iters' EventBase loop callbacks, each belonging to one of
+// `numContexts' requests, or to none if numContexts is 0.
+void eventBaseCallbacks(size_t iters, size_t numContexts) {
+  EventBase evb;
+  std::vector<std::shared_ptr<RequestContext>> contexts;
+  BENCHMARK_SUSPEND {
+    for (size_t i = 0; i < numContexts; ++i) {
+      contexts.push_back(makeContext(2, true));
+    }
+  }
+  constexpr size_t kBatch = 1024;
+  size_t done = 0;
+  while (done < iters) {
+    size_t batch = std::min(kBatch, iters - done);
+    BENCHMARK_SUSPEND {
+      for (size_t i = 0; i < batch; ++i) {
+        RequestContextScopeGuard g(
+            numContexts ? contexts[i % numContexts]
+                        : std::shared_ptr<RequestContext>());
+        evb.runInLoop([&done] { ++done; });
+      }
+    }
+    evb.loopOnce();
+  }
+}
+
+} // namespace
+
+BENCHMARK(getContextDataByString, iters) {
+  getContextData(iters, false);
+}
+
+BENCHMARK_RELATIVE(getContextDataByToken, iters) {
+  getContextData(iters, true);
+}
+
+BENCHMARK_DRAW_LINE()
+
+BENCHMARK(scopeGuardSameContext, iters) {
+  std::shared_ptr<RequestContext> ctx;
+  BENCHMARK_SUSPEND {
+    ctx = makeContext(2, true);
+  }
+  RequestContextScopeGuard outer(ctx);
+  for (size_t i = 0; i < iters; ++i) {
+    RequestContextScopeGuard g(ctx);
+  }
+}
+
+BENCHMARK(switchContextsEmpty, iters) {
+  switchContexts(iters, 0, false);
+}
+
+BENCHMARK(switchContextsNoCallbacks, iters) {
+  switchContexts(iters, 4, false);
+}
+
+BENCHMARK(switchContextsWithCallbacks, iters) {
+  switchContexts(iters, 4, true);
+}
+
+BENCHMARK_DRAW_LINE()
+
+BENCHMARK(eventBaseCallbacksNoContext, iters) {
+  eventBaseCallbacks(iters, 0);
+}
+
+BENCHMARK_RELATIVE(eventBaseCallbacksOneContext, iters) {
+  eventBaseCallbacks(iters, 1);
+}
+
+BENCHMARK_RELATIVE(eventBaseCallbacksManyContexts, iters) {
+  eventBaseCallbacks(iters, 16);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -16,6 +16,7 @@
 
 #include <thread>
 
+#include <folly/Conv.h>
 #include <folly/Memory.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/Request.h>
@@ -147,3 +148,170 @@ TEST(RequestContext, deadlockTest) {
       "test", std::make_unique<DeadlockTestData>("test2"));
   RequestContext::get()->clearContextData("test");
 }
+
+TEST(RequestContext, tokens) {
+  RequestToken a("tokenA");
+  RequestToken b("tokenB");
+  EXPECT_EQ(a, RequestToken("tokenA"));
+  EXPECT_NE(a, b);
+  EXPECT_EQ("tokenA", a.getDebugString());
+
+  RequestContextScopeGuard rctx;
+  RequestContext::get()->setContextData(a, std::make_unique<TestData>(1));
+  EXPECT_TRUE(RequestContext::get()->hasContextData("tokenA"));
+  EXPECT_FALSE(RequestContext::get()->hasContextData(b));
+  EXPECT_EQ(
+      1,
+      dynamic_cast<TestData*>(RequestContext::get()->getContextData("tokenA"))
+          ->data_);
+
+  RequestContext::get()->clearContextData(a);
+  EXPECT_FALSE(RequestContext::get()->hasContextData(a));
+  EXPECT_EQ(nullptr, RequestContext::get()->getContextData(a));
+}
+
+TEST(RequestContext, noCallback) {
+  class NoCallbackData : public TestData {
+   public:
+    NoCallbackData() : TestData(0) {}
+    bool hasCallback() override {
+      return false;
+    }
+  };
+
+  RequestContext::create();
+  auto ctx = RequestContext::saveContext();
+  ctx->setContextData("noCallback", std::make_unique<NoCallbackData>());
+  ctx->setContextData("callback", std::make_unique<TestData>(1));
+  auto noCallback = dynamic_cast<TestData*>(ctx->getContextData("noCallback"));
+  auto callback = dynamic_cast<TestData*>(ctx->getContextData("callback"));
+
+  RequestContext::setContext(nullptr);
+  RequestContext::setContext(ctx);
+  EXPECT_EQ(0, noCallback->set_);
+  EXPECT_EQ(0, noCallback->unset_);
+  EXPECT_EQ(1, callback->set_);
+  EXPECT_EQ(1, callback->unset_);
+  RequestContext::setContext(nullptr);
+}
+
+TEST(RequestContext, scopeGuardSameContext) {
+  RequestContext::create();
+  auto ctx = RequestContext::saveContext();
+  ctx->setContextData("test", std::make_unique<TestData>(1));
+  auto data = dynamic_cast<TestData*>(ctx->getContextData("test"));
+  auto useCount = ctx.use_count();
+  {
+    RequestContextScopeGuard g(ctx);
+    EXPECT_EQ(useCount, ctx.use_count());
+    EXPECT_EQ(ctx.get(), RequestContext::get());
+  }
+  EXPECT_EQ(ctx.get(), RequestContext::get());
+  EXPECT_EQ(0, data->set_);
+  EXPECT_EQ(0, data->unset_);
+
+  {
+    RequestContextScopeGuard g(std::shared_ptr<RequestContext>{});
+    EXPECT_EQ(nullptr, RequestContext::saveContext());
+    RequestContextScopeGuard g2(ctx);
+    EXPECT_EQ(ctx.get(), RequestContext::get());
+  }
+  EXPECT_EQ(ctx.get(), RequestContext::get());
+  EXPECT_EQ(2, data->set_);
+  EXPECT_EQ(2, data->unset_);
+  RequestContext::setContext(nullptr);
+}
+
+TEST(RequestContext, scopeGuardSameContextReplaced) {
+  RequestContext::create();
+  std::weak_ptr<RequestContext> weak = RequestContext::saveContext();
+  {
+    RequestContextScopeGuard g(RequestContext::saveContext());
+    // The guard restores a context replaced in its scope, even after
+    // everybody else dropped it.
+    RequestContext::create();
+    EXPECT_FALSE(weak.expired());
+    EXPECT_NE(weak.lock().get(), RequestContext::get());
+  }
+  EXPECT_EQ(weak.lock().get(), RequestContext::get());
+
+  // Guards may go out of scope out of order when interleaved by fibers.
+  auto ctx1 = RequestContext::saveContext();
+  auto ctx2 = std::make_shared<RequestContext>();
+  auto g1 = std::make_unique<RequestContextScopeGuard>(ctx1);
+  RequestContext::setContext(ctx2);
+  auto g2 = std::make_unique<RequestContextScopeGuard>(ctx2);
+  RequestContext::setContext(ctx1);
+  g1.reset();
+  EXPECT_EQ(ctx1.get(), RequestContext::get());
+  RequestContext::setContext(ctx2);
+  RequestContext::create();
+  g2.reset();
+  EXPECT_EQ(ctx2.get(), RequestContext::get());
+  RequestContext::setContext(nullptr);
+}
+
+TEST(RequestContext, concurrentReadsAndWrites) {
+  auto ctx = std::make_shared<RequestContext>();
+  std::vector<RequestToken> tokens;
+  for (int i = 0; i < 32; ++i) {
+    tokens.emplace_back(folly::to<std::string>("concurrent", i));
+  }
+  ctx->setContextData(tokens[0], std::make_unique<TestData>(0));
+
+  std::atomic<bool> done{false};
+  // Lookups are lock-free and must always see the data that is never
+  // cleared, whatever the writer is doing to the other keys.
+  std::thread reader([&] {
+    while (!done.load()) {
+      auto data = dynamic_cast<TestData*>(ctx->getContextData(tokens[0]));
+      ASSERT_NE(nullptr, data);
+      EXPECT_EQ(0, data->data_);
+      for (size_t i = 1; i < tokens.size(); ++i) {
+        ctx->hasContextData(tokens[i]);
+      }
+    }
+  });
+  for (int round = 0; round < 100; ++round) {
+    for (size_t i = 1; i < tokens.size(); ++i) {
+      ctx->setContextData(tokens[i], std::make_unique<TestData>(int(i)));
+    }
+    for (size_t i = 1; i < tokens.size(); ++i) {
+      ctx->clearContextData(tokens[i]);
+    }
+  }
+  done = true;
+  reader.join();
+}
+
+TEST(RequestContext, clearDataWhileSwitching) {
+  struct CheckedData : RequestData {
+    ~CheckedData() override {
+      alive_ = false;
+    }
+    void onSet() override {
+      EXPECT_TRUE(alive_);
+    }
+    void onUnset() override {
+      EXPECT_TRUE(alive_);
+    }
+    std::atomic<bool> alive_{true};
+  };
+
+  auto ctx = std::make_shared<RequestContext>();
+  RequestToken token("clearWhileSwitching");
+  std::atomic<bool> done{false};
+  // Switching runs the callbacks of data that may be cleared concurrently,
+  // which must stay alive until the switch is over.
+  std::thread switcher([&] {
+    while (!done.load()) {
+      RequestContextScopeGuard g(ctx);
+    }
+  });
+  for (int i = 0; i < 10000; ++i) {
+    ctx->setContextData(token, std::make_unique<CheckedData>());
+    ctx->clearContextData(token);
+  }
+  done = true;
+  switcher.join();
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/RequestTrace.h>
+
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+using namespace std::chrono_literals;
+
+namespace {
+
+class RequestTraceTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    options_ = RequestTrace::getOptions();
+    RequestTrace::setSink(&sink_);
+  }
+
+  void TearDown() override {
+    RequestTrace::setSink(nullptr);
+    RequestTrace::setOptions(options_);
+  }
+
+  std::vector<RequestTraceEventType> typesOf(const RequestTimeline& t) {
+    std::vector<RequestTraceEventType> types;
+    for (const auto& event : t.events) {
+      types.push_back(event.type);
+    }
+    return types;
+  }
+
+  RequestTraceSink sink_;
+  RequestTrace::Options options_;
+};
+
+RequestTraceEvent makeEvent(
+    std::chrono::nanoseconds time,
+    RequestTraceEventType type,
+    uint32_t thread = 1) {
+  return RequestTraceEvent{time, thread, type, nullptr};
+}
+} // namespace
+
+TEST_F(RequestTraceTest, NeedsContextAndSink) {
+  EXPECT_FALSE(RequestTrace::start("noContext"));
+  EXPECT_EQ(nullptr, RequestTrace::get());
+
+  RequestTrace::setSink(nullptr);
+  {
+    RequestContextScopeGuard rctx;
+    EXPECT_FALSE(RequestTrace::start("noSink"));
+    EXPECT_FALSE(RequestTrace::maybeStart("noSink"));
+    EXPECT_EQ(nullptr, RequestTrace::get());
+  }
+}
+
+TEST_F(RequestTraceTest, Sampling) {
+  RequestTrace::Options options;
+  options.sampleRate = 0;
+  RequestTrace::setOptions(options);
+  {
+    RequestContextScopeGuard rctx;
+    EXPECT_FALSE(RequestTrace::maybeStart("disabled"));
+  }
+
+  options.sampleRate = 1;
+  RequestTrace::setOptions(options);
+  {
+    RequestContextScopeGuard rctx;
+    EXPECT_TRUE(RequestTrace::maybeStart("always"));
+    EXPECT_NE(nullptr, RequestTrace::get());
+    // Starting again keeps the existing trace
+    EXPECT_TRUE(RequestTrace::start("again"));
+  }
+  RequestTimeline timeline;
+  ASSERT_TRUE(sink_.read(timeline));
+  EXPECT_STREQ("always", timeline.name);
+  EXPECT_FALSE(sink_.read(timeline));
+}
+
+TEST_F(RequestTraceTest, EmitsTimelineWhenContextIsDestroyed) {
+  {
+    RequestContextScopeGuard rctx;
+    ASSERT_TRUE(RequestTrace::start("simple"));
+    RequestTrace::annotate("parsed");
+
+    RequestTimeline timeline;
+    EXPECT_FALSE(sink_.read(timeline));
+  }
+  EXPECT_EQ(nullptr, RequestTrace::get());
+  // Not traced anymore
+  RequestTrace::annotate("ignored");
+
+  RequestTimeline timeline;
+  ASSERT_TRUE(sink_.read(timeline));
+  EXPECT_STREQ("simple", timeline.name);
+  EXPECT_EQ(0, timeline.droppedEvents);
+  EXPECT_EQ(
+      (std::vector<RequestTraceEventType>{RequestTraceEventType::Start,
+                                          RequestTraceEventType::Annotation,
+                                          RequestTraceEventType::ContextUnset,
+                                          RequestTraceEventType::Finish}),
+      typesOf(timeline));
+  EXPECT_STREQ("parsed", timeline.events[1].label);
+  for (size_t i = 1; i < timeline.events.size(); ++i) {
+    EXPECT_LE(timeline.events[i - 1].time, timeline.events[i].time);
+  }
+  EXPECT_EQ(timeline.events.back().time, timeline.duration());
+  EXPECT_NE(std::string::npos, timeline.toString().find("Annotation parsed"));
+}
+
+TEST_F(RequestTraceTest, FollowsRequestAcrossThreads) {
+  ScopedEventBaseThread thread;
+  uint32_t workerThread = 0;
+  {
+    RequestContextScopeGuard rctx;
+    ASSERT_TRUE(RequestTrace::start("hop"));
+    thread.getEventBase()->runInEventBaseThreadAndWait([&] {
+      EXPECT_NE(nullptr, RequestTrace::get());
+      RequestTrace::annotate("worker");
+    });
+    // Queue time on the other side should show up as waiting
+    std::this_thread::sleep_for(1ms);
+  }
+  EXPECT_EQ(nullptr, RequestTrace::get());
+
+  RequestTimeline timeline;
+  ASSERT_TRUE(sink_.read(timeline));
+  auto mainThread = timeline.events.front().thread;
+  bool sawSet = false;
+  for (const auto& event : timeline.events) {
+    if (event.type == RequestTraceEventType::Annotation) {
+      workerThread = event.thread;
+    }
+    if (event.type == RequestTraceEventType::ContextSet) {
+      sawSet = true;
+    }
+  }
+  EXPECT_TRUE(sawSet);
+  EXPECT_NE(0, workerThread);
+  EXPECT_NE(mainThread, workerThread);
+  EXPECT_LE(timeline.activeTime(), timeline.duration());
+}
+
+TEST_F(RequestTraceTest, DropsEventsBeyondCapacity) {
+  RequestTrace::Options options;
+  options.maxEvents = 4;
+  RequestTrace::setOptions(options);
+  {
+    RequestContextScopeGuard rctx;
+    ASSERT_TRUE(RequestTrace::start("big"));
+    for (int i = 0; i < 10; ++i) {
+      RequestTrace::annotate("step");
+    }
+  }
+  RequestTimeline timeline;
+  ASSERT_TRUE(sink_.read(timeline));
+  // Start + 3 annotations, then Finish which is always kept
+  EXPECT_EQ(5, timeline.events.size());
+  // 7 annotations and the ContextUnset
+  EXPECT_EQ(8, timeline.droppedEvents);
+  EXPECT_EQ(RequestTraceEventType::Finish, timeline.events.back().type);
+}
+
+TEST_F(RequestTraceTest, SinkDropsWhenFull) {
+  RequestTraceSink sink(1);
+  RequestTrace::setSink(&sink);
+  for (int i = 0; i < 3; ++i) {
+    RequestContextScopeGuard rctx;
+    ASSERT_TRUE(RequestTrace::start("full"));
+  }
+  EXPECT_EQ(2, sink.dropped());
+  RequestTimeline timeline;
+  EXPECT_TRUE(sink.read(timeline));
+  EXPECT_FALSE(sink.read(timeline));
+}
+
+TEST(RequestTimeline, ActiveTime) {
+  using T = RequestTraceEventType;
+  RequestTimeline timeline;
+  timeline.events = {
+      makeEvent(0us, T::Start),
+      makeEvent(10us, T::ContextUnset),
+      // Queued for 20us
+      makeEvent(30us, T::ContextSet, 2),
+      // Fanned out to two threads
+      makeEvent(35us, T::ContextSet, 3),
+      makeEvent(40us, T::ContextUnset, 2),
+      makeEvent(50us, T::ContextUnset, 3),
+      makeEvent(100us, T::Finish),
+  };
+  EXPECT_EQ(100us, timeline.duration());
+  EXPECT_EQ(30us, timeline.activeTime());
+}
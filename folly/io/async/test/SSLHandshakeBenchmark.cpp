@@ -0,0 +1,323 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Loopback TLS handshake benchmark: client threads do back to back full
+ * handshakes with a server running on a single EventBase, which meanwhile
+ * measures how late a 1ms timer fires, i.e. how long every other
+ * connection on that loop would wait.
+ *
+ * Runs with the private key operations done inline on the server's loop,
+ * then offloaded to --key_threads threads
+ * (SSLContext::offloadPrivateKeyOperations()).
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <folly/Executor.h>
+#include <folly/SocketAddress.h>
+#include <folly/io/async/AsyncSSLSocket.h>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/SSLContext.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <folly/portability/GFlags.h>
+
+DEFINE_int32(clients, 8, "Client threads, doing one handshake at a time");
+DEFINE_int32(key_threads, 4, "Threads for offloaded private key operations");
+DEFINE_int32(seconds, 5, "Duration of each run");
+DEFINE_string(
+    cert,
+    "folly/io/async/test/certs/tests-cert.pem",
+    "Server certificate");
+DEFINE_string(
+    key,
+    "folly/io/async/test/certs/tests-key.pem",
+    "Server private key");
+
+using namespace folly;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Executor spreading tasks over a few threads.
+ */
+class KeyThreads : public Executor {
+ public:
+  explicit KeyThreads(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      threads_.emplace_back(new ScopedEventBaseThread());
+    }
+  }
+
+  void add(Func f) override {
+    threads_[next_++ % threads_.size()]->getEventBase()->add(std::move(f));
+  }
+
+ private:
+  std::vector<std::unique_ptr<ScopedEventBaseThread>> threads_;
+  std::atomic<size_t> next_{0};
+};
+
+/**
+ * Records by how much a periodic timer fires late.
+ */
+class LoopLagMonitor : public AsyncTimeout {
+ public:
+  explicit LoopLagMonitor(EventBase* eventBase) : AsyncTimeout(eventBase) {
+    schedule();
+  }
+
+  void timeoutExpired() noexcept override {
+    lags_.push_back(Clock::now() - deadline_);
+    schedule();
+  }
+
+  // Percentile p (0 to 1) of the lags, in microseconds
+  int64_t percentile(double p) {
+    if (lags_.empty()) {
+      return 0;
+    }
+    std::sort(lags_.begin(), lags_.end());
+    auto lag = lags_[std::min(lags_.size() - 1, size_t(p * lags_.size()))];
+    return std::chrono::duration_cast<std::chrono::microseconds>(lag).count();
+  }
+
+ private:
+  static constexpr std::chrono::milliseconds kPeriod{1};
+
+  void schedule() {
+    deadline_ = Clock::now() + kPeriod;
+    scheduleTimeout(kPeriod);
+  }
+
+  Clock::time_point deadline_;
+  std::vector<Clock::duration> lags_;
+};
+
+constexpr std::chrono::milliseconds LoopLagMonitor::kPeriod;
+
+/**
+ * Accepts connections, and closes them once the handshake is done.
+ */
+class Server : public AsyncServerSocket::AcceptCallback,
+               public AsyncSSLSocket::HandshakeCB {
+ public:
+  Server(EventBase* eventBase, std::shared_ptr<SSLContext> ctx)
+      : eventBase_(eventBase),
+        ctx_(std::move(ctx)),
+        socket_(AsyncServerSocket::newSocket(eventBase)) {
+    socket_->bind(0);
+    socket_->listen(1024);
+    socket_->addAcceptCallback(this, nullptr);
+    socket_->startAccepting();
+  }
+
+  ~Server() override {
+    socket_->stopAccepting();
+    auto handshakes = handshakes_;
+    for (auto sock : handshakes) {
+      done(sock);
+    }
+  }
+
+  SocketAddress getAddress() const {
+    SocketAddress address;
+    socket_->getAddress(&address);
+    return address;
+  }
+
+  void connectionAccepted(int fd, const SocketAddress&) noexcept override {
+    auto sock = new AsyncSSLSocket(ctx_, eventBase_, fd, true);
+    handshakes_.insert(sock);
+    sock->sslAccept(this);
+  }
+
+  void acceptError(const std::exception&) noexcept override {}
+
+  void handshakeSuc(AsyncSSLSocket* sock) noexcept override {
+    done(sock);
+  }
+
+  void handshakeErr(AsyncSSLSocket* sock, const AsyncSocketException&)
+      noexcept override {
+    done(sock);
+  }
+
+ private:
+  void done(AsyncSSLSocket* sock) {
+    if (handshakes_.erase(sock) == 0) {
+      // Closing sock below, which calls handshakeErr()
+      return;
+    }
+    sock->closeNow();
+    sock->destroy();
+  }
+
+  EventBase* eventBase_;
+  std::shared_ptr<SSLContext> ctx_;
+  std::shared_ptr<AsyncServerSocket> socket_;
+  std::set<AsyncSSLSocket*> handshakes_;
+};
+
+/**
+ * Connects to the server over and over, counting completed handshakes.
+ */
+class Client : public AsyncSocket::ConnectCallback {
+ public:
+  Client(EventBase* eventBase, SocketAddress address)
+      : eventBase_(eventBase),
+        ctx_(std::make_shared<SSLContext>()),
+        address_(std::move(address)) {}
+
+  void start() {
+    if (stopped_) {
+      return;
+    }
+    socket_.reset(new AsyncSSLSocket(ctx_, eventBase_));
+    socket_->connect(this, address_);
+  }
+
+  void stop() {
+    stopped_ = true;
+    socket_.reset();
+  }
+
+  void connectSuccess() noexcept override {
+    ++handshakes;
+    restart();
+  }
+
+  void connectErr(const AsyncSocketException&) noexcept override {
+    ++errors;
+    restart();
+  }
+
+  std::atomic<uint64_t> handshakes{0};
+  std::atomic<uint64_t> errors{0};
+
+ private:
+  void restart() {
+    if (!stopped_) {
+      // Not from within the socket's callback, which is about to return
+      // into the socket.
+      eventBase_->runInLoop([this] { start(); });
+    }
+  }
+
+  EventBase* eventBase_;
+  std::shared_ptr<SSLContext> ctx_;
+  SocketAddress address_;
+  AsyncSSLSocket::UniquePtr socket_;
+  bool stopped_{false};
+};
+
+void run(const char* name, std::shared_ptr<Executor> keyExecutor) {
+  auto ctx = std::make_shared<SSLContext>();
+  ctx->loadCertificate(FLAGS_cert.c_str());
+  ctx->loadPrivateKey(FLAGS_key.c_str());
+  if (keyExecutor) {
+    ctx->offloadPrivateKeyOperations(keyExecutor);
+  }
+
+  ScopedEventBaseThread serverThread;
+  auto serverEvb = serverThread.getEventBase();
+  std::unique_ptr<Server> server;
+  std::unique_ptr<LoopLagMonitor> monitor;
+  serverEvb->runInEventBaseThreadAndWait([&] {
+    server.reset(new Server(serverEvb, ctx));
+    monitor.reset(new LoopLagMonitor(serverEvb));
+  });
+
+  // Clients outlive their threads, which may have callbacks pending
+  std::vector<std::unique_ptr<Client>> clients;
+  std::vector<std::unique_ptr<ScopedEventBaseThread>> clientThreads;
+  for (int i = 0; i < FLAGS_clients; ++i) {
+    clientThreads.emplace_back(new ScopedEventBaseThread());
+    auto evb = clientThreads.back()->getEventBase();
+    clients.emplace_back(new Client(evb, server->getAddress()));
+    auto client = clients.back().get();
+    evb->runInEventBaseThread([client] { client->start(); });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(FLAGS_seconds));
+
+  uint64_t handshakes = 0;
+  uint64_t errors = 0;
+  for (auto& client : clients) {
+    handshakes += client->handshakes;
+    errors += client->errors;
+  }
+  for (size_t i = 0; i < clients.size(); ++i) {
+    auto client = clients[i].get();
+    clientThreads[i]->getEventBase()->runInEventBaseThreadAndWait(
+        [client] { client->stop(); });
+  }
+  int64_t p50, p99, p999;
+  serverEvb->runInEventBaseThreadAndWait([&] {
+    p50 = monitor->percentile(0.5);
+    p99 = monitor->percentile(0.99);
+    p999 = monitor->percentile(0.999);
+    monitor.reset();
+    server.reset();
+  });
+
+  printf(
+      "%-10s %12.0f %8llu %10lld %10lld %10lld\n",
+      name,
+      double(handshakes) / FLAGS_seconds,
+      (unsigned long long)errors,
+      (long long)p50,
+      (long long)p99,
+      (long long)p999);
+}
+
+} // namespace
+
+/**
+ * 2048-bit RSA key, TLS 1.2, 8 clients, on a single CPU, where offloading
+ * can't add throughput, only take signing out of the server loop's way:
+ *
+ * keys       handshakes/s   errors  lag p50us  lag p99us lag p999us
+ * inline              678        0       6278      13786      20209
+ * offload             549        0       2849       8784      11168
+ */
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  printf(
+      "%-10s %12s %8s %10s %10s %10s\n",
+      "keys",
+      "handshakes/s",
+      "errors",
+      "lag p50us",
+      "lag p99us",
+      "lag p999us");
+  run("inline", nullptr);
+#if FOLLY_OPENSSL_HAS_ASYNC
+  run("offload", std::make_shared<KeyThreads>(FLAGS_key_threads));
+#endif
+  return 0;
+}
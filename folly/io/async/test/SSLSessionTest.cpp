@@ -165,6 +165,112 @@ TEST_F(SSLSessionTest, SerializeDeserializeTest) {
   }
 }
 
+/**
+ * Handshakes with the given server context, resuming session if set, and
+ * returns the client's session.
+ */
+std::unique_ptr<SSLSession> handshake(
+    EventBase& eventBase,
+    std::shared_ptr<SSLContext> clientCtx,
+    std::shared_ptr<SSLContext> serverCtx,
+    SSLSession* session,
+    bool& reused) {
+  int fds[2];
+  getfds(fds);
+  AsyncSSLSocket::UniquePtr clientSock(
+      new AsyncSSLSocket(clientCtx, &eventBase, fds[0], false));
+  auto clientPtr = clientSock.get();
+  if (session) {
+    clientSock->setSSLSession(session->getRawSSLSessionDangerous(), true);
+  }
+  AsyncSSLSocket::UniquePtr serverSock(
+      new AsyncSSLSocket(serverCtx, &eventBase, fds[1], true));
+  SSLHandshakeClient client(std::move(clientSock), false, false);
+  SSLHandshakeServer server(std::move(serverSock), false, false);
+
+  eventBase.loop();
+  EXPECT_TRUE(client.handshakeSuccess_);
+  reused = clientPtr->getSSLSessionReused();
+  return std::make_unique<SSLSession>(clientPtr->getSSLSession());
+}
+
+TEST_F(SSLSessionTest, ExternalSessionCache) {
+  // Two server contexts, as in two worker processes, sharing a cache
+  auto cache = std::make_shared<ssl::ShardedSSLSessionCache>();
+  std::shared_ptr<SSLContext> serverCtx1(new SSLContext());
+  std::shared_ptr<SSLContext> serverCtx2(new SSLContext());
+  for (auto& ctx : {serverCtx1, serverCtx2}) {
+    getctx(clientCtx, ctx);
+    // Resume by session ID only
+    ctx->setOptions(SSL_OP_NO_TICKET);
+    ctx->setSessionCache(cache);
+  }
+
+  bool reused;
+  auto sess = handshake(eventBase, clientCtx, serverCtx1, nullptr, reused);
+  EXPECT_FALSE(reused);
+  EXPECT_EQ(1, cache->getStats().stores);
+
+  handshake(eventBase, clientCtx, serverCtx2, sess.get(), reused);
+  EXPECT_TRUE(reused);
+  EXPECT_EQ(1, cache->getStats().hits);
+
+  // Without the cache, the session is unknown to the server
+  std::shared_ptr<SSLContext> serverCtx3(new SSLContext());
+  getctx(clientCtx, serverCtx3);
+  serverCtx3->setOptions(SSL_OP_NO_TICKET);
+  handshake(eventBase, clientCtx, serverCtx3, sess.get(), reused);
+  EXPECT_FALSE(reused);
+}
+
+TEST_F(SSLSessionTest, TicketKeyRotation) {
+  auto manager1 = std::make_shared<ssl::TLSTicketKeyManager>();
+  auto manager2 = std::make_shared<ssl::TLSTicketKeyManager>();
+  manager1->setTLSTicketKeySeeds({}, {"seed1"}, {});
+  manager2->setTLSTicketKeySeeds({}, {"seed1"}, {});
+  std::shared_ptr<SSLContext> serverCtx1(new SSLContext());
+  std::shared_ptr<SSLContext> serverCtx2(new SSLContext());
+  getctx(clientCtx, serverCtx1);
+  getctx(clientCtx, serverCtx2);
+  serverCtx1->setTicketKeyManager(manager1);
+  serverCtx2->setTicketKeyManager(manager2);
+
+  bool reused;
+  auto sess = handshake(eventBase, clientCtx, serverCtx1, nullptr, reused);
+  EXPECT_FALSE(reused);
+
+  // Tickets are accepted by any server with the same seeds
+  handshake(eventBase, clientCtx, serverCtx2, sess.get(), reused);
+  EXPECT_TRUE(reused);
+
+  // After a rotation, the ticket is still accepted, and renewed
+  manager2->rotate("seed2");
+  auto renewed =
+      handshake(eventBase, clientCtx, serverCtx2, sess.get(), reused);
+  EXPECT_TRUE(reused);
+
+  // A server that hasn't rotated yet accepts the renewed ticket if it
+  // knows the new seed
+  manager1->setTLSTicketKeySeeds({}, {"seed1"}, {"seed2"});
+  handshake(eventBase, clientCtx, serverCtx1, renewed.get(), reused);
+  EXPECT_TRUE(reused);
+
+  // Once seed1 is dropped, tickets under it aren't accepted anymore
+  manager2->rotate("seed3");
+  handshake(eventBase, clientCtx, serverCtx2, sess.get(), reused);
+  EXPECT_FALSE(reused);
+  handshake(eventBase, clientCtx, serverCtx2, renewed.get(), reused);
+  EXPECT_TRUE(reused);
+
+  // A server with a random key doesn't accept any of them
+  std::shared_ptr<SSLContext> serverCtx3(new SSLContext());
+  getctx(clientCtx, serverCtx3);
+  serverCtx3->setTicketKeyManager(
+      std::make_shared<ssl::TLSTicketKeyManager>());
+  handshake(eventBase, clientCtx, serverCtx3, renewed.get(), reused);
+  EXPECT_FALSE(reused);
+}
+
 TEST_F(SSLSessionTest, GetSessionID) {
   int fds[2];
   getfds(fds);
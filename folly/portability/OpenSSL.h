@@ -38,6 +38,10 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#if FOLLY_OPENSSL_IS_110 && !defined(OPENSSL_NO_ASYNC)
+#include <openssl/async.h>
+#endif
+
 #ifndef OPENSSL_NO_EC
 #include <openssl/ec.h>
 #include <openssl/ecdsa.h>
@@ -80,6 +84,14 @@
 #define FOLLY_OPENSSL_HAS_ALPN 0
 #endif
 
+// OpenSSL 1.1.0 and later can pause a handshake in an async job
+// (SSL_MODE_ASYNC), e.g. while a private key operation runs elsewhere.
+#if FOLLY_OPENSSL_IS_110 && !defined(OPENSSL_NO_ASYNC)
+#define FOLLY_OPENSSL_HAS_ASYNC 1
+#else
+#define FOLLY_OPENSSL_HAS_ASYNC 0
+#endif
+
 // This attempts to "unify" the OpenSSL libcrypto/libssl APIs between
 // OpenSSL 1.0.2, 1.1.0 (and some earlier versions) and BoringSSL. The general
 // idea is to provide namespaced wrapper methods for versions which do not
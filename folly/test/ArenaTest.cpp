@@ -15,6 +15,7 @@
  */
 
 #include <folly/Arena.h>
+#include <folly/FBVector.h>
 #include <folly/Memory.h>
 #include <folly/portability/GTest.h>
 
@@ -168,6 +169,101 @@ TEST(Arena, MoveArena) {
   EXPECT_EQ(bytesUsed, moved.bytesUsed());
 }
 
+TEST(Arena, MarkRewind) {
+  SysArena arena(64);
+  auto empty = arena.mark();
+  auto a = arena.allocate(8);
+  auto totalSize = arena.totalSize();
+  auto bytesUsed = arena.bytesUsed();
+
+  // Rewinding within the current block hands out the same memory again.
+  auto m = arena.mark();
+  auto b = arena.allocate(8);
+  arena.rewindTo(m);
+  EXPECT_EQ(bytesUsed, arena.bytesUsed());
+  EXPECT_EQ(b, arena.allocate(8));
+  arena.rewindTo(m);
+
+  // Blocks allocated since the mark, small and large, are freed.
+  for (int i = 0; i < 100; ++i) {
+    arena.allocate(48);
+    arena.allocate(1000);
+  }
+  EXPECT_GT(arena.totalSize(), totalSize + 100 * 1000);
+  arena.rewindTo(m);
+  EXPECT_EQ(totalSize, arena.totalSize());
+  EXPECT_EQ(bytesUsed, arena.bytesUsed());
+  EXPECT_EQ(b, arena.allocate(8));
+
+  // Nested marks.
+  auto m1 = arena.mark();
+  arena.allocate(1000);
+  auto m2 = arena.mark();
+  arena.allocate(1000);
+  arena.allocate(10);
+  arena.rewindTo(m2);
+  arena.allocate(10);
+  arena.rewindTo(m1);
+  EXPECT_EQ(totalSize, arena.totalSize());
+  EXPECT_NE(a, nullptr);
+
+  arena.rewindTo(empty);
+  EXPECT_EQ(sizeof(SysArena), arena.totalSize());
+  EXPECT_EQ(0, arena.bytesUsed());
+  arena.allocate(8);
+}
+
+TEST(Arena, RewindMerged) {
+  SysArena arena(64);
+  arena.allocate(8);
+  auto totalSize = arena.totalSize();
+  auto m = arena.mark();
+  SysArena other(64);
+  other.allocate(8);
+  other.allocate(1000);
+  arena.merge(std::move(other));
+  EXPECT_GT(arena.totalSize(), totalSize);
+  arena.rewindTo(m);
+  EXPECT_EQ(totalSize, arena.totalSize());
+}
+
+TEST(Arena, Reset) {
+  SysArena arena(64);
+  arena.reset();
+  EXPECT_EQ(sizeof(SysArena), arena.totalSize());
+
+  for (int i = 0; i < 100; ++i) {
+    arena.allocate(48);
+  }
+  auto big = arena.allocate(4992);
+  arena.reset();
+  EXPECT_EQ(0, arena.bytesUsed());
+  EXPECT_EQ(
+      sizeof(SysArena) + 4992 + SysArena::kBlockOverhead, arena.totalSize());
+
+  // The largest block is reused, no new memory is needed until it's full.
+  auto totalSize = arena.totalSize();
+  EXPECT_EQ(big, arena.allocate(100));
+  for (int i = 0; i < 4800 / 48; ++i) {
+    arena.allocate(48);
+  }
+  EXPECT_EQ(totalSize, arena.totalSize());
+  arena.allocate(1000);
+  EXPECT_GT(arena.totalSize(), totalSize);
+}
+
+TEST(Arena, ArenaAllocator) {
+  SysArena arena;
+  fbvector<size_t, ArenaAllocator<size_t>> vec{ArenaAllocator<size_t>(&arena)};
+  for (size_t i = 0; i < 1000; i++) {
+    vec.push_back(i);
+  }
+  for (size_t i = 0; i < 1000; i++) {
+    EXPECT_EQ(i, vec[i]);
+  }
+  EXPECT_GE(arena.bytesUsed(), 1000 * sizeof(size_t));
+}
+
 int main(int argc, char *argv[]) {
   testing::InitGoogleTest(&argc, argv);
   gflags::ParseCommandLineFlags(&argc, &argv, true);
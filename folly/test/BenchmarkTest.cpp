@@ -18,7 +18,9 @@
 #include <folly/Foreach.h>
 #include <folly/String.h>
 #include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <numeric>
 #include <random>
 #include <vector>
@@ -360,6 +362,18 @@ BENCHMARK(BenchmarkSuspender_dismissing_value, iter) {
   }
 }
 
+BENCHMARK_DRAW_LINE();
+
+std::mutex contendedMutex;
+BENCHMARK_MULTITHREADED(mutexLockUnlock) {
+  std::lock_guard<std::mutex> g(contendedMutex);
+}
+
+std::atomic<size_t> stripedCounters[64 * 16];
+BENCHMARK_MULTITHREADED(stripedAtomicIncrement, thread) {
+  stripedCounters[(thread % 64) * 16].fetch_add(1);
+}
+
 int main(int argc, char** argv) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
   runBenchmarks();
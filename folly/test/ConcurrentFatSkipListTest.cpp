@@ -0,0 +1,256 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/ConcurrentFatSkipList.h>
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/Arena.h>
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+
+namespace {
+
+typedef ConcurrentFatSkipList<int, std::less<int>, SysAlloc, 4> SmallNodeList;
+typedef SmallNodeList::Accessor SmallNodeAccessor;
+
+template <class Accessor>
+void expectEqual(const std::set<int>& expected, const Accessor& accessor) {
+  EXPECT_EQ(expected.size(), accessor.size());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), accessor.begin()));
+  EXPECT_EQ(expected.size(), std::distance(accessor.begin(), accessor.end()));
+}
+
+} // namespace
+
+TEST(ConcurrentFatSkipList, Empty) {
+  SmallNodeAccessor accessor(SmallNodeList::createInstance());
+  EXPECT_TRUE(accessor.empty());
+  EXPECT_TRUE(accessor.begin() == accessor.end());
+  EXPECT_TRUE(accessor.lower_bound(1) == accessor.end());
+  EXPECT_FALSE(accessor.contains(1));
+  EXPECT_EQ(0, accessor.erase(1));
+}
+
+TEST(ConcurrentFatSkipList, RandomInsertErase) {
+  SmallNodeAccessor accessor(SmallNodeList::createInstance());
+  std::set<int> expected;
+  std::mt19937 rng(1234);
+  for (int i = 0; i < 10000; ++i) {
+    int v = rng() % 2000;
+    if (rng() % 3) {
+      EXPECT_EQ(expected.insert(v).second, accessor.insert(v));
+    } else {
+      EXPECT_EQ(expected.erase(v), accessor.erase(v));
+    }
+  }
+  expectEqual(expected, accessor);
+
+  for (int v = -1; v <= 2000; ++v) {
+    EXPECT_EQ(expected.count(v), accessor.count(v));
+    auto it = accessor.lower_bound(v);
+    auto expectedIt = expected.lower_bound(v);
+    if (expectedIt == expected.end()) {
+      EXPECT_TRUE(it == accessor.end());
+    } else {
+      ASSERT_TRUE(it != accessor.end());
+      EXPECT_EQ(*expectedIt, *it);
+    }
+    EXPECT_EQ(expected.count(v) ? it : accessor.end(), accessor.find(v));
+  }
+
+  for (auto v : std::set<int>(expected)) {
+    EXPECT_EQ(1, accessor.erase(v));
+  }
+  EXPECT_TRUE(accessor.empty());
+  EXPECT_TRUE(accessor.begin() == accessor.end());
+}
+
+TEST(ConcurrentFatSkipList, CreateFromSorted) {
+  for (int size : {0, 1, 4, 5, 100, 10000}) {
+    std::vector<int> values;
+    for (int i = 0; i < size; ++i) {
+      values.push_back(2 * i);
+      if (i % 10 == 0) {
+        values.push_back(2 * i);
+      }
+    }
+    SmallNodeAccessor accessor(
+        SmallNodeList::createInstanceFromSorted(values.begin(), values.end()));
+    std::set<int> expected(values.begin(), values.end());
+    expectEqual(expected, accessor);
+    for (int i = 0; i < size; ++i) {
+      EXPECT_TRUE(accessor.contains(2 * i));
+      EXPECT_FALSE(accessor.contains(2 * i + 1));
+      if (i % 7 == 0) {
+        EXPECT_TRUE(accessor.insert(2 * i + 1));
+        expected.insert(2 * i + 1);
+      }
+    }
+    expectEqual(expected, accessor);
+  }
+}
+
+TEST(ConcurrentFatSkipList, InsertSorted) {
+  typedef ConcurrentFatSkipList<std::string> StringList;
+  StringList::Accessor accessor(StringList::createInstance());
+  std::set<std::string> expected;
+  std::mt19937 rng(4321);
+  for (int b = 0; b < 100; ++b) {
+    std::vector<std::string> batch;
+    for (int i = 0; i < 100; ++i) {
+      batch.push_back(std::to_string(rng() % 5000));
+    }
+    std::sort(batch.begin(), batch.end());
+    size_t added = 0;
+    for (auto& s : batch) {
+      added += expected.insert(s).second;
+    }
+    EXPECT_EQ(added, accessor.insertSorted(batch.begin(), batch.end()));
+  }
+  EXPECT_EQ(expected.size(), accessor.size());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), accessor.begin()));
+
+  // Appending at the end fills up nodes.
+  std::vector<std::string> tail;
+  for (int i = 0; i < 1000; ++i) {
+    tail.push_back("x" + std::to_string(1000 + i));
+  }
+  EXPECT_EQ(1000, accessor.insertSorted(tail.begin(), tail.end()));
+  EXPECT_EQ(expected.size() + 1000, accessor.size());
+  EXPECT_EQ("x1999", *std::next(accessor.begin(), accessor.size() - 1));
+}
+
+TEST(ConcurrentFatSkipList, IteratorsSurviveWrites) {
+  std::vector<int> values(1000);
+  for (int i = 0; i < 1000; ++i) {
+    values[i] = i * 10;
+  }
+  SmallNodeAccessor accessor(
+      SmallNodeList::createInstanceFromSorted(values.begin(), values.end()));
+  auto it = accessor.lower_bound(5000);
+  for (int i = 0; i < 1000; ++i) {
+    accessor.insert(i * 10 + 5);
+    accessor.erase(i * 10);
+  }
+  // The iterator still walks the nodes as they were.
+  int n = 0;
+  for (; it != accessor.end(); ++it) {
+    ++n;
+  }
+  EXPECT_GE(n, 500);
+}
+
+TEST(ConcurrentFatSkipList, ConcurrentReadersAndWriter) {
+  std::vector<int> values;
+  for (int i = 0; i < 10000; ++i) {
+    values.push_back(2 * i);
+  }
+  auto list =
+      SmallNodeList::createInstanceFromSorted(values.begin(), values.end());
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&] {
+      SmallNodeAccessor accessor(list);
+      while (!done.load()) {
+        // Even numbers are never removed, so they are always seen, in order.
+        int prev = -1;
+        int evens = 0;
+        for (auto v : accessor) {
+          EXPECT_LT(prev, v);
+          prev = v;
+          evens += v % 2 == 0;
+        }
+        EXPECT_EQ(10000, evens);
+        EXPECT_TRUE(accessor.contains(2 * 1234));
+      }
+    });
+  }
+  {
+    SmallNodeAccessor accessor(list);
+    for (int round = 0; round < 20; ++round) {
+      std::vector<int> odds;
+      for (int i = round; i < 10000; i += 7) {
+        odds.push_back(2 * i + 1);
+      }
+      accessor.insertSorted(odds.begin(), odds.end());
+      for (auto v : odds) {
+        accessor.erase(v);
+      }
+    }
+  }
+  done = true;
+  for (auto& t : readers) {
+    t.join();
+  }
+  expectEqual(std::set<int>(values.begin(), values.end()),
+              SmallNodeAccessor(list));
+}
+
+namespace {
+
+struct Counted {
+  static std::atomic<int> instances;
+
+  explicit Counted(int v) : value(v) { ++instances; }
+  Counted(const Counted& other) : value(other.value) { ++instances; }
+  ~Counted() { --instances; }
+
+  bool operator<(const Counted& other) const { return value < other.value; }
+
+  int value;
+};
+
+std::atomic<int> Counted::instances(0);
+
+} // namespace
+
+TEST(ConcurrentFatSkipList, NodesAreFreed) {
+  typedef ConcurrentFatSkipList<Counted> CountedList;
+  {
+    auto list = CountedList::createInstance();
+    CountedList::Accessor accessor(list);
+    for (int i = 0; i < 1000; ++i) {
+      accessor.insert(Counted(i * 7 % 1000));
+    }
+    for (int i = 0; i < 1000; i += 2) {
+      accessor.erase(Counted(i));
+    }
+    EXPECT_EQ(500, accessor.size());
+  }
+  EXPECT_EQ(0, Counted::instances);
+}
+
+TEST(ConcurrentFatSkipList, SysArena) {
+  typedef ConcurrentFatSkipList<std::string, std::less<std::string>, SysArena>
+      ArenaList;
+  std::vector<std::string> values;
+  for (int i = 0; i < 10000; ++i) {
+    values.push_back(std::to_string(1000000 + i));
+  }
+  auto list = ArenaList::createInstanceFromSorted(values.begin(), values.end());
+  ArenaList::Accessor accessor(list);
+  EXPECT_EQ(10000, accessor.size());
+  EXPECT_TRUE(accessor.insert("0"));
+  EXPECT_EQ("0", *accessor.begin());
+}
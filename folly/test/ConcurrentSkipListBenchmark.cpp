@@ -22,6 +22,7 @@
 #include <thread>
 
 #include <folly/Benchmark.h>
+#include <folly/ConcurrentFatSkipList.h>
 #include <folly/ConcurrentSkipList.h>
 #include <folly/Hash.h>
 #include <folly/RWSpinLock.h>
@@ -47,6 +48,8 @@ typedef int ValueType;
 typedef ConcurrentSkipList<ValueType> SkipListType;
 typedef SkipListType::Accessor SkipListAccessor;
 typedef std::set<ValueType> SetType;
+typedef ConcurrentFatSkipList<ValueType> FatSkipListType;
+typedef FatSkipListType::Accessor FatSkipListAccessor;
 
 static std::vector<ValueType> gData;
 static void initData() {
@@ -296,6 +299,142 @@ void BM_AddSkipList(int iters, int size) {
   }
 }
 
+// Loading size sorted elements (and freeing them again), per list.
+static std::vector<ValueType> sortedData(int size) {
+  std::vector<ValueType> data(gData.begin(), gData.begin() + size);
+  std::sort(data.begin(), data.end());
+  return data;
+}
+
+void BM_AddSortedSkipList(int iters, int size) {
+  BenchmarkSuspender susp;
+  auto data = sortedData(size);
+  susp.dismiss();
+
+  for (int i = 0; i < iters; ++i) {
+    auto skipList = SkipListType::create(kInitHeadHeight);
+    for (auto v : data) {
+      skipList.add(v);
+    }
+  }
+}
+
+void BM_InsertSortedSkipList(int iters, int size) {
+  BenchmarkSuspender susp;
+  auto data = sortedData(size);
+  susp.dismiss();
+
+  for (int i = 0; i < iters; ++i) {
+    auto skipList = SkipListType::create(kInitHeadHeight);
+    skipList.insertSorted(data.begin(), data.end());
+  }
+}
+
+void BM_BuildSkipList(int iters, int size) {
+  BenchmarkSuspender susp;
+  auto data = sortedData(size);
+  susp.dismiss();
+
+  for (int i = 0; i < iters; ++i) {
+    SkipListType::createInstanceFromSorted(data.begin(), data.end());
+  }
+}
+
+void BM_BuildFatSkipList(int iters, int size) {
+  BenchmarkSuspender susp;
+  auto data = sortedData(size);
+  susp.dismiss();
+
+  for (int i = 0; i < iters; ++i) {
+    FatSkipListType::createInstanceFromSorted(data.begin(), data.end());
+  }
+}
+
+// Adding sorted batches of 1000 random keys to a list of size elements, per
+// batch.
+static constexpr int kBatchSize = 1000;
+
+template <class Accessor>
+void insertBatches(Accessor& accessor, int iters, int size) {
+  BenchmarkSuspender susp;
+  std::vector<std::vector<ValueType>> batches;
+  for (int i = 0; i < iters; ++i) {
+    auto first =
+      gData.begin() + (size + i * kBatchSize) % (kMaxValue - kBatchSize);
+    batches.emplace_back(first, first + kBatchSize);
+    std::sort(batches.back().begin(), batches.back().end());
+  }
+  susp.dismiss();
+
+  for (auto& batch : batches) {
+    accessor.insertSorted(batch.begin(), batch.end());
+  }
+}
+
+void BM_InsertBatchesSkipList(int iters, int size) {
+  BenchmarkSuspender susp;
+  auto data = sortedData(size);
+  SkipListAccessor accessor(
+      SkipListType::createInstanceFromSorted(data.begin(), data.end()));
+  susp.dismiss();
+  insertBatches(accessor, iters, size);
+  susp.rehire();
+}
+
+void BM_InsertBatchesFatSkipList(int iters, int size) {
+  BenchmarkSuspender susp;
+  auto data = sortedData(size);
+  FatSkipListAccessor accessor(
+      FatSkipListType::createInstanceFromSorted(data.begin(), data.end()));
+  susp.dismiss();
+  insertBatches(accessor, iters, size);
+  susp.rehire();
+}
+
+// Scanning 100 elements from a random start key, per scan.
+static constexpr int kScanLength = 100;
+
+template <class Container>
+void scanRanges(const Container& container, int iters) {
+  int64_t sum = 0;
+  for (int i = 0; i < iters; ++i) {
+    auto it = container.lower_bound(gData[i % kMaxValue]);
+    for (int j = 0; j < kScanLength && it != container.end(); ++j, ++it) {
+      sum += *it;
+    }
+  }
+  doNotOptimizeAway(sum);
+}
+
+void BM_ScanSet(int iters, int size) {
+  BenchmarkSuspender susp;
+  auto data = sortedData(size);
+  SetType aset(data.begin(), data.end());
+  susp.dismiss();
+  scanRanges(aset, iters);
+  susp.rehire();
+}
+
+void BM_ScanSkipList(int iters, int size) {
+  BenchmarkSuspender susp;
+  auto data = sortedData(size);
+  SkipListAccessor accessor(
+      SkipListType::createInstanceFromSorted(data.begin(), data.end()));
+  susp.dismiss();
+  scanRanges(accessor, iters);
+  susp.rehire();
+}
+
+void BM_ScanFatSkipList(int iters, int size) {
+  BenchmarkSuspender susp;
+  auto data = sortedData(size);
+  FatSkipListAccessor accessor(
+      FatSkipListType::createInstanceFromSorted(data.begin(), data.end()));
+  susp.dismiss();
+  scanRanges(accessor, iters);
+  susp.rehire();
+}
+
 BENCHMARK(Accessor, iters) {
   BenchmarkSuspender susp;
   auto skiplist = SkipListType::createInstance(kInitHeadHeight);
@@ -581,6 +720,37 @@ BENCHMARK_PARAM(BM_CSLMergeLookup,       1000000);
 BENCHMARK_DRAW_LINE();
 
 
+BENCHMARK_PARAM(BM_AddSortedSkipList,    1000);
+BENCHMARK_PARAM(BM_InsertSortedSkipList, 1000);
+BENCHMARK_PARAM(BM_BuildSkipList,        1000);
+BENCHMARK_PARAM(BM_BuildFatSkipList,     1000);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(BM_AddSortedSkipList,    1000000);
+BENCHMARK_PARAM(BM_InsertSortedSkipList, 1000000);
+BENCHMARK_PARAM(BM_BuildSkipList,        1000000);
+BENCHMARK_PARAM(BM_BuildFatSkipList,     1000000);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(BM_InsertBatchesSkipList,    65536);
+BENCHMARK_PARAM(BM_InsertBatchesFatSkipList, 65536);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(BM_InsertBatchesSkipList,    1000000);
+BENCHMARK_PARAM(BM_InsertBatchesFatSkipList, 1000000);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(BM_ScanSet,         65536);
+BENCHMARK_PARAM(BM_ScanSkipList,    65536);
+BENCHMARK_PARAM(BM_ScanFatSkipList, 65536);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(BM_ScanSet,         1000000);
+BENCHMARK_PARAM(BM_ScanSkipList,    1000000);
+BENCHMARK_PARAM(BM_ScanFatSkipList, 1000000);
+BENCHMARK_DRAW_LINE();
+
+
 // multithreaded benchmarking
 
 BENCHMARK_PARAM(BM_ContentionStdSet, 1024);
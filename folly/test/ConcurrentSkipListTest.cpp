@@ -263,6 +263,104 @@ TEST(ConcurrentSkipList, TestStringType) {
   EXPECT_TRUE(std::is_sorted(accessor.begin(), accessor.end()));
 }
 
+TEST(ConcurrentSkipList, CreateFromSorted) {
+  for (int size : {0, 1, 3, 4, 100, 10000}) {
+    VectorType values;
+    for (int i = 0; i < size; ++i) {
+      values.push_back(2 * i);
+      if (i % 10 == 0) {
+        values.push_back(2 * i);  // duplicates are skipped
+      }
+    }
+    auto sl = SkipListType::createInstanceFromSorted(
+        values.begin(), values.end());
+    SkipListAccessor skipList(sl);
+    EXPECT_EQ(size, skipList.size());
+    EXPECT_TRUE(std::equal(skipList.begin(), skipList.end(),
+                           SetType(values.begin(), values.end()).begin()));
+    for (int i = 0; i < size; ++i) {
+      EXPECT_TRUE(skipList.contains(2 * i));
+      EXPECT_FALSE(skipList.contains(2 * i + 1));
+    }
+
+    // Still a regular list afterwards.
+    for (int i = 0; i < size; ++i) {
+      EXPECT_TRUE(skipList.add(2 * i + 1));
+      if (i % 3 == 0) {
+        EXPECT_TRUE(skipList.remove(2 * i));
+      }
+    }
+    int prev = -1;
+    size_t n = 0;
+    for (auto v : skipList) {
+      EXPECT_LT(prev, v);
+      prev = v;
+      ++n;
+    }
+    EXPECT_EQ(n, skipList.size());
+  }
+}
+
+TEST(ConcurrentSkipList, InsertSorted) {
+  auto skipList(SkipListType::create(kHeadHeight));
+  SetType verifier;
+  for (int i = 0; i < 1000; i += 3) {
+    skipList.add(i);
+    verifier.insert(i);
+  }
+  VectorType batch;
+  for (int i = 0; i < 2000; i += 2) {
+    batch.push_back(i);
+    batch.push_back(i);
+  }
+  size_t expected = 0;
+  for (auto v : batch) {
+    expected += verifier.insert(v).second;
+  }
+  EXPECT_EQ(expected, skipList.insertSorted(batch.begin(), batch.end()));
+  EXPECT_EQ(verifier.size(), skipList.size());
+  EXPECT_TRUE(std::equal(verifier.begin(), verifier.end(), skipList.begin()));
+  EXPECT_EQ(0, skipList.insertSorted(batch.begin(), batch.end()));
+}
+
+void testConcurrentInsertSorted(int numThreads) {
+  auto skipList(SkipListType::create(kHeadHeight));
+  vector<std::thread> threads;
+  for (int i = 0; i < numThreads; ++i) {
+    threads.emplace_back([&, i] {
+      // Interleaved and overlapping batches.
+      const int step = numThreads / 2 + 1;
+      for (int b = 0; b < 10; ++b) {
+        VectorType batch;
+        for (int j = b * 1000 + i; j < (b + 2) * 1000; j += step) {
+          batch.push_back(j);
+        }
+        skipList.insertSorted(batch.begin(), batch.end());
+        if (i % 2) {
+          skipList.remove(batch[batch.size() / 2]);
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  int prev = -1;
+  size_t n = 0;
+  for (auto v : skipList) {
+    EXPECT_LT(prev, v);
+    prev = v;
+    ++n;
+  }
+  EXPECT_EQ(n, skipList.size());
+}
+
+TEST(ConcurrentSkipList, ConcurrentInsertSorted) {
+  for (int numThreads = 2; numThreads < 10; numThreads += 3) {
+    testConcurrentInsertSorted(numThreads);
+  }
+}
+
 struct UniquePtrComp {
   bool operator ()(
       const std::unique_ptr<int> &x, const std::unique_ptr<int> &y) const {
@@ -572,6 +572,158 @@ TEST(Singleton, SingletonEagerInitParallel) {
   }
 }
 
+namespace {
+struct RecordedDependenciesTag {};
+struct DepA {};
+struct DepB {};
+}
+template <typename T, typename Tag = detail::DefaultTag>
+using SingletonRecordedDependencies =
+    Singleton<T, Tag, RecordedDependenciesTag>;
+TEST(Singleton, RecordedDependencies) {
+  auto& vault = *SingletonVault::singleton<RecordedDependenciesTag>();
+  SingletonRecordedDependencies<std::string, DepB> b([] {
+    /* sleep override */
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return new std::string("b");
+  });
+  SingletonRecordedDependencies<std::string, DepA> a([] {
+    auto dependency =
+        SingletonRecordedDependencies<std::string, DepB>::try_get();
+    return new std::string("a" + *dependency);
+  });
+  vault.registrationComplete();
+
+  auto a_instance = SingletonRecordedDependencies<std::string, DepA>::try_get();
+  EXPECT_EQ("ab", *a_instance);
+
+  auto dependencies = vault.getDependencies();
+  ASSERT_EQ(1, dependencies.size());
+  EXPECT_NE(std::string::npos, dependencies[0].first.find("DepA"));
+  EXPECT_NE(std::string::npos, dependencies[0].second.find("DepB"));
+
+  // b is created from a's create function, and completes first
+  auto stats = vault.getCreationStats();
+  ASSERT_EQ(2, stats.size());
+  EXPECT_NE(std::string::npos, stats[0].name.find("DepB"));
+  EXPECT_NE(std::string::npos, stats[1].name.find("DepA"));
+  EXPECT_GE(stats[0].totalTime, std::chrono::milliseconds(10));
+  EXPECT_GE(stats[1].totalTime, stats[0].totalTime);
+  EXPECT_LT(stats[1].selfTime, stats[0].totalTime);
+  EXPECT_FALSE(stats[0].eager);
+
+  // Saved dependencies can be loaded back by name
+  EXPECT_EQ(1, vault.addDependencies(dependencies));
+  EXPECT_EQ(
+      0, vault.addDependencies({{"not a singleton", dependencies[0].second}}));
+  EXPECT_EQ(dependencies, vault.getDependencies());
+}
+
+namespace {
+struct ExistingDependencyTag {};
+}
+template <typename T, typename Tag = detail::DefaultTag>
+using SingletonExistingDependency = Singleton<T, Tag, ExistingDependencyTag>;
+TEST(Singleton, RecordedDependencyOnExistingSingleton) {
+  using SingletonA = SingletonExistingDependency<std::string, DepA>;
+  using SingletonB = SingletonExistingDependency<std::string, DepB>;
+  auto& vault = *SingletonVault::singleton<ExistingDependencyTag>();
+  SingletonB b([] { return new std::string("b"); });
+  SingletonA a([] { return new std::string("a" + *SingletonB::try_get()); });
+  vault.registrationComplete();
+
+  // b already exists when a's create function gets it
+  EXPECT_EQ("b", *SingletonB::try_get());
+  EXPECT_TRUE(vault.getDependencies().empty());
+  EXPECT_EQ("ab", *SingletonA::try_get());
+
+  auto dependencies = vault.getDependencies();
+  ASSERT_EQ(1, dependencies.size());
+  EXPECT_NE(std::string::npos, dependencies[0].first.find("DepA"));
+  EXPECT_NE(std::string::npos, dependencies[0].second.find("DepB"));
+}
+
+namespace {
+struct EagerInitDependenciesTag {};
+template <int N>
+struct Stage {};
+}
+template <typename T, typename Tag = detail::DefaultTag>
+using SingletonEagerInitDependencies =
+    Singleton<T, Tag, EagerInitDependenciesTag>;
+TEST(Singleton, SingletonEagerInitDependencies) {
+  auto& vault = *SingletonVault::singleton<EagerInitDependenciesTag>();
+
+  std::mutex mutex;
+  std::vector<int> created;
+  auto create = [&](int n) {
+    return [&, n] {
+      /* sleep override */
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      std::lock_guard<std::mutex> g(mutex);
+      created.push_back(n);
+      return new int(n);
+    };
+  };
+
+  // 0 <- {1, 2} <- 3, where only 3 is eager; 1 and 2 may run in parallel.
+  SingletonEagerInitDependencies<int, Stage<0>> s0(create(0));
+  SingletonEagerInitDependencies<int, Stage<1>> s1(create(1));
+  SingletonEagerInitDependencies<int, Stage<2>> s2(create(2));
+  SingletonEagerInitDependencies<int, Stage<3>> s3(create(3));
+  s1.dependsOn<int, Stage<0>>();
+  s2.dependsOn<int, Stage<0>>();
+  s3.shouldEagerInit().dependsOn<int, Stage<1>>().dependsOn<int, Stage<2>>();
+  vault.registrationComplete();
+
+  folly::Baton<> done;
+  {
+    TestEagerInitParallelExecutor exe(4);
+    vault.doEagerInitVia(exe, &done);
+    done.wait();
+  }
+
+  ASSERT_EQ(4, created.size());
+  EXPECT_EQ(0, created[0]);
+  EXPECT_EQ(3, created[3]);
+  EXPECT_EQ(4, vault.livingSingletonCount());
+
+  auto stats = vault.getCreationStats();
+  ASSERT_EQ(4, stats.size());
+  EXPECT_TRUE(stats[3].eager);
+  EXPECT_FALSE(stats[0].eager);
+}
+
+TEST(Singleton, SingletonEagerInitDependencyCycle) {
+  struct CycleTag {};
+  auto& vault = *SingletonVault::singleton<CycleTag>();
+  Singleton<int, Stage<0>, CycleTag> s0;
+  Singleton<int, Stage<1>, CycleTag> s1;
+  s0.shouldEagerInit().dependsOn<int, Stage<1>>();
+  s1.shouldEagerInit().dependsOn<int, Stage<0>>();
+  vault.registrationComplete();
+
+  folly::EventBase eb;
+  folly::Baton<> done;
+  vault.doEagerInitVia(eb, &done);
+  eb.loop();
+  done.wait();
+  EXPECT_EQ(2, vault.livingSingletonCount());
+}
+
+TEST(Singleton, SingletonEagerInitNothing) {
+  struct NothingTag {};
+  auto& vault = *SingletonVault::singleton<NothingTag>();
+  Singleton<int, detail::DefaultTag, NothingTag> sing;
+  vault.registrationComplete();
+
+  folly::EventBase eb;
+  folly::Baton<> done;
+  vault.doEagerInitVia(eb, &done);
+  EXPECT_TRUE(done.try_wait());
+  EXPECT_EQ(0, vault.livingSingletonCount());
+}
+
 struct MockTag {};
 template <typename T, typename Tag = detail::DefaultTag>
 using SingletonMock = Singleton <T, Tag, MockTag>;
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/SlabAllocator.h>
+
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/MPMCQueue.h>
+#include <folly/portability/GFlags.h>
+
+using namespace folly;
+
+SlabAllocator slab;
+
+struct Malloc {
+  void* allocate(size_t size) {
+    return malloc(size);
+  }
+  void deallocate(void* p) {
+    free(p);
+  }
+} sys;
+
+template <class Alloc>
+void allocFree(Alloc& alloc, size_t iters, size_t size) {
+  for (size_t i = 0; i < iters; ++i) {
+    auto p = alloc.allocate(size);
+    doNotOptimizeAway(p);
+    alloc.deallocate(p);
+  }
+}
+
+template <class Alloc>
+void batch(Alloc& alloc, size_t iters, size_t size) {
+  constexpr size_t kBatch = 1000;
+  std::vector<void*> ptrs;
+  ptrs.reserve(kBatch);
+  for (size_t i = 0; i < iters; i += kBatch) {
+    for (size_t j = i; j < std::min(iters, i + kBatch); ++j) {
+      ptrs.push_back(alloc.allocate(size));
+    }
+    for (auto p : ptrs) {
+      alloc.deallocate(p);
+    }
+    ptrs.clear();
+  }
+}
+
+// Allocates on this thread, frees on another.
+template <class Alloc>
+void producerConsumer(Alloc& alloc, size_t iters, size_t size) {
+  MPMCQueue<void*> queue(1024);
+  std::thread consumer([&] {
+    for (size_t i = 0; i < iters; ++i) {
+      void* p;
+      queue.blockingRead(p);
+      alloc.deallocate(p);
+    }
+  });
+  for (size_t i = 0; i < iters; ++i) {
+    queue.blockingWrite(alloc.allocate(size));
+  }
+  consumer.join();
+}
+
+BENCHMARK(malloc_alloc_free_32, iters) {
+  allocFree(sys, iters, 32);
+}
+
+BENCHMARK_RELATIVE(slab_alloc_free_32, iters) {
+  allocFree(slab, iters, 32);
+}
+
+BENCHMARK(malloc_batch_64, iters) {
+  batch(sys, iters, 64);
+}
+
+BENCHMARK_RELATIVE(slab_batch_64, iters) {
+  batch(slab, iters, 64);
+}
+
+BENCHMARK(malloc_batch_1000, iters) {
+  batch(sys, iters, 1000);
+}
+
+BENCHMARK_RELATIVE(slab_batch_1000, iters) {
+  batch(slab, iters, 1000);
+}
+
+BENCHMARK(malloc_producer_consumer_48, iters) {
+  producerConsumer(sys, iters, 48);
+}
+
+BENCHMARK_RELATIVE(slab_producer_consumer_48, iters) {
+  producerConsumer(slab, iters, 48);
+}
+
+BENCHMARK_DRAW_LINE();
+
+template <class Map>
+void mapInsertErase(size_t iters) {
+  Map m;
+  for (size_t i = 0; i < iters; ++i) {
+    m[i % 4096] = i;
+    if (m.size() == 4096) {
+      m.clear();
+    }
+  }
+}
+
+BENCHMARK(std_map_std_allocator, iters) {
+  mapInsertErase<std::map<int, int>>(iters);
+}
+
+BENCHMARK_RELATIVE(std_map_slab_allocator, iters) {
+  mapInsertErase<std::map<
+      int,
+      int,
+      std::less<int>,
+      SlabStlAllocator<std::pair<const int, int>>>>(iters);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/SlabAllocator.h>
+
+#include <cstring>
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <folly/Baton.h>
+#include <folly/ConcurrentSkipList.h>
+#include <folly/MPMCQueue.h>
+#include <folly/Memory.h>
+#include <folly/detail/MemoryIdler.h>
+#include <folly/portability/GTest.h>
+#include <folly/sorted_vector_types.h>
+
+using namespace folly;
+
+namespace {
+
+SlabAllocator::Options smallSlabs() {
+  SlabAllocator::Options options;
+  options.slabSize = 4096;
+  options.chunkSize = 64 * 1024;
+  options.maxEmptySlabs = 0;
+  return options;
+}
+
+} // namespace
+
+TEST(SlabAllocator, Sizes) {
+  SlabAllocator alloc;
+  std::vector<std::pair<char*, size_t>> blocks;
+  for (size_t size = 0; size <= 2 * alloc.maxSmallSize() + 100; size += 7) {
+    auto p = static_cast<char*>(alloc.allocate(size));
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p) % SlabAllocator::kAlignment);
+    EXPECT_GE(alloc.goodSize(size), size);
+    memset(p, int(size), alloc.goodSize(size));
+    blocks.emplace_back(p, size);
+  }
+  EXPECT_GT(alloc.getStats().largeBytes, 0);
+  for (auto& block : blocks) {
+    for (size_t i = 0; i < block.second; ++i) {
+      ASSERT_EQ(char(block.second), block.first[i]);
+    }
+    alloc.deallocate(block.first);
+  }
+  EXPECT_EQ(0, alloc.getStats().largeBytes);
+  alloc.deallocate(nullptr);
+}
+
+TEST(SlabAllocator, ReusesFreedMemory) {
+  SlabAllocator alloc;
+  auto p = alloc.allocate(40);
+  alloc.deallocate(p);
+  EXPECT_EQ(p, alloc.allocate(40));
+  // Same size class.
+  alloc.deallocate(p);
+  EXPECT_EQ(p, alloc.allocate(48));
+  alloc.deallocate(p);
+}
+
+TEST(SlabAllocator, DistinctObjects) {
+  SlabAllocator alloc(smallSlabs());
+  std::set<void*> seen;
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 10000; ++i) {
+    auto p = alloc.allocate(24);
+    EXPECT_TRUE(seen.insert(p).second);
+    ptrs.push_back(p);
+  }
+  for (auto p : ptrs) {
+    alloc.deallocate(p);
+  }
+}
+
+TEST(SlabAllocator, ReleaseFreeMemory) {
+  SlabAllocator::Options options;
+  options.maxEmptySlabs = 1000;
+  SlabAllocator alloc(options);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 100000; ++i) {
+    ptrs.push_back(alloc.allocate(64));
+  }
+  auto mapped = alloc.getStats().mappedBytes;
+  EXPECT_GE(mapped, 100000 * 64);
+  for (auto p : ptrs) {
+    alloc.deallocate(p);
+  }
+  alloc.flushThreadCache();
+  EXPECT_GT(alloc.getStats().emptySlabBytes, 0);
+
+  auto released = alloc.releaseFreeMemory();
+  auto stats = alloc.getStats();
+  EXPECT_GE(released, mapped / 2);
+  EXPECT_EQ(0, stats.emptySlabBytes);
+  EXPECT_EQ(released, stats.purgedSlabBytes);
+  EXPECT_EQ(mapped, stats.mappedBytes);
+
+  // Purged slabs are reused before mapping new ones.
+  ptrs.clear();
+  for (int i = 0; i < 1000; ++i) {
+    auto p = static_cast<char*>(alloc.allocate(64));
+    memset(p, 1, 64);
+    ptrs.push_back(p);
+  }
+  EXPECT_EQ(mapped, alloc.getStats().mappedBytes);
+  for (auto p : ptrs) {
+    alloc.deallocate(p);
+  }
+}
+
+TEST(SlabAllocator, EmptySlabsAreReleasedBeyondLimit) {
+  SlabAllocator alloc(smallSlabs());
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 10000; ++i) {
+    ptrs.push_back(alloc.allocate(100));
+  }
+  for (auto p : ptrs) {
+    alloc.deallocate(p);
+  }
+  alloc.flushThreadCache();
+  auto stats = alloc.getStats();
+  EXPECT_EQ(0, stats.emptySlabBytes);
+  EXPECT_GT(stats.purgedSlabBytes, 0);
+}
+
+TEST(SlabAllocator, CrossThreadFrees) {
+  SlabAllocator alloc(smallSlabs());
+  MPMCQueue<void*> queue(1000);
+  constexpr int kRounds = 100000;
+  std::thread consumer([&] {
+    for (int i = 0; i < kRounds; ++i) {
+      void* p;
+      queue.blockingRead(p);
+      EXPECT_EQ(i, *static_cast<int*>(p));
+      alloc.deallocate(p);
+    }
+  });
+  for (int i = 0; i < kRounds; ++i) {
+    auto p = alloc.allocate(sizeof(int));
+    *static_cast<int*>(p) = i;
+    queue.blockingWrite(p);
+  }
+  consumer.join();
+  // Objects freed by the consumer come back to the producer through the
+  // depot, so the footprint is bounded by the queue and the caches.
+  EXPECT_LT(alloc.getStats().mappedBytes, 1 << 20);
+}
+
+TEST(SlabAllocator, ThreadExitFlushesCache) {
+  SlabAllocator::Options options;
+  options.maxEmptySlabs = 1000;
+  SlabAllocator alloc(options);
+  std::thread([&] {
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 1000; ++i) {
+      ptrs.push_back(alloc.allocate(32));
+    }
+    for (auto p : ptrs) {
+      alloc.deallocate(p);
+    }
+  }).join();
+  // Only the depot holds objects now; once they're returned to their slabs,
+  // all of those are empty.
+  EXPECT_GE(alloc.releaseFreeMemory(), 1000 * 32);
+  EXPECT_EQ(0, alloc.getStats().emptySlabBytes);
+}
+
+TEST(SlabAllocator, MemoryIdlerFlush) {
+  SlabAllocator::Options options;
+  options.maxEmptySlabs = 1000;
+  SlabAllocator alloc(options);
+  Baton<> flushed;
+  Baton<> done;
+  std::thread idle([&] {
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 10000; ++i) {
+      ptrs.push_back(alloc.allocate(16));
+    }
+    for (auto p : ptrs) {
+      alloc.deallocate(p);
+    }
+    detail::MemoryIdler::flushLocalMallocCaches();
+    flushed.post();
+    done.wait();
+  });
+  flushed.wait();
+
+  // The idle thread's cache was flushed, not released to the OS: this
+  // thread reuses its objects.
+  auto stats = alloc.getStats();
+  EXPECT_EQ(0, stats.purgedSlabBytes);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 10000; ++i) {
+    ptrs.push_back(alloc.allocate(16));
+  }
+  EXPECT_EQ(stats.mappedBytes, alloc.getStats().mappedBytes);
+  for (auto p : ptrs) {
+    alloc.deallocate(p);
+  }
+  done.post();
+  idle.join();
+}
+
+TEST(SlabAllocator, HugePages) {
+  // Falls back to regular pages if no hugetlbfs is mounted.
+  SlabAllocator::Options options;
+  options.useHugePages = true;
+  SlabAllocator alloc(options);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 10000; ++i) {
+    auto p = alloc.allocate(200);
+    memset(p, 0, 200);
+    ptrs.push_back(p);
+  }
+  for (auto p : ptrs) {
+    alloc.deallocate(p);
+  }
+  alloc.releaseFreeMemory();
+}
+
+TEST(SlabAllocator, StlAllocators) {
+  SlabAllocator alloc;
+
+  typedef StlAllocator<SlabAllocator, int> Alloc;
+  std::vector<int, Alloc> v{Alloc(&alloc)};
+  std::vector<int, SlabStlAllocator<int>> v2{SlabStlAllocator<int>(&alloc)};
+  for (int i = 0; i < 1000; ++i) {
+    v.push_back(i);
+    v2.push_back(i);
+  }
+  EXPECT_TRUE(std::equal(v.begin(), v.end(), v2.begin()));
+
+  std::map<
+      int,
+      int,
+      std::less<int>,
+      SlabStlAllocator<std::pair<const int, int>>>
+      m;
+  sorted_vector_map<
+      int,
+      int,
+      std::less<int>,
+      SlabStlAllocator<std::pair<int, int>>>
+      svm;
+  for (int i = 0; i < 1000; ++i) {
+    m[i] = i;
+    svm[999 - i] = i;
+  }
+  EXPECT_EQ(1000, m.size());
+  EXPECT_EQ(1000, svm.size());
+  EXPECT_EQ(999, svm.begin()->second);
+  EXPECT_EQ(&SlabAllocator::getDefault(), m.get_allocator().allocator());
+}
+
+TEST(SlabAllocator, ConcurrentSkipList) {
+  SlabAllocator alloc;
+  using SkipList = ConcurrentSkipList<std::string, std::less<std::string>,
+                                      SlabAlloc>;
+  auto list = SkipList::createInstance(10, SlabAlloc(&alloc));
+  {
+    SkipList::Accessor accessor(list);
+    for (int i = 0; i < 10000; ++i) {
+      accessor.add(std::to_string(i));
+    }
+    for (int i = 0; i < 10000; i += 2) {
+      accessor.remove(std::to_string(i));
+    }
+    EXPECT_EQ(5000, accessor.size());
+  }
+  list.reset();
+}
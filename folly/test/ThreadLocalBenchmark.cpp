@@ -80,6 +80,101 @@ boost::thread_specific_ptr<int> boost_tsp;
 REG(boost_tsp);
 BENCHMARK_DRAW_LINE();
 
+// Single-threaded get() on an id inside the range of elements kept in static
+// thread-local storage vs. one beyond it.
+struct StaticRangeTag {};
+struct DynamicRangeTag {};
+
+template <class Tag>
+void getLoop(size_t iters, size_t idsBefore) {
+  std::vector<ThreadLocalPtr<int, Tag>> fillers(idsBefore);
+  ThreadLocalPtr<int, Tag> tl;
+  BENCHMARK_SUSPEND {
+    for (auto& f : fillers) {
+      f.get();
+    }
+    tl.reset(new int(0));
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    ++*tl.get();
+  }
+  doNotOptimizeAway(*tl);
+}
+
+BENCHMARK(get_static_id, iters) {
+  getLoop<StaticRangeTag>(iters, 0);
+}
+
+BENCHMARK_RELATIVE(get_dynamic_id, iters) {
+  getLoop<DynamicRangeTag>(
+      iters, threadlocal_detail::kStaticElementsCapacity);
+}
+
+ThreadLocal<int> tlInt;
+BENCHMARK(get_ThreadLocal_int, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    ++*tlInt;
+  }
+  doNotOptimizeAway(*tlInt);
+}
+BENCHMARK_DRAW_LINE();
+
+// Aggregation with accessAllThreads() while threads using the same Tag keep
+// being created and exiting, and thread creation/exit while a (single, as
+// with a stats exporter) thread keeps aggregating.
+struct ChurnTag {};
+ThreadLocal<int, ChurnTag> churnCounter;
+
+int sumAllThreads() {
+  int sum = 0;
+  for (const auto& i : churnCounter.accessAllThreads()) {
+    sum += i;
+  }
+  return sum;
+}
+
+void spawnAndJoin() {
+  std::thread([] { ++*churnCounter; }).join();
+}
+
+template <class F>
+void runInBackground(size_t iters, F&& f, int numBg, void (*bg)()) {
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  BENCHMARK_SUSPEND {
+    for (int i = 0; i < numBg; ++i) {
+      threads.emplace_back([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+          bg();
+        }
+      });
+    }
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    f();
+  }
+  BENCHMARK_SUSPEND {
+    stop = true;
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+}
+
+BENCHMARK(accessAllThreads_with_thread_churn, iters) {
+  runInBackground(
+      iters,
+      [] { doNotOptimizeAway(sumAllThreads()); },
+      FLAGS_numThreads,
+      spawnAndJoin);
+}
+
+BENCHMARK(thread_churn_with_accessAllThreads, iters) {
+  runInBackground(
+      iters, spawnAndJoin, 1, [] { doNotOptimizeAway(sumAllThreads()); });
+}
+BENCHMARK_DRAW_LINE();
+
 int main(int argc, char** argv) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
   gflags::SetCommandLineOptionWithMode(
@@ -98,3 +193,19 @@ Benchmark                               Iters   Total t    t/iter iter/sec
  + 295% BM_mt_boost_tsp             100000000  157.8 ms  1.578 ns  604.5 M
 ------------------------------------------------------------------------------
 */
+
+/*
+Static vs. dynamic ids and accessAllThreads() under thread churn, ran with
+--numThreads=8 on a single-core VM (so the churn numbers mostly measure
+scheduling; compare them on real hardware before drawing conclusions)
+
+Benchmark                                           relative  time/iter  iters/s
+------------------------------------------------------------------------------
+get_static_id                                                132.63ps    7.54G
+get_dynamic_id                                        7.91%     1.68ns  596.68M
+get_ThreadLocal_int                                          333.36ps    3.00G
+------------------------------------------------------------------------------
+accessAllThreads_with_thread_churn                            34.73ns   28.79M
+thread_churn_with_accessAllThreads                             1.42ms   703.07
+------------------------------------------------------------------------------
+*/
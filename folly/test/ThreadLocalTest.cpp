@@ -329,6 +329,127 @@ TEST(ThreadLocalPtr, AccessAllThreadsCounter) {
   }
 }
 
+TEST(ThreadLocalPtr, AccessAllThreadsDoesNotBlockThreadCreation) {
+  struct Tag {};
+  ThreadLocal<int, Tag> val;
+  *val = 1;
+
+  Baton<> created;
+  std::thread t;
+  {
+    auto accessor = val.accessAllThreads();
+    // A thread touching the same Tag for the first time registers itself
+    // with the meta; that must not wait for the accessor to be released.
+    t = std::thread([&] {
+      *val = 2;
+      created.post();
+    });
+    EXPECT_TRUE(created.timed_wait(std::chrono::seconds(10)));
+
+    // The accessor iterates over the elements that existed when it was
+    // taken.
+    int total = 0;
+    for (auto& i : accessor) {
+      total += i;
+    }
+    EXPECT_EQ(1, total);
+  }
+  // Exiting threads wait for the accessor, so only join once it's released.
+  t.join();
+}
+
+TEST(ThreadLocalPtr, AccessAllThreadsDuringExitingThreadCleanup) {
+  struct Tag {};
+  struct Locker {
+    std::mutex* mutex;
+    Baton<>* disposing;
+    ~Locker() {
+      disposing->post();
+      std::lock_guard<std::mutex> g(*mutex);
+    }
+  };
+  ThreadLocalPtr<Locker, Tag> val;
+
+  std::mutex mutex;
+  Baton<> disposing;
+  std::unique_lock<std::mutex> lock(mutex);
+  std::thread t([&] { val.reset(new Locker{&mutex, &disposing}); });
+  disposing.wait();
+  // The exiting thread is disposing of its elements and waits for a lock we
+  // hold: accessing all threads must not wait for it in turn.
+  {
+    auto accessor = val.accessAllThreads();
+    EXPECT_TRUE(accessor.begin() == accessor.end());
+  }
+  lock.unlock();
+  t.join();
+}
+
+TEST(ThreadLocalPtr, ManyInstances) {
+  // Enough instances to cover ids both inside and beyond the range of
+  // elements kept in static thread-local storage.
+  struct Tag {};
+  const int kNumInstances = 3 * threadlocal_detail::kStaticElementsCapacity;
+  const int kNumThreads = 4;
+  std::vector<ThreadLocalPtr<int, Tag>> tls(kNumInstances);
+
+  std::atomic<int> phase(0);
+  std::atomic<int> done(0);
+  auto waitFor = [](std::atomic<int>& a, int v) {
+    while (a.load() != v) { usleep(100); }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kNumInstances; ++i) {
+        EXPECT_EQ(nullptr, tls[i].get());
+        tls[i].reset(new int(t * 1000 + i));
+      }
+      for (int i = 0; i < kNumInstances; ++i) {
+        EXPECT_EQ(t * 1000 + i, *tls[i]);
+      }
+      done.fetch_add(1);
+
+      waitFor(phase, 1);
+      for (int i = 0; i < kNumInstances / 2; ++i) {
+        EXPECT_EQ(t * 1000 + i + kNumInstances / 2, *tls[i]);
+      }
+      for (int i = kNumInstances / 2; i < kNumInstances; ++i) {
+        EXPECT_EQ(nullptr, tls[i].get());
+      }
+      done.fetch_add(1);
+    });
+  }
+  waitFor(done, kNumThreads);
+
+  for (int i = 0; i < kNumInstances; ++i) {
+    EXPECT_EQ(nullptr, tls[i].get());
+    std::set<int> seen;
+    for (auto& v : tls[i].accessAllThreads()) {
+      seen.insert(v);
+    }
+    ASSERT_EQ(kNumThreads, seen.size());
+    for (int t = 0; t < kNumThreads; ++t) {
+      EXPECT_EQ(1, seen.count(t * 1000 + i));
+    }
+  }
+
+  // Destroy the first half of the instances; the new ones at the back reuse
+  // their ids and must not observe the elements of the destroyed ones.
+  tls.erase(tls.begin(), tls.begin() + kNumInstances / 2);
+  tls.resize(kNumInstances);
+  for (int i = kNumInstances / 2; i < kNumInstances; ++i) {
+    auto accessor = tls[i].accessAllThreads();
+    EXPECT_TRUE(accessor.begin() == accessor.end());
+  }
+  phase.store(1);
+  waitFor(done, 2 * kNumThreads);
+
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
 TEST(ThreadLocal, resetNull) {
   ThreadLocal<int> tl;
   tl.reset(new int(4));
@@ -84,10 +84,12 @@
 #define FOLLY_SDT_ARG_TEMPLATE_7    FOLLY_SDT_ARG_TEMPLATE_6 FOLLY_SDT_ARGFMT(7)
 #define FOLLY_SDT_ARG_TEMPLATE_8    FOLLY_SDT_ARG_TEMPLATE_7 FOLLY_SDT_ARGFMT(8)
 
-// Structure of note section for the probe.
+// Structure of note section for the probe. The "?" flag puts the note in
+// the section group of the code it describes, so probes in inline functions
+// and templates are discarded along with duplicate COMDAT instantiations.
 #define FOLLY_SDT_NOTE_CONTENT(provider, name, arg_template)                   \
   FOLLY_SDT_ASM_1(990: FOLLY_SDT_NOP)                                          \
-  FOLLY_SDT_ASM_3(     .pushsection .note.stapsdt,"","note")                   \
+  FOLLY_SDT_ASM_3(     .pushsection .note.stapsdt,"?","note")                  \
   FOLLY_SDT_ASM_1(     .balign 4)                                              \
   FOLLY_SDT_ASM_3(     .4byte 992f-991f, 994f-993f, FOLLY_SDT_NOTE_TYPE)       \
   FOLLY_SDT_ASM_1(991: .asciz FOLLY_SDT_NOTE_NAME)                             \